@@ -2,15 +2,18 @@
 #define UTILS_ALGORITHM_H
 
 #include <algorithm>
+#include <cmath>
 #include <utility>
 
+#include "config.h"
+
 namespace p {
   
   /*
    * Linear interpolation between two values.
    */
   template<typename T, typename Scalar>
-  inline T lerp(const T& begin, const T& end, Scalar amount) {
+  P_CONSTEXPR T lerp(const T& begin, const T& end, Scalar amount) {
     //T ret = begin + (end - begin) * amount;
     T ret = begin * (Scalar(1.0) - amount) + end * amount; // doesn't require T::operator -
     return ret;
@@ -20,14 +23,14 @@ namespace p {
    * Restricts a value to a range
    */
   template<typename T>
-  inline T clamp(T val, T vmin, T vmax) {
+  P_CONSTEXPR T clamp(T val, T vmin, T vmax) {
     using std::max;
     using std::min;
     return max(min(val, vmax), vmin);
   }
   
   template<typename T>
-  inline const T& clamp(const T& val, const std::pair<T, T>& range) {
+  P_CONSTEXPR T clamp(const T& val, const std::pair<T, T>& range) {
     return clamp(val, range.first, range.second);
   }
   
@@ -35,23 +38,46 @@ namespace p {
    * Forces a value to be between 0.0 and 1.0
    */
   template<typename T>
-  inline T saturate(const T& val) {
+  P_CONSTEXPR T saturate(const T& val) {
     return clamp(val, T(0.0), T(1.0));
   }
+
+  namespace detail {
+    /*
+     * floor() for constant expressions. Values too large to fit a long long
+     * are already integral.
+     */
+    template<typename T>
+    P_CONSTEXPR T constexpr_floor(T x) {
+      const long double limit = 4611686018427387904.0L; // 2^62
+      if (x != x || x >= limit || x <= -limit)
+        return x;
+      const T t = T(static_cast<long long>(x));
+      return t > x ? t - T(1) : t;
+    }
+
+    template<typename T>
+    P_CONSTEXPR_DISPATCH T floor_value(T x) {
+      if (P_CONSTANT_EVALUATED())
+        return constexpr_floor(x);
+      using std::floor;
+      return floor(x);
+    }
+  }
   
   /*
    * Wraps a value in a range. Useful when dealing with rotations.
    */
   template<typename T>
-  inline T wrap(const T& value, const T& lower, const T& upper) {
+  P_CONSTEXPR_DISPATCH T wrap(const T& value, const T& lower, const T& upper) {
     T distance = upper - lower;
-    T times = floor((value - lower) / distance);
+    T times = detail::floor_value((value - lower) / distance);
     T ret = value - (times * distance);
     return ret;
   }
   
   template<typename T>
-  inline T wrap(const T& value, const std::pair<T, T>& range) {
+  P_CONSTEXPR_DISPATCH T wrap(const T& value, const std::pair<T, T>& range) {
     return wrap(value, range.first, range.second);
   }
 } // !p
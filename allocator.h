@@ -0,0 +1,235 @@
+/* -- allocator.h ----------------------------------------------------*- c++ -*-
+ * Memory for large and short-lived arrays of vectors and matrices.
+ *
+ * aligned_allocator<T, A> is a standard allocator that puts the array on
+ * an A byte boundary (a cache line by default), so SIMD loads never split
+ * a line:
+ *
+ * std::vector<p::vec4, p::aligned_allocator<p::vec4> > points;
+ *
+ * arena hands out scratch arrays from large blocks it keeps between
+ * frames. reset() makes all of it free again in constant time, so once
+ * the blocks have grown to a frame's worth of data nothing else touches
+ * the heap:
+ *
+ * p::arena scratch;
+ * for (;;) {
+ *   scratch.reset();
+ *   p::span<p::vec3> tmp = scratch.allocate_n<p::vec3>(count);
+ *   ...
+ * }
+ *
+ * Arena arrays are uninitialized and are never destroyed, so only trivially
+ * destructible types can go in them. An arena is not thread safe.
+ *
+ * vec<float, 4>, vec<int, 4> and mat<float, 4, N> get 16 byte alignment
+ * when P_ALIGNED_VEC is defined (see config.h); arrays of them then need
+ * an allocator that respects it, such as the ones here or C++17 new.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_ALLOCATOR_H
+#define P_UTILS_ALLOCATOR_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "span.h"
+
+namespace p {
+  namespace detail {
+    /**
+     * Allocates bytes aligned to alignment, which must be a power of two.
+     * The original pointer is stored just in front of the returned block.
+     */
+    inline void *aligned_alloc(std::size_t bytes, std::size_t alignment) {
+      if (bytes > std::numeric_limits<std::size_t>::max() - alignment - sizeof(void *))
+        throw std::bad_alloc();
+      void *raw = ::operator new(bytes + alignment + sizeof(void *));
+      std::size_t addr = reinterpret_cast<std::size_t>(raw) + sizeof(void *);
+      addr = (addr + alignment - 1) & ~(alignment - 1);
+      reinterpret_cast<void **>(addr)[-1] = raw;
+      return reinterpret_cast<void *>(addr);
+    }
+
+    inline void aligned_free(void *ptr) {
+      if (ptr)
+        ::operator delete(reinterpret_cast<void **>(ptr)[-1]);
+    }
+  }
+
+  /**
+   * Standard allocator aligning every array to Alignment bytes, which must
+   * be a power of two.
+   */
+  template<typename T, std::size_t Alignment = 64>
+  class aligned_allocator {
+  public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    enum {alignment = Alignment < alignof(T) ? alignof(T) : Alignment};
+
+    template<typename U>
+    struct rebind {typedef aligned_allocator<U, Alignment> other; };
+
+    aligned_allocator() {}
+    template<typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment> &) {}
+
+    T *allocate(std::size_t n) {
+      if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        throw std::bad_alloc();
+      return static_cast<T *>(detail::aligned_alloc(n * sizeof(T), alignment));
+    }
+
+    void deallocate(T *ptr, std::size_t) {detail::aligned_free(ptr); }
+
+    template<typename U>
+    bool operator ==(const aligned_allocator<U, Alignment> &) const {return true; }
+    template<typename U>
+    bool operator !=(const aligned_allocator<U, Alignment> &) const {return false; }
+  };
+
+  class arena {
+  public:
+    enum {default_alignment = 16};
+
+    /**
+     * Blocks are block_size bytes, or larger for requests that don't fit
+     * in one. None is allocated until the first request.
+     */
+    explicit arena(std::size_t block_size = 1 << 16)
+      : block_size(block_size), current(0), used(0) {}
+
+    ~arena() {
+      for (std::size_t i = 0; i < blocks.size(); ++i)
+        detail::aligned_free(blocks[i].data);
+    }
+
+    /**
+     * bytes of uninitialized memory aligned to alignment, a power of two.
+     * Valid until the next reset().
+     */
+    void *allocate(std::size_t bytes, std::size_t alignment = default_alignment) {
+      assert(alignment && !(alignment & (alignment - 1)));
+      while (current < blocks.size()) {
+        const block &b = blocks[current];
+        const std::size_t base = reinterpret_cast<std::size_t>(b.data);
+        const std::size_t start = (base + used + alignment - 1) & ~(alignment - 1);
+        if (start - base <= b.size && bytes <= b.size - (start - base)) {
+          used = start - base + bytes;
+          return reinterpret_cast<void *>(start);
+        }
+        // the rest of this block stays unused until reset()
+        ++current;
+        used = 0;
+      }
+
+      if (bytes > std::numeric_limits<std::size_t>::max() - alignment)
+        throw std::bad_alloc();
+      block b;
+      b.size = std::max(block_size, bytes + alignment);
+      b.data = static_cast<char *>(detail::aligned_alloc(b.size, 64));
+      blocks.push_back(b);
+      current = blocks.size() - 1;
+      used = 0;
+      return allocate(bytes, alignment);
+    }
+
+    /**
+     * An uninitialized array of n T, aligned to at least 16 bytes for the
+     * SIMD paths.
+     */
+    template<typename T>
+    span<T> allocate_n(std::size_t n) {
+      static_assert(std::is_trivially_destructible<T>::value,
+                    "arena arrays are never destroyed");
+      if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        throw std::bad_alloc();
+      const std::size_t alignment = std::max<std::size_t>(alignof(T), default_alignment);
+      return span<T>(static_cast<T *>(allocate(n * sizeof(T), alignment)), n);
+    }
+
+    /**
+     * Frees everything allocated so far, keeping the blocks.
+     */
+    void reset() {
+      current = 0;
+      used = 0;
+    }
+
+    /**
+     * Total size of the blocks held.
+     */
+    std::size_t capacity() const {
+      std::size_t total = 0;
+      for (std::size_t i = 0; i < blocks.size(); ++i)
+        total += blocks[i].size;
+      return total;
+    }
+
+  private:
+    arena(const arena &);
+    arena &operator =(const arena &);
+
+    struct block {
+      char *data;
+      std::size_t size;
+    };
+
+    std::vector<block> blocks;
+    std::size_t block_size, current, used;
+  };
+
+  /**
+   * Standard allocator drawing from an arena, for containers that live
+   * no longer than a frame. deallocate() does nothing; the memory comes
+   * back with arena::reset().
+   */
+  template<typename T>
+  class arena_allocator {
+  public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<typename U>
+    struct rebind {typedef arena_allocator<U> other; };
+
+    explicit arena_allocator(arena &a) : source(&a) {}
+    template<typename U>
+    arena_allocator(const arena_allocator<U> &other) : source(other.source) {}
+
+    T *allocate(std::size_t n) {
+      if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        throw std::bad_alloc();
+      return static_cast<T *>(source->allocate(
+        n * sizeof(T), std::max<std::size_t>(alignof(T), arena::default_alignment)));
+    }
+
+    void deallocate(T *, std::size_t) {}
+
+    template<typename U>
+    bool operator ==(const arena_allocator<U> &other) const {return source == other.source; }
+    template<typename U>
+    bool operator !=(const arena_allocator<U> &other) const {return source != other.source; }
+
+    arena *source;
+  };
+} // !p
+
+#endif // !P_UTILS_ALLOCATOR_H
@@ -0,0 +1,508 @@
+/* -- approx_math.h --------------------------------------------------*- c++ -*-
+ * Polynomial sin, cos, exp, log, atan2 and rsqrt for floats, float vectors
+ * and arrays of either, four lanes at a time in the registers of simd.h.
+ *
+ * Every function takes the accuracy it is allowed to trade for speed:
+ *
+ *   approx::fast     about 10 to 15 bits
+ *   approx::medium   about 17 to 20 bits
+ *   approx::precise  within a few units in the last place
+ *
+ * vec3 d = p::approx::sin<p::approx::medium>(angles);
+ * p::approx::exp_n<p::approx::fast>(weights, weights);
+ *
+ * Largest errors measured against the exact result, in float ULPs; sin
+ * and cos over |x| <= 8192, exp over results above 2^-126 (below that,
+ * about the same absolute error), log over all positive floats:
+ *
+ *             fast    medium   precise
+ *   sin       9500        30         3
+ *   cos       9500        30         3
+ *   exp       1700        75         2
+ *   log       1500        30         1
+ *   atan2      300        15         3
+ *
+ * rsqrt is simd::rsqrt_estimate, simd::rsqrt, and a division by sqrt,
+ * special cases and all.
+ *
+ * sin and cos lose accuracy beyond 8192 and are meaningless beyond 2^22.
+ * For infinities and NaN the others give what std:: gives, except that
+ * atan2 treats a zero y or x as positive, sign bit or not.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_APPROX_MATH_H
+#define P_UTILS_APPROX_MATH_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+
+#include "vector.h"
+#include "quaternion.h"
+#include "simd.h"
+#include "span.h"
+#include "vector_batch.h"
+
+namespace p {
+  namespace approx {
+    enum accuracy {
+      fast,
+      medium,
+      precise
+    };
+  }
+
+  namespace detail {
+    inline simd::f32x4 mad(simd::f32x4 a, simd::f32x4 b, float c) {
+      return simd::add(simd::mul(a, b), simd::splat(c));
+    }
+
+    /**
+     * The polynomials, fitted for least maximum relative error of the whole
+     * function. Each gives the correction term P(u) of
+     *   sin r = r + r u P(u)             u = r^2, |r| <= pi/4
+     *   cos r = 1 - u / 2 + u^2 P(u)
+     *   exp r = 1 + r + r^2 P(r)         |r| <= log(2) / 2
+     *   log(1 + m) = m - m^2 / 2 + m^3 P(m)    sqrt(1/2) - 1 <= m < sqrt(2) - 1
+     *   atan z = z + z u P(u)            u = z^2, |z| <= tan(pi/8)
+     */
+    template<approx::accuracy A> struct approx_poly;
+
+    template<> struct approx_poly<approx::fast> {
+      static simd::f32x4 sin(simd::f32x4) {return simd::splat(-1.62427915e-1f); }
+      static simd::f32x4 cos(simd::f32x4) {return simd::splat(4.08993054e-2f); }
+      static simd::f32x4 exp(simd::f32x4 r) {return mad(r, simd::splat(1.66628109e-1f), 5.03941027e-1f); }
+      static simd::f32x4 log(simd::f32x4 m) {
+        return mad(mad(m, simd::splat(1.73250062e-1f), -2.64612477e-1f), m, 3.35673320e-1f);
+      }
+      static simd::f32x4 atan(simd::f32x4 u) {return mad(u, simd::splat(1.70341778e-1f), -3.31833775e-1f); }
+    };
+
+    template<> struct approx_poly<approx::medium> {
+      static simd::f32x4 sin(simd::f32x4 u) {return mad(u, simd::splat(8.16328192e-3f), -1.66633904e-1f); }
+      static simd::f32x4 cos(simd::f32x4 u) {return mad(u, simd::splat(-1.36612317e-3f), 4.16619964e-2f); }
+      static simd::f32x4 exp(simd::f32x4 r) {
+        return mad(mad(r, simd::splat(4.12777481e-2f), 1.67535139e-1f), r, 5.00051160e-1f);
+      }
+      static simd::f32x4 log(simd::f32x4 m) {
+        simd::f32x4 p = mad(m, simd::splat(1.17819007e-1f), -1.84071898e-1f);
+        p = mad(p, m, 2.04421871e-1f);
+        p = mad(p, m, -2.49438328e-1f);
+        return mad(p, m, 3.33208609e-1f);
+      }
+      static simd::f32x4 atan(simd::f32x4 u) {
+        return mad(mad(u, simd::splat(-1.12251630e-1f), 1.97141438e-1f), u, -3.33255078e-1f);
+      }
+    };
+
+    template<> struct approx_poly<approx::precise> {
+      static simd::f32x4 sin(simd::f32x4 u) {
+        return mad(mad(u, simd::splat(-1.95152832e-4f), 8.33216076e-3f), u, -1.66666546e-1f);
+      }
+      static simd::f32x4 cos(simd::f32x4 u) {
+        return mad(mad(u, simd::splat(2.44331571e-5f), -1.38873163e-3f), u, 4.16666457e-2f);
+      }
+      static simd::f32x4 exp(simd::f32x4 r) {
+        simd::f32x4 p = mad(r, simd::splat(1.38146133e-3f), 8.36870982e-3f);
+        p = mad(p, r, 4.16683874e-2f);
+        p = mad(p, r, 1.66665207e-1f);
+        return mad(p, r, 4.99999935e-1f);
+      }
+      static simd::f32x4 log(simd::f32x4 m) {
+        simd::f32x4 p = mad(m, simd::splat(-7.63449399e-2f), 1.27615746e-1f);
+        p = mad(p, m, -1.31601822e-1f);
+        p = mad(p, m, 1.42017584e-1f);
+        p = mad(p, m, -1.66233574e-1f);
+        p = mad(p, m, 2.00012269e-1f);
+        p = mad(p, m, -2.50008210e-1f);
+        return mad(p, m, 3.33333317e-1f);
+      }
+      static simd::f32x4 atan(simd::f32x4 u) {
+        simd::f32x4 p = mad(u, simd::splat(7.98496291e-2f), -1.38625786e-1f);
+        p = mad(p, u, 1.99772775e-1f);
+        return mad(p, u, -3.33329835e-1f);
+      }
+    };
+
+    /**
+     * Rounds to nearest for |x| < 2^22, by pushing the fraction out of the
+     * mantissa and back.
+     */
+    inline simd::f32x4 approx_round(simd::f32x4 x) {
+      const simd::f32x4 shift = simd::splat(12582912.0f);
+      return simd::sub(simd::add(x, shift), shift);
+    }
+
+    /**
+     * sin of x = r + q pi/2, from sin r and cos r. cos is the same with
+     * q + 1. f = q/4 - round(q/4) is 0, 1/4, +-1/2 or -1/4 for q mod 4 = 0
+     * to 3, which tells the quadrant apart with float compares only.
+     */
+    inline simd::f32x4 approx_quadrant(simd::f32x4 s, simd::f32x4 c, simd::f32x4 q) {
+      const simd::f32x4 quarter = simd::mul(q, simd::splat(0.25f));
+      const simd::f32x4 f = simd::sub(quarter, approx_round(quarter));
+      const simd::f32x4 odd = simd::sub(simd::mul(f, f), simd::splat(0.0625f));
+      const simd::f32x4 v = simd::select(simd::less(simd::mul(odd, odd), simd::splat(1e-3f)), c, s);
+      const simd::f32x4 d = simd::sub(f, simd::splat(0.125f));
+      return simd::select(simd::less(simd::splat(0.0625f), simd::mul(d, d)),
+                          simd::sub(simd::splat(0.0f), v), v);
+    }
+
+    /**
+     * sin r and cos r for x = r + q pi/2. pi/2 is split in four, the first
+     * three of 11 bits so that q times them is exact for |q| < 2^13.
+     */
+    template<approx::accuracy A>
+    inline void approx_sincos(simd::f32x4 x, simd::f32x4 &s, simd::f32x4 &c,
+                              simd::f32x4 &q) {
+      q = approx_round(simd::mul(x, simd::splat(0.636619772f)));
+      simd::f32x4 r = simd::sub(x, simd::mul(q, simd::splat(1.5703125f)));
+      r = simd::sub(r, simd::mul(q, simd::splat(4.83751297e-4f)));
+      r = simd::sub(r, simd::mul(q, simd::splat(7.54953362e-8f)));
+      r = simd::sub(r, simd::mul(q, simd::splat(2.56334407e-12f)));
+
+      const simd::f32x4 u = simd::mul(r, r);
+      s = simd::add(r, simd::mul(simd::mul(r, u), approx_poly<A>::sin(u)));
+      c = simd::add(mad(u, simd::splat(-0.5f), 1.0f),
+                    simd::mul(simd::mul(u, u), approx_poly<A>::cos(u)));
+    }
+
+    template<approx::accuracy A>
+    struct approx_sin_op {
+      simd::f32x4 operator()(simd::f32x4 x) const {
+        simd::f32x4 s, c, q;
+        approx_sincos<A>(x, s, c, q);
+        return approx_quadrant(s, c, q);
+      }
+    };
+
+    template<approx::accuracy A>
+    struct approx_cos_op {
+      simd::f32x4 operator()(simd::f32x4 x) const {
+        simd::f32x4 s, c, q;
+        approx_sincos<A>(x, s, c, q);
+        return approx_quadrant(s, c, simd::add(q, simd::splat(1.0f)));
+      }
+    };
+
+    /**
+     * e^x = 2^n e^r with r = x - n log(2), log(2) in two parts. Clamping x
+     * keeps n within simd::ldexp's range and lets infinities and zero come
+     * out of it; NaN goes through min and max.
+     */
+    template<approx::accuracy A>
+    struct approx_exp_op {
+      simd::f32x4 operator()(simd::f32x4 x) const {
+        x = simd::max(simd::min(x, simd::splat(89.0f)), simd::splat(-104.0f));
+        const simd::f32x4 n = approx_round(simd::mul(x, simd::splat(1.44269504f)));
+        simd::f32x4 r = simd::sub(x, simd::mul(n, simd::splat(0.693359375f)));
+        r = simd::sub(r, simd::mul(n, simd::splat(-2.12194440e-4f)));
+        const simd::f32x4 e = simd::add(simd::add(r, simd::splat(1.0f)),
+                                        simd::mul(simd::mul(r, r), approx_poly<A>::exp(r)));
+        return simd::ldexp(e, n);
+      }
+    };
+
+    /**
+     * log x = e log(2) + log(1 + m), with m + 1 the mantissa moved into
+     * [sqrt(1/2), sqrt(2)). Denormals are scaled up first.
+     */
+    template<approx::accuracy A>
+    struct approx_log_op {
+      simd::f32x4 operator()(simd::f32x4 x) const {
+        const simd::f32x4 denormal = simd::less(x, simd::splat(std::numeric_limits<float>::min()));
+        const simd::f32x4 scaled = simd::select(denormal, simd::mul(x, simd::splat(8388608.0f)), x);
+        simd::f32x4 e;
+        simd::f32x4 m = simd::frexp(scaled, e);
+        e = simd::sub(e, simd::select(denormal, simd::splat(23.0f), simd::splat(0.0f)));
+
+        const simd::f32x4 low = simd::less(m, simd::splat(0.707106781f));
+        e = simd::sub(e, simd::select(low, simd::splat(1.0f), simd::splat(0.0f)));
+        m = simd::sub(simd::add(m, simd::select(low, m, simd::splat(0.0f))), simd::splat(1.0f));
+
+        const simd::f32x4 m2 = simd::mul(m, m);
+        simd::f32x4 y = simd::mul(simd::mul(m2, m), approx_poly<A>::log(m));
+        y = simd::add(y, simd::mul(e, simd::splat(-2.12194440e-4f)));
+        y = simd::sub(y, simd::mul(m2, simd::splat(0.5f)));
+        y = simd::add(simd::add(m, y), simd::mul(e, simd::splat(0.693359375f)));
+
+        // inf - inf makes NaN of infinities and NaN, then the special cases
+        y = simd::add(y, simd::sub(x, x));
+        y = simd::select(simd::less(x, simd::splat(std::numeric_limits<float>::denorm_min())),
+                         simd::splat(-std::numeric_limits<float>::infinity()), y);
+        y = simd::select(simd::less(x, simd::splat(0.0f)),
+                         simd::splat(std::numeric_limits<float>::quiet_NaN()), y);
+        return simd::select(simd::less(simd::splat(std::numeric_limits<float>::max()), x), x, y);
+      }
+    };
+
+    /**
+     * The angle of the smaller of |y| and |x| over the larger, reduced by
+     * pi/4 above tan(pi/8) with a single division, then moved to its
+     * octant and quadrant.
+     */
+    template<approx::accuracy A>
+    inline simd::f32x4 approx_atan2(simd::f32x4 y, simd::f32x4 x) {
+      const simd::f32x4 zero = simd::splat(0.0f);
+      const simd::f32x4 ax = simd::max(x, simd::sub(zero, x)), ay = simd::max(y, simd::sub(zero, y));
+      // min and max return their first operand for NaN, so a NaN of y
+      // stays in lo and one of x in hi; both infinite is the same as 1, 1
+      const simd::f32x4 both_inf = simd::less(simd::splat(std::numeric_limits<float>::max()),
+                                              simd::min(ay, ax));
+      const simd::f32x4 lo = simd::select(both_inf, simd::splat(1.0f), simd::min(ay, ax));
+      const simd::f32x4 hi = simd::select(both_inf, simd::splat(1.0f), simd::max(ax, ay));
+
+      const simd::f32x4 big = simd::less(simd::mul(hi, simd::splat(0.414213562f)), lo);
+      simd::f32x4 z = simd::div(simd::select(big, simd::sub(lo, hi), lo),
+                                simd::select(big, simd::add(lo, hi), hi));
+      // both zero
+      z = simd::select(simd::less(hi, simd::splat(std::numeric_limits<float>::denorm_min())), zero, z);
+
+      const simd::f32x4 u = simd::mul(z, z);
+      simd::f32x4 a = simd::add(z, simd::mul(simd::mul(z, u), approx_poly<A>::atan(u)));
+      a = simd::add(a, simd::select(big, simd::splat(0.785398163f), zero));
+      a = simd::select(simd::less(ax, ay), simd::sub(simd::splat(1.57079633f), a), a);
+      a = simd::select(simd::less(x, zero), simd::sub(simd::splat(3.14159265f), a), a);
+      return simd::select(simd::less(y, zero), simd::sub(zero, a), a);
+    }
+
+    template<approx::accuracy A> struct approx_rsqrt_op;
+
+    template<> struct approx_rsqrt_op<approx::fast> {
+      simd::f32x4 operator()(simd::f32x4 x) const {return simd::rsqrt_estimate(x); }
+    };
+
+    template<> struct approx_rsqrt_op<approx::medium> {
+      simd::f32x4 operator()(simd::f32x4 x) const {return simd::rsqrt(x); }
+    };
+
+    template<> struct approx_rsqrt_op<approx::precise> {
+      simd::f32x4 operator()(simd::f32x4 x) const {
+        return simd::div(simd::splat(1.0f), simd::sqrt(x));
+      }
+    };
+
+    template<typename OpT>
+    inline float approx_scalar(float x, const OpT &op) {
+      return simd::first(op(simd::splat(x)));
+    }
+
+    template<std::size_t N, typename OpT>
+    inline vec<float, N> approx_vec(const vec<float, N> &v, const OpT &op) {
+      vec<float, N> r;
+      map_floats(v.components, r.components, N, op);
+      return r;
+    }
+  }
+
+  namespace approx {
+    template<accuracy A>
+    inline float sin(float x) {return detail::approx_scalar(x, detail::approx_sin_op<A>()); }
+
+    template<accuracy A, std::size_t N>
+    inline vec<float, N> sin(const vec<float, N> &v) {
+      return detail::approx_vec(v, detail::approx_sin_op<A>());
+    }
+
+    template<accuracy A>
+    inline float cos(float x) {return detail::approx_scalar(x, detail::approx_cos_op<A>()); }
+
+    template<accuracy A, std::size_t N>
+    inline vec<float, N> cos(const vec<float, N> &v) {
+      return detail::approx_vec(v, detail::approx_cos_op<A>());
+    }
+
+    /**
+     * sin and cos for the price of one range reduction and one pair of
+     * polynomials.
+     */
+    template<accuracy A>
+    inline void sincos(float x, float &s, float &c) {
+      simd::f32x4 vs, vc, q;
+      detail::approx_sincos<A>(simd::splat(x), vs, vc, q);
+      s = simd::first(detail::approx_quadrant(vs, vc, q));
+      c = simd::first(detail::approx_quadrant(vs, vc, simd::add(q, simd::splat(1.0f))));
+    }
+
+    template<accuracy A>
+    inline float exp(float x) {return detail::approx_scalar(x, detail::approx_exp_op<A>()); }
+
+    template<accuracy A, std::size_t N>
+    inline vec<float, N> exp(const vec<float, N> &v) {
+      return detail::approx_vec(v, detail::approx_exp_op<A>());
+    }
+
+    template<accuracy A>
+    inline float log(float x) {return detail::approx_scalar(x, detail::approx_log_op<A>()); }
+
+    template<accuracy A, std::size_t N>
+    inline vec<float, N> log(const vec<float, N> &v) {
+      return detail::approx_vec(v, detail::approx_log_op<A>());
+    }
+
+    template<accuracy A>
+    inline float atan2(float y, float x) {
+      return simd::first(detail::approx_atan2<A>(simd::splat(y), simd::splat(x)));
+    }
+
+    /**
+     * Component-wise atan2(y[i], x[i]).
+     */
+    template<accuracy A, std::size_t N>
+    inline vec<float, N> atan2(const vec<float, N> &y, const vec<float, N> &x) {
+      float ty[4] = {0.0f, 0.0f, 0.0f, 0.0f}, tx[4] = {0.0f, 0.0f, 0.0f, 0.0f}, ta[4];
+      vec<float, N> r;
+      for (std::size_t i = 0; i < N; i += 4) {
+        const std::size_t n = N - i < 4 ? N - i : 4;
+        std::copy(y.components + i, y.components + i + n, ty);
+        std::copy(x.components + i, x.components + i + n, tx);
+        simd::store(ta, detail::approx_atan2<A>(simd::load(ty), simd::load(tx)));
+        std::copy(ta, ta + n, r.components + i);
+      }
+      return r;
+    }
+
+    template<accuracy A>
+    inline float rsqrt(float x) {
+      P_INSTRUMENT_COUNT(op_sqrt, float, 1, 1);
+      return detail::approx_scalar(x, detail::approx_rsqrt_op<A>());
+    }
+
+    template<accuracy A, std::size_t N>
+    inline vec<float, N> rsqrt(const vec<float, N> &v) {
+      P_INSTRUMENT_COUNT(op_sqrt, float, N, N);
+      return detail::approx_vec(v, detail::approx_rsqrt_op<A>());
+    }
+
+    /**
+     * p::axis_angle with sincos in place of std::sin and std::cos.
+     */
+    template<accuracy A>
+    inline quatf axis_angle(const vec3 &axis, float angle) {
+      float s, c;
+      sincos<A>(angle * 0.5f, s, c);
+      return make_quat(axis[0] * s, axis[1] * s, axis[2] * s, c);
+    }
+
+    /**
+     * out[i] = f(in[i]) over arrays of floats or of float vectors,
+     * component-wise; out may be in.
+     */
+    template<accuracy A>
+    inline void sin_n(span<const float> in, span<float> out) {
+      assert(in.size() == out.size());
+      detail::map_floats(in.data(), out.data(), in.size(), detail::approx_sin_op<A>());
+    }
+
+    template<accuracy A, std::size_t N>
+    inline void sin_n(span<const vec<float, N> > in, span<vec<float, N> > out) {
+      sin_n<A>(detail::flatten(in), detail::flatten(out));
+    }
+
+    template<accuracy A>
+    inline void cos_n(span<const float> in, span<float> out) {
+      assert(in.size() == out.size());
+      detail::map_floats(in.data(), out.data(), in.size(), detail::approx_cos_op<A>());
+    }
+
+    template<accuracy A, std::size_t N>
+    inline void cos_n(span<const vec<float, N> > in, span<vec<float, N> > out) {
+      cos_n<A>(detail::flatten(in), detail::flatten(out));
+    }
+
+    template<accuracy A>
+    inline void exp_n(span<const float> in, span<float> out) {
+      assert(in.size() == out.size());
+      detail::map_floats(in.data(), out.data(), in.size(), detail::approx_exp_op<A>());
+    }
+
+    template<accuracy A, std::size_t N>
+    inline void exp_n(span<const vec<float, N> > in, span<vec<float, N> > out) {
+      exp_n<A>(detail::flatten(in), detail::flatten(out));
+    }
+
+    template<accuracy A>
+    inline void log_n(span<const float> in, span<float> out) {
+      assert(in.size() == out.size());
+      detail::map_floats(in.data(), out.data(), in.size(), detail::approx_log_op<A>());
+    }
+
+    template<accuracy A, std::size_t N>
+    inline void log_n(span<const vec<float, N> > in, span<vec<float, N> > out) {
+      log_n<A>(detail::flatten(in), detail::flatten(out));
+    }
+
+    template<accuracy A>
+    inline void rsqrt_n(span<const float> in, span<float> out) {
+      assert(in.size() == out.size());
+      P_INSTRUMENT_COUNT(op_sqrt, float, 1, in.size());
+      detail::map_floats(in.data(), out.data(), in.size(), detail::approx_rsqrt_op<A>());
+    }
+
+    template<accuracy A, std::size_t N>
+    inline void rsqrt_n(span<const vec<float, N> > in, span<vec<float, N> > out) {
+      rsqrt_n<A>(detail::flatten(in), detail::flatten(out));
+    }
+
+    /**
+     * s[i] = sin(in[i]), c[i] = cos(in[i]); s and c may be in, not each
+     * other.
+     */
+    template<accuracy A>
+    inline void sincos_n(span<const float> in, span<float> s, span<float> c) {
+      assert(in.size() == s.size() && in.size() == c.size());
+      const std::size_t n = in.size();
+      float ti[4] = {0.0f, 0.0f, 0.0f, 0.0f}, ts[4], tc[4];
+      for (std::size_t i = 0; i < n; i += 4) {
+        const bool whole = i + 4 <= n;
+        const std::size_t k = whole ? 4 : n - i;
+        if (!whole)
+          std::copy(in.data() + i, in.data() + n, ti);
+        simd::f32x4 vs, vc, q;
+        detail::approx_sincos<A>(simd::load(whole ? in.data() + i : ti), vs, vc, q);
+        simd::store(whole ? s.data() + i : ts, detail::approx_quadrant(vs, vc, q));
+        simd::store(whole ? c.data() + i : tc,
+                    detail::approx_quadrant(vs, vc, simd::add(q, simd::splat(1.0f))));
+        if (!whole) {
+          std::copy(ts, ts + k, s.data() + i);
+          std::copy(tc, tc + k, c.data() + i);
+        }
+      }
+    }
+
+    template<accuracy A, std::size_t N>
+    inline void sincos_n(span<const vec<float, N> > in, span<vec<float, N> > s,
+                         span<vec<float, N> > c) {
+      sincos_n<A>(detail::flatten(in), detail::flatten(s), detail::flatten(c));
+    }
+
+    /**
+     * out[i] = atan2(y[i], x[i]); out may be y or x.
+     */
+    template<accuracy A>
+    inline void atan2_n(span<const float> y, span<const float> x, span<float> out) {
+      assert(y.size() == x.size() && y.size() == out.size());
+      const std::size_t n = y.size();
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+        simd::store(out.data() + i, detail::approx_atan2<A>(simd::load(y.data() + i),
+                                                            simd::load(x.data() + i)));
+      if (i < n) {
+        float ty[4] = {0.0f, 0.0f, 0.0f, 0.0f}, tx[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        std::copy(y.data() + i, y.data() + n, ty);
+        std::copy(x.data() + i, x.data() + n, tx);
+        simd::store(ty, detail::approx_atan2<A>(simd::load(ty), simd::load(tx)));
+        std::copy(ty, ty + (n - i), out.data() + i);
+      }
+    }
+
+    template<accuracy A, std::size_t N>
+    inline void atan2_n(span<const vec<float, N> > y, span<const vec<float, N> > x,
+                        span<vec<float, N> > out) {
+      atan2_n<A>(detail::flatten(y), detail::flatten(x), detail::flatten(out));
+    }
+  }
+} // !p
+
+#endif // !P_UTILS_APPROX_MATH_H
@@ -0,0 +1,82 @@
+/* -- config.h -------------------------------------------------------*- c++ -*-
+ * Compiler feature macros shared by the other headers.
+ *
+ * P_CONSTEXPR            constexpr from C++14 on, where constexpr functions
+ *                        may contain loops and assignments; inline before.
+ * P_CONSTANT_EVALUATED() true while the compiler evaluates a constant
+ *                        expression. Functions with SIMD or <cmath> fast
+ *                        paths check it to take their plain code instead.
+ * P_CONSTEXPR_DISPATCH   constexpr for such functions when the compiler
+ *                        can tell (GCC 9, clang 9, MSVC 19.25 and later),
+ *                        inline otherwise.
+ * P_UNROLL               put before a loop whose trip count is a small
+ *                        compile time constant to have it unrolled
+ *                        completely (GCC 8 and clang); nothing elsewhere.
+ *
+ * Options the user can define before including any of the headers:
+ *
+ * P_NO_SIMD              plain component-wise code everywhere (simd.h).
+ * P_NO_DISPATCH          only the compile time SIMD level, no AVX2 or
+ *                        AVX-512 kernels picked at run time (cpu.h).
+ * P_INSTRUMENT           count the vector operations per kind and type
+ *                        (instrument.h); for profiling builds.
+ * P_ALIGNED_VEC          16 byte alignment for four-component vectors of
+ *                        4-byte types and for matrices with such rows, so
+ *                        that they never straddle a cache line. Changes the
+ *                        ABI; define it for the whole program.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_CONFIG_H
+#define P_UTILS_CONFIG_H
+
+#include <cstddef>
+#include <type_traits>
+
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#  define P_CONSTEXPR constexpr
+#else
+#  define P_CONSTEXPR inline
+#endif
+
+#if defined(__cpp_lib_is_constant_evaluated)
+#  define P_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined(__has_builtin)
+#  if __has_builtin(__builtin_is_constant_evaluated)
+#    define P_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#  endif
+#elif (defined(__GNUC__) && __GNUC__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925)
+#  define P_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+
+#if defined(P_CONSTANT_EVALUATED)
+#  define P_CONSTEXPR_DISPATCH P_CONSTEXPR
+#else
+#  define P_CONSTANT_EVALUATED() false
+#  define P_CONSTEXPR_DISPATCH inline
+#endif
+
+#if defined(__clang__)
+#  define P_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#  define P_UNROLL _Pragma("GCC unroll 16")
+#else
+#  define P_UNROLL
+#endif
+
+namespace p {
+  namespace detail {
+    /**
+     * Alignment of vec<T, N> and of mat<T, N, M>, whose rows are vec<T, N>.
+     */
+    template<typename T, std::size_t N>
+    struct vec_alignment {
+#if defined(P_ALIGNED_VEC)
+      static const std::size_t value = N == 4 && sizeof(T) == 4 ? 16 : alignof(T);
+#else
+      static const std::size_t value = alignof(T);
+#endif
+    };
+  }
+}
+
+#endif // !P_UTILS_CONFIG_H
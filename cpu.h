@@ -0,0 +1,185 @@
+/* -- cpu.h ----------------------------------------------------------*- c++ -*-
+ * Instruction set levels picked at run time.
+ *
+ * simd.h fixes the baseline at compile time: SSE2 on x86, so that one
+ * binary runs on every x86-64 host. The heavier batch kernels (see
+ * vector_batch.h and vector_packed.h) are also compiled for AVX2 and
+ * AVX-512 with per-function target attributes, and pick the best version
+ * the CPU has. The CPU is queried once, on the first call of active_isa().
+ *
+ * std::puts(p::isa_name(p::active_isa()));   // "avx2" on a Haswell
+ * p::force_isa(p::isa_sse2);                 // e.g. to compare timings
+ *
+ * The levels follow the x86-64 micro-architecture levels: isa_avx2 needs
+ * AVX2, FMA and F16C (x86-64-v3), isa_avx512 AVX-512 F, BW, DQ and VL on
+ * top (x86-64-v4). A kernel without a version for the active level uses
+ * the best one below it. The wider versions use fused multiply-adds and
+ * sum in a different order, so results may differ in the last bits
+ * between levels; for a given level they are reproducible.
+ *
+ * The environment variable P_ISA, set to one of the level names, caps the
+ * level for the whole process without recompiling. Define P_NO_DISPATCH
+ * to compile only the baseline.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_CPU_H
+#define P_UTILS_CPU_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "simd.h"
+
+#if defined(P_SIMD_SSE2) && !defined(P_NO_DISPATCH)
+#  if defined(__GNUC__)
+#    include <cpuid.h>
+#    define P_DISPATCH_X86 1
+#    define P_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#    define P_TARGET_AVX512 \
+       __attribute__((target("avx2,fma,f16c,avx512f,avx512bw,avx512dq,avx512vl")))
+#  elif defined(_MSC_VER) && _MSC_VER >= 1910
+#    include <intrin.h>
+#    define P_DISPATCH_X86 1
+#    define P_TARGET_AVX2
+#    define P_TARGET_AVX512
+#  endif
+#endif
+
+#if defined(P_DISPATCH_X86)
+#  include <immintrin.h>
+#endif
+
+namespace p {
+  /**
+   * Instruction set levels. Only the levels of one architecture compare
+   * meaningfully.
+   */
+  enum isa {
+    isa_scalar,
+    isa_neon,
+    isa_sse2,
+    isa_avx2,
+    isa_avx512
+  };
+
+  inline const char *isa_name(isa level) {
+    static const char *const names[] = {"scalar", "neon", "sse2", "avx2", "avx512"};
+    return names[level];
+  }
+
+  /**
+   * The level simd.h compiles for; nothing runs below it.
+   */
+  inline isa compiled_isa() {
+#if defined(P_SIMD_SSE2)
+    return isa_sse2;
+#elif defined(P_SIMD_NEON)
+    return isa_neon;
+#else
+    return isa_scalar;
+#endif
+  }
+
+  namespace detail {
+#if defined(P_DISPATCH_X86)
+    inline void cpuid(unsigned leaf, unsigned r[4]) {
+#  if defined(_MSC_VER)
+      int regs[4];
+      __cpuidex(regs, int(leaf), 0);
+      for (int i = 0; i < 4; ++i)
+        r[i] = unsigned(regs[i]);
+#  else
+      __cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+#  endif
+    }
+
+    /**
+     * The register state the OS saves on context switches (XCR0).
+     */
+    inline unsigned os_saved_state() {
+#  if defined(_MSC_VER)
+      return unsigned(_xgetbv(0));
+#  else
+      unsigned lo, hi;
+      __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+      return lo;
+#  endif
+    }
+
+    inline isa detect_isa() {
+      unsigned r[4];
+      cpuid(0, r);
+      if (r[0] < 7)
+        return isa_sse2;
+
+      cpuid(1, r);
+      const bool fma = (r[2] >> 12) & 1, osxsave = (r[2] >> 27) & 1;
+      const bool avx = (r[2] >> 28) & 1, f16c = (r[2] >> 29) & 1;
+      if (!(osxsave && avx && fma && f16c))
+        return isa_sse2;
+
+      // XMM and YMM state, then opmask and both halves of the ZMM state
+      const unsigned state = os_saved_state();
+      cpuid(7, r);
+      if ((state & 0x6) != 0x6 || !((r[1] >> 5) & 1))
+        return isa_sse2;
+
+      const unsigned avx512 = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);
+      if ((state & 0xe6) != 0xe6 || (r[1] & avx512) != avx512)
+        return isa_avx2;
+      return isa_avx512;
+    }
+#else
+    inline isa detect_isa() {return compiled_isa(); }
+#endif
+
+    inline isa clamp_isa(isa level, isa highest) {
+      if (level > highest)
+        return highest;
+      return level < compiled_isa() ? compiled_isa() : level;
+    }
+  }
+
+  /**
+   * The highest level both the CPU and the build support.
+   */
+  inline isa detected_isa() {
+    static const isa level = detail::detect_isa();
+    return level;
+  }
+
+  namespace detail {
+    inline std::atomic<int> &isa_state() {
+      static std::atomic<int> level([] {
+        isa l = detected_isa();
+        if (const char *cap = std::getenv("P_ISA"))
+          for (int i = isa_scalar; i <= isa_avx512; ++i)
+            if (!std::strcmp(cap, isa_name(isa(i))))
+              l = clamp_isa(isa(i), l);
+        return int(l);
+      }());
+      return level;
+    }
+  }
+
+  /**
+   * The level the kernels dispatch on.
+   */
+  inline isa active_isa() {
+    return isa(detail::isa_state().load(std::memory_order_relaxed));
+  }
+
+  /**
+   * Makes the kernels use `level`, limited to what detected_isa() allows
+   * and to at least compiled_isa(). Returns the level now active. Meant for
+   * start up and tests; it must not race with running kernels.
+   */
+  inline isa force_isa(isa level) {
+    const isa l = detail::clamp_isa(level, detected_isa());
+    detail::isa_state().store(int(l), std::memory_order_relaxed);
+    return l;
+  }
+} // !p
+
+#endif // !P_UTILS_CPU_H
@@ -0,0 +1,338 @@
+/* -- instrument.h ---------------------------------------------------*- c++ -*-
+ * Operation counters for finding where vector arithmetic is spent.
+ *
+ * Define P_INSTRUMENT for the whole program to have vector.h and
+ * vector_stream.h count what they do, per kind of operation and per vector
+ * type and size:
+ *
+ *   op_transform  calls of transform(), and so of the arithmetic operators
+ *   op_flop       component additions, subtractions, multiplications and
+ *                 negations, including those of dot and cross products
+ *   op_div        component divisions
+ *   op_sqrt       square roots and reciprocal square roots
+ *   op_splat      make_vec<N>(scalar)
+ *   op_temporary  vectors returned by value from the operators
+ *   op_parse      vectors read by operator >> and the bulk parsers
+ *
+ * Without it the hooks expand to nothing and none of the code below is
+ * compiled.
+ *
+ * Counts go to a table of the calling thread, without locking. Code can
+ * be attributed to named scopes, which nest; anything outside one counts
+ * under "":
+ *
+ * void step() {
+ *   P_INSTRUMENT_SCOPE("physics");
+ *   ...
+ * }
+ *
+ * p::instrument::report(std::cerr);   // all threads, highest count first
+ * p::instrument::reset();
+ *
+ * Threads that exit leave their counts behind for the report. Vectors
+ * other than float, double, int and unsigned char count as "other", and
+ * sizes above 4 as size 0 ("n" in the report). In constant expressions
+ * nothing is counted; in an instrumented build vectors can only be used in
+ * them where P_CONSTEXPR_DISPATCH is constexpr (see config.h).
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_INSTRUMENT_H
+#define P_UTILS_INSTRUMENT_H
+
+#include "config.h"
+
+#if defined(P_INSTRUMENT)
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#define P_INSTRUMENT_COUNT(kind, T, N, n)                                  \
+  do {                                                                      \
+    if (!P_CONSTANT_EVALUATED())                                            \
+      ::p::instrument::count<T, N>(::p::instrument::kind, n);               \
+  } while (false)
+
+#define P_INSTRUMENT_TRANSFORM(OpT, T, N, temporaries)                     \
+  do {                                                                      \
+    if (!P_CONSTANT_EVALUATED())                                            \
+      ::p::instrument::count_transform<OpT, T, N>(temporaries);            \
+  } while (false)
+
+#define P_INSTRUMENT_CAT2(a, b) a##b
+#define P_INSTRUMENT_CAT(a, b) P_INSTRUMENT_CAT2(a, b)
+#define P_INSTRUMENT_SCOPE(name)                                           \
+  static const int P_INSTRUMENT_CAT(p_instrument_id_, __LINE__) =          \
+    ::p::instrument::scope_id(name);                                        \
+  const ::p::instrument::scope P_INSTRUMENT_CAT(p_instrument_scope_, __LINE__)( \
+    P_INSTRUMENT_CAT(p_instrument_id_, __LINE__))
+
+namespace p {
+  namespace instrument {
+    enum op_kind {
+      op_transform,
+      op_flop,
+      op_div,
+      op_sqrt,
+      op_splat,
+      op_temporary,
+      op_parse,
+      op_kinds
+    };
+
+    inline const char *op_name(op_kind kind) {
+      static const char *const names[] = {
+        "transform", "flop", "div", "sqrt", "splat", "temporary", "parse"
+      };
+      return names[kind];
+    }
+
+    /**
+     * One line of a snapshot(); size is 0 for vectors of more than four
+     * components.
+     */
+    struct op_count {
+      const char *scope;
+      op_kind kind;
+      const char *type;
+      std::size_t size;
+      std::uint64_t count;
+    };
+  }
+
+  namespace detail {
+    enum {instrument_scopes = 16};
+    enum {instrument_types = 5};
+    enum {instrument_sizes = 5};
+
+    template<typename T> struct instrument_type {enum {value = 4}; };
+    template<> struct instrument_type<float> {enum {value = 0}; };
+    template<> struct instrument_type<double> {enum {value = 1}; };
+    template<> struct instrument_type<int> {enum {value = 2}; };
+    template<> struct instrument_type<unsigned char> {enum {value = 3}; };
+
+    inline const char *instrument_type_name(std::size_t t) {
+      static const char *const names[] = {"float", "double", "int", "unsigned char", "other"};
+      return names[t];
+    }
+
+    /**
+     * What each component of a transform() with the functor counts as;
+     * op_kinds for nothing beyond the transform itself.
+     */
+    template<typename OpT> struct instrument_functor {enum {value = instrument::op_kinds}; };
+    template<typename T> struct instrument_functor<std::plus<T> > {
+      enum {value = instrument::op_flop};
+    };
+    template<typename T> struct instrument_functor<std::minus<T> > {
+      enum {value = instrument::op_flop};
+    };
+    template<typename T> struct instrument_functor<std::multiplies<T> > {
+      enum {value = instrument::op_flop};
+    };
+    template<typename T> struct instrument_functor<std::divides<T> > {
+      enum {value = instrument::op_div};
+    };
+
+    /**
+     * Written only by its own thread; the atomics let snapshot() read it
+     * meanwhile.
+     */
+    struct instrument_table {
+      instrument_table() : n() {}
+      std::atomic<std::uint64_t>
+        n[instrument_scopes][instrument::op_kinds][instrument_types][instrument_sizes];
+    };
+
+    struct instrument_registry {
+      instrument_registry() : scope_count(1) {scopes[0] = ""; }
+
+      std::mutex m;
+      std::vector<instrument_table *> live;
+      instrument_table retired;  // counts of the threads that exited
+      const char *scopes[instrument_scopes];
+      std::size_t scope_count;
+    };
+
+    // never destroyed, for threads that exit during static destruction
+    inline instrument_registry &instrument_state() {
+      static instrument_registry *r = new instrument_registry;
+      return *r;
+    }
+
+    struct instrument_thread {
+      instrument_thread() : scope(0) {
+        instrument_registry &r = instrument_state();
+        std::lock_guard<std::mutex> lock(r.m);
+        r.live.push_back(&table);
+      }
+
+      ~instrument_thread() {
+        instrument_registry &r = instrument_state();
+        std::lock_guard<std::mutex> lock(r.m);
+        std::atomic<std::uint64_t> *from = &table.n[0][0][0][0], *to = &r.retired.n[0][0][0][0];
+        for (std::size_t i = 0; i < sizeof(table.n) / sizeof(from[0]); ++i)
+          to[i].store(to[i].load(std::memory_order_relaxed) +
+                      from[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &table));
+      }
+
+      instrument_table table;
+      int scope;
+    };
+
+    inline instrument_thread &instrument_local() {
+      static thread_local instrument_thread t;
+      return t;
+    }
+  }
+
+  namespace instrument {
+    template<typename T, std::size_t N>
+    inline void count(op_kind kind, std::uint64_t n = 1) {
+      detail::instrument_thread &t = detail::instrument_local();
+      std::atomic<std::uint64_t> &c =
+        t.table.n[t.scope][kind][detail::instrument_type<T>::value][N <= 4 ? N : 0];
+      c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /**
+     * One transform() of N components with functor OpT, returning
+     * `temporaries` new vectors.
+     */
+    template<typename OpT, typename T, std::size_t N>
+    inline void count_transform(std::uint64_t temporaries) {
+      count<T, N>(op_transform);
+      if (int(detail::instrument_functor<OpT>::value) != op_kinds)
+        count<T, N>(op_kind(detail::instrument_functor<OpT>::value), N);
+      if (temporaries)
+        count<T, N>(op_temporary, temporaries);
+    }
+
+    /**
+     * The id of the scope called name, registering it the first time. Up
+     * to 15 names are kept; any further ones count under "". name must
+     * outlive the counters.
+     */
+    inline int scope_id(const char *name) {
+      detail::instrument_registry &r = detail::instrument_state();
+      std::lock_guard<std::mutex> lock(r.m);
+      for (std::size_t i = 0; i < r.scope_count; ++i)
+        if (!std::strcmp(r.scopes[i], name))
+          return int(i);
+      if (r.scope_count == detail::instrument_scopes)
+        return 0;
+      r.scopes[r.scope_count] = name;
+      return int(r.scope_count++);
+    }
+
+    /**
+     * Counts the calling thread's operations under scope id until
+     * destroyed; P_INSTRUMENT_SCOPE makes one.
+     */
+    class scope {
+    public:
+      explicit scope(int id) : previous(detail::instrument_local().scope) {
+        detail::instrument_local().scope = id;
+      }
+
+      ~scope() {detail::instrument_local().scope = previous; }
+
+    private:
+      scope(const scope &);
+      scope &operator =(const scope &);
+
+      int previous;
+    };
+
+    /**
+     * The counts of all threads, live and exited, added up; only those
+     * that aren't zero, highest first.
+     */
+    inline std::vector<op_count> snapshot() {
+      detail::instrument_registry &r = detail::instrument_state();
+      std::lock_guard<std::mutex> lock(r.m);
+
+      std::vector<op_count> out;
+      for (std::size_t s = 0; s < r.scope_count; ++s)
+        for (std::size_t k = 0; k < op_kinds; ++k)
+          for (std::size_t t = 0; t < detail::instrument_types; ++t)
+            for (std::size_t n = 0; n < detail::instrument_sizes; ++n) {
+              std::uint64_t sum = r.retired.n[s][k][t][n].load(std::memory_order_relaxed);
+              for (std::size_t i = 0; i < r.live.size(); ++i)
+                sum += r.live[i]->n[s][k][t][n].load(std::memory_order_relaxed);
+              if (sum) {
+                const op_count c = {r.scopes[s], op_kind(k),
+                                    detail::instrument_type_name(t), n, sum};
+                out.push_back(c);
+              }
+            }
+
+      std::stable_sort(out.begin(), out.end(), [](const op_count &a, const op_count &b) {
+        return a.count > b.count;
+      });
+      return out;
+    }
+
+    /**
+     * The sum of one kind over all scopes, types and sizes.
+     */
+    inline std::uint64_t total(op_kind kind) {
+      const std::vector<op_count> counts = snapshot();
+      std::uint64_t sum = 0;
+      for (std::size_t i = 0; i < counts.size(); ++i)
+        if (counts[i].kind == kind)
+          sum += counts[i].count;
+      return sum;
+    }
+
+    /**
+     * Writes snapshot() one count per line: scope, kind, vector type and
+     * count, as in "physics flop vec<float, 3> 1200".
+     */
+    inline void report(std::ostream &out) {
+      const std::vector<op_count> counts = snapshot();
+      for (std::size_t i = 0; i < counts.size(); ++i) {
+        const op_count &c = counts[i];
+        out << (*c.scope ? c.scope : "-") << ' ' << op_name(c.kind) << " vec<" << c.type;
+        if (c.size)
+          out << ", " << c.size;
+        else
+          out << ", n";
+        out << "> " << c.count << '\n';
+      }
+    }
+
+    /**
+     * Zeroes all counts. Counts of other threads that are running
+     * meanwhile may survive it.
+     */
+    inline void reset() {
+      detail::instrument_registry &r = detail::instrument_state();
+      std::lock_guard<std::mutex> lock(r.m);
+      const std::size_t n = sizeof(r.retired.n) / sizeof(r.retired.n[0][0][0][0]);
+      for (std::size_t t = 0; t <= r.live.size(); ++t) {
+        detail::instrument_table &table = t < r.live.size() ? *r.live[t] : r.retired;
+        std::atomic<std::uint64_t> *c = &table.n[0][0][0][0];
+        for (std::size_t i = 0; i < n; ++i)
+          c[i].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+} // !p
+
+#else
+
+#define P_INSTRUMENT_COUNT(kind, T, N, n) ((void)0)
+#define P_INSTRUMENT_TRANSFORM(OpT, T, N, temporaries) ((void)0)
+#define P_INSTRUMENT_SCOPE(name) ((void)0)
+
+#endif // P_INSTRUMENT
+
+#endif // !P_UTILS_INSTRUMENT_H
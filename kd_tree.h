@@ -0,0 +1,350 @@
+/* -- kd_tree.h ------------------------------------------------------*- c++ -*-
+ * Spatial index over a static set of vec3 points.
+ *
+ * kd_tree copies the points into tree order, so a query reads one
+ * contiguous array instead of chasing node pointers. Every range of more
+ * than leaf_size points is split at its median along its widest axis; the
+ * median point sits between its two halves and only its axis is stored
+ * besides it. Leaves are short ranges that are scanned straight through.
+ *
+ * p::kd_tree tree(p::span<const p::vec3>(points));
+ * p::kd_neighbor n[8];
+ * std::size_t found = tree.nearest_k(q, p::span<p::kd_neighbor>(n));
+ *
+ * Queries work on squared distances and return indices into the array the
+ * tree was built from. Neighbors at the same distance are ordered by index,
+ * so the results are the same as those of a brute force search. The tree
+ * is built in parallel on a thread_pool; the batch queries are split over
+ * one the same way. Points must be finite.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_KD_TREE_H
+#define P_UTILS_KD_TREE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "vector.h"
+#include "vector_batch.h"
+#include "span.h"
+#include "parallel.h"
+
+namespace p {
+  /**
+   * A query result; index is kd_tree::npos where fewer points were found
+   * than asked for.
+   */
+  struct kd_neighbor {
+    std::uint32_t index;
+    float distance2;
+  };
+
+  namespace detail {
+    inline bool kd_closer(const kd_neighbor &a, const kd_neighbor &b) {
+      return a.distance2 < b.distance2 ||
+        (a.distance2 == b.distance2 && a.index < b.index);
+    }
+
+    inline float kd_distance2(const vec3 &a, const vec3 &b) {
+      const float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+      return dx*dx + dy*dy + dz*dz;
+    }
+
+    struct kd_entry {
+      vec3 point;
+      std::uint32_t index;
+    };
+
+    // ranges per parallel build task and queries per parallel chunk
+    const std::size_t kd_build_tasks = 64;
+    const std::size_t kd_query_chunk = 256;
+  }
+
+  class kd_tree {
+  public:
+    enum {npos = 0xffffffffu};
+    enum {leaf_size = 8};
+
+    kd_tree() {}
+
+    explicit kd_tree(span<const vec3> points,
+                     thread_pool &pool = thread_pool::shared()) {
+      build(points, pool);
+    }
+
+    /**
+     * Replaces the contents with an index over points, which may hold at
+     * most 2^32 - 1 of them.
+     */
+    void build(span<const vec3> points, thread_pool &pool = thread_pool::shared()) {
+      assert(points.size() < npos);
+      std::vector<detail::kd_entry> entries(points.size());
+      for (std::size_t i = 0; i < points.size(); ++i) {
+        entries[i].point = points[i];
+        entries[i].index = std::uint32_t(i);
+      }
+      axes.assign(points.size(), 0);
+
+      // split serially until there is enough independent work to share
+      std::vector<std::pair<std::size_t, std::size_t> > tasks, next;
+      tasks.push_back(std::make_pair(std::size_t(0), points.size()));
+      while (tasks.size() < detail::kd_build_tasks) {
+        next.clear();
+        bool split = false;
+        for (std::size_t t = 0; t < tasks.size(); ++t) {
+          const std::size_t b = tasks[t].first, e = tasks[t].second;
+          if (e - b <= leaf_size) {
+            next.push_back(tasks[t]);
+            continue;
+          }
+          const std::size_t m = split_range(entries.data(), b, e);
+          next.push_back(std::make_pair(b, m));
+          next.push_back(std::make_pair(m + 1, e));
+          split = true;
+        }
+        tasks.swap(next);
+        if (!split)
+          break;
+      }
+
+      detail::kd_entry *data = entries.data();
+      pool.parallel_for(tasks.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t t = begin; t < end; ++t)
+          build_range(data, tasks[t].first, tasks[t].second);
+      });
+
+      pts.resize(points.size());
+      ids.resize(points.size());
+      for (std::size_t i = 0; i < entries.size(); ++i) {
+        pts[i] = entries[i].point;
+        ids[i] = entries[i].index;
+      }
+    }
+
+    std::size_t size() const {return pts.size(); }
+    bool empty() const {return pts.empty(); }
+
+    /**
+     * The out.size() points closest to q, nearest first. Returns how many
+     * were found, which is less only if the tree holds fewer points; the
+     * rest of out is set to npos and infinity.
+     */
+    std::size_t nearest_k(const vec3 &q, span<kd_neighbor> out) const {
+      knn_state s = {q, out.data(), out.size(), 0};
+      if (s.k)
+        search_k(s, 0, pts.size());
+      std::sort_heap(s.heap, s.heap + s.count, detail::kd_closer);
+      for (std::size_t i = s.count; i < s.k; ++i) {
+        s.heap[i].index = std::uint32_t(npos);
+        s.heap[i].distance2 = std::numeric_limits<float>::infinity();
+      }
+      return s.count;
+    }
+
+    kd_neighbor nearest(const vec3 &q) const {
+      kd_neighbor n;
+      nearest_k(q, span<kd_neighbor>(&n, 1));
+      return n;
+    }
+
+    /**
+     * Calls f(index, distance2) for every point within radius of q, in no
+     * particular order.
+     */
+    template<typename F>
+    void for_each_within(const vec3 &q, float radius, F f) const {
+      search_radius(q, radius * radius, 0, pts.size(), f);
+    }
+
+    /**
+     * Appends the indices of the points within radius of q to out.
+     */
+    void within_radius(const vec3 &q, float radius, std::vector<std::uint32_t> &out) const {
+      for_each_within(q, radius, [&out](std::uint32_t i, float) {out.push_back(i); });
+    }
+
+    /**
+     * Calls f(index) for every point inside box, bounds included.
+     */
+    template<typename F>
+    void for_each_in(const aabb<float, 3> &box, F f) const {
+      search_box(box, 0, pts.size(), f);
+    }
+
+    void within_box(const aabb<float, 3> &box, std::vector<std::uint32_t> &out) const {
+      for_each_in(box, [&out](std::uint32_t i) {out.push_back(i); });
+    }
+
+    /**
+     * nearest_k() for every query; out holds k results per query, one
+     * query after the other.
+     */
+    void nearest_k_n(span<const vec3> queries, std::size_t k, span<kd_neighbor> out,
+                     thread_pool &pool = thread_pool::shared()) const {
+      assert(out.size() == queries.size() * k);
+      pool.parallel_for(queries.size(), detail::kd_query_chunk,
+                        [&](std::size_t begin, std::size_t end) {
+                          for (std::size_t i = begin; i < end; ++i)
+                            nearest_k(queries[i], out.subspan(i * k, k));
+                        });
+    }
+
+    void nearest_n(span<const vec3> queries, span<kd_neighbor> out,
+                   thread_pool &pool = thread_pool::shared()) const {
+      nearest_k_n(queries, 1, out, pool);
+    }
+
+    /**
+     * The number of points within radius of each query.
+     */
+    void count_within_n(span<const vec3> queries, float radius, span<std::size_t> out,
+                        thread_pool &pool = thread_pool::shared()) const {
+      assert(out.size() == queries.size());
+      pool.parallel_for(queries.size(), detail::kd_query_chunk,
+                        [&](std::size_t begin, std::size_t end) {
+                          for (std::size_t i = begin; i < end; ++i) {
+                            std::size_t n = 0;
+                            for_each_within(queries[i], radius,
+                                            [&n](std::uint32_t, float) {++n; });
+                            out[i] = n;
+                          }
+                        });
+    }
+
+  private:
+    struct knn_state {
+      vec3 q;
+      kd_neighbor *heap;  // max-heap on kd_closer of the best found so far
+      std::size_t k, count;
+    };
+
+    /**
+     * Puts the median of [b, e) along its widest axis in the middle and
+     * returns its position.
+     */
+    std::size_t split_range(detail::kd_entry *e, std::size_t b, std::size_t end) {
+      vec3 lo = e[b].point, hi = e[b].point;
+      for (std::size_t i = b + 1; i < end; ++i) {
+        lo = min(lo, e[i].point);
+        hi = max(hi, e[i].point);
+      }
+      const vec3 extent = hi - lo;
+      const std::uint8_t axis = extent[0] >= extent[1]
+        ? (extent[0] >= extent[2] ? 0 : 2) : (extent[1] >= extent[2] ? 1 : 2);
+
+      const std::size_t m = b + (end - b) / 2;
+      std::nth_element(e + b, e + m, e + end,
+                       [axis](const detail::kd_entry &x, const detail::kd_entry &y) {
+                         return x.point[axis] < y.point[axis];
+                       });
+      axes[m] = axis;
+      return m;
+    }
+
+    void build_range(detail::kd_entry *e, std::size_t b, std::size_t end) {
+      while (end - b > leaf_size) {
+        const std::size_t m = split_range(e, b, end);
+        build_range(e, b, m);
+        b = m + 1;
+      }
+    }
+
+    void consider(knn_state &s, std::size_t i) const {
+      const kd_neighbor n = {ids[i], detail::kd_distance2(s.q, pts[i])};
+      if (s.count < s.k) {
+        s.heap[s.count++] = n;
+        std::push_heap(s.heap, s.heap + s.count, detail::kd_closer);
+      }
+      else if (detail::kd_closer(n, s.heap[0])) {
+        std::pop_heap(s.heap, s.heap + s.count, detail::kd_closer);
+        s.heap[s.count - 1] = n;
+        std::push_heap(s.heap, s.heap + s.count, detail::kd_closer);
+      }
+    }
+
+    void search_k(knn_state &s, std::size_t b, std::size_t e) const {
+      while (e - b > leaf_size) {
+        const std::size_t m = b + (e - b) / 2;
+        const float d = s.q[axes[m]] - pts[m][axes[m]];
+        consider(s, m);
+        // the near side first; the far one only if it can hold anything closer
+        if (d < 0.0f) {
+          search_k(s, b, m);
+          if (s.count == s.k && d * d > s.heap[0].distance2)
+            return;
+          b = m + 1;
+        }
+        else {
+          search_k(s, m + 1, e);
+          if (s.count == s.k && d * d > s.heap[0].distance2)
+            return;
+          e = m;
+        }
+      }
+      for (std::size_t i = b; i < e; ++i)
+        consider(s, i);
+    }
+
+    template<typename F>
+    void search_radius(const vec3 &q, float r2, std::size_t b, std::size_t e, F &f) const {
+      while (e - b > leaf_size) {
+        const std::size_t m = b + (e - b) / 2;
+        const float d = q[axes[m]] - pts[m][axes[m]];
+        const float d2 = detail::kd_distance2(q, pts[m]);
+        if (d2 <= r2)
+          f(ids[m], d2);
+        if (d * d <= r2) {
+          search_radius(q, r2, b, m, f);
+          b = m + 1;
+        }
+        else if (d < 0.0f)
+          e = m;
+        else
+          b = m + 1;
+      }
+      for (std::size_t i = b; i < e; ++i) {
+        const float d2 = detail::kd_distance2(q, pts[i]);
+        if (d2 <= r2)
+          f(ids[i], d2);
+      }
+    }
+
+    template<typename F>
+    void search_box(const aabb<float, 3> &box, std::size_t b, std::size_t e, F &f) const {
+      while (e - b > leaf_size) {
+        const std::size_t m = b + (e - b) / 2;
+        const std::uint8_t axis = axes[m];
+        const float split = pts[m][axis];
+        if (inside(box, pts[m]))
+          f(ids[m]);
+        if (box.min[axis] <= split && split <= box.max[axis]) {
+          search_box(box, b, m, f);
+          b = m + 1;
+        }
+        else if (box.max[axis] < split)
+          e = m;
+        else
+          b = m + 1;
+      }
+      for (std::size_t i = b; i < e; ++i)
+        if (inside(box, pts[i]))
+          f(ids[i]);
+    }
+
+    static bool inside(const aabb<float, 3> &box, const vec3 &v) {
+      return box.min[0] <= v[0] && v[0] <= box.max[0] &&
+             box.min[1] <= v[1] && v[1] <= box.max[1] &&
+             box.min[2] <= v[2] && v[2] <= box.max[2];
+    }
+
+    std::vector<vec3> pts;            // in tree order
+    std::vector<std::uint32_t> ids;   // original index of each point
+    std::vector<std::uint8_t> axes;   // split axis of each median point
+  };
+} // !p
+
+#endif // !P_UTILS_KD_TREE_H
@@ -1,29 +1,52 @@
 /* -- matrix.h -------------------------------------------------------*- c++ -*-
  *
+ * mat<T, M, N> is a row-major matrix with M columns and N rows; row(j)
+ * returns the j:th row as a vec<T, M>.
+ *
+ * Operations that can be done on matrices:
+ *   mat * mat, mat * vec, transpose
+ *   determinant, inverse, affine_inverse (2x2, 3x3 and 4x4 only)
+ *
+ * Linear systems are better solved with matrix_solve.h than through
+ * inverse.
+ *
+ * The products are computed straight into the returned value, so a chain
+ * like proj * view * model only holds one result per multiplication.
+ * mat3 and mat4 use the SIMD registers from simd.h; other sizes go through
+ * a blocked generic loop. The 4x4 inverse is computed block-wise with
+ * shuffles, and affine_inverse only inverts the linear part, so prefer it
+ * for rigid and affine transforms.
+ *
+ * All of the above, and mat(T), are constexpr (see config.h); in constant
+ * expressions the SIMD sizes use the generic code. row() and the default
+ * constructor, which leaves the components uninitialized, aren't.
  * -------------------------------------------------------------------------- */
 
 #ifndef P_UTILS_MATRIX_H
 #define P_UTILS_MATRIX_H
 
 #include <algorithm>
+#include <cstddef>
 
-namespace p {
+#include "config.h"
+#include "vector.h"
+#include "simd.h"
 
-  template<typename T, std::size_t N>
-  class vec;
+namespace p {
 
   /**
    * The general case.
    */
   template<typename T, std::size_t M, std::size_t N>
-  struct mat {
+  struct alignas(detail::vec_alignment<T, M>::value) mat {
     typedef T value_type;
     enum {width = M};
     enum {height = N};
 
     mat() {}
-    explicit mat(T val) {
-      std::fill(components, components + M*N, val);
+    P_CONSTEXPR explicit mat(T val) : components() {
+      for (std::size_t i = 0; i < M*N; ++i)
+        components[i] = val;
     }
 
     vec<T, M> &row(std::size_t j) {
@@ -31,7 +54,7 @@ namespace p {
     }
 
     const vec<T, M> &row(std::size_t j) const {
-      return reinterpret_cast<vec<T, M> &>(components[M*j]);
+      return reinterpret_cast<const vec<T, M> &>(components[M*j]);
     }
   
     T components[M*N];
@@ -41,6 +64,641 @@ namespace p {
   template<typename T, std::size_t M> struct mat<T, M, 0> {private: mat(); };
   template<typename T, std::size_t N> struct mat<T, 0, N> {private: mat(); };
 
+  namespace detail {
+    /**
+     * out (C columns, R rows) = a (K columns, R rows) * b (C columns, K rows).
+     * The general case runs i-k-j over blocks of the shared dimension and
+     * the output columns, so the inner loop streams through rows of b and
+     * out.
+     */
+    template<typename T, std::size_t C, std::size_t K, std::size_t R>
+    struct mat_mul_generic {
+      enum {block = 32};
+
+      static P_CONSTEXPR void apply(const mat<T, K, R> &a,
+                                    const mat<T, C, K> &b,
+                                    mat<T, C, R> &out) {
+        for (std::size_t i = 0; i < C*R; ++i)
+          out.components[i] = T();
+
+        for (std::size_t kk = 0; kk < K; kk += block) {
+          const std::size_t kend = std::min<std::size_t>(kk + block, K);
+          for (std::size_t jj = 0; jj < C; jj += block) {
+            const std::size_t jend = std::min<std::size_t>(jj + block, C);
+            for (std::size_t i = 0; i < R; ++i) {
+              T *orow = out.components + C*i;
+              for (std::size_t k = kk; k < kend; ++k) {
+                const T aik = a.components[K*i + k];
+                const T *brow = b.components + C*k;
+                for (std::size_t j = jj; j < jend; ++j)
+                  orow[j] += aik * brow[j];
+              }
+            }
+          }
+        }
+      }
+    };
+
+    /**
+     * out (R components) = a (K columns, R rows) * v (K components).
+     */
+    template<typename T, std::size_t K, std::size_t R>
+    struct mat_vec_mul_generic {
+      static P_CONSTEXPR void apply(const mat<T, K, R> &a, const vec<T, K> &v,
+                                    vec<T, R> &out) {
+        for (std::size_t i = 0; i < R; ++i) {
+          const T *arow = a.components + K*i;
+          T sum = T();
+          for (std::size_t k = 0; k < K; ++k)
+            sum += arow[k] * v[k];
+          out[i] = sum;
+        }
+      }
+    };
+
+    /**
+     * The products used by the operators; specialized below for the SIMD
+     * sizes, which use the generic code in constant expressions.
+     */
+    template<typename T, std::size_t C, std::size_t K, std::size_t R>
+    struct mat_mul : mat_mul_generic<T, C, K, R> {};
+
+    template<typename T, std::size_t K, std::size_t R>
+    struct mat_vec_mul : mat_vec_mul_generic<T, K, R> {};
+
+#if defined(P_SIMD)
+    /**
+     * Every output row is a linear combination of the rows of b, weighted by
+     * the corresponding row of a.
+     */
+    template<>
+    struct mat_mul<float, 4, 4, 4> {
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 4, 4> &a,
+                                             const mat<float, 4, 4> &b,
+                                             mat<float, 4, 4> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_mul_generic<float, 4, 4, 4>::apply(a, b, out);
+        else
+          apply_simd(a, b, out);
+      }
+
+      static void apply_simd(const mat<float, 4, 4> &a, const mat<float, 4, 4> &b,
+                             mat<float, 4, 4> &out) {
+        const simd::f32x4 b0 = simd::load(b.components);
+        const simd::f32x4 b1 = simd::load(b.components + 4);
+        const simd::f32x4 b2 = simd::load(b.components + 8);
+        const simd::f32x4 b3 = simd::load(b.components + 12);
+
+        for (std::size_t i = 0; i < 4; ++i) {
+          const float *arow = a.components + 4*i;
+          simd::f32x4 r = simd::mul(simd::splat(arow[0]), b0);
+          r = simd::add(r, simd::mul(simd::splat(arow[1]), b1));
+          r = simd::add(r, simd::mul(simd::splat(arow[2]), b2));
+          r = simd::add(r, simd::mul(simd::splat(arow[3]), b3));
+          simd::store(out.components + 4*i, r);
+        }
+      }
+    };
+
+    /**
+     * Each row is multiplied with v, then a transpose turns the four
+     * horizontal sums into vertical adds.
+     */
+    template<>
+    struct mat_vec_mul<float, 4, 4> {
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 4, 4> &a,
+                                             const vec<float, 4> &v,
+                                             vec<float, 4> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_vec_mul_generic<float, 4, 4>::apply(a, v, out);
+        else
+          apply_simd(a, v, out);
+      }
+
+      static void apply_simd(const mat<float, 4, 4> &a, const vec<float, 4> &v,
+                             vec<float, 4> &out) {
+        const simd::f32x4 x = simd::load(v.components);
+        simd::f32x4 r0 = simd::mul(simd::load(a.components), x);
+        simd::f32x4 r1 = simd::mul(simd::load(a.components + 4), x);
+        simd::f32x4 r2 = simd::mul(simd::load(a.components + 8), x);
+        simd::f32x4 r3 = simd::mul(simd::load(a.components + 12), x);
+        simd::transpose(r0, r1, r2, r3);
+        simd::store(out.components,
+                    simd::add(simd::add(r0, r1), simd::add(r2, r3)));
+      }
+    };
+
+    template<>
+    struct mat_mul<float, 3, 3, 3> {
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 3, 3> &a,
+                                             const mat<float, 3, 3> &b,
+                                             mat<float, 3, 3> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_mul_generic<float, 3, 3, 3>::apply(a, b, out);
+        else
+          apply_simd(a, b, out);
+      }
+
+      static void apply_simd(const mat<float, 3, 3> &a, const mat<float, 3, 3> &b,
+                             mat<float, 3, 3> &out) {
+        const simd::f32x4 b0 = simd::load3(b.components);
+        const simd::f32x4 b1 = simd::load3(b.components + 3);
+        const simd::f32x4 b2 = simd::load3(b.components + 6);
+
+        for (std::size_t i = 0; i < 3; ++i) {
+          const float *arow = a.components + 3*i;
+          simd::f32x4 r = simd::mul(simd::splat(arow[0]), b0);
+          r = simd::add(r, simd::mul(simd::splat(arow[1]), b1));
+          r = simd::add(r, simd::mul(simd::splat(arow[2]), b2));
+          simd::store3(out.components + 3*i, r);
+        }
+      }
+    };
+
+    template<>
+    struct mat_vec_mul<float, 3, 3> {
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 3, 3> &a,
+                                             const vec<float, 3> &v,
+                                             vec<float, 3> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_vec_mul_generic<float, 3, 3>::apply(a, v, out);
+        else
+          apply_simd(a, v, out);
+      }
+
+      static void apply_simd(const mat<float, 3, 3> &a, const vec<float, 3> &v,
+                             vec<float, 3> &out) {
+        const simd::f32x4 x = simd::load3(v.components);
+        simd::f32x4 r0 = simd::mul(simd::load3(a.components), x);
+        simd::f32x4 r1 = simd::mul(simd::load3(a.components + 3), x);
+        simd::f32x4 r2 = simd::mul(simd::load3(a.components + 6), x);
+        simd::f32x4 r3 = simd::splat(0.0f);
+        simd::transpose(r0, r1, r2, r3);
+        simd::store3(out.components, simd::add(simd::add(r0, r1), r2));
+      }
+    };
+#endif // P_SIMD
+  }
+
+  /**
+   * Matrix product; the width of lhs must match the height of rhs.
+   */
+  template<typename T, std::size_t C, std::size_t K, std::size_t R>
+  P_CONSTEXPR mat<T, C, R> operator *(const mat<T, K, R> &lhs,
+                                      const mat<T, C, K> &rhs) {
+    mat<T, C, R> ret((T()));
+    detail::mat_mul<T, C, K, R>::apply(lhs, rhs, ret);
+    return ret;
+  }
+
+  /**
+   * Transforms a column vector; the result has one component per row.
+   */
+  template<typename T, std::size_t K, std::size_t R>
+  P_CONSTEXPR vec<T, R> operator *(const mat<T, K, R> &lhs, const vec<T, K> &rhs) {
+    vec<T, R> ret = {};
+    detail::mat_vec_mul<T, K, R>::apply(lhs, rhs, ret);
+    return ret;
+  }
+
+  namespace detail {
+    /**
+     * out (N columns, M rows) = transpose of a (M columns, N rows).
+     */
+    template<typename T, std::size_t M, std::size_t N>
+    struct mat_transpose_generic {
+      static P_CONSTEXPR void apply(const mat<T, M, N> &a, mat<T, N, M> &out) {
+        for (std::size_t i = 0; i < N; ++i)
+          for (std::size_t j = 0; j < M; ++j)
+            out.components[N*j + i] = a.components[M*i + j];
+      }
+    };
+
+    /**
+     * Determinant and inverse of square matrices, by cofactors. Only
+     * 2x2, 3x3 and 4x4 are defined.
+     */
+    template<typename T, std::size_t N> struct mat_inverse_generic;
+
+    template<typename T>
+    struct mat_inverse_generic<T, 2> {
+      static P_CONSTEXPR T determinant(const mat<T, 2, 2> &a) {
+        const T *m = a.components;
+        return m[0]*m[3] - m[1]*m[2];
+      }
+
+      static P_CONSTEXPR void apply(const mat<T, 2, 2> &a, mat<T, 2, 2> &out) {
+        const T *m = a.components;
+        const T inv = T(1) / determinant(a);
+        out.components[0] = m[3] * inv;
+        out.components[1] = -m[1] * inv;
+        out.components[2] = -m[2] * inv;
+        out.components[3] = m[0] * inv;
+      }
+    };
+
+    template<typename T>
+    struct mat_inverse_generic<T, 3> {
+      static P_CONSTEXPR T determinant(const mat<T, 3, 3> &a) {
+        const T *m = a.components;
+        return m[0] * (m[4]*m[8] - m[5]*m[7]) -
+               m[1] * (m[3]*m[8] - m[5]*m[6]) +
+               m[2] * (m[3]*m[7] - m[4]*m[6]);
+      }
+
+      static P_CONSTEXPR void apply(const mat<T, 3, 3> &a, mat<T, 3, 3> &out) {
+        const T *m = a.components;
+        T *o = out.components;
+        const T c0 = m[4]*m[8] - m[5]*m[7];
+        const T c1 = m[5]*m[6] - m[3]*m[8];
+        const T c2 = m[3]*m[7] - m[4]*m[6];
+        const T inv = T(1) / (m[0]*c0 + m[1]*c1 + m[2]*c2);
+
+        o[0] = c0 * inv;
+        o[1] = (m[2]*m[7] - m[1]*m[8]) * inv;
+        o[2] = (m[1]*m[5] - m[2]*m[4]) * inv;
+        o[3] = c1 * inv;
+        o[4] = (m[0]*m[8] - m[2]*m[6]) * inv;
+        o[5] = (m[2]*m[3] - m[0]*m[5]) * inv;
+        o[6] = c2 * inv;
+        o[7] = (m[1]*m[6] - m[0]*m[7]) * inv;
+        o[8] = (m[0]*m[4] - m[1]*m[3]) * inv;
+      }
+    };
+
+    /**
+     * Uses the 2x2 minors of the top two rows (s) and the bottom two
+     * rows (c); each is shared by several cofactors.
+     */
+    template<typename T>
+    struct mat_inverse_generic<T, 4> {
+      struct minors {
+        P_CONSTEXPR explicit minors(const T *m) : s(), c() {
+          s[0] = m[0]*m[5] - m[4]*m[1];
+          s[1] = m[0]*m[6] - m[4]*m[2];
+          s[2] = m[0]*m[7] - m[4]*m[3];
+          s[3] = m[1]*m[6] - m[5]*m[2];
+          s[4] = m[1]*m[7] - m[5]*m[3];
+          s[5] = m[2]*m[7] - m[6]*m[3];
+
+          c[0] = m[8]*m[13] - m[12]*m[9];
+          c[1] = m[8]*m[14] - m[12]*m[10];
+          c[2] = m[8]*m[15] - m[12]*m[11];
+          c[3] = m[9]*m[14] - m[13]*m[10];
+          c[4] = m[9]*m[15] - m[13]*m[11];
+          c[5] = m[10]*m[15] - m[14]*m[11];
+        }
+
+        P_CONSTEXPR T determinant() const {
+          return s[0]*c[5] - s[1]*c[4] + s[2]*c[3] +
+                 s[3]*c[2] - s[4]*c[1] + s[5]*c[0];
+        }
+
+        T s[6], c[6];
+      };
+
+      static P_CONSTEXPR T determinant(const mat<T, 4, 4> &a) {
+        return minors(a.components).determinant();
+      }
+
+      static P_CONSTEXPR void apply(const mat<T, 4, 4> &a, mat<T, 4, 4> &out) {
+        const T *m = a.components;
+        T *o = out.components;
+        const minors mi(m);
+        const T *s = mi.s, *c = mi.c;
+        const T inv = T(1) / mi.determinant();
+
+        o[0]  = ( m[5]*c[5]  - m[6]*c[4]  + m[7]*c[3])  * inv;
+        o[1]  = (-m[1]*c[5]  + m[2]*c[4]  - m[3]*c[3])  * inv;
+        o[2]  = ( m[13]*s[5] - m[14]*s[4] + m[15]*s[3]) * inv;
+        o[3]  = (-m[9]*s[5]  + m[10]*s[4] - m[11]*s[3]) * inv;
+
+        o[4]  = (-m[4]*c[5]  + m[6]*c[2]  - m[7]*c[1])  * inv;
+        o[5]  = ( m[0]*c[5]  - m[2]*c[2]  + m[3]*c[1])  * inv;
+        o[6]  = (-m[12]*s[5] + m[14]*s[2] - m[15]*s[1]) * inv;
+        o[7]  = ( m[8]*s[5]  - m[10]*s[2] + m[11]*s[1]) * inv;
+
+        o[8]  = ( m[4]*c[4]  - m[5]*c[2]  + m[7]*c[0])  * inv;
+        o[9]  = (-m[0]*c[4]  + m[1]*c[2]  - m[3]*c[0])  * inv;
+        o[10] = ( m[12]*s[4] - m[13]*s[2] + m[15]*s[0]) * inv;
+        o[11] = (-m[8]*s[4]  + m[9]*s[2]  - m[11]*s[0]) * inv;
+
+        o[12] = (-m[4]*c[3]  + m[5]*c[1]  - m[6]*c[0])  * inv;
+        o[13] = ( m[0]*c[3]  - m[1]*c[1]  + m[2]*c[0])  * inv;
+        o[14] = (-m[12]*s[3] + m[13]*s[1] - m[14]*s[0]) * inv;
+        o[15] = ( m[8]*s[3]  - m[9]*s[1]  + m[10]*s[0]) * inv;
+      }
+    };
+
+    /**
+     * Inverse of an affine transform: the linear part (top left) is
+     * inverted on its own and the translation (last column) is mapped
+     * through it. The last row is assumed to be 0 ... 0 1.
+     */
+    template<typename T, std::size_t N>
+    struct mat_affine_inverse_generic {
+      static P_CONSTEXPR void apply(const mat<T, N, N> &a, mat<T, N, N> &out) {
+        mat<T, N-1, N-1> l((T())), li((T()));
+        for (std::size_t i = 0; i < N-1; ++i)
+          for (std::size_t j = 0; j < N-1; ++j)
+            l.components[(N-1)*i + j] = a.components[N*i + j];
+        mat_inverse_generic<T, N-1>::apply(l, li);
+
+        for (std::size_t i = 0; i < N-1; ++i) {
+          T t = T();
+          for (std::size_t j = 0; j < N-1; ++j) {
+            const T v = li.components[(N-1)*i + j];
+            out.components[N*i + j] = v;
+            t -= v * a.components[N*j + N-1];
+          }
+          out.components[N*i + N-1] = t;
+        }
+        for (std::size_t j = 0; j < N-1; ++j)
+          out.components[N*(N-1) + j] = T();
+        out.components[N*N - 1] = T(1);
+      }
+    };
+
+    template<typename T, std::size_t M, std::size_t N>
+    struct mat_transpose : mat_transpose_generic<T, M, N> {};
+
+    template<typename T, std::size_t N>
+    struct mat_inverse : mat_inverse_generic<T, N> {};
+
+    template<typename T, std::size_t N>
+    struct mat_affine_inverse : mat_affine_inverse_generic<T, N> {};
+
+#if defined(P_SIMD)
+    template<>
+    struct mat_transpose<float, 4, 4> {
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 4, 4> &a,
+                                             mat<float, 4, 4> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_transpose_generic<float, 4, 4>::apply(a, out);
+        else
+          apply_simd(a, out);
+      }
+
+      static void apply_simd(const mat<float, 4, 4> &a, mat<float, 4, 4> &out) {
+        simd::f32x4 r0 = simd::load(a.components);
+        simd::f32x4 r1 = simd::load(a.components + 4);
+        simd::f32x4 r2 = simd::load(a.components + 8);
+        simd::f32x4 r3 = simd::load(a.components + 12);
+        simd::transpose(r0, r1, r2, r3);
+        simd::store(out.components, r0);
+        simd::store(out.components + 4, r1);
+        simd::store(out.components + 8, r2);
+        simd::store(out.components + 12, r3);
+      }
+    };
+
+    /**
+     * Cross product of the first three lanes; the fourth lane is
+     * a[3]*b[3] - a[3]*b[3], i.e. zero.
+     */
+    inline simd::f32x4 simd_cross3(simd::f32x4 a, simd::f32x4 b) {
+      return simd::sub(
+        simd::mul(simd::swizzle<1, 2, 0, 3>(a), simd::swizzle<2, 0, 1, 3>(b)),
+        simd::mul(simd::swizzle<2, 0, 1, 3>(a), simd::swizzle<1, 2, 0, 3>(b)));
+    }
+
+    /**
+     * The inverse of a 3x3 matrix with rows a, b and c has the columns
+     * cross(b, c), cross(c, a) and cross(a, b), divided by the determinant
+     * dot(a, cross(b, c)).
+     */
+    template<>
+    struct mat_inverse<float, 3> {
+      static P_CONSTEXPR_DISPATCH float determinant(const mat<float, 3, 3> &m) {
+        if (P_CONSTANT_EVALUATED())
+          return mat_inverse_generic<float, 3>::determinant(m);
+        return determinant_simd(m);
+      }
+
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 3, 3> &m,
+                                             mat<float, 3, 3> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_inverse_generic<float, 3>::apply(m, out);
+        else
+          apply_simd(m, out);
+      }
+
+      static float determinant_simd(const mat<float, 3, 3> &m) {
+        const simd::f32x4 a = simd::load3(m.components);
+        const simd::f32x4 b = simd::load3(m.components + 3);
+        const simd::f32x4 c = simd::load3(m.components + 6);
+        return simd::dot(a, simd_cross3(b, c));
+      }
+
+      static void apply_simd(const mat<float, 3, 3> &m, mat<float, 3, 3> &out) {
+        const simd::f32x4 a = simd::load3(m.components);
+        const simd::f32x4 b = simd::load3(m.components + 3);
+        const simd::f32x4 c = simd::load3(m.components + 6);
+        simd::f32x4 r0 = simd_cross3(b, c);
+        simd::f32x4 r1 = simd_cross3(c, a);
+        simd::f32x4 r2 = simd_cross3(a, b);
+        simd::f32x4 r3 = simd::splat(0.0f);
+
+        const simd::f32x4 inv = simd::splat(1.0f / simd::dot(a, r0));
+        r0 = simd::mul(r0, inv);
+        r1 = simd::mul(r1, inv);
+        r2 = simd::mul(r2, inv);
+        simd::transpose(r0, r1, r2, r3);
+        simd::store3(out.components, r0);
+        simd::store3(out.components + 3, r1);
+        simd::store3(out.components + 6, r2);
+      }
+    };
+
+    /**
+     * Block-wise inverse: the matrix is split into the 2x2 blocks
+     *   | A B |
+     *   | C D |
+     * with one block per register, and the inverse is built from 2x2
+     * products of those and their adjugates (written X#).
+     */
+    template<>
+    struct mat_inverse<float, 4> {
+      static P_CONSTEXPR_DISPATCH float determinant(const mat<float, 4, 4> &m) {
+        if (P_CONSTANT_EVALUATED())
+          return mat_inverse_generic<float, 4>::determinant(m);
+        return determinant_simd(m);
+      }
+
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 4, 4> &m,
+                                             mat<float, 4, 4> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_inverse_generic<float, 4>::apply(m, out);
+        else
+          apply_simd(m, out);
+      }
+
+      // 2x2 row-major a * b
+      static simd::f32x4 mul2(simd::f32x4 a, simd::f32x4 b) {
+        return simd::add(
+          simd::mul(a, simd::swizzle<0, 3, 0, 3>(b)),
+          simd::mul(simd::swizzle<1, 0, 3, 2>(a), simd::swizzle<2, 1, 2, 1>(b)));
+      }
+
+      // a# * b
+      static simd::f32x4 adj_mul2(simd::f32x4 a, simd::f32x4 b) {
+        return simd::sub(
+          simd::mul(simd::swizzle<3, 3, 0, 0>(a), b),
+          simd::mul(simd::swizzle<1, 1, 2, 2>(a), simd::swizzle<2, 3, 0, 1>(b)));
+      }
+
+      // a * b#
+      static simd::f32x4 mul_adj2(simd::f32x4 a, simd::f32x4 b) {
+        return simd::sub(
+          simd::mul(a, simd::swizzle<3, 0, 3, 0>(b)),
+          simd::mul(simd::swizzle<1, 0, 3, 2>(a), simd::swizzle<2, 1, 2, 1>(b)));
+      }
+
+      struct blocks {
+        explicit blocks(const float *m) {
+          const simd::f32x4 r0 = simd::load(m), r1 = simd::load(m + 4);
+          const simd::f32x4 r2 = simd::load(m + 8), r3 = simd::load(m + 12);
+          a = simd::shuffle<0, 1, 0, 1>(r0, r1);
+          b = simd::shuffle<2, 3, 2, 3>(r0, r1);
+          c = simd::shuffle<0, 1, 0, 1>(r2, r3);
+          d = simd::shuffle<2, 3, 2, 3>(r2, r3);
+
+          // (|A|, |B|, |C|, |D|)
+          const simd::f32x4 det = simd::sub(
+            simd::mul(simd::shuffle<0, 2, 0, 2>(r0, r2),
+                      simd::shuffle<1, 3, 1, 3>(r1, r3)),
+            simd::mul(simd::shuffle<1, 3, 1, 3>(r0, r2),
+                      simd::shuffle<0, 2, 0, 2>(r1, r3)));
+          det_a = simd::swizzle<0, 0, 0, 0>(det);
+          det_b = simd::swizzle<1, 1, 1, 1>(det);
+          det_c = simd::swizzle<2, 2, 2, 2>(det);
+          det_d = simd::swizzle<3, 3, 3, 3>(det);
+
+          a_b = adj_mul2(a, b);
+          d_c = adj_mul2(d, c);
+        }
+
+        // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+        float determinant() const {
+          const float tr = simd::dot(a_b, simd::swizzle<0, 2, 1, 3>(d_c));
+          return simd::first(simd::add(simd::mul(det_a, det_d),
+                                       simd::mul(det_b, det_c))) - tr;
+        }
+
+        simd::f32x4 a, b, c, d;
+        simd::f32x4 det_a, det_b, det_c, det_d;
+        simd::f32x4 a_b, d_c;
+      };
+
+      static float determinant_simd(const mat<float, 4, 4> &m) {
+        return blocks(m.components).determinant();
+      }
+
+      static void apply_simd(const mat<float, 4, 4> &m, mat<float, 4, 4> &out) {
+        const blocks k(m.components);
+
+        // adjugates of the blocks of the inverse
+        simd::f32x4 x = simd::sub(simd::mul(k.det_d, k.a), mul2(k.b, k.d_c));
+        simd::f32x4 w = simd::sub(simd::mul(k.det_a, k.d), mul2(k.c, k.a_b));
+        simd::f32x4 y = simd::sub(simd::mul(k.det_b, k.c), mul_adj2(k.d, k.a_b));
+        simd::f32x4 z = simd::sub(simd::mul(k.det_c, k.b), mul_adj2(k.a, k.d_c));
+
+        const float det = k.determinant();
+        const simd::f32x4 inv = simd::div(simd::set(1.0f, -1.0f, -1.0f, 1.0f),
+                                          simd::splat(det));
+        x = simd::mul(x, inv);
+        y = simd::mul(y, inv);
+        z = simd::mul(z, inv);
+        w = simd::mul(w, inv);
+
+        // undo the adjugates and put the blocks back in rows
+        simd::store(out.components, simd::shuffle<3, 1, 3, 1>(x, y));
+        simd::store(out.components + 4, simd::shuffle<2, 0, 2, 0>(x, y));
+        simd::store(out.components + 8, simd::shuffle<3, 1, 3, 1>(z, w));
+        simd::store(out.components + 12, simd::shuffle<2, 0, 2, 0>(z, w));
+      }
+    };
+
+    /**
+     * The linear part is inverted as in mat_inverse<float, 3>, with the
+     * translation riding along in the fourth lane until the transpose.
+     */
+    template<>
+    struct mat_affine_inverse<float, 4> {
+      static P_CONSTEXPR_DISPATCH void apply(const mat<float, 4, 4> &m,
+                                             mat<float, 4, 4> &out) {
+        if (P_CONSTANT_EVALUATED())
+          mat_affine_inverse_generic<float, 4>::apply(m, out);
+        else
+          apply_simd(m, out);
+      }
+
+      static void apply_simd(const mat<float, 4, 4> &m, mat<float, 4, 4> &out) {
+        const simd::f32x4 a = simd::load(m.components);
+        const simd::f32x4 b = simd::load(m.components + 4);
+        const simd::f32x4 c = simd::load(m.components + 8);
+        simd::f32x4 r0 = simd_cross3(b, c);
+        simd::f32x4 r1 = simd_cross3(c, a);
+        simd::f32x4 r2 = simd_cross3(a, b);
+
+        const simd::f32x4 inv = simd::splat(1.0f / simd::dot(a, r0));
+        r0 = simd::mul(r0, inv);
+        r1 = simd::mul(r1, inv);
+        r2 = simd::mul(r2, inv);
+
+        // -inverse * t, plus the 1 of the last row
+        simd::f32x4 t = simd::mul(r0, simd::swizzle<3, 3, 3, 3>(a));
+        t = simd::add(t, simd::mul(r1, simd::swizzle<3, 3, 3, 3>(b)));
+        t = simd::add(t, simd::mul(r2, simd::swizzle<3, 3, 3, 3>(c)));
+        simd::f32x4 r3 = simd::sub(simd::set(0.0f, 0.0f, 0.0f, 1.0f), t);
+
+        simd::transpose(r0, r1, r2, r3);
+        simd::store(out.components, r0);
+        simd::store(out.components + 4, r1);
+        simd::store(out.components + 8, r2);
+        simd::store(out.components + 12, r3);
+      }
+    };
+#endif // P_SIMD
+  }
+
+  template<typename T, std::size_t M, std::size_t N>
+  P_CONSTEXPR mat<T, N, M> transpose(const mat<T, M, N> &m) {
+    mat<T, N, M> ret((T()));
+    detail::mat_transpose<T, M, N>::apply(m, ret);
+    return ret;
+  }
+
+  /**
+   * Defined for 2x2, 3x3 and 4x4 matrices.
+   */
+  template<typename T, std::size_t N>
+  P_CONSTEXPR T determinant(const mat<T, N, N> &m) {
+    return detail::mat_inverse<T, N>::determinant(m);
+  }
+
+  /**
+   * Defined for 2x2, 3x3 and 4x4 matrices. The result of inverting a
+   * singular matrix is undefined; check determinant() first if m may be.
+   */
+  template<typename T, std::size_t N>
+  P_CONSTEXPR mat<T, N, N> inverse(const mat<T, N, N> &m) {
+    mat<T, N, N> ret((T()));
+    detail::mat_inverse<T, N>::apply(m, ret);
+    return ret;
+  }
+
+  /**
+   * Inverse of an affine transform (a 2D one for 3x3, a 3D one for 4x4):
+   * much cheaper than inverse(), but m's last row must be 0 ... 0 1.
+   */
+  template<typename T, std::size_t N>
+  P_CONSTEXPR mat<T, N, N> affine_inverse(const mat<T, N, N> &m) {
+    mat<T, N, N> ret((T()));
+    detail::mat_affine_inverse<T, N>::apply(m, ret);
+    return ret;
+  }
+
   typedef mat<float, 3, 3> mat3;
   typedef mat<float, 4, 4> mat4;
 }
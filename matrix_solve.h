@@ -0,0 +1,449 @@
+/* -- matrix_solve.h -------------------------------------------------*- c++ -*-
+ * Direct solvers for small square systems a * x = b.
+ *
+ *   lu_decompose, lu_solve              LU with partial pivoting
+ *   cholesky_decompose, cholesky_solve  symmetric positive definite a
+ *   solve, solve_spd                    factor and solve in one call
+ *
+ * p::vec3 x;
+ * if (p::solve(a, b, x))
+ *   ...
+ *
+ * The loops all run to the fixed size N and are unrolled completely (see
+ * P_UNROLL in config.h), so a 3x3 or 4x4 solve is straight-line code.
+ * Factoring once and solving for several right-hand sides saves the
+ * factorization each time.
+ *
+ * The batch versions of solve and solve_spd take many systems at once in
+ * SoA form: the matrices as vec_soa<T, N*N> of their row-major components,
+ * the right-hand sides and solutions as vec_soa<T, N>. For float every
+ * SIMD lane solves its own system, the row exchanges of the pivoting done
+ * as per-lane selects; the results are the same as those of the single
+ * system versions.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_MATRIX_SOLVE_H
+#define P_UTILS_MATRIX_SOLVE_H
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include "config.h"
+#include "matrix.h"
+#include "vector_soa.h"
+#include "simd.h"
+
+namespace p {
+  namespace detail {
+    /**
+     * Arithmetic for the kernels below on one system at a time.
+     */
+    template<typename T>
+    struct solve_scalar {
+      typedef T value;
+      typedef bool mask;
+
+      static T splat(T s) {return s; }
+      static T add(T a, T b) {return a + b; }
+      static T sub(T a, T b) {return a - b; }
+      static T mul(T a, T b) {return a * b; }
+      static T div(T a, T b) {return a / b; }
+      static T sqrt(T a) {using std::sqrt; return sqrt(a); }
+      static T abs(T a) {return a < T() ? -a : a; }
+
+      static bool yes() {return true; }
+      static bool less(T a, T b) {return a < b; }
+      static bool both(bool a, bool b) {return a && b; }
+      static T select(bool m, T a, T b) {return m ? a : b; }
+    };
+
+    /**
+     * The same on the four lanes of a simd::f32x4, one system per lane.
+     */
+    struct solve_simd {
+      typedef simd::f32x4 value;
+      typedef simd::f32x4 mask;
+
+      static value splat(float s) {return simd::splat(s); }
+      static value add(value a, value b) {return simd::add(a, b); }
+      static value sub(value a, value b) {return simd::sub(a, b); }
+      static value mul(value a, value b) {return simd::mul(a, b); }
+      static value div(value a, value b) {return simd::div(a, b); }
+      static value sqrt(value a) {return simd::sqrt(a); }
+      static value abs(value a) {return simd::max(a, simd::sub(simd::splat(0.0f), a)); }
+
+      static mask yes() {return simd::less(simd::splat(0.0f), simd::splat(1.0f)); }
+      static mask less(value a, value b) {return simd::less(a, b); }
+      static mask both(mask a, mask b) {return simd::select(a, b, a); }
+      static value select(mask m, value a, value b) {return simd::select(m, a, b); }
+    };
+
+    template<typename L, std::size_t N>
+    struct lu_kernel {
+      typedef typename L::value V;
+      typedef typename L::mask M;
+
+      /**
+       * Factors the row-major a in place: U on and above the diagonal, the
+       * multipliers of L below it. swap[N*k + i] tells whether step k
+       * exchanged rows k and i. Returns whether no pivot was zero.
+       */
+      static M decompose(V *a, M *swap) {
+        M ok = L::yes();
+        P_UNROLL for (std::size_t k = 0; k < N; ++k) {
+          P_UNROLL for (std::size_t i = k + 1; i < N; ++i) {
+            const M m = L::less(L::abs(a[N*k + k]), L::abs(a[N*i + k]));
+            swap[N*k + i] = m;
+            P_UNROLL for (std::size_t j = 0; j < N; ++j) {
+              const V t = a[N*k + j];
+              a[N*k + j] = L::select(m, a[N*i + j], t);
+              a[N*i + j] = L::select(m, t, a[N*i + j]);
+            }
+          }
+
+          ok = L::both(ok, L::less(L::splat(0), L::abs(a[N*k + k])));
+          const V inv = L::div(L::splat(1), a[N*k + k]);
+          P_UNROLL for (std::size_t i = k + 1; i < N; ++i) {
+            const V f = L::mul(a[N*i + k], inv);
+            a[N*i + k] = f;
+            P_UNROLL for (std::size_t j = k + 1; j < N; ++j)
+              a[N*i + j] = L::sub(a[N*i + j], L::mul(f, a[N*k + j]));
+          }
+        }
+        return ok;
+      }
+
+      /**
+       * Applies the row exchanges of decompose() to x.
+       */
+      static void permute(const M *swap, V *x) {
+        P_UNROLL for (std::size_t k = 0; k < N; ++k)
+          P_UNROLL for (std::size_t i = k + 1; i < N; ++i) {
+            const V t = x[k];
+            x[k] = L::select(swap[N*k + i], x[i], t);
+            x[i] = L::select(swap[N*k + i], t, x[i]);
+          }
+      }
+
+      /**
+       * Replaces the permuted right-hand side x with the solution.
+       */
+      static void substitute(const V *lu, V *x) {
+        P_UNROLL for (std::size_t i = 1; i < N; ++i)
+          P_UNROLL for (std::size_t k = 0; k < i; ++k)
+            x[i] = L::sub(x[i], L::mul(lu[N*i + k], x[k]));
+        back_substitute(lu, x);
+      }
+
+      /**
+       * decompose(), permute() and substitute() in one pass, carrying x
+       * along through the elimination instead of keeping L; the arithmetic
+       * and so the result are the same, with half the row exchanges. a is
+       * overwritten.
+       */
+      static M solve(V *a, V *x) {
+        M ok = L::yes();
+        P_UNROLL for (std::size_t k = 0; k < N; ++k) {
+          P_UNROLL for (std::size_t i = k + 1; i < N; ++i) {
+            const M m = L::less(L::abs(a[N*k + k]), L::abs(a[N*i + k]));
+            P_UNROLL for (std::size_t j = k; j < N; ++j) {
+              const V t = a[N*k + j];
+              a[N*k + j] = L::select(m, a[N*i + j], t);
+              a[N*i + j] = L::select(m, t, a[N*i + j]);
+            }
+            const V t = x[k];
+            x[k] = L::select(m, x[i], t);
+            x[i] = L::select(m, t, x[i]);
+          }
+
+          ok = L::both(ok, L::less(L::splat(0), L::abs(a[N*k + k])));
+          const V inv = L::div(L::splat(1), a[N*k + k]);
+          P_UNROLL for (std::size_t i = k + 1; i < N; ++i) {
+            const V f = L::mul(a[N*i + k], inv);
+            P_UNROLL for (std::size_t j = k + 1; j < N; ++j)
+              a[N*i + j] = L::sub(a[N*i + j], L::mul(f, a[N*k + j]));
+            x[i] = L::sub(x[i], L::mul(f, x[k]));
+          }
+        }
+        back_substitute(a, x);
+        return ok;
+      }
+
+      static void back_substitute(const V *u, V *x) {
+        P_UNROLL for (std::size_t r = 0; r < N; ++r) {
+          const std::size_t i = N - 1 - r;
+          P_UNROLL for (std::size_t j = i + 1; j < N; ++j)
+            x[i] = L::sub(x[i], L::mul(u[N*i + j], x[j]));
+          x[i] = L::div(x[i], u[N*i + i]);
+        }
+      }
+    };
+
+    template<typename L, std::size_t N>
+    struct cholesky_kernel {
+      typedef typename L::value V;
+      typedef typename L::mask M;
+
+      /**
+       * Writes the lower triangle of l, with l * transpose(l) = a, reading
+       * only the lower triangle of the row-major a. Returns whether a was
+       * positive definite.
+       */
+      static M decompose(const V *a, V *l) {
+        M ok = L::yes();
+        P_UNROLL for (std::size_t j = 0; j < N; ++j) {
+          V d = a[N*j + j];
+          P_UNROLL for (std::size_t k = 0; k < j; ++k)
+            d = L::sub(d, L::mul(l[N*j + k], l[N*j + k]));
+          ok = L::both(ok, L::less(L::splat(0), d));
+          // a lane that failed takes sqrt(1), keeping the other lanes' work finite
+          const V ljj = L::sqrt(L::select(ok, d, L::splat(1)));
+          l[N*j + j] = ljj;
+
+          const V inv = L::div(L::splat(1), ljj);
+          P_UNROLL for (std::size_t i = j + 1; i < N; ++i) {
+            V s = a[N*i + j];
+            P_UNROLL for (std::size_t k = 0; k < j; ++k)
+              s = L::sub(s, L::mul(l[N*i + k], l[N*j + k]));
+            l[N*i + j] = L::mul(s, inv);
+          }
+        }
+        return ok;
+      }
+
+      /**
+       * Replaces the right-hand side x with the solution.
+       */
+      static void substitute(const V *l, V *x) {
+        P_UNROLL for (std::size_t i = 0; i < N; ++i) {
+          P_UNROLL for (std::size_t k = 0; k < i; ++k)
+            x[i] = L::sub(x[i], L::mul(l[N*i + k], x[k]));
+          x[i] = L::div(x[i], l[N*i + i]);
+        }
+
+        P_UNROLL for (std::size_t r = 0; r < N; ++r) {
+          const std::size_t i = N - 1 - r;
+          P_UNROLL for (std::size_t k = i + 1; k < N; ++k)
+            x[i] = L::sub(x[i], L::mul(l[N*k + i], x[k]));
+          x[i] = L::div(x[i], l[N*i + i]);
+        }
+      }
+    };
+  }
+
+  /**
+   * P * a = L * U, with the unit diagonal of L left out. Row i of lu comes
+   * from row row[i] of a.
+   */
+  template<typename T, std::size_t N>
+  struct lu_decomposition {
+    mat<T, N, N> lu;
+    std::uint8_t row[N];
+  };
+
+  /**
+   * Returns false if a is singular; d is then not usable.
+   */
+  template<typename T, std::size_t N>
+  inline bool lu_decompose(const mat<T, N, N> &a, lu_decomposition<T, N> &d) {
+    typedef detail::lu_kernel<detail::solve_scalar<T>, N> kernel;
+    bool swap[N*N];
+    d.lu = a;
+    const bool ok = kernel::decompose(d.lu.components, swap);
+
+    for (std::size_t i = 0; i < N; ++i)
+      d.row[i] = std::uint8_t(i);
+    for (std::size_t k = 0; k < N; ++k)
+      for (std::size_t i = k + 1; i < N; ++i)
+        if (swap[N*k + i])
+          std::swap(d.row[k], d.row[i]);
+    return ok;
+  }
+
+  template<typename T, std::size_t N>
+  inline vec<T, N> lu_solve(const lu_decomposition<T, N> &d, const vec<T, N> &b) {
+    vec<T, N> x;
+    for (std::size_t i = 0; i < N; ++i)
+      x[i] = b[d.row[i]];
+    detail::lu_kernel<detail::solve_scalar<T>, N>::substitute(d.lu.components, x.components);
+    return x;
+  }
+
+  /**
+   * The lower triangular l with l * transpose(l) = a, for a symmetric
+   * positive definite a; only its lower triangle is read. Returns false if
+   * a is not positive definite.
+   */
+  template<typename T, std::size_t N>
+  inline bool cholesky_decompose(const mat<T, N, N> &a, mat<T, N, N> &l) {
+    l = mat<T, N, N>(T());
+    return detail::cholesky_kernel<detail::solve_scalar<T>, N>::decompose(
+      a.components, l.components);
+  }
+
+  template<typename T, std::size_t N>
+  inline vec<T, N> cholesky_solve(const mat<T, N, N> &l, const vec<T, N> &b) {
+    vec<T, N> x = b;
+    detail::cholesky_kernel<detail::solve_scalar<T>, N>::substitute(l.components, x.components);
+    return x;
+  }
+
+  /**
+   * Solves a * x = b by LU decomposition. Returns false, leaving x alone,
+   * if a is singular.
+   */
+  template<typename T, std::size_t N>
+  inline bool solve(const mat<T, N, N> &a, const vec<T, N> &b, vec<T, N> &x) {
+    mat<T, N, N> m = a;
+    vec<T, N> r = b;
+    if (!detail::lu_kernel<detail::solve_scalar<T>, N>::solve(m.components, r.components))
+      return false;
+    x = r;
+    return true;
+  }
+
+  /**
+   * Solves a * x = b by Cholesky decomposition, about twice as fast as
+   * solve() for symmetric positive definite a. Returns false, leaving x
+   * alone, for any other a.
+   */
+  template<typename T, std::size_t N>
+  inline bool solve_spd(const mat<T, N, N> &a, const vec<T, N> &b, vec<T, N> &x) {
+    mat<T, N, N> l;
+    if (!cholesky_decompose(a, l))
+      return false;
+    x = cholesky_solve(l, b);
+    return true;
+  }
+
+  namespace detail {
+    /**
+     * Solves systems [begin, size) of a batch one at a time with f, which
+     * is solve() or solve_spd(). Returns how many failed.
+     */
+    template<typename T, std::size_t N>
+    inline std::size_t solve_each(const vec_soa<T, N*N> &a, const vec_soa<T, N> &b,
+                                  vec_soa<T, N> &x, std::size_t begin,
+                                  bool (*f)(const mat<T, N, N> &, const vec<T, N> &,
+                                            vec<T, N> &)) {
+      std::size_t failed = 0;
+      for (std::size_t i = begin; i < b.size(); ++i) {
+        mat<T, N, N> m;
+        vec<T, N> r;
+        for (std::size_t c = 0; c < N*N; ++c)
+          m.components[c] = a.component(c)[i];
+        for (std::size_t c = 0; c < N; ++c)
+          r[c] = b.component(c)[i];
+
+        if (f(m, r, r))
+          for (std::size_t c = 0; c < N; ++c)
+            x.component(c)[i] = r[c];
+        else {
+          for (std::size_t c = 0; c < N; ++c)
+            x.component(c)[i] = std::numeric_limits<T>::quiet_NaN();
+          ++failed;
+        }
+      }
+      return failed;
+    }
+  }
+
+  /**
+   * Batch solve(): x[i] solves a[i] * x[i] = b[i], with a[i] row-major.
+   * x is resized to match and may be b. Systems without a solution get
+   * NaN; returns how many there were.
+   */
+  template<typename T, std::size_t N>
+  inline std::size_t solve(const vec_soa<T, N*N> &a, const vec_soa<T, N> &b,
+                           vec_soa<T, N> &x) {
+    assert(a.size() == b.size());
+    x.resize(b.size());
+    return detail::solve_each<T, N>(a, b, x, 0, &solve<T, N>);
+  }
+
+  /**
+   * Batch solve_spd(), with the same conventions.
+   */
+  template<typename T, std::size_t N>
+  inline std::size_t solve_spd(const vec_soa<T, N*N> &a, const vec_soa<T, N> &b,
+                               vec_soa<T, N> &x) {
+    assert(a.size() == b.size());
+    x.resize(b.size());
+    return detail::solve_each<T, N>(a, b, x, 0, &solve_spd<T, N>);
+  }
+
+  namespace detail {
+    /**
+     * Stores the solutions of four systems, NaN in the lanes that failed,
+     * and returns how many did.
+     */
+    template<std::size_t N>
+    inline std::size_t store_solutions(vec_soa<float, N> &x, std::size_t i,
+                                       const simd::f32x4 *r, simd::f32x4 ok) {
+      const simd::f32x4 nan = simd::splat(std::numeric_limits<float>::quiet_NaN());
+      for (std::size_t c = 0; c < N; ++c)
+        simd::store(x.component(c) + i, simd::select(ok, r[c], nan));
+
+      float bad[4];
+      simd::store(bad, simd::select(ok, simd::splat(0.0f), simd::splat(1.0f)));
+      return std::size_t(bad[0] + bad[1] + bad[2] + bad[3]);
+    }
+  }
+
+  /**
+   * Float versions, four systems per simd::f32x4 and the rest one at a
+   * time.
+   */
+  template<std::size_t N>
+  inline std::size_t solve(const vec_soa<float, N*N> &a, const vec_soa<float, N> &b,
+                           vec_soa<float, N> &x) {
+    typedef detail::lu_kernel<detail::solve_simd, N> kernel;
+    assert(a.size() == b.size());
+    const std::size_t n = b.size();
+    x.resize(n);
+
+    std::size_t failed = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+      simd::f32x4 m[N*N], r[N];
+      for (std::size_t c = 0; c < N*N; ++c)
+        m[c] = simd::load(a.component(c) + i);
+      for (std::size_t c = 0; c < N; ++c)
+        r[c] = simd::load(b.component(c) + i);
+
+      const simd::f32x4 ok = kernel::solve(m, r);
+      failed += detail::store_solutions(x, i, r, ok);
+    }
+
+    return failed + detail::solve_each<float, N>(a, b, x, i, &solve<float, N>);
+  }
+
+  template<std::size_t N>
+  inline std::size_t solve_spd(const vec_soa<float, N*N> &a, const vec_soa<float, N> &b,
+                               vec_soa<float, N> &x) {
+    typedef detail::cholesky_kernel<detail::solve_simd, N> kernel;
+    assert(a.size() == b.size());
+    const std::size_t n = b.size();
+    x.resize(n);
+
+    std::size_t failed = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+      simd::f32x4 m[N*N], l[N*N], r[N];
+      for (std::size_t c = 0; c < N*N; ++c)
+        m[c] = simd::load(a.component(c) + i);
+      for (std::size_t c = 0; c < N; ++c)
+        r[c] = simd::load(b.component(c) + i);
+
+      const simd::f32x4 ok = kernel::decompose(m, l);
+      kernel::substitute(l, r);
+      failed += detail::store_solutions(x, i, r, ok);
+    }
+
+    return failed + detail::solve_each<float, N>(a, b, x, i, &solve_spd<float, N>);
+  }
+} // !p
+
+#endif // !P_UTILS_MATRIX_SOLVE_H
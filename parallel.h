@@ -0,0 +1,179 @@
+/* -- parallel.h -----------------------------------------------------*- c++ -*-
+ * A small fixed thread pool for the batch operations.
+ *
+ * parallel_for() splits [0, n) into chunks of a fixed size and hands them
+ * out to the workers and the calling thread, then waits for all of them:
+ *
+ * p::thread_pool::shared().parallel_for(n, 4096,
+ *   [&](std::size_t begin, std::size_t end) { ... });
+ *
+ * Chunk boundaries only depend on n and the chunk size, never on the number
+ * of threads, so anything computed per chunk comes out the same however
+ * many threads run it. The function must not throw. A parallel_for called
+ * from inside a worker runs serially on that worker.
+ *
+ * Needs C++11 threads; link with -pthread.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_PARALLEL_H
+#define P_UTILS_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace p {
+  namespace detail {
+    struct parallel_job {
+      void (*run)(void *fn, std::size_t begin, std::size_t end);
+      void *fn;
+      std::size_t n, chunk, chunks;
+      std::atomic<std::size_t> next;
+      std::atomic<std::size_t> remaining;
+    };
+
+    template<typename F>
+    inline void parallel_call(void *fn, std::size_t begin, std::size_t end) {
+      (*static_cast<F *>(fn))(begin, end);
+    }
+
+    inline bool &in_parallel_worker() {
+      static thread_local bool flag = false;
+      return flag;
+    }
+  }
+
+  class thread_pool {
+  public:
+    /**
+     * Starts `workers` threads. The thread calling parallel_for() also
+     * runs chunks, so 0 workers is valid and runs everything serially.
+     */
+    explicit thread_pool(std::size_t workers)
+      : job(0), generation(0), active(0), stop(false) {
+      for (std::size_t i = 0; i < workers; ++i)
+        threads.push_back(std::thread(&thread_pool::work_loop, this));
+    }
+
+    ~thread_pool() {
+      {
+        std::lock_guard<std::mutex> lock(m);
+        stop = true;
+      }
+      wake.notify_all();
+      for (std::size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    }
+
+    /**
+     * Number of threads that run chunks, including the caller.
+     */
+    std::size_t size() const {return threads.size() + 1; }
+
+    /**
+     * Calls fn(begin, end) for every chunk of [0, n) and returns when all
+     * of them are done.
+     */
+    template<typename F>
+    void parallel_for(std::size_t n, std::size_t chunk, F fn) {
+      if (n == 0)
+        return;
+      chunk = std::max<std::size_t>(chunk, 1);
+
+      if (n <= chunk || threads.empty() || detail::in_parallel_worker()) {
+        for (std::size_t i = 0; i < n; i += chunk)
+          fn(i, std::min(n, i + chunk));
+        return;
+      }
+
+      // one job at a time; later callers wait here
+      std::lock_guard<std::mutex> serial(submit);
+
+      detail::parallel_job j;
+      j.run = &detail::parallel_call<F>;
+      j.fn = &fn;
+      j.n = n;
+      j.chunk = chunk;
+      j.chunks = (n + chunk - 1) / chunk;
+      j.next = 0;
+      j.remaining = j.chunks;
+
+      {
+        std::lock_guard<std::mutex> lock(m);
+        job = &j;
+        ++generation;
+      }
+      wake.notify_all();
+
+      detail::in_parallel_worker() = true;
+      run_chunks(j);
+      detail::in_parallel_worker() = false;
+
+      // j lives on this stack, so wait until no worker holds it
+      std::unique_lock<std::mutex> lock(m);
+      done.wait(lock, [&] {return j.remaining == 0 && active == 0; });
+      job = 0;
+    }
+
+    /**
+     * A process wide pool with one thread per hardware thread.
+     */
+    static thread_pool &shared() {
+      static thread_pool pool(
+        std::max<unsigned>(std::thread::hardware_concurrency(), 1) - 1);
+      return pool;
+    }
+
+  private:
+    thread_pool(const thread_pool &);
+    thread_pool &operator =(const thread_pool &);
+
+    void run_chunks(detail::parallel_job &j) {
+      std::size_t i;
+      while ((i = j.next.fetch_add(1)) < j.chunks) {
+        const std::size_t begin = i * j.chunk;
+        j.run(j.fn, begin, std::min(j.n, begin + j.chunk));
+        if (j.remaining.fetch_sub(1) == 1) {
+          std::lock_guard<std::mutex> lock(m);
+          done.notify_all();
+        }
+      }
+    }
+
+    void work_loop() {
+      detail::in_parallel_worker() = true;
+      unsigned seen = 0;
+      std::unique_lock<std::mutex> lock(m);
+      for (;;) {
+        wake.wait(lock, [&] {return stop || generation != seen; });
+        if (stop)
+          return;
+        seen = generation;
+        detail::parallel_job *j = job;
+        if (!j)
+          continue;
+
+        ++active;
+        lock.unlock();
+        run_chunks(*j);
+        lock.lock();
+        if (--active == 0)
+          done.notify_all();
+      }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex submit, m;
+    std::condition_variable wake, done;
+    detail::parallel_job *job;
+    unsigned generation;
+    std::size_t active;
+    bool stop;
+  };
+} // !p
+
+#endif // !P_UTILS_PARALLEL_H
@@ -0,0 +1,320 @@
+/* -- quaternion.h ---------------------------------------------------*- c++ -*-
+ * Quaternions for rotations.
+ *
+ * quat<T> wraps a vec<T, 4> holding x, y, z (the imaginary part) and w,
+ * the same layout as an orientation stored in a vec4, so arrays of either
+ * can be reinterpreted as the other.
+ *
+ * Operations that can be done on quaternions:
+ *   quat * quat, conjugate, inverse, dot_product, magnitude, normalize
+ *   rotate (a vec3), axis_angle
+ *   to_mat3, to_mat4, to_quat (from the rotation part of a mat3/mat4)
+ *   nlerp, slerp
+ *
+ * Rotations follow the matrix convention of matrix.h: to_mat3(q) * v ==
+ * rotate(q, v), and q1 * q2 rotates by q2 first. quat<float> uses the
+ * SIMD registers from simd.h for the product and rotate(). Batch slerp_n
+ * and nlerp_n are in vector_batch.h.
+ *
+ * p::quatf q = p::axis_angle(p::make_vec(0.0f, 0.0f, 1.0f), 1.57f);
+ * p::vec3 v = p::rotate(q, p::make_vec(1.0f, 0.0f, 0.0f));
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_QUATERNION_H
+#define P_UTILS_QUATERNION_H
+
+#include <cstddef>
+#include <cmath>
+
+#include "config.h"
+#include "algorithm.h"
+#include "vector.h"
+#include "matrix.h"
+#include "simd.h"
+
+namespace p {
+  template<typename T>
+  struct quat {
+    typedef T value_type;
+
+    P_CONSTEXPR T &operator [](std::size_t pos) {return v[pos];}
+    P_CONSTEXPR T operator [](std::size_t pos) const {return v[pos];}
+
+    vec<T, 4> v; // x, y, z, w
+  };
+
+  template<typename T>
+  P_CONSTEXPR quat<T> make_quat(T x, T y, T z, T w) {
+    const quat<T> q = {{{{x, y, z, w}}}}; return q;
+  }
+
+  template<typename T>
+  P_CONSTEXPR quat<T> make_quat(const vec<T, 4> &v) {
+    const quat<T> q = {v}; return q;
+  }
+
+  template<typename T>
+  P_CONSTEXPR quat<T> identity_quat() {
+    return make_quat(T(0), T(0), T(0), T(1));
+  }
+
+  /**
+   * Rotation by angle radians around axis, which must be normalized.
+   */
+  template<typename T>
+  inline quat<T> axis_angle(const vec<T, 3> &axis, T angle) {
+    using std::sin;
+    using std::cos;
+    const T s = sin(angle * T(0.5));
+    return make_quat(axis[0] * s, axis[1] * s, axis[2] * s, cos(angle * T(0.5)));
+  }
+
+  namespace detail {
+    template<typename T>
+    struct quat_mul_generic {
+      static P_CONSTEXPR quat<T> apply(const quat<T> &a, const quat<T> &b) {
+        return make_quat(a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1],
+                         a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0],
+                         a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3],
+                         a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2]);
+      }
+    };
+
+    /**
+     * v + 2w(u x v) + 2u x (u x v), with u the imaginary part of q.
+     */
+    template<typename T>
+    struct quat_rotate_generic {
+      static P_CONSTEXPR vec<T, 3> apply(const quat<T> &q, const vec<T, 3> &v) {
+        const vec<T, 3> u = make_vec(q[0], q[1], q[2]);
+        const vec<T, 3> t = cross_product(u, v) * T(2);
+        return v + t * q[3] + cross_product(u, t);
+      }
+    };
+
+    template<typename T>
+    struct quat_mul : quat_mul_generic<T> {};
+
+    template<typename T>
+    struct quat_rotate : quat_rotate_generic<T> {};
+
+#if defined(P_SIMD)
+    /**
+     * The product is a.w * b plus a.x, a.y and a.z times b with its lanes
+     * swapped in pairs and some signs flipped.
+     */
+    template<>
+    struct quat_mul<float> {
+      static P_CONSTEXPR_DISPATCH quat<float> apply(const quat<float> &a,
+                                                    const quat<float> &b) {
+        if (P_CONSTANT_EVALUATED())
+          return quat_mul_generic<float>::apply(a, b);
+        return apply_simd(a, b);
+      }
+
+      static quat<float> apply_simd(const quat<float> &a, const quat<float> &b) {
+        const simd::f32x4 va = simd::load(a.v.components);
+        const simd::f32x4 vb = simd::load(b.v.components);
+
+        simd::f32x4 r = simd::mul(simd::swizzle<3, 3, 3, 3>(va), vb);
+        r = simd::add(r, simd::mul(
+          simd::mul(simd::swizzle<0, 0, 0, 0>(va), simd::swizzle<3, 2, 1, 0>(vb)),
+          simd::set(1.0f, -1.0f, 1.0f, -1.0f)));
+        r = simd::add(r, simd::mul(
+          simd::mul(simd::swizzle<1, 1, 1, 1>(va), simd::swizzle<2, 3, 0, 1>(vb)),
+          simd::set(1.0f, 1.0f, -1.0f, -1.0f)));
+        r = simd::add(r, simd::mul(
+          simd::mul(simd::swizzle<2, 2, 2, 2>(va), simd::swizzle<1, 0, 3, 2>(vb)),
+          simd::set(-1.0f, 1.0f, 1.0f, -1.0f)));
+
+        quat<float> ret;
+        simd::store(ret.v.components, r);
+        return ret;
+      }
+    };
+
+    template<>
+    struct quat_rotate<float> {
+      static P_CONSTEXPR_DISPATCH vec<float, 3> apply(const quat<float> &q,
+                                                      const vec<float, 3> &v) {
+        if (P_CONSTANT_EVALUATED())
+          return quat_rotate_generic<float>::apply(q, v);
+        return apply_simd(q, v);
+      }
+
+      static vec<float, 3> apply_simd(const quat<float> &q, const vec<float, 3> &v) {
+        const simd::f32x4 vq = simd::load(q.v.components);
+        const simd::f32x4 u = simd::mul(vq, simd::set(1.0f, 1.0f, 1.0f, 0.0f));
+        const simd::f32x4 vv = simd::load3(v.components);
+
+        const simd::f32x4 c = simd_cross3(u, vv);
+        const simd::f32x4 t = simd::add(c, c);
+        const simd::f32x4 r =
+          simd::add(simd::add(vv, simd::mul(t, simd::swizzle<3, 3, 3, 3>(vq))),
+                    simd_cross3(u, t));
+
+        vec<float, 3> ret;
+        simd::store3(ret.components, r);
+        return ret;
+      }
+    };
+#endif // P_SIMD
+  }
+
+  /**
+   * Hamilton product; the rotation q2 followed by q1.
+   */
+  template<typename T>
+  P_CONSTEXPR quat<T> operator *(const quat<T> &q1, const quat<T> &q2) {
+    return detail::quat_mul<T>::apply(q1, q2);
+  }
+
+  template<typename T>
+  P_CONSTEXPR quat<T> conjugate(const quat<T> &q) {
+    return make_quat(-q[0], -q[1], -q[2], q[3]);
+  }
+
+  template<typename T>
+  P_CONSTEXPR T dot_product(const quat<T> &q1, const quat<T> &q2) {
+    return dot_product(q1.v, q2.v);
+  }
+
+  template<typename T>
+  inline T magnitude(const quat<T> &q) {
+    return magnitude(q.v);
+  }
+
+  template<typename T>
+  inline quat<T> normalize(const quat<T> &q) {
+    return make_quat(normalize(q.v));
+  }
+
+  /**
+   * The inverse of any non-zero quaternion. For unit quaternions, which
+   * is all rotations, conjugate() is the same and cheaper.
+   */
+  template<typename T>
+  P_CONSTEXPR quat<T> inverse(const quat<T> &q) {
+    return make_quat(conjugate(q).v / dot_product(q, q));
+  }
+
+  /**
+   * Rotates v by the unit quaternion q.
+   */
+  template<typename T>
+  P_CONSTEXPR vec<T, 3> rotate(const quat<T> &q, const vec<T, 3> &v) {
+    return detail::quat_rotate<T>::apply(q, v);
+  }
+
+  /**
+   * Rotation matrix of the unit quaternion q.
+   */
+  template<typename T>
+  P_CONSTEXPR mat<T, 3, 3> to_mat3(const quat<T> &q) {
+    const T x = q[0], y = q[1], z = q[2], w = q[3];
+    mat<T, 3, 3> m((T()));
+    T *o = m.components;
+    o[0] = T(1) - T(2)*(y*y + z*z); o[1] = T(2)*(x*y - w*z); o[2] = T(2)*(x*z + w*y);
+    o[3] = T(2)*(x*y + w*z); o[4] = T(1) - T(2)*(x*x + z*z); o[5] = T(2)*(y*z - w*x);
+    o[6] = T(2)*(x*z - w*y); o[7] = T(2)*(y*z + w*x); o[8] = T(1) - T(2)*(x*x + y*y);
+    return m;
+  }
+
+  /**
+   * to_mat3(q) in the upper left of an otherwise identity mat4.
+   */
+  template<typename T>
+  P_CONSTEXPR mat<T, 4, 4> to_mat4(const quat<T> &q) {
+    const mat<T, 3, 3> r = to_mat3(q);
+    mat<T, 4, 4> m((T()));
+    for (std::size_t i = 0; i < 3; ++i)
+      for (std::size_t j = 0; j < 3; ++j)
+        m.components[4*i + j] = r.components[3*i + j];
+    m.components[15] = T(1);
+    return m;
+  }
+
+  namespace detail {
+    /**
+     * Shepperd's method: the square root is taken of the largest of
+     * 4w^2, 4x^2, 4y^2 and 4z^2, and the other three follow from the
+     * off-diagonal elements. m has N columns; only the upper left 3x3 is
+     * read.
+     */
+    template<typename T, std::size_t N>
+    inline quat<T> rotation_to_quat(const T *m) {
+      using std::sqrt;
+      const T m00 = m[0], m01 = m[1], m02 = m[2];
+      const T m10 = m[N], m11 = m[N+1], m12 = m[N+2];
+      const T m20 = m[2*N], m21 = m[2*N+1], m22 = m[2*N+2];
+
+      const T trace = m00 + m11 + m22;
+      if (trace > T(0)) {
+        const T s = sqrt(trace + T(1)) * T(2);
+        return make_quat((m21 - m12) / s, (m02 - m20) / s, (m10 - m01) / s, s / T(4));
+      } else if (m00 > m11 && m00 > m22) {
+        const T s = sqrt(T(1) + m00 - m11 - m22) * T(2);
+        return make_quat(s / T(4), (m01 + m10) / s, (m02 + m20) / s, (m21 - m12) / s);
+      } else if (m11 > m22) {
+        const T s = sqrt(T(1) + m11 - m00 - m22) * T(2);
+        return make_quat((m01 + m10) / s, s / T(4), (m12 + m21) / s, (m02 - m20) / s);
+      } else {
+        const T s = sqrt(T(1) + m22 - m00 - m11) * T(2);
+        return make_quat((m02 + m20) / s, (m12 + m21) / s, s / T(4), (m10 - m01) / s);
+      }
+    }
+  }
+
+  /**
+   * The unit quaternion of a rotation matrix. The upper left 3x3 of m must
+   * be orthonormal with determinant 1; the rest of a mat4 is ignored.
+   */
+  template<typename T>
+  inline quat<T> to_quat(const mat<T, 3, 3> &m) {
+    return detail::rotation_to_quat<T, 3>(m.components);
+  }
+
+  template<typename T>
+  inline quat<T> to_quat(const mat<T, 4, 4> &m) {
+    return detail::rotation_to_quat<T, 4>(m.components);
+  }
+
+  /**
+   * Normalized lerp along the shorter arc. Cheaper than slerp, but the
+   * angular speed isn't constant over t.
+   */
+  template<typename T, typename Scalar>
+  inline quat<T> nlerp(const quat<T> &q1, const quat<T> &q2, Scalar t) {
+    const vec<T, 4> to = dot_product(q1, q2) < T(0) ? -q2.v : q2.v;
+    return make_quat(normalize(lerp(q1.v, to, T(t))));
+  }
+
+  /**
+   * Spherical interpolation along the shorter arc. Falls back to nlerp
+   * when q1 and q2 are too close for the sine weights to be accurate.
+   */
+  template<typename T, typename Scalar>
+  inline quat<T> slerp(const quat<T> &q1, const quat<T> &q2, Scalar t) {
+    using std::acos;
+    using std::sin;
+    T d = dot_product(q1, q2);
+    vec<T, 4> to = q2.v;
+    if (d < T(0)) {
+      d = -d;
+      to = -to;
+    }
+    if (d > T(0.9995))
+      return make_quat(normalize(lerp(q1.v, to, T(t))));
+
+    const T theta = acos(d);
+    const T inv = T(1) / sin(theta);
+    const T w1 = sin((T(1) - T(t)) * theta) * inv;
+    const T w2 = sin(T(t) * theta) * inv;
+    return make_quat(q1.v * w1 + to * w2);
+  }
+
+  typedef quat<float> quatf;
+  typedef quat<double> quatd;
+} // !p
+
+#endif // !P_UTILS_QUATERNION_H
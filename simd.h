@@ -0,0 +1,412 @@
+/* -- simd.h ---------------------------------------------------------*- c++ -*-
+ * Thin wrapper around the 4-wide float registers of the target, used by the
+ * vector and matrix headers for their fast paths.
+ *
+ * The instruction set is picked at compile time:
+ *   SSE2    - when __SSE2__ (or an x64 MSVC target) is present
+ *   NEON    - when __ARM_NEON is present
+ *   scalar  - otherwise, or when P_NO_SIMD is defined
+ *
+ * P_SIMD is defined to 1 when one of the hardware paths is active. The
+ * scalar fallback implements the same interface with plain loops, so code
+ * written against p::simd compiles in every mode.
+ *
+ * f32x4 a = simd::load(ptr);
+ * simd::store(out, simd::add(a, simd::splat(1.0f)));
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_SIMD_H
+#define P_UTILS_SIMD_H
+
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if !defined(P_NO_SIMD)
+#  if defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define P_SIMD_SSE2 1
+#  elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    define P_SIMD_NEON 1
+#  endif
+#endif
+
+#if defined(P_SIMD_SSE2)
+#  include <emmintrin.h>
+#  define P_SIMD 1
+#elif defined(P_SIMD_NEON)
+#  include <arm_neon.h>
+#  define P_SIMD 1
+#endif
+
+namespace p {
+  namespace simd {
+
+#if defined(P_SIMD_SSE2)
+    typedef __m128 f32x4;
+
+    inline f32x4 load(const float *p) {return _mm_loadu_ps(p); }
+    inline void store(float *p, f32x4 v) {_mm_storeu_ps(p, v); }
+    inline f32x4 splat(float s) {return _mm_set1_ps(s); }
+    inline f32x4 set(float x, float y, float z, float w) {
+      return _mm_setr_ps(x, y, z, w);
+    }
+
+    /**
+     * Loads three floats; the fourth lane is set to pad.
+     */
+    inline f32x4 load3(const float *p, float pad = 0.0f) {
+      return _mm_setr_ps(p[0], p[1], p[2], pad);
+    }
+
+    inline void store3(float *p, f32x4 v) {
+      float tmp[4];
+      _mm_storeu_ps(tmp, v);
+      std::memcpy(p, tmp, sizeof(float) * 3);
+    }
+
+    inline f32x4 add(f32x4 a, f32x4 b) {return _mm_add_ps(a, b); }
+    inline f32x4 sub(f32x4 a, f32x4 b) {return _mm_sub_ps(a, b); }
+    inline f32x4 mul(f32x4 a, f32x4 b) {return _mm_mul_ps(a, b); }
+    inline f32x4 div(f32x4 a, f32x4 b) {return _mm_div_ps(a, b); }
+    inline f32x4 min(f32x4 a, f32x4 b) {return _mm_min_ps(b, a); }
+    inline f32x4 max(f32x4 a, f32x4 b) {return _mm_max_ps(b, a); }
+    inline f32x4 sqrt(f32x4 a) {return _mm_sqrt_ps(a); }
+    inline float first(f32x4 v) {return _mm_cvtss_f32(v); }
+
+    /**
+     * Hardware estimate of 1/sqrt(a); relative error at most 1.5 * 2^-12.
+     */
+    inline f32x4 rsqrt_estimate(f32x4 a) {return _mm_rsqrt_ps(a); }
+
+    /**
+     * rsqrt_estimate refined by one Newton-Raphson step; relative error
+     * below 2^-21.
+     */
+    inline f32x4 rsqrt(f32x4 a) {
+      const f32x4 y = _mm_rsqrt_ps(a);
+      const f32x4 half_a = _mm_mul_ps(_mm_set1_ps(0.5f), a);
+      return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f),
+                                      _mm_mul_ps(half_a, _mm_mul_ps(y, y))));
+    }
+
+    /**
+     * Sum of all four lanes.
+     */
+    inline float hsum(f32x4 v) {
+      f32x4 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+      f32x4 sums = _mm_add_ps(v, shuf);
+      shuf = _mm_movehl_ps(shuf, sums);
+      return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+    }
+
+    /**
+     * Transposes the 4x4 matrix held in r0..r3, one row per register.
+     */
+    inline void transpose(f32x4 &r0, f32x4 &r1, f32x4 &r2, f32x4 &r3) {
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    }
+
+    /**
+     * (a[i0], a[i1], b[i2], b[i3]).
+     */
+    template<int i0, int i1, int i2, int i3>
+    inline f32x4 shuffle(f32x4 a, f32x4 b) {
+      return _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0));
+    }
+
+    /**
+     * Lane mask of a < b, for select().
+     */
+    inline f32x4 less(f32x4 a, f32x4 b) {return _mm_cmplt_ps(a, b); }
+
+    /**
+     * a where mask is set, b elsewhere.
+     */
+    inline f32x4 select(f32x4 mask, f32x4 a, f32x4 b) {
+      return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    /**
+     * Truncates, then steps down the lanes that went up. Lanes of 2^23
+     * and more, infinities and NaN are already integral and kept.
+     */
+    inline f32x4 floor(f32x4 a) {
+      const f32x4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+      const f32x4 f = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+      const f32x4 mag = _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+      return select(_mm_cmplt_ps(mag, _mm_set1_ps(8388608.0f)), f, a);
+    }
+
+    /**
+     * a * 2^n for integral n in [-252, 254], in two steps so that results
+     * can overflow to infinity or go through the denormals to zero.
+     */
+    inline f32x4 ldexp(f32x4 a, f32x4 n) {
+      const __m128i ni = _mm_cvttps_epi32(n), bias = _mm_set1_epi32(127);
+      const __m128i h = _mm_srai_epi32(ni, 1);
+      const f32x4 s0 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(h, bias), 23));
+      const f32x4 s1 = _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_add_epi32(_mm_sub_epi32(ni, h), bias), 23));
+      return _mm_mul_ps(_mm_mul_ps(a, s0), s1);
+    }
+
+    /**
+     * The m in [0.5, 1), with the sign of a, and the e of a = m * 2^e, for
+     * normal a. Lanes with zero, denormals, infinities or NaN are garbage.
+     */
+    inline f32x4 frexp(f32x4 a, f32x4 &e) {
+      const __m128i bits = _mm_castps_si128(a);
+      e = _mm_cvtepi32_ps(_mm_sub_epi32(
+        _mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7f800000)), 23),
+        _mm_set1_epi32(126)));
+      return _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(int(0x807fffff))),
+                                           _mm_set1_epi32(0x3f000000)));
+    }
+
+#elif defined(P_SIMD_NEON)
+    typedef float32x4_t f32x4;
+
+    inline f32x4 load(const float *p) {return vld1q_f32(p); }
+    inline void store(float *p, f32x4 v) {vst1q_f32(p, v); }
+    inline f32x4 splat(float s) {return vdupq_n_f32(s); }
+    inline f32x4 set(float x, float y, float z, float w) {
+      const float tmp[4] = {x, y, z, w};
+      return vld1q_f32(tmp);
+    }
+
+    inline f32x4 load3(const float *p, float pad = 0.0f) {
+      return vsetq_lane_f32(pad, vcombine_f32(vld1_f32(p), vld1_dup_f32(p + 2)), 3);
+    }
+
+    inline void store3(float *p, f32x4 v) {
+      vst1_f32(p, vget_low_f32(v));
+      vst1q_lane_f32(p + 2, v, 2);
+    }
+
+    inline f32x4 add(f32x4 a, f32x4 b) {return vaddq_f32(a, b); }
+    inline f32x4 sub(f32x4 a, f32x4 b) {return vsubq_f32(a, b); }
+    inline f32x4 mul(f32x4 a, f32x4 b) {return vmulq_f32(a, b); }
+    inline f32x4 min(f32x4 a, f32x4 b) {return vminq_f32(a, b); }
+    inline f32x4 max(f32x4 a, f32x4 b) {return vmaxq_f32(a, b); }
+    inline float first(f32x4 v) {return vgetq_lane_f32(v, 0); }
+
+    /**
+     * Hardware estimate of 1/sqrt(a); relative error at most 2^-8.
+     */
+    inline f32x4 rsqrt_estimate(f32x4 a) {return vrsqrteq_f32(a); }
+
+    /**
+     * rsqrt_estimate refined by two Newton-Raphson steps; relative error
+     * below 2^-21.
+     */
+    inline f32x4 rsqrt(f32x4 a) {
+      f32x4 y = vrsqrteq_f32(a);
+      y = vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+      return vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+    }
+
+#  if defined(__aarch64__)
+    inline f32x4 div(f32x4 a, f32x4 b) {return vdivq_f32(a, b); }
+    inline f32x4 sqrt(f32x4 a) {return vsqrtq_f32(a); }
+    inline float hsum(f32x4 v) {return vaddvq_f32(v); }
+#  else
+    inline f32x4 div(f32x4 a, f32x4 b) {
+      float ta[4], tb[4];
+      vst1q_f32(ta, a); vst1q_f32(tb, b);
+      for (std::size_t i = 0; i < 4; ++i)
+        ta[i] /= tb[i];
+      return vld1q_f32(ta);
+    }
+    inline f32x4 sqrt(f32x4 a) {
+      float ta[4];
+      vst1q_f32(ta, a);
+      for (std::size_t i = 0; i < 4; ++i)
+        ta[i] = std::sqrt(ta[i]);
+      return vld1q_f32(ta);
+    }
+    inline float hsum(f32x4 v) {
+      float32x2_t r = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+      return vget_lane_f32(vpadd_f32(r, r), 0);
+    }
+#  endif
+
+    inline void transpose(f32x4 &r0, f32x4 &r1, f32x4 &r2, f32x4 &r3) {
+      const float32x4x2_t t01 = vtrnq_f32(r0, r1);
+      const float32x4x2_t t23 = vtrnq_f32(r2, r3);
+      r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+      r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+      r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+      r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+    }
+
+    template<int i0, int i1, int i2, int i3>
+    inline f32x4 shuffle(f32x4 a, f32x4 b) {
+#  if defined(__clang__)
+      return __builtin_shufflevector(a, b, i0, i1, i2 + 4, i3 + 4);
+#  else
+      const float r[4] = {vgetq_lane_f32(a, i0), vgetq_lane_f32(a, i1),
+                          vgetq_lane_f32(b, i2), vgetq_lane_f32(b, i3)};
+      return vld1q_f32(r);
+#  endif
+    }
+
+    inline f32x4 less(f32x4 a, f32x4 b) {
+      return vreinterpretq_f32_u32(vcltq_f32(a, b));
+    }
+
+    inline f32x4 select(f32x4 mask, f32x4 a, f32x4 b) {
+      return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+    }
+
+#  if defined(__aarch64__)
+    inline f32x4 floor(f32x4 a) {return vrndmq_f32(a); }
+#  else
+    inline f32x4 floor(f32x4 a) {
+      const f32x4 t = vcvtq_f32_s32(vcvtq_s32_f32(a));
+      const uint32x4_t up = vcgtq_f32(t, a);
+      const f32x4 f = vsubq_f32(t, vreinterpretq_f32_u32(
+        vandq_u32(up, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+      return vbslq_f32(vcltq_f32(vabsq_f32(a), vdupq_n_f32(8388608.0f)), f, a);
+    }
+#  endif
+
+    inline f32x4 ldexp(f32x4 a, f32x4 n) {
+      const int32x4_t ni = vcvtq_s32_f32(n), bias = vdupq_n_s32(127);
+      const int32x4_t h = vshrq_n_s32(ni, 1);
+      const f32x4 s0 = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(h, bias), 23));
+      const f32x4 s1 = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vsubq_s32(ni, h), bias), 23));
+      return vmulq_f32(vmulq_f32(a, s0), s1);
+    }
+
+    inline f32x4 frexp(f32x4 a, f32x4 &e) {
+      const uint32x4_t bits = vreinterpretq_u32_f32(a);
+      e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(
+        vshrq_n_u32(vandq_u32(bits, vdupq_n_u32(0x7f800000u)), 23)), vdupq_n_s32(126)));
+      return vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x807fffffu)),
+                                             vdupq_n_u32(0x3f000000u)));
+    }
+
+#else
+    /**
+     * Scalar fallback; same interface, plain loops.
+     */
+    struct f32x4 {float v[4]; };
+
+    inline f32x4 load(const float *p) {
+      f32x4 r; std::memcpy(r.v, p, sizeof r.v); return r;
+    }
+    inline void store(float *p, f32x4 v) {std::memcpy(p, v.v, sizeof v.v); }
+    inline f32x4 splat(float s) {const f32x4 r = {{s, s, s, s}}; return r; }
+    inline f32x4 set(float x, float y, float z, float w) {
+      const f32x4 r = {{x, y, z, w}}; return r;
+    }
+
+    inline f32x4 load3(const float *p, float pad = 0.0f) {
+      const f32x4 r = {{p[0], p[1], p[2], pad}}; return r;
+    }
+    inline void store3(float *p, f32x4 v) {
+      std::memcpy(p, v.v, sizeof(float) * 3);
+    }
+
+#define P_SIMD_SCALAR_BINOP(name, expr)                   \
+    inline f32x4 name(f32x4 a, f32x4 b) {                 \
+      f32x4 r;                                            \
+      for (std::size_t i = 0; i < 4; ++i)                 \
+        r.v[i] = (expr);                                  \
+      return r;                                           \
+    }
+
+    P_SIMD_SCALAR_BINOP(add, a.v[i] + b.v[i])
+    P_SIMD_SCALAR_BINOP(sub, a.v[i] - b.v[i])
+    P_SIMD_SCALAR_BINOP(mul, a.v[i] * b.v[i])
+    P_SIMD_SCALAR_BINOP(div, a.v[i] / b.v[i])
+    P_SIMD_SCALAR_BINOP(min, b.v[i] < a.v[i] ? b.v[i] : a.v[i])
+    P_SIMD_SCALAR_BINOP(max, a.v[i] < b.v[i] ? b.v[i] : a.v[i])
+
+#undef P_SIMD_SCALAR_BINOP
+
+    inline f32x4 sqrt(f32x4 a) {
+      for (std::size_t i = 0; i < 4; ++i)
+        a.v[i] = std::sqrt(a.v[i]);
+      return a;
+    }
+    inline float first(f32x4 v) {return v.v[0]; }
+
+    /**
+     * Without hardware estimates both rsqrt variants are exact.
+     */
+    inline f32x4 rsqrt(f32x4 a) {
+      for (std::size_t i = 0; i < 4; ++i)
+        a.v[i] = 1.0f / std::sqrt(a.v[i]);
+      return a;
+    }
+    inline f32x4 rsqrt_estimate(f32x4 a) {return rsqrt(a); }
+
+    inline float hsum(f32x4 v) {return (v.v[0] + v.v[1]) + (v.v[2] + v.v[3]); }
+
+    inline void transpose(f32x4 &r0, f32x4 &r1, f32x4 &r2, f32x4 &r3) {
+      f32x4 *rows[4] = {&r0, &r1, &r2, &r3};
+      for (std::size_t i = 0; i < 4; ++i)
+        for (std::size_t j = i + 1; j < 4; ++j)
+          std::swap(rows[i]->v[j], rows[j]->v[i]);
+    }
+
+    template<int i0, int i1, int i2, int i3>
+    inline f32x4 shuffle(f32x4 a, f32x4 b) {
+      const f32x4 r = {{a.v[i0], a.v[i1], b.v[i2], b.v[i3]}}; return r;
+    }
+
+    /**
+     * Masks are 1 or 0 per lane here; only select() looks at them.
+     */
+    inline f32x4 less(f32x4 a, f32x4 b) {
+      f32x4 r;
+      for (std::size_t i = 0; i < 4; ++i)
+        r.v[i] = a.v[i] < b.v[i] ? 1.0f : 0.0f;
+      return r;
+    }
+
+    inline f32x4 select(f32x4 mask, f32x4 a, f32x4 b) {
+      for (std::size_t i = 0; i < 4; ++i)
+        a.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i];
+      return a;
+    }
+
+    inline f32x4 floor(f32x4 a) {
+      for (std::size_t i = 0; i < 4; ++i)
+        a.v[i] = std::floor(a.v[i]);
+      return a;
+    }
+
+    inline f32x4 ldexp(f32x4 a, f32x4 n) {
+      for (std::size_t i = 0; i < 4; ++i)
+        a.v[i] = n.v[i] == n.v[i] ? std::ldexp(a.v[i], int(n.v[i])) : n.v[i];
+      return a;
+    }
+
+    inline f32x4 frexp(f32x4 a, f32x4 &e) {
+      for (std::size_t i = 0; i < 4; ++i) {
+        int exponent = 0;
+        a.v[i] = std::frexp(a.v[i], &exponent);
+        e.v[i] = float(exponent);
+      }
+      return a;
+    }
+#endif
+
+    /**
+     * Dot product of all four lanes.
+     */
+    inline float dot(f32x4 a, f32x4 b) {return hsum(mul(a, b)); }
+
+    /**
+     * (a[i0], a[i1], a[i2], a[i3]).
+     */
+    template<int i0, int i1, int i2, int i3>
+    inline f32x4 swizzle(f32x4 a) {return shuffle<i0, i1, i2, i3>(a, a); }
+  } // !simd
+} // !p
+
+#endif // !P_UTILS_SIMD_H
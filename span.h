@@ -0,0 +1,67 @@
+/* -- span.h ---------------------------------------------------------*- c++ -*-
+ * Non-owning view of a contiguous array, used by the batch operations.
+ *
+ * A span<T> can be created from a pointer and a count, a built-in array or
+ * a std::vector, and a span<T> converts to a span<const T>:
+ *
+ * std::vector<vec3> normals = ...;
+ * p::normalize_n(normals);
+ * p::normalize_n(p::span<vec3>(&normals[16], 32));
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_SPAN_H
+#define P_UTILS_SPAN_H
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace p {
+  template<typename T>
+  class span {
+  public:
+    typedef T element_type;
+    typedef typename std::remove_const<T>::type value_type;
+    typedef T *iterator;
+
+    span() : ptr(0), count(0) {}
+    span(T *ptr, std::size_t count) : ptr(ptr), count(count) {}
+
+    template<std::size_t N>
+    span(T (&arr)[N]) : ptr(arr), count(N) {}
+
+    template<typename A>
+    span(std::vector<value_type, A> &v) : ptr(v.data()), count(v.size()) {}
+
+    template<typename A>
+    span(const std::vector<value_type, A> &v) : ptr(v.data()), count(v.size()) {}
+
+    span(const span<value_type> &other) : ptr(other.data()), count(other.size()) {}
+
+    T *data() const {return ptr; }
+    std::size_t size() const {return count; }
+    bool empty() const {return count == 0; }
+
+    T &operator [](std::size_t pos) const {
+      assert(pos < count);
+      return ptr[pos];
+    }
+
+    iterator begin() const {return ptr; }
+    iterator end() const {return ptr + count; }
+
+    span subspan(std::size_t offset, std::size_t n) const {
+      assert(offset + n <= count);
+      return span(ptr + offset, n);
+    }
+
+    span first(std::size_t n) const {return subspan(0, n); }
+
+  private:
+    T *ptr;
+    std::size_t count;
+  };
+} // !p
+
+#endif // !P_UTILS_SPAN_H
@@ -0,0 +1,110 @@
+#include "allocator.h"
+#include "vector.h"
+#include "matrix.h"
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+
+using namespace p;
+
+namespace {
+  std::size_t misalignment(const void *ptr, std::size_t alignment) {
+    return reinterpret_cast<std::size_t>(ptr) % alignment;
+  }
+}
+
+TEST(allocator, aligned_vec) {
+#if defined(P_ALIGNED_VEC)
+  EXPECT_EQ(16u, alignof(vec4));
+  EXPECT_EQ(16u, alignof(ivec4));
+  EXPECT_EQ(16u, (alignof(mat<float, 4, 4>)));
+  EXPECT_EQ(16u, (alignof(mat<float, 4, 3>)));
+#endif
+  EXPECT_EQ(alignof(float), alignof(vec3));
+  EXPECT_EQ(alignof(double), (alignof(vec<double, 4>)));
+  EXPECT_EQ(16u, sizeof(vec4));
+  EXPECT_EQ(64u, (sizeof(mat<float, 4, 4>)));
+  EXPECT_EQ(alignof(vec4), (alignof(mat<float, 4, 4>)));
+}
+
+TEST(allocator, aligned_allocator) {
+  std::vector<vec3, aligned_allocator<vec3> > v(5);
+  EXPECT_EQ(0u, misalignment(v.data(), 64));
+  for (std::size_t i = 0; i < 100; ++i)
+    v.push_back(make_vec(float(i), 0.0f, 0.0f));
+  EXPECT_EQ(0u, misalignment(v.data(), 64));
+  EXPECT_FLOAT_EQ(99.0f, v.back().x);
+
+  std::vector<vec4, aligned_allocator<vec4, 16> > w(3, make_vec(1.0f, 2.0f, 3.0f, 4.0f));
+  EXPECT_EQ(0u, misalignment(w.data(), 16));
+  EXPECT_FLOAT_EQ(3.0f, w[2].z);
+}
+
+TEST(allocator, huge_requests) {
+  // sizes whose padding would wrap around fail instead of returning a
+  // small block
+  const std::size_t max = std::numeric_limits<std::size_t>::max();
+  aligned_allocator<char> chars;
+  EXPECT_THROW(chars.allocate(max), std::bad_alloc);
+  EXPECT_THROW(chars.allocate(max - 32), std::bad_alloc);
+  EXPECT_THROW(aligned_allocator<vec4>().allocate(max / 8), std::bad_alloc);
+
+  arena a(1024);
+  EXPECT_THROW(a.allocate(max - 8), std::bad_alloc);
+  EXPECT_THROW(a.allocate(max - 100, 64), std::bad_alloc);
+  EXPECT_THROW(a.allocate_n<vec4>(max / sizeof(vec4)), std::bad_alloc);
+  EXPECT_EQ(0u, a.capacity());
+  EXPECT_NE(static_cast<void *>(0), a.allocate(16));
+}
+
+TEST(allocator, arena) {
+  arena a(1024);
+  EXPECT_EQ(0u, a.capacity());
+
+  span<vec3> v = a.allocate_n<vec3>(10);
+  EXPECT_EQ(10u, v.size());
+  EXPECT_EQ(0u, misalignment(v.data(), 16));
+  span<mat<float, 4, 4> > m = a.allocate_n<mat<float, 4, 4> >(2);
+  EXPECT_EQ(0u, misalignment(m.data(), 16));
+  EXPECT_GE(reinterpret_cast<const char *>(m.data()),
+            reinterpret_cast<const char *>(v.data() + 10));
+
+  for (std::size_t i = 0; i < v.size(); ++i)
+    v[i] = make_vec(float(i), 1.0f, 2.0f);
+  m[1] = mat<float, 4, 4>(3.0f);
+  EXPECT_FLOAT_EQ(9.0f, v[9].x);
+  EXPECT_FLOAT_EQ(3.0f, m[1].components[15]);
+
+  // larger than a block, and more blocks
+  span<vec4> big = a.allocate_n<vec4>(1000);
+  EXPECT_EQ(0u, misalignment(big.data(), 16));
+  big[999] = make_vec(1.0f, 2.0f, 3.0f, 4.0f);
+  a.allocate(600, 64);
+  a.allocate(600, 64);
+  const std::size_t capacity = a.capacity();
+  EXPECT_GE(capacity, 1000 * sizeof(vec4) + 1200);
+
+  // the same requests after reset reuse the blocks
+  a.reset();
+  EXPECT_EQ(v.data(), a.allocate_n<vec3>(10).data());
+  a.allocate_n<mat<float, 4, 4> >(2);
+  a.allocate_n<vec4>(1000);
+  a.allocate(600, 64);
+  a.allocate(600, 64);
+  EXPECT_EQ(capacity, a.capacity());
+}
+
+TEST(allocator, arena_allocator) {
+  arena a;
+  std::vector<vec3, arena_allocator<vec3> > v((arena_allocator<vec3>(a)));
+  for (std::size_t i = 0; i < 1000; ++i)
+    v.push_back(make_vec(float(i), 0.0f, 0.0f));
+  EXPECT_FLOAT_EQ(999.0f, v[999].x);
+  EXPECT_EQ(0u, misalignment(v.data(), 16));
+
+  std::vector<int, arena_allocator<int> > w((arena_allocator<vec3>(a)));
+  EXPECT_TRUE(w.get_allocator() == v.get_allocator());
+}
@@ -0,0 +1,160 @@
+#include "approx_math.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace p;
+
+namespace {
+  // distance from the exact value in float ULPs, of the larger of |exact|
+  // and the smallest normal float
+  double ulps(float got, double exact) {
+    const double a = std::fmax(std::fabs(exact), double(std::numeric_limits<float>::min()));
+    return std::fabs(double(got) - exact) / std::ldexp(1.0, std::ilogb(a) - 23);
+  }
+
+  float random_float(std::uint32_t &seed, float lo, float hi) {
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * float(seed >> 8) / 16777216.0f;
+  }
+
+  // the largest errors of one tier over random arguments
+  template<approx::accuracy A>
+  void measure(double (&err)[5]) {
+    for (std::size_t i = 0; i < 5; ++i)
+      err[i] = 0.0;
+    std::uint32_t seed = 1;
+    for (int t = 0; t < 200000; ++t) {
+      const float x = random_float(seed, -8192.0f, 8192.0f) * (t % 2 ? 1.0f : 1.0f / 1024.0f);
+      err[0] = std::fmax(err[0], ulps(approx::sin<A>(x), std::sin(double(x))));
+      err[1] = std::fmax(err[1], ulps(approx::cos<A>(x), std::cos(double(x))));
+
+      const float e = random_float(seed, -87.0f, 88.0f);
+      err[2] = std::fmax(err[2], ulps(approx::exp<A>(e), std::exp(double(e))));
+
+      const float l = std::ldexp(random_float(seed, 1.0f, 2.0f), int(seed % 250) - 140);
+      err[3] = std::fmax(err[3], ulps(approx::log<A>(l), std::log(double(l))));
+
+      const float y = random_float(seed, -100.0f, 100.0f), z = random_float(seed, -100.0f, 100.0f);
+      err[4] = std::fmax(err[4], ulps(approx::atan2<A>(y, z), std::atan2(double(y), double(z))));
+    }
+  }
+
+  template<approx::accuracy A>
+  void expect_within(const double (&bound)[5]) {
+    static const char *const names[] = {"sin", "cos", "exp", "log", "atan2"};
+    double err[5];
+    measure<A>(err);
+    for (std::size_t i = 0; i < 5; ++i)
+      EXPECT_GE(bound[i], err[i]) << names[i];
+  }
+}
+
+TEST(approx_math, documented_errors) {
+  const double fast[] = {9500, 9500, 1700, 1500, 300};
+  const double medium[] = {30, 30, 75, 30, 15};
+  const double precise[] = {3, 3, 2, 1, 3};
+  expect_within<approx::fast>(fast);
+  expect_within<approx::medium>(medium);
+  expect_within<approx::precise>(precise);
+
+  // each tier is better than the one before
+  double a[5], b[5];
+  measure<approx::fast>(a);
+  measure<approx::medium>(b);
+  for (std::size_t i = 0; i < 5; ++i)
+    EXPECT_LT(b[i], a[i]);
+}
+
+TEST(approx_math, special_values) {
+  const float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(0.0f, approx::sin<approx::precise>(0.0f));
+  EXPECT_EQ(1.0f, approx::cos<approx::precise>(0.0f));
+  EXPECT_TRUE(std::isnan(approx::sin<approx::fast>(inf)));
+  EXPECT_TRUE(std::isnan(approx::cos<approx::fast>(std::nanf(""))));
+
+  EXPECT_EQ(1.0f, approx::exp<approx::precise>(0.0f));
+  EXPECT_EQ(inf, approx::exp<approx::precise>(100.0f));
+  EXPECT_EQ(inf, approx::exp<approx::fast>(inf));
+  EXPECT_EQ(0.0f, approx::exp<approx::precise>(-200.0f));
+  EXPECT_EQ(0.0f, approx::exp<approx::medium>(-inf));
+  EXPECT_TRUE(std::isnan(approx::exp<approx::precise>(std::nanf(""))));
+  // through the denormals
+  EXPECT_NEAR(std::exp(-100.0), approx::exp<approx::precise>(-100.0f), 1e-44);
+
+  EXPECT_EQ(0.0f, approx::log<approx::precise>(1.0f));
+  EXPECT_EQ(-inf, approx::log<approx::precise>(0.0f));
+  EXPECT_EQ(inf, approx::log<approx::precise>(inf));
+  EXPECT_TRUE(std::isnan(approx::log<approx::fast>(-1.0f)));
+  EXPECT_TRUE(std::isnan(approx::log<approx::fast>(-inf)));
+  EXPECT_TRUE(std::isnan(approx::log<approx::fast>(std::nanf(""))));
+  EXPECT_NEAR(std::log(1e-40), approx::log<approx::precise>(1e-40f), 1e-5);
+
+  EXPECT_EQ(0.0f, approx::atan2<approx::precise>(0.0f, 0.0f));
+  EXPECT_NEAR(3.14159265f, approx::atan2<approx::precise>(0.0f, -1.0f), 1e-6f);
+  EXPECT_NEAR(-1.57079633f, approx::atan2<approx::precise>(-5.0f, 0.0f), 1e-6f);
+  EXPECT_NEAR(0.785398163f, approx::atan2<approx::precise>(inf, inf), 1e-6f);
+  EXPECT_NEAR(-2.35619449f, approx::atan2<approx::precise>(-inf, -inf), 1e-6f);
+  EXPECT_EQ(0.0f, approx::atan2<approx::precise>(1.0f, inf));
+  EXPECT_TRUE(std::isnan(approx::atan2<approx::fast>(std::nanf(""), 1.0f)));
+  EXPECT_TRUE(std::isnan(approx::atan2<approx::fast>(1.0f, std::nanf(""))));
+  EXPECT_TRUE(std::isnan(approx::atan2<approx::fast>(std::nanf(""), inf)));
+
+  EXPECT_EQ(0.5f, approx::rsqrt<approx::precise>(4.0f));
+  EXPECT_NEAR(0.5f, approx::rsqrt<approx::fast>(4.0f), 0.5f / 256.0f);
+}
+
+TEST(approx_math, vectors_and_arrays) {
+  const vec3 v = make_vec(0.5f, -2.0f, 3.0f);
+  const vec3 s = approx::sin<approx::medium>(v), c = approx::cos<approx::medium>(v);
+  const vec3 e = approx::exp<approx::medium>(v), r = approx::rsqrt<approx::medium>(v * v);
+  const vec3 a = approx::atan2<approx::medium>(v, make_vec(1.0f, 1.0f, -1.0f));
+  for (std::size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(approx::sin<approx::medium>(v[i]), s[i]);
+    EXPECT_EQ(approx::cos<approx::medium>(v[i]), c[i]);
+    EXPECT_EQ(approx::exp<approx::medium>(v[i]), e[i]);
+    EXPECT_EQ(approx::rsqrt<approx::medium>(v[i] * v[i]), r[i]);
+  }
+  EXPECT_EQ(approx::atan2<approx::medium>(3.0f, -1.0f), a[2]);
+  const vec<float, 6> l = approx::log<approx::precise>(make_vec<6>(2.0f));
+  EXPECT_EQ(approx::log<approx::precise>(2.0f), l[5]);
+
+  // every length of tail
+  for (std::size_t n = 0; n < 10; ++n) {
+    std::vector<float> in(n), out(n), sn(n), cs(n);
+    for (std::size_t i = 0; i < n; ++i)
+      in[i] = float(i) * 0.7f - 3.0f;
+    approx::sin_n<approx::precise>(in, out);
+    approx::sincos_n<approx::precise>(in, sn, cs);
+    for (std::size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(approx::sin<approx::precise>(in[i]), out[i]);
+      EXPECT_EQ(out[i], sn[i]);
+      EXPECT_EQ(approx::cos<approx::precise>(in[i]), cs[i]);
+    }
+
+    approx::atan2_n<approx::fast>(in, out, out);
+    approx::exp_n<approx::fast>(cs, cs);
+    for (std::size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(approx::atan2<approx::fast>(in[i], sn[i]), out[i]);
+      EXPECT_EQ(approx::exp<approx::fast>(approx::cos<approx::precise>(in[i])), cs[i]);
+    }
+  }
+
+  std::vector<vec3> points(7, v), ex(7), sin3(7), cos3(7);
+  approx::exp_n<approx::fast>(span<const vec3>(points), span<vec3>(ex));
+  approx::sincos_n<approx::fast>(span<const vec3>(points), span<vec3>(sin3), span<vec3>(cos3));
+  approx::rsqrt_n<approx::fast>(span<const vec3>(ex), span<vec3>(ex));
+  for (std::size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(approx::rsqrt<approx::fast>(approx::exp<approx::fast>(v[i])), ex[6][i]);
+    EXPECT_EQ(approx::sin<approx::fast>(v[i]), sin3[6][i]);
+    EXPECT_EQ(approx::cos<approx::fast>(v[i]), cos3[6][i]);
+  }
+
+  const quatf q = approx::axis_angle<approx::precise>(make_vec(0.0f, 0.0f, 1.0f), 1.0f);
+  const quatf e_q = axis_angle(make_vec(0.0f, 0.0f, 1.0f), 1.0f);
+  for (std::size_t i = 0; i < 4; ++i)
+    EXPECT_NEAR(e_q.v[i], q.v[i], 1e-7f);
+}
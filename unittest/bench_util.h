@@ -0,0 +1,52 @@
+#ifndef P_BENCH_UTIL_H
+#define P_BENCH_UTIL_H
+
+#include "vector.h"
+#include "matrix.h"
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace bench {
+  // number of elements every benchmark iteration works on
+  const std::size_t count = 1024;
+
+  // small, non-zero components so division and integer types behave
+  template<typename T>
+  inline T value(std::size_t i, std::size_t c) {
+    return T(1 + (i * 7 + c * 3) % 13);
+  }
+
+  template<typename T, std::size_t N>
+  inline void fill(p::vec<T, N> &v, std::size_t i) {
+    for (std::size_t c = 0; c < N; ++c)
+      v[c] = value<T>(i, c);
+  }
+
+  template<typename T, std::size_t M, std::size_t N>
+  inline void fill(p::mat<T, M, N> &m, std::size_t i) {
+    for (std::size_t c = 0; c < M*N; ++c)
+      m.components[c] = value<T>(i, c) / T(8);
+  }
+
+  template<typename V>
+  inline std::vector<V> make_array(std::size_t salt = 0) {
+    std::vector<V> arr(count);
+    for (std::size_t i = 0; i < count; ++i)
+      fill(arr[i], i + salt);
+    return arr;
+  }
+
+  /**
+   * Reports elements/sec (items_per_second) and the time per element.
+   */
+  inline void set_counters(benchmark::State &state, std::size_t per_iteration = count) {
+    state.SetItemsProcessed(state.iterations() * per_iteration);
+    state.counters["time/op"] = benchmark::Counter(
+      double(per_iteration),
+      benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+  }
+}
+
+#endif // !P_BENCH_UTIL_H
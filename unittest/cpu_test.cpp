@@ -0,0 +1,136 @@
+#include "cpu.h"
+#include "vector_batch.h"
+#include "vector_packed.h"
+#include "vector.h"
+#include "matrix.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace p;
+
+namespace {
+  /**
+   * Puts the level found at start back when a test is done.
+   */
+  struct isa_guard {
+    isa_guard() : saved(active_isa()) {}
+    ~isa_guard() {force_isa(saved); }
+    isa saved;
+  };
+
+  struct batch_results {
+    std::vector<vec3> n3, t3;
+    std::vector<vec4> n4, t4;
+    std::vector<float> d3, d4, unpacked;
+    std::vector<vec<half, 3> > packed;
+    vec3 s3;
+    vec4 s4;
+    aabb<float, 3> b3;
+    aabb<float, 4> b4;
+  };
+
+  batch_results run_kernels(std::size_t n) {
+    std::vector<vec3> v3(n), w3(n);
+    std::vector<vec4> v4(n), w4(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      const float f = float(i % 53) - 26.0f;
+      v3[i] = make_vec(f, 0.5f * f + 1.0f, 3.0f - f);
+      w3[i] = make_vec(1.0f, -f, 0.125f * f);
+      v4[i] = make_vec(f, 2.0f, -0.25f * f, 1.0f + 0.01f * f);
+      w4[i] = make_vec(-f, 1.0f, f * f, 0.5f);
+    }
+    mat4 m;
+    for (std::size_t c = 0; c < 16; ++c)
+      m.components[c] = float(c % 5) - 1.5f;
+
+    batch_results r;
+    r.n3.resize(n); r.n4.resize(n); r.t3.resize(n); r.t4.resize(n);
+    r.d3.resize(n); r.d4.resize(n);
+    normalize_n(span<const vec3>(v3), span<vec3>(r.n3));
+    normalize_n(span<const vec4>(v4), span<vec4>(r.n4));
+    dot_product_n(span<const vec3>(v3), span<const vec3>(w3), span<float>(r.d3));
+    dot_product_n(span<const vec4>(v4), span<const vec4>(w4), span<float>(r.d4));
+    transform_points(m, span<const vec3>(v3), span<vec3>(r.t3));
+    transform_points(m, span<const vec4>(v4), span<vec4>(r.t4));
+    r.s3 = sum(span<const vec3>(v3));
+    r.s4 = sum(span<const vec4>(v4));
+    r.b3 = bounding_box(span<const vec3>(v3));
+    r.b4 = bounding_box(span<const vec4>(v4));
+
+    r.packed.resize(n);
+    r.unpacked.resize(3 * n);
+    pack_n(span<const vec3>(r.n3), span<vec<half, 3> >(r.packed));
+    unpack_n(span<const half>(reinterpret_cast<const half *>(r.packed.data()), 3 * n), span<float>(r.unpacked));
+    return r;
+  }
+
+  template<typename V>
+  void expect_near(const V &e, const V &a, float tolerance, std::size_t i) {
+    for (std::size_t c = 0; c < V::size; ++c)
+      EXPECT_NEAR(e[c], a[c], (std::abs(e[c]) + 1.0f) * tolerance) << i << " " << c;
+  }
+}
+
+TEST(cpu, levels) {
+  isa_guard guard;
+  EXPECT_LE(compiled_isa(), detected_isa());
+  EXPECT_LE(active_isa(), detected_isa());
+  EXPECT_GE(active_isa(), compiled_isa());
+  EXPECT_STREQ("sse2", isa_name(isa_sse2));
+  EXPECT_STREQ("avx512", isa_name(isa_avx512));
+
+  // clamped to what the build and the CPU can run
+  EXPECT_EQ(compiled_isa(), force_isa(isa_scalar));
+  EXPECT_EQ(compiled_isa(), active_isa());
+  EXPECT_EQ(detected_isa(), force_isa(isa_avx512));
+  EXPECT_EQ(detected_isa(), active_isa());
+#if defined(P_NO_SIMD)
+  EXPECT_EQ(isa_scalar, detected_isa());
+#endif
+}
+
+TEST(cpu, kernels_agree) {
+  isa_guard guard;
+  // every group width, a tail, and several parallel chunks for the
+  // reductions and transforms
+  const std::size_t n = 40013;
+  force_isa(compiled_isa());
+  const batch_results base = run_kernels(n);
+
+  for (int level = compiled_isa() + 1; level <= detected_isa(); ++level) {
+    if (force_isa(isa(level)) != isa(level))
+      continue;
+    const batch_results r = run_kernels(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      expect_near(base.n3[i], r.n3[i], 1e-6f, i);
+      expect_near(base.n4[i], r.n4[i], 1e-6f, i);
+      expect_near(base.t3[i], r.t3[i], 1e-6f, i);
+      expect_near(base.t4[i], r.t4[i], 1e-6f, i);
+      EXPECT_NEAR(base.d3[i], r.d3[i], (std::abs(base.d3[i]) + 1.0f) * 1e-6f) << i;
+      EXPECT_NEAR(base.d4[i], r.d4[i], (std::abs(base.d4[i]) + 1.0f) * 1e-6f) << i;
+    }
+    expect_near(base.s3, r.s3, 1e-6f, 0);
+    expect_near(base.s4, r.s4, 1e-6f, 0);
+    for (std::size_t c = 0; c < 3; ++c) {
+      EXPECT_EQ(base.b3.min[c], r.b3.min[c]);
+      EXPECT_EQ(base.b3.max[c], r.b3.max[c]);
+    }
+    for (std::size_t c = 0; c < 4; ++c) {
+      EXPECT_EQ(base.b4.min[c], r.b4.min[c]);
+      EXPECT_EQ(base.b4.max[c], r.b4.max[c]);
+    }
+
+    // half conversions are exact at every level, on the same input
+    std::vector<vec<half, 3> > packed(n);
+    pack_n(span<const vec3>(base.n3), span<vec<half, 3> >(packed));
+    std::vector<float> unpacked(3 * n);
+    unpack_n(span<const half>(reinterpret_cast<const half *>(base.packed.data()), 3 * n), span<float>(unpacked));
+    EXPECT_EQ(0, std::memcmp(&packed[0], &base.packed[0], n * sizeof(packed[0])));
+    EXPECT_EQ(base.unpacked, unpacked);
+  }
+}
@@ -0,0 +1,157 @@
+#include "instrument.h"
+#include "vector.h"
+#include "vector_stream.h"
+#include "vector_loader.h"
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace p;
+
+#if defined(P_INSTRUMENT)
+
+namespace {
+  std::uint64_t counted(const char *scope, instrument::op_kind kind,
+                        const char *type, std::size_t size) {
+    const std::vector<instrument::op_count> counts = instrument::snapshot();
+    for (std::size_t i = 0; i < counts.size(); ++i)
+      if (!std::strcmp(counts[i].scope, scope) && counts[i].kind == kind &&
+          !std::strcmp(counts[i].type, type) && counts[i].size == size)
+        return counts[i].count;
+    return 0;
+  }
+}
+
+TEST(instrument, vector_ops) {
+  instrument::reset();
+  {
+    P_INSTRUMENT_SCOPE("test.ops");
+    volatile float s = 2.0f;
+    const vec3 a = make_vec(1.0f, 2.0f, 3.0f), b = make_vec<3>(float(s));
+    const vec3 c = a + b;
+    const vec3 n = normalize(c);
+    const float d = dot_product(make_vec(1.0f, 2.0f, 3.0f, 4.0f), make_vec<4>(float(s)));
+    const ivec2 i = make_vec(1, 2) * 3;
+    EXPECT_FLOAT_EQ(1.0f, magnitude(n));
+    EXPECT_FLOAT_EQ(20.0f, d);
+    EXPECT_EQ(6, i[1]);
+  }
+
+  // +, normalize's /, and magnitude's sqrt twice
+  EXPECT_EQ(2u, counted("test.ops", instrument::op_transform, "float", 3));
+  EXPECT_EQ(1u, counted("test.ops", instrument::op_splat, "float", 3));
+  EXPECT_EQ(1u, counted("test.ops", instrument::op_splat, "float", 4));
+  EXPECT_EQ(3u, counted("test.ops", instrument::op_div, "float", 3));
+  EXPECT_EQ(2u, counted("test.ops", instrument::op_sqrt, "float", 3));
+  EXPECT_EQ(3u + 5u + 5u, counted("test.ops", instrument::op_flop, "float", 3));
+  EXPECT_EQ(7u, counted("test.ops", instrument::op_flop, "float", 4));
+  EXPECT_EQ(2u, counted("test.ops", instrument::op_flop, "int", 2));
+  EXPECT_EQ(1u, counted("test.ops", instrument::op_temporary, "int", 2));
+
+  instrument::reset();
+  EXPECT_EQ(0u, instrument::total(instrument::op_flop));
+}
+
+TEST(instrument, scopes_and_threads) {
+  instrument::reset();
+  std::thread worker([] {
+    P_INSTRUMENT_SCOPE("test.worker");
+    vec4 v = make_vec(1.0f, 1.0f, 1.0f, 1.0f);
+    for (int i = 0; i < 100; ++i)
+      v = v * 0.5f;
+    {
+      P_INSTRUMENT_SCOPE("test.inner");
+      v = -v;
+    }
+    v = v + v;
+    EXPECT_GT(v[0], -1.0f);
+  });
+  worker.join();
+
+  // the thread is gone, its counts aren't
+  EXPECT_EQ(101u, counted("test.worker", instrument::op_transform, "float", 4));
+  EXPECT_EQ(4u, counted("test.inner", instrument::op_flop, "float", 4));
+  EXPECT_EQ(0u, counted("", instrument::op_transform, "float", 4));
+
+  std::ostringstream out;
+  instrument::report(out);
+  EXPECT_NE(std::string::npos, out.str().find("test.worker transform vec<float, 4> 101\n"));
+  EXPECT_EQ(0u, out.str().find("test.worker "));
+}
+
+TEST(instrument, parse) {
+  instrument::reset();
+  {
+    P_INSTRUMENT_SCOPE("test.parse");
+    const char text[] = "1 2 3 4 5 6 7";
+    vec3 points[4];
+    const parse_result r = parse_vectors(text, text + sizeof(text) - 1, span<vec3>(points));
+    EXPECT_EQ(2u, r.count);
+
+    std::istringstream in("1 2 3");
+    in >> points[0];
+    // failed reads count nothing
+    std::istringstream bad("one 2 3");
+    EXPECT_FALSE(bad >> points[1]);
+  }
+  EXPECT_EQ(3u, counted("test.parse", instrument::op_parse, "float", 3));
+
+  // one per color, whichever way it is read
+  const auto read_color = [](const char *text) {
+    vec3 color;
+    std::istringstream in(text);
+    return bool(in >> color_reader(color));
+  };
+  {
+    P_INSTRUMENT_SCOPE("test.color.numbers");
+    EXPECT_TRUE(read_color("1 0.5 0.25"));
+  }
+  {
+    P_INSTRUMENT_SCOPE("test.color.hex");
+    EXPECT_TRUE(read_color("0xFF8000"));
+  }
+  {
+    P_INSTRUMENT_SCOPE("test.color.keyword");
+    EXPECT_TRUE(read_color("red"));
+  }
+  {
+    P_INSTRUMENT_SCOPE("test.color.invalid");
+    EXPECT_FALSE(read_color("blue"));
+  }
+  EXPECT_EQ(1u, counted("test.color.numbers", instrument::op_parse, "float", 3));
+  EXPECT_EQ(1u, counted("test.color.hex", instrument::op_parse, "float", 3));
+  EXPECT_EQ(1u, counted("test.color.keyword", instrument::op_parse, "float", 3));
+  EXPECT_EQ(0u, counted("test.color.invalid", instrument::op_parse, "float", 3));
+}
+
+TEST(instrument, loader) {
+  // chunks parsed on the workers count in the scope of the caller
+  std::string text;
+  for (int i = 0; i < 2000; ++i)
+    text += "1 2 3\n";
+  instrument::reset();
+  thread_pool pool(3);
+  {
+    P_INSTRUMENT_SCOPE("test.loader");
+    std::istringstream in(text);
+    vector_loader<float, 3> loader(in, load_as_vectors, pool, 64);
+    for (span<const vec3> batch; loader.next(batch); ) {}
+    EXPECT_EQ(2000u, loader.result().count);
+  }
+  EXPECT_EQ(2000u, counted("test.loader", instrument::op_parse, "float", 3));
+  EXPECT_EQ(0u, counted("", instrument::op_parse, "float", 3));
+}
+
+#else
+
+TEST(instrument, disabled) {
+  // the hooks compile to nothing
+  P_INSTRUMENT_SCOPE("test.disabled");
+  P_INSTRUMENT_COUNT(op_flop, float, 3, 1);
+  EXPECT_FLOAT_EQ(3.0f, (make_vec(1.0f, 2.0f) + make_vec<2>(1.0f))[1]);
+}
+
+#endif
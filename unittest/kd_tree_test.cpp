@@ -0,0 +1,135 @@
+#include "kd_tree.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace p;
+
+namespace {
+  std::vector<vec3> make_points(std::size_t n, std::uint32_t seed) {
+    std::vector<vec3> v(n);
+    for (std::size_t i = 0; i < n; ++i)
+      for (std::size_t c = 0; c < 3; ++c) {
+        seed = seed * 1664525u + 1013904223u;
+        // a coarse grid, so that there are ties and duplicates
+        v[i][c] = float(seed >> 24) / 16.0f;
+      }
+    return v;
+  }
+
+  std::vector<kd_neighbor> brute_force(const std::vector<vec3> &points,
+                                       const vec3 &q, std::size_t k) {
+    std::vector<kd_neighbor> all(points.size());
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      all[i].index = std::uint32_t(i);
+      all[i].distance2 = detail::kd_distance2(q, points[i]);
+    }
+    std::sort(all.begin(), all.end(), detail::kd_closer);
+    all.resize(std::min(k, all.size()));
+    return all;
+  }
+}
+
+TEST(kd_tree, nearest_k) {
+  const std::vector<vec3> points = make_points(2000, 1);
+  const std::vector<vec3> queries = make_points(100, 2);
+  const kd_tree tree((span<const vec3>(points)));
+  EXPECT_EQ(points.size(), tree.size());
+
+  for (std::size_t k = 1; k <= 20; k += 19) {
+    std::vector<kd_neighbor> n(k);
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+      EXPECT_EQ(k, tree.nearest_k(queries[i], span<kd_neighbor>(n)));
+      const std::vector<kd_neighbor> expected = brute_force(points, queries[i], k);
+      for (std::size_t j = 0; j < k; ++j) {
+        EXPECT_EQ(expected[j].index, n[j].index) << i << " " << j;
+        EXPECT_EQ(expected[j].distance2, n[j].distance2) << i << " " << j;
+      }
+    }
+  }
+
+  // a point of the set finds itself, or a duplicate with a lower index
+  const kd_neighbor self = tree.nearest(points[77]);
+  EXPECT_EQ(0.0f, self.distance2);
+  EXPECT_LE(self.index, 77u);
+}
+
+TEST(kd_tree, small) {
+  kd_tree empty;
+  kd_neighbor n[3];
+  EXPECT_EQ(0u, empty.nearest_k(make_vec(0.0f, 0.0f, 0.0f), span<kd_neighbor>(n)));
+  EXPECT_EQ(std::uint32_t(kd_tree::npos), n[0].index);
+
+  const vec3 two[2] = {{{1.0f, 0.0f, 0.0f}}, {{0.0f, 2.0f, 0.0f}}};
+  const kd_tree tree((span<const vec3>(two)));
+  EXPECT_EQ(2u, tree.nearest_k(make_vec(0.0f, 0.0f, 0.0f), span<kd_neighbor>(n)));
+  EXPECT_EQ(0u, n[0].index);
+  EXPECT_EQ(1u, n[1].index);
+  EXPECT_FLOAT_EQ(4.0f, n[1].distance2);
+  EXPECT_EQ(std::uint32_t(kd_tree::npos), n[2].index);
+}
+
+TEST(kd_tree, radius_and_box) {
+  const std::vector<vec3> points = make_points(3000, 3);
+  const std::vector<vec3> queries = make_points(50, 4);
+  const kd_tree tree((span<const vec3>(points)));
+
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    const float r = 0.5f + float(i) / 10.0f;
+    std::vector<std::uint32_t> found;
+    tree.within_radius(queries[i], r, found);
+    std::sort(found.begin(), found.end());
+
+    std::vector<std::uint32_t> expected;
+    for (std::size_t j = 0; j < points.size(); ++j)
+      if (detail::kd_distance2(queries[i], points[j]) <= r * r)
+        expected.push_back(std::uint32_t(j));
+    EXPECT_EQ(expected, found) << i;
+
+    const aabb<float, 3> box = {queries[i] - make_vec<3>(r), queries[i] + make_vec<3>(r)};
+    found.clear();
+    tree.within_box(box, found);
+    std::sort(found.begin(), found.end());
+
+    expected.clear();
+    for (std::size_t j = 0; j < points.size(); ++j)
+      if (points[j].x >= box.min.x && points[j].x <= box.max.x &&
+          points[j].y >= box.min.y && points[j].y <= box.max.y &&
+          points[j].z >= box.min.z && points[j].z <= box.max.z)
+        expected.push_back(std::uint32_t(j));
+    EXPECT_EQ(expected, found) << i;
+  }
+}
+
+TEST(kd_tree, batch) {
+  const std::vector<vec3> points = make_points(5000, 5);
+  const std::vector<vec3> queries = make_points(1000, 6);
+  thread_pool serial(0), pool(3);
+  const kd_tree a(span<const vec3>(points), serial), b(span<const vec3>(points), pool);
+
+  const std::size_t k = 4;
+  std::vector<kd_neighbor> na(queries.size() * k), nb(queries.size() * k);
+  a.nearest_k_n(span<const vec3>(queries), k, span<kd_neighbor>(na), serial);
+  b.nearest_k_n(span<const vec3>(queries), k, span<kd_neighbor>(nb), pool);
+  std::vector<kd_neighbor> one(queries.size());
+  b.nearest_n(span<const vec3>(queries), span<kd_neighbor>(one), pool);
+
+  std::vector<std::size_t> counts(queries.size());
+  b.count_within_n(span<const vec3>(queries), 1.0f, span<std::size_t>(counts), pool);
+
+  kd_neighbor n[k];
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    a.nearest_k(queries[i], span<kd_neighbor>(n));
+    for (std::size_t j = 0; j < k; ++j) {
+      EXPECT_EQ(n[j].index, na[i*k + j].index);
+      EXPECT_EQ(n[j].index, nb[i*k + j].index);
+    }
+    EXPECT_EQ(n[0].index, one[i].index);
+
+    std::vector<std::uint32_t> found;
+    a.within_radius(queries[i], 1.0f, found);
+    EXPECT_EQ(found.size(), counts[i]);
+  }
+}
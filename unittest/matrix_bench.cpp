@@ -0,0 +1,268 @@
+#include "matrix.h"
+#include "matrix_solve.h"
+#include "vector.h"
+#include "vector_batch.h"
+#include "quaternion.h"
+#include "bench_util.h"
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace p;
+
+template<typename M> static void BM_mat_mul(benchmark::State &state) {
+  const std::vector<M> a = bench::make_array<M>(), b = bench::make_array<M>(5);
+  std::vector<M> out(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = a[i] * b[i];
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_mat_mul, mat3);
+BENCHMARK_TEMPLATE(BM_mat_mul, mat4);
+
+template<typename M, typename V> static void BM_mat_vec_mul(benchmark::State &state) {
+  M m;
+  bench::fill(m, 0);
+  const std::vector<V> v = bench::make_array<V>();
+  std::vector<V> out(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = m * v[i];
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_mat_vec_mul, mat3, vec3);
+BENCHMARK_TEMPLATE(BM_mat_vec_mul, mat4, vec4);
+
+static void BM_mat_chain(benchmark::State &state) {
+  const std::vector<mat4> a = bench::make_array<mat4>();
+  mat4 proj, view;
+  bench::fill(proj, 1);
+  bench::fill(view, 2);
+  std::vector<mat4> out(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = proj * view * a[i];
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_mat_chain);
+
+// rotation about z plus translation, so both inverses apply
+static std::vector<mat4> make_affine() {
+  std::vector<mat4> m(bench::count, mat4(0.0f));
+  for (std::size_t i = 0; i < bench::count; ++i) {
+    const float a = 0.01f * float(i);
+    m[i].components[0] = std::cos(a); m[i].components[1] = -std::sin(a);
+    m[i].components[4] = std::sin(a); m[i].components[5] = std::cos(a);
+    m[i].components[10] = 1.0f;
+    m[i].components[3] = float(i); m[i].components[11] = 2.0f;
+    m[i].components[15] = 1.0f;
+  }
+  return m;
+}
+
+static void BM_mat_inverse(benchmark::State &state) {
+  const std::vector<mat4> m = make_affine();
+  std::vector<mat4> out(bench::count);
+  for (auto _ : state) {
+    inverse_n(span<const mat4>(m), span<mat4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_mat_inverse);
+
+static void BM_mat_affine_inverse(benchmark::State &state) {
+  const std::vector<mat4> m = make_affine();
+  std::vector<mat4> out(bench::count);
+  for (auto _ : state) {
+    affine_inverse_n(span<const mat4>(m), span<mat4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_mat_affine_inverse);
+
+static void BM_mat_transpose(benchmark::State &state) {
+  const std::vector<mat4> m = bench::make_array<mat4>();
+  std::vector<mat4> out(bench::count);
+  for (auto _ : state) {
+    transpose_n(span<const mat4>(m), span<mat4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_mat_transpose);
+
+// large enough to be split over the shared pool; arg is the thread count
+template<typename V> static void BM_transform_points(benchmark::State &state) {
+  const std::size_t n = 1 << 20;
+  thread_pool pool(std::size_t(state.range(0)) - 1);
+  mat4 m;
+  bench::fill(m, 3);
+  std::vector<V> in(n), out(n);
+  for (std::size_t i = 0; i < n; ++i)
+    bench::fill(in[i], i);
+  for (auto _ : state) {
+    transform_points(m, span<const V>(in), span<V>(out), pool);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state, n);
+}
+BENCHMARK_TEMPLATE(BM_transform_points, vec3)->Arg(1)->Arg(4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_transform_points, vec4)->Arg(1)->Arg(4)->UseRealTime();
+
+// the per-element loop transform_points replaces
+static void BM_transform_points_loop(benchmark::State &state) {
+  const std::size_t n = 1 << 20;
+  mat4 m;
+  bench::fill(m, 3);
+  std::vector<vec4> in(n), out(n);
+  for (std::size_t i = 0; i < n; ++i)
+    bench::fill(in[i], i);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < n; ++i)
+      out[i] = m * in[i];
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state, n);
+}
+BENCHMARK(BM_transform_points_loop)->UseRealTime();
+
+static void make_keyframes(std::vector<quatf> &a, std::vector<quatf> &b,
+                           std::vector<float> &t) {
+  a.resize(bench::count);
+  b.resize(bench::count);
+  t.resize(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i) {
+    vec3 axis;
+    bench::fill(axis, i);
+    a[i] = axis_angle(normalize(axis), 0.01f * float(i % 97));
+    b[i] = axis_angle(normalize(axis), 1.5f - 0.01f * float(i % 89));
+    t[i] = float(i % 17) / 16.0f;
+  }
+}
+
+static void BM_slerp_n(benchmark::State &state) {
+  std::vector<quatf> a, b, out(bench::count);
+  std::vector<float> t;
+  make_keyframes(a, b, t);
+  for (auto _ : state) {
+    slerp_n(span<const quatf>(a), span<const quatf>(b), span<const float>(t), span<quatf>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_slerp_n);
+
+// the per-element loop slerp_n replaces
+static void BM_slerp_loop(benchmark::State &state) {
+  std::vector<quatf> a, b, out(bench::count);
+  std::vector<float> t;
+  make_keyframes(a, b, t);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = slerp(a[i], b[i], t[i]);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_slerp_loop);
+
+// symmetric and diagonally dominant, so both solvers apply
+template<std::size_t N> static std::vector<mat<float, N, N> > make_systems() {
+  std::vector<mat<float, N, N> > m = bench::make_array<mat<float, N, N> >();
+  for (std::size_t i = 0; i < m.size(); ++i)
+    for (std::size_t r = 0; r < N; ++r) {
+      for (std::size_t c = 0; c < r; ++c)
+        m[i].components[N*r + c] = m[i].components[N*c + r];
+      m[i].components[N*r + r] += float(2*N);
+    }
+  return m;
+}
+
+template<std::size_t N> static void BM_solve(benchmark::State &state) {
+  const std::vector<mat<float, N, N> > a = make_systems<N>();
+  const std::vector<vec<float, N> > b = bench::make_array<vec<float, N> >(3);
+  std::vector<vec<float, N> > x(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      solve(a[i], b[i], x[i]);
+    benchmark::DoNotOptimize(x.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_solve, 3);
+BENCHMARK_TEMPLATE(BM_solve, 4);
+
+template<std::size_t N> static void BM_solve_spd(benchmark::State &state) {
+  const std::vector<mat<float, N, N> > a = make_systems<N>();
+  const std::vector<vec<float, N> > b = bench::make_array<vec<float, N> >(3);
+  std::vector<vec<float, N> > x(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      solve_spd(a[i], b[i], x[i]);
+    benchmark::DoNotOptimize(x.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_solve_spd, 3);
+BENCHMARK_TEMPLATE(BM_solve_spd, 4);
+
+// one system per SIMD lane; arg 0 is solve, 1 solve_spd
+template<std::size_t N> static void BM_solve_soa(benchmark::State &state) {
+  const std::vector<mat<float, N, N> > m = make_systems<N>();
+  vec_soa<float, N*N> a(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i)
+    for (std::size_t c = 0; c < N*N; ++c)
+      a.component(c)[i] = m[i].components[c];
+  const std::vector<vec<float, N> > v = bench::make_array<vec<float, N> >(3);
+  const vec_soa<float, N> b(v.data(), v.size());
+  vec_soa<float, N> x(bench::count);
+  for (auto _ : state) {
+    if (state.range(0))
+      solve_spd(a, b, x);
+    else
+      solve(a, b, x);
+    benchmark::DoNotOptimize(x.component(0));
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_solve_soa, 3)->Arg(0)->Arg(1);
+BENCHMARK_TEMPLATE(BM_solve_soa, 4)->Arg(0)->Arg(1);
+
+// what solving with the existing API costs
+static void BM_solve_inverse(benchmark::State &state) {
+  const std::vector<mat4> a = make_systems<4>();
+  const std::vector<vec4> b = bench::make_array<vec4>(3);
+  std::vector<vec4> x(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      x[i] = inverse(a[i]) * b[i];
+    benchmark::DoNotOptimize(x.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_solve_inverse);
@@ -0,0 +1,199 @@
+#include "matrix_solve.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+
+using namespace p;
+
+namespace {
+  template<typename T, std::size_t N>
+  mat<T, N, N> make_mat(const T (&c)[N*N]) {
+    mat<T, N, N> m;
+    for (std::size_t i = 0; i < N*N; ++i)
+      m.components[i] = c[i];
+    return m;
+  }
+
+  template<typename T, std::size_t N>
+  vec<T, N> apply(const mat<T, N, N> &a, const vec<T, N> &x) {
+    vec<T, N> r;
+    for (std::size_t i = 0; i < N; ++i) {
+      r[i] = T();
+      for (std::size_t j = 0; j < N; ++j)
+        r[i] += a.components[N*i + j] * x[j];
+    }
+    return r;
+  }
+
+  template<typename T, std::size_t N>
+  mat<T, N, N> random_matrix(std::uint32_t &seed) {
+    mat<T, N, N> m;
+    for (std::size_t c = 0; c < N*N; ++c) {
+      seed = seed * 1664525u + 1013904223u;
+      m.components[c] = T(int(seed >> 20) - 2048) / T(512);
+    }
+    return m;
+  }
+
+  /**
+   * b * transpose(b) + identity, which is positive definite.
+   */
+  template<typename T, std::size_t N>
+  mat<T, N, N> random_spd(std::uint32_t &seed) {
+    const mat<T, N, N> b = random_matrix<T, N>(seed);
+    mat<T, N, N> m;
+    for (std::size_t i = 0; i < N; ++i)
+      for (std::size_t j = 0; j < N; ++j) {
+        T s = i == j ? T(1) : T();
+        for (std::size_t k = 0; k < N; ++k)
+          s += b.components[N*i + k] * b.components[N*j + k];
+        m.components[N*i + j] = s;
+      }
+    return m;
+  }
+}
+
+TEST(matrix_solve, lu) {
+  // needs a row exchange on the first step
+  const float c[] = {0.0f, 2.0f, 1.0f,
+                     1.0f, 1.0f, 1.0f,
+                     4.0f, 1.0f, 0.0f};
+  const mat3 a = make_mat<float, 3>(c);
+  const vec3 b = make_vec(5.0f, 4.0f, 6.0f);
+
+  lu_decomposition<float, 3> d;
+  ASSERT_TRUE(lu_decompose(a, d));
+  EXPECT_EQ(2, d.row[0]);
+  const vec3 x = lu_solve(d, b);
+  EXPECT_NEAR(1.0f, x[0], 1e-5f);
+  EXPECT_NEAR(2.0f, x[1], 1e-5f);
+  EXPECT_NEAR(1.0f, x[2], 1e-5f);
+
+  vec3 y;
+  EXPECT_TRUE(solve(a, b, y));
+  EXPECT_EQ(x[0], y[0]);
+  EXPECT_EQ(x[1], y[1]);
+  EXPECT_EQ(x[2], y[2]);
+
+  std::uint32_t seed = 1;
+  for (int t = 0; t < 100; ++t) {
+    const mat<double, 4, 4> m = random_matrix<double, 4>(seed);
+    const vec<double, 4> r = apply(m, make_vec(1.0, -2.0, 3.0, 0.5));
+    vec<double, 4> s;
+    ASSERT_TRUE(solve(m, r, s));
+    const vec<double, 4> back = apply(m, s);
+    for (std::size_t i = 0; i < 4; ++i)
+      EXPECT_NEAR(r[i], back[i], 1e-9) << t;
+  }
+}
+
+TEST(matrix_solve, singular) {
+  const float c[] = {1.0f, 2.0f, 3.0f,
+                     2.0f, 4.0f, 6.0f,
+                     0.0f, 1.0f, 1.0f};
+  const mat3 a = make_mat<float, 3>(c);
+  vec3 x = make_vec(7.0f, 7.0f, 7.0f);
+  EXPECT_FALSE(solve(a, make_vec(1.0f, 1.0f, 1.0f), x));
+  EXPECT_EQ(7.0f, x[0]);
+  EXPECT_FALSE(solve(mat3(0.0f), make_vec(1.0f, 1.0f, 1.0f), x));
+  EXPECT_FALSE(solve_spd(a, make_vec(1.0f, 1.0f, 1.0f), x));
+}
+
+TEST(matrix_solve, cholesky) {
+  std::uint32_t seed = 2;
+  for (int t = 0; t < 100; ++t) {
+    const mat<double, 4, 4> a = random_spd<double, 4>(seed);
+    mat<double, 4, 4> l;
+    ASSERT_TRUE(cholesky_decompose(a, l));
+    for (std::size_t i = 0; i < 4; ++i)
+      for (std::size_t j = 0; j < 4; ++j) {
+        double s = 0.0;
+        for (std::size_t k = 0; k < 4; ++k)
+          s += l.components[4*i + k] * l.components[4*j + k];
+        EXPECT_NEAR(a.components[4*i + j], s, 1e-9);
+        if (j > i) {
+          EXPECT_EQ(0.0, l.components[4*i + j]);
+        }
+      }
+
+    const vec<double, 4> b = make_vec(1.0, 2.0, 3.0, 4.0);
+    vec<double, 4> x, y;
+    ASSERT_TRUE(solve_spd(a, b, x));
+    ASSERT_TRUE(solve(a, b, y));
+    for (std::size_t i = 0; i < 4; ++i)
+      EXPECT_NEAR(y[i], x[i], 1e-9);
+  }
+
+  // symmetric but indefinite
+  const float c[] = {1.0f, 2.0f, 2.0f, 1.0f};
+  const mat<float, 2, 2> a = make_mat<float, 2>(c);
+  mat<float, 2, 2> l;
+  EXPECT_FALSE(cholesky_decompose(a, l));
+}
+
+TEST(matrix_solve, batch) {
+  const std::size_t n = 1003;
+  vec_soa<float, 16> a(n), spd(n);
+  vec_soa<float, 4> b(n), x, y;
+  vec_soa<double, 16> ad(n);
+  vec_soa<double, 4> bd(n), xd;
+
+  std::uint32_t seed = 3;
+  std::size_t singular = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    mat4 m = random_matrix<float, 4>(seed);
+    if (i % 97 == 5) {
+      m.row(2) = make_vec<4>(0.0f);
+      ++singular;
+    }
+    const mat4 s = random_spd<float, 4>(seed);
+    for (std::size_t c = 0; c < 16; ++c) {
+      a.component(c)[i] = m.components[c];
+      spd.component(c)[i] = s.components[c];
+      ad.component(c)[i] = m.components[c];
+    }
+    for (std::size_t c = 0; c < 4; ++c)
+      bd.component(c)[i] = b.component(c)[i] = float(c + i % 7) - 3.0f;
+  }
+
+  EXPECT_EQ(singular, solve(a, b, x));
+  EXPECT_EQ(0u, solve_spd(spd, b, y));
+  EXPECT_EQ(singular, solve(ad, bd, xd));
+  ASSERT_EQ(n, x.size());
+
+  for (std::size_t i = 0; i < n; ++i) {
+    mat4 m, s;
+    vec4 r, e;
+    for (std::size_t c = 0; c < 16; ++c) {
+      m.components[c] = a.component(c)[i];
+      s.components[c] = spd.component(c)[i];
+    }
+    for (std::size_t c = 0; c < 4; ++c)
+      r[c] = b.component(c)[i];
+
+    // every lane gives the same bits as the single system code
+    if (solve(m, r, e))
+      for (std::size_t c = 0; c < 4; ++c) {
+        EXPECT_EQ(e[c], x.component(c)[i]) << i;
+        EXPECT_NEAR(e[c], xd.component(c)[i], 1e-2 * (1.0 + std::fabs(e[c]))) << i;
+      }
+    else
+      for (std::size_t c = 0; c < 4; ++c) {
+        EXPECT_TRUE(std::isnan(x.component(c)[i])) << i;
+        EXPECT_TRUE(std::isnan(xd.component(c)[i])) << i;
+      }
+
+    ASSERT_TRUE(solve_spd(s, r, e));
+    for (std::size_t c = 0; c < 4; ++c)
+      EXPECT_EQ(e[c], y.component(c)[i]) << i;
+  }
+
+  // in place
+  solve(a, b, b);
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t c = 0; c < 4; ++c)
+      if (!std::isnan(x.component(c)[i])) {
+        EXPECT_EQ(x.component(c)[i], b.component(c)[i]);
+      }
+}
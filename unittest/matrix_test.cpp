@@ -2,6 +2,9 @@
 #include "vector.h"
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+
 TEST(matrix, ctor) {
   {
 	p::mat<float, 1, 1> m(0.0f);
@@ -49,3 +52,238 @@ TEST(matrix, access) {
 }
 
   
+namespace {
+  template<typename T, std::size_t C, std::size_t K, std::size_t R>
+  p::mat<T, C, R> naive_mul(const p::mat<T, K, R> &a, const p::mat<T, C, K> &b) {
+    p::mat<T, C, R> r(T(0));
+    for (std::size_t i = 0; i < R; ++i)
+      for (std::size_t j = 0; j < C; ++j)
+        for (std::size_t k = 0; k < K; ++k)
+          r.components[i*C + j] += a.components[i*K + k] * b.components[k*C + j];
+    return r;
+  }
+
+  template<typename T, std::size_t M, std::size_t N>
+  void fill_sequence(p::mat<T, M, N> &m, T start) {
+    for (std::size_t i = 0; i < M*N; ++i)
+      m.components[i] = start + T(i % 7) - T(i % 3) * T(2);
+  }
+}
+
+TEST(matrix, mul_mat4) {
+  p::mat4 a, b;
+  fill_sequence(a, 1.0f);
+  fill_sequence(b, -2.0f);
+
+  const p::mat4 r = a * b;
+  const p::mat4 expected = naive_mul(a, b);
+  for (std::size_t i = 0; i < 16; ++i)
+    EXPECT_FLOAT_EQ(expected.components[i], r.components[i]);
+
+  const p::mat4 chain = a * b * a;
+  const p::mat4 expected_chain = naive_mul(expected, a);
+  for (std::size_t i = 0; i < 16; ++i)
+    EXPECT_FLOAT_EQ(expected_chain.components[i], chain.components[i]);
+}
+
+TEST(matrix, mul_mat3) {
+  p::mat3 a, b;
+  fill_sequence(a, 0.5f);
+  fill_sequence(b, 3.0f);
+
+  const p::mat3 r = a * b;
+  const p::mat3 expected = naive_mul(a, b);
+  for (std::size_t i = 0; i < 9; ++i)
+    EXPECT_FLOAT_EQ(expected.components[i], r.components[i]);
+}
+
+TEST(matrix, mul_generic) {
+  // 3 columns, 2 rows times 2 columns, 3 rows
+  p::mat<int, 3, 2> a;
+  p::mat<int, 2, 3> b;
+  fill_sequence(a, 1);
+  fill_sequence(b, 4);
+
+  const p::mat<int, 2, 2> r = a * b;
+  const p::mat<int, 2, 2> expected = naive_mul(a, b);
+  for (std::size_t i = 0; i < 4; ++i)
+    EXPECT_EQ(expected.components[i], r.components[i]);
+
+  // larger than a block
+  p::mat<double, 40, 36> c;
+  p::mat<double, 33, 40> d;
+  fill_sequence(c, 0.25);
+  fill_sequence(d, -1.0);
+
+  const p::mat<double, 33, 36> big = c * d;
+  const p::mat<double, 33, 36> expected_big = naive_mul(c, d);
+  for (std::size_t i = 0; i < 33*36; ++i)
+    EXPECT_DOUBLE_EQ(expected_big.components[i], big.components[i]);
+}
+
+TEST(matrix, mul_vec) {
+  p::mat4 m;
+  fill_sequence(m, 1.0f);
+  const p::vec4 v = {1.0f, -2.0f, 0.5f, 3.0f};
+
+  const p::vec4 r = m * v;
+  for (std::size_t i = 0; i < 4; ++i)
+    EXPECT_FLOAT_EQ(dot_product(m.row(i), v), r[i]);
+
+  p::mat3 m3;
+  fill_sequence(m3, 2.0f);
+  const p::vec3 v3 = {0.5f, 4.0f, -1.0f};
+
+  const p::vec3 r3 = m3 * v3;
+  for (std::size_t i = 0; i < 3; ++i)
+    EXPECT_FLOAT_EQ(dot_product(m3.row(i), v3), r3[i]);
+
+  p::mat<float, 3, 2> m32;
+  fill_sequence(m32, 1.0f);
+  const p::vec2 r2 = m32 * v3;
+  EXPECT_FLOAT_EQ(dot_product(m32.row(0), v3), r2.x);
+  EXPECT_FLOAT_EQ(dot_product(m32.row(1), v3), r2.y);
+}
+
+namespace {
+  template<typename T, std::size_t N>
+  void expect_identity(const p::mat<T, N, N> &m, T eps) {
+    for (std::size_t i = 0; i < N; ++i)
+      for (std::size_t j = 0; j < N; ++j)
+        EXPECT_NEAR(i == j ? T(1) : T(0), m.components[N*i + j], eps);
+  }
+
+  // rotation about z by a, uniform scale s, translation t
+  p::mat4 affine4(float a, float s, const p::vec3 &t) {
+    p::mat4 m(0.0f);
+    m.components[0] = s * std::cos(a); m.components[1] = -s * std::sin(a);
+    m.components[4] = s * std::sin(a); m.components[5] = s * std::cos(a);
+    m.components[10] = s;
+    m.components[3] = t.x; m.components[7] = t.y; m.components[11] = t.z;
+    m.components[15] = 1.0f;
+    return m;
+  }
+}
+
+TEST(matrix, transpose) {
+  p::mat4 m;
+  fill_sequence(m, 1.0f);
+  const p::mat4 t = transpose(m);
+  for (std::size_t i = 0; i < 4; ++i)
+    for (std::size_t j = 0; j < 4; ++j)
+      EXPECT_EQ(m.components[4*i + j], t.components[4*j + i]);
+
+  p::mat<int, 3, 2> r;
+  fill_sequence(r, 0);
+  const p::mat<int, 2, 3> rt = transpose(r);
+  for (std::size_t i = 0; i < 2; ++i)
+    for (std::size_t j = 0; j < 3; ++j)
+      EXPECT_EQ(r.components[3*i + j], rt.components[2*j + i]);
+}
+
+TEST(matrix, determinant) {
+  p::mat<double, 2, 2> m2;
+  m2.components[0] = 3.0; m2.components[1] = 1.0;
+  m2.components[2] = 4.0; m2.components[3] = 2.0;
+  EXPECT_DOUBLE_EQ(2.0, determinant(m2));
+
+  const float c3[9] = {2, 0, 1, 1, 3, 2, 1, 1, 2};
+  p::mat3 m3;
+  std::copy(c3, c3 + 9, m3.components);
+  EXPECT_FLOAT_EQ(6.0f, determinant(m3));
+
+  const float c4[16] = {1, 0, 2, -1, 3, 0, 0, 5, 2, 1, 4, -3, 1, 0, 5, 0};
+  p::mat4 m4;
+  std::copy(c4, c4 + 16, m4.components);
+  EXPECT_FLOAT_EQ(30.0f, determinant(m4));
+
+  p::mat<double, 4, 4> d4;
+  std::copy(c4, c4 + 16, d4.components);
+  EXPECT_DOUBLE_EQ(30.0, determinant(d4));
+
+  EXPECT_FLOAT_EQ(0.0f, determinant(p::mat4(1.0f)));
+}
+
+TEST(matrix, inverse) {
+  const float c4[16] = {1, 0, 2, -1, 3, 0, 0, 5, 2, 1, 4, -3, 1, 0, 5, 0};
+  p::mat4 m4;
+  std::copy(c4, c4 + 16, m4.components);
+  expect_identity(m4 * inverse(m4), 1e-5f);
+  expect_identity(inverse(m4) * m4, 1e-5f);
+
+  p::mat<double, 4, 4> d4;
+  std::copy(c4, c4 + 16, d4.components);
+  expect_identity(d4 * inverse(d4), 1e-12);
+
+  const p::mat4 a = affine4(0.3f, 2.0f, p::make_vec(1.0f, -2.0f, 3.0f));
+  const p::mat4 ai = inverse(a);
+  expect_identity(a * ai, 1e-5f);
+
+  const float c3[9] = {2, 0, 1, 1, 3, 2, 1, 1, 2};
+  p::mat3 m3;
+  std::copy(c3, c3 + 9, m3.components);
+  expect_identity(m3 * inverse(m3), 1e-5f);
+
+  p::mat<double, 3, 3> d3;
+  std::copy(c3, c3 + 9, d3.components);
+  expect_identity(d3 * inverse(d3), 1e-12);
+
+  p::mat<double, 2, 2> m2;
+  m2.components[0] = 3.0; m2.components[1] = 1.0;
+  m2.components[2] = 4.0; m2.components[3] = 2.0;
+  expect_identity(m2 * inverse(m2), 1e-12);
+}
+
+namespace {
+  constexpr p::mat4 scale_translate(float s, float x, float y, float z) {
+    p::mat4 m(0.0f);
+    m.components[0] = s; m.components[5] = s; m.components[10] = s;
+    m.components[3] = x; m.components[7] = y; m.components[11] = z;
+    m.components[15] = 1.0f;
+    return m;
+  }
+}
+
+TEST(matrix, constexpr_ops) {
+  constexpr p::mat4 a = scale_translate(2.0f, 1.0f, -2.0f, 4.0f);
+  constexpr p::mat4 b = scale_translate(0.5f, 0.0f, 1.0f, 0.0f);
+
+  constexpr p::mat4 ab = a * b;
+  static_assert(ab.components[0] == 1.0f && ab.components[7] == 0.0f, "mul");
+  static_assert(determinant(a) == 8.0f, "determinant");
+  static_assert(transpose(a).components[12] == 1.0f, "transpose");
+
+  constexpr p::mat4 ai = inverse(a);
+  static_assert(ai.components[0] == 0.5f && ai.components[11] == -2.0f, "inverse");
+  constexpr p::mat4 aa = affine_inverse(a);
+  static_assert(aa.components[3] == -0.5f && aa.components[7] == 1.0f, "affine_inverse");
+
+  constexpr p::vec4 v = a * p::make_vec(1.0f, 1.0f, 1.0f, 1.0f);
+  static_assert(v[0] == 3.0f && v[1] == 0.0f && v[2] == 6.0f && v[3] == 1.0f, "mul_vec");
+
+  // and the SIMD paths agree at run time
+  const p::mat4 rt = a;
+  const p::mat4 rti = inverse(rt);
+  for (std::size_t i = 0; i < 16; ++i)
+    EXPECT_FLOAT_EQ(ai.components[i], rti.components[i]);
+}
+
+TEST(matrix, affine_inverse) {
+  const p::mat4 a = affine4(1.1f, 0.5f, p::make_vec(4.0f, 0.5f, -7.0f));
+  const p::mat4 ai = affine_inverse(a);
+  const p::mat4 full = inverse(a);
+  for (std::size_t i = 0; i < 16; ++i)
+    EXPECT_NEAR(full.components[i], ai.components[i], 1e-5f);
+  expect_identity(a * ai, 1e-5f);
+
+  // 2D: rotation and translation in a mat3
+  p::mat<double, 3, 3> m(0.0);
+  m.components[0] = std::cos(0.7); m.components[1] = -std::sin(0.7);
+  m.components[3] = std::sin(0.7); m.components[4] = std::cos(0.7);
+  m.components[2] = 5.0; m.components[5] = -1.5; m.components[8] = 1.0;
+  expect_identity(m * affine_inverse(m), 1e-12);
+
+  p::mat3 f;
+  std::copy(m.components, m.components + 9, f.components);
+  expect_identity(f * affine_inverse(f), 1e-5f);
+}
@@ -0,0 +1,68 @@
+#include "parallel.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+using namespace p;
+
+TEST(parallel, covers_range) {
+  thread_pool pool(3);
+  EXPECT_EQ(4u, pool.size());
+
+  const std::size_t sizes[] = {0, 1, 99, 100, 101, 1000, 12345};
+  for (std::size_t s = 0; s < sizeof sizes / sizeof sizes[0]; ++s) {
+    const std::size_t n = sizes[s];
+    std::vector<int> hits(n, 0);
+    std::atomic<std::size_t> calls(0);
+    pool.parallel_for(n, 100, [&](std::size_t begin, std::size_t end) {
+      EXPECT_EQ(0u, begin % 100);
+      EXPECT_TRUE(end == n || end - begin == 100);
+      for (std::size_t i = begin; i < end; ++i)
+        ++hits[i];
+      ++calls;
+    });
+
+    EXPECT_EQ((n + 99) / 100, calls.load());
+    for (std::size_t i = 0; i < n; ++i)
+      EXPECT_EQ(1, hits[i]);
+  }
+}
+
+TEST(parallel, no_workers) {
+  thread_pool pool(0);
+  EXPECT_EQ(1u, pool.size());
+
+  std::size_t sum = 0;
+  pool.parallel_for(1000, 7, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i)
+      sum += i;
+  });
+  EXPECT_EQ(999u * 1000u / 2, sum);
+}
+
+TEST(parallel, nested) {
+  thread_pool pool(2);
+  std::vector<std::size_t> inner(64, 0);
+  pool.parallel_for(64, 4, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i)
+      pool.parallel_for(10, 3, [&](std::size_t b, std::size_t e) {
+        inner[i] += e - b;
+      });
+  });
+
+  for (std::size_t i = 0; i < inner.size(); ++i)
+    EXPECT_EQ(10u, inner[i]);
+}
+
+TEST(parallel, repeated) {
+  // many short jobs in a row, to shake out hand-over races
+  thread_pool pool(4);
+  std::atomic<std::size_t> total(0);
+  for (int r = 0; r < 2000; ++r)
+    pool.parallel_for(64, 8, [&](std::size_t begin, std::size_t end) {
+      total += end - begin;
+    });
+  EXPECT_EQ(2000u * 64u, total.load());
+}
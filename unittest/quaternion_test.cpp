@@ -0,0 +1,123 @@
+#include "quaternion.h"
+#include "matrix.h"
+#include "vector.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+
+using namespace p;
+
+namespace {
+  const float pi = 3.14159265358979f;
+
+  void expect_near(const vec3 &expected, const vec3 &actual, float eps) {
+    for (std::size_t i = 0; i < 3; ++i)
+      EXPECT_NEAR(expected[i], actual[i], eps) << "component " << i;
+  }
+
+  // q and -q are the same rotation
+  void expect_same_rotation(const quatf &expected, const quatf &actual, float eps) {
+    const float sign = dot_product(expected, actual) < 0.0f ? -1.0f : 1.0f;
+    for (std::size_t i = 0; i < 4; ++i)
+      EXPECT_NEAR(expected[i], sign * actual[i], eps) << "component " << i;
+  }
+}
+
+TEST(quaternion, ctor) {
+  const quatf q = make_quat(1.0f, 2.0f, 3.0f, 4.0f);
+  EXPECT_EQ(1.0f, q.v.x);
+  EXPECT_EQ(4.0f, q.v.w);
+  EXPECT_EQ(sizeof(vec4), sizeof(quatf));
+
+  const quatf id = identity_quat<float>();
+  expect_near(make_vec(1.0f, 2.0f, 3.0f), rotate(id, make_vec(1.0f, 2.0f, 3.0f)), 0.0f);
+}
+
+TEST(quaternion, rotate) {
+  const quatf z90 = axis_angle(make_vec(0.0f, 0.0f, 1.0f), pi / 2);
+  expect_near(make_vec(0.0f, 1.0f, 0.0f), rotate(z90, make_vec(1.0f, 0.0f, 0.0f)), 1e-6f);
+  expect_near(make_vec(-2.0f, 0.0f, 3.0f), rotate(z90, make_vec(0.0f, 2.0f, 3.0f)), 1e-6f);
+
+  const quatd x90 = axis_angle(make_vec(1.0, 0.0, 0.0), 3.14159265358979 / 2);
+  const vec<double, 3> r = rotate(x90, make_vec(0.0, 1.0, 0.0));
+  EXPECT_NEAR(0.0, r[1], 1e-12);
+  EXPECT_NEAR(1.0, r[2], 1e-12);
+}
+
+TEST(quaternion, mul) {
+  const quatf a = axis_angle(normalize(make_vec(1.0f, 2.0f, -0.5f)), 0.7f);
+  const quatf b = axis_angle(normalize(make_vec(-0.3f, 0.1f, 1.0f)), 2.1f);
+  const vec3 v = make_vec(0.5f, -1.0f, 2.0f);
+
+  // a * b rotates by b, then a
+  expect_near(rotate(a, rotate(b, v)), rotate(a * b, v), 1e-5f);
+
+  // the same as the generic code
+  const quat<double> ad = make_quat(double(a[0]), double(a[1]), double(a[2]), double(a[3]));
+  const quat<double> bd = make_quat(double(b[0]), double(b[1]), double(b[2]), double(b[3]));
+  const quat<double> abd = ad * bd;
+  const quatf ab = a * b;
+  for (std::size_t i = 0; i < 4; ++i)
+    EXPECT_NEAR(abd[i], ab[i], 1e-6);
+
+  expect_same_rotation(identity_quat<float>(), a * conjugate(a), 1e-6f);
+  const quatf s = make_quat(a.v * 3.0f);
+  expect_same_rotation(identity_quat<float>(), s * inverse(s), 1e-6f);
+  EXPECT_NEAR(3.0f, magnitude(s), 1e-5f);
+  EXPECT_NEAR(1.0f, magnitude(normalize(s)), 1e-6f);
+}
+
+TEST(quaternion, matrices) {
+  const quatf q = axis_angle(normalize(make_vec(1.0f, -2.0f, 0.5f)), 1.2f);
+  const vec3 v = make_vec(0.5f, -1.0f, 2.0f);
+
+  const mat3 m3 = to_mat3(q);
+  expect_near(rotate(q, v), m3 * v, 1e-5f);
+  expect_same_rotation(q, to_quat(m3), 1e-6f);
+
+  const mat4 m4 = to_mat4(q);
+  const vec4 r = m4 * make_vec(v.x, v.y, v.z, 1.0f);
+  expect_near(rotate(q, v), make_vec(r.x, r.y, r.z), 1e-5f);
+  EXPECT_FLOAT_EQ(1.0f, r.w);
+  expect_same_rotation(q, to_quat(m4), 1e-6f);
+
+  // every branch of to_quat: trace > 0, and each of x, y, z largest
+  const quatf rotations[4] = {
+    axis_angle(make_vec(0.0f, 0.0f, 1.0f), 0.3f),
+    axis_angle(make_vec(1.0f, 0.0f, 0.0f), 3.0f),
+    axis_angle(make_vec(0.0f, 1.0f, 0.0f), 3.0f),
+    axis_angle(make_vec(0.0f, 0.0f, 1.0f), 3.0f)
+  };
+  for (std::size_t i = 0; i < 4; ++i)
+    expect_same_rotation(rotations[i], to_quat(to_mat3(rotations[i])), 1e-6f);
+}
+
+TEST(quaternion, interpolation) {
+  const vec3 axis = normalize(make_vec(1.0f, 1.0f, 0.0f));
+  const quatf a = axis_angle(axis, 0.2f);
+  const quatf b = axis_angle(axis, 1.4f);
+
+  expect_same_rotation(a, slerp(a, b, 0.0f), 1e-6f);
+  expect_same_rotation(b, slerp(a, b, 1.0f), 1e-6f);
+  expect_same_rotation(axis_angle(axis, 0.5f), slerp(a, b, 0.25f), 1e-6f);
+  expect_same_rotation(axis_angle(axis, 0.8f), nlerp(a, b, 0.5f), 1e-6f);
+
+  // the shorter arc: -b is the same rotation as b
+  const quatf nb = make_quat(-b.v);
+  expect_same_rotation(axis_angle(axis, 0.5f), slerp(a, nb, 0.25f), 1e-6f);
+  expect_same_rotation(axis_angle(axis, 0.8f), nlerp(a, nb, 0.5f), 1e-6f);
+
+  // nearly equal rotations go through nlerp
+  const quatf c = axis_angle(axis, 0.2001f);
+  EXPECT_NEAR(1.0f, magnitude(slerp(a, c, 0.5f)), 1e-6f);
+}
+
+TEST(quaternion, constexpr_ops) {
+  constexpr quatf a = make_quat(0.0f, 0.0f, 1.0f, 0.0f); // 180 degrees around z
+  constexpr quatf aa = a * a;
+  static_assert(aa[3] == -1.0f, "mul");
+  static_assert(conjugate(a)[2] == -1.0f, "conjugate");
+  static_assert(rotate(a, make_vec(1.0f, 2.0f, 3.0f))[0] == -1.0f, "rotate");
+  static_assert(to_mat3(a).components[4] == -1.0f, "to_mat3");
+}
@@ -0,0 +1,201 @@
+#include "vector.h"
+#include "vector_stream.h"
+#include "vector_loader.h"
+#include "bench_util.h"
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace p;
+
+template<typename V> static void BM_stream_write(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  for (auto _ : state) {
+    std::ostringstream ss;
+    for (std::size_t i = 0; i < bench::count; ++i)
+      ss << a[i] << '\n';
+    benchmark::DoNotOptimize(ss.str().size());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_stream_write, vec3);
+BENCHMARK_TEMPLATE(BM_stream_write, vec4);
+BENCHMARK_TEMPLATE(BM_stream_write, ivec3);
+BENCHMARK_TEMPLATE(BM_stream_write, ubvec4);
+
+template<typename V> static void BM_stream_read(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  std::ostringstream text;
+  for (std::size_t i = 0; i < bench::count; ++i)
+    text << a[i] << '\n';
+  const std::string str = text.str();
+
+  std::vector<V> out(bench::count);
+  for (auto _ : state) {
+    std::istringstream ss(str);
+    for (std::size_t i = 0; i < bench::count; ++i)
+      ss >> out[i];
+    benchmark::DoNotOptimize(out.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_stream_read, vec3);
+BENCHMARK_TEMPLATE(BM_stream_read, vec4);
+BENCHMARK_TEMPLATE(BM_stream_read, ivec3);
+
+static void BM_stream_read_keyword(benchmark::State &state) {
+  std::string str;
+  for (std::size_t i = 0; i < bench::count; ++i)
+    str += "zero\n";
+
+  std::vector<vec3> out(bench::count);
+  for (auto _ : state) {
+    std::istringstream ss(str);
+    for (std::size_t i = 0; i < bench::count; ++i)
+      ss >> out[i];
+    benchmark::DoNotOptimize(out.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_stream_read_keyword);
+
+template<typename V> static void BM_color_read_hex(benchmark::State &state) {
+  std::string str;
+  for (std::size_t i = 0; i < bench::count; ++i)
+    str += "0xC00FFE\n";
+
+  std::vector<V> out(bench::count);
+  for (auto _ : state) {
+    std::istringstream ss(str);
+    for (std::size_t i = 0; i < bench::count; ++i)
+      ss >> color_reader(out[i]);
+    benchmark::DoNotOptimize(out.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_color_read_hex, vec3);
+BENCHMARK_TEMPLATE(BM_color_read_hex, ubvec3);
+
+template<typename V> static void BM_color_write_hex(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  for (auto _ : state) {
+    std::ostringstream ss;
+    ss << std::hex;
+    for (std::size_t i = 0; i < bench::count; ++i)
+      ss << a[i] << '\n';
+    benchmark::DoNotOptimize(ss.str().size());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_color_write_hex, ubvec4);
+
+template<typename V> static void BM_parse_vectors(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  std::ostringstream text;
+  for (std::size_t i = 0; i < bench::count; ++i)
+    text << a[i] << '\n';
+  const std::string str = text.str();
+
+  std::vector<V> out(bench::count);
+  for (auto _ : state) {
+    const parse_result r = parse_vectors(str.data(), str.data() + str.size(), span<V>(out));
+    benchmark::DoNotOptimize(r);
+    benchmark::DoNotOptimize(out.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_parse_vectors, vec3);
+BENCHMARK_TEMPLATE(BM_parse_vectors, vec4);
+BENCHMARK_TEMPLATE(BM_parse_vectors, ivec3);
+
+static void BM_parse_colors_hex(benchmark::State &state) {
+  std::string str;
+  for (std::size_t i = 0; i < bench::count; ++i)
+    str += "0xC00FFE\n";
+
+  std::vector<vec3> out(bench::count);
+  for (auto _ : state) {
+    const parse_result r = parse_colors(str.data(), str.data() + str.size(), span<vec3>(out));
+    benchmark::DoNotOptimize(r);
+    benchmark::DoNotOptimize(out.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_parse_colors_hex);
+
+template<typename V> static void BM_format_vectors(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  std::vector<char> buf(bench::count * 64);
+  for (auto _ : state) {
+    const format_result r = format_vectors(span<const V>(a), buf.data(), buf.data() + buf.size());
+    benchmark::DoNotOptimize(r);
+    benchmark::DoNotOptimize(buf.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_format_vectors, vec3);
+BENCHMARK_TEMPLATE(BM_format_vectors, vec4);
+BENCHMARK_TEMPLATE(BM_format_vectors, ivec3);
+BENCHMARK_TEMPLATE(BM_format_vectors, ubvec4);
+
+template<typename V> static void BM_format_colors(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  std::vector<char> buf(bench::count * 16);
+  for (auto _ : state) {
+    const format_result r = format_colors(span<const V>(a), buf.data(), buf.data() + buf.size());
+    benchmark::DoNotOptimize(r);
+    benchmark::DoNotOptimize(buf.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_format_colors, vec4);
+BENCHMARK_TEMPLATE(BM_format_colors, ubvec4);
+
+// a file's worth of lines, loaded in 64 KiB chunks; arg is the thread count
+static void BM_load_vectors(benchmark::State &state) {
+  const std::size_t lines = 64 * bench::count;
+  std::ostringstream text;
+  for (std::size_t i = 0; i < lines; ++i) {
+    vec3 v;
+    bench::fill(v, i);
+    text << v * 0.37f << '\n';
+  }
+  const std::string str = text.str();
+
+  thread_pool pool(std::size_t(state.range(0)) - 1);
+  for (auto _ : state) {
+    std::istringstream in(str);
+    vector_loader<float, 3> loader(in, load_as_vectors, pool, 1 << 16);
+    std::size_t n = 0;
+    for (span<const vec3> batch; loader.next(batch); )
+      n += batch.size();
+    benchmark::DoNotOptimize(n);
+  }
+  bench::set_counters(state, lines);
+}
+BENCHMARK(BM_load_vectors)->Arg(1)->Arg(4)->UseRealTime();
+
+// the same text through operator >>
+static void BM_load_stream(benchmark::State &state) {
+  const std::size_t lines = 64 * bench::count;
+  std::ostringstream text;
+  for (std::size_t i = 0; i < lines; ++i) {
+    vec3 v;
+    bench::fill(v, i);
+    text << v * 0.37f << '\n';
+  }
+  const std::string str = text.str();
+
+  for (auto _ : state) {
+    std::istringstream in(str);
+    std::size_t n = 0;
+    for (vec3 v; in >> v; )
+      ++n;
+    benchmark::DoNotOptimize(n);
+  }
+  bench::set_counters(state, lines);
+}
+BENCHMARK(BM_load_stream)->UseRealTime();
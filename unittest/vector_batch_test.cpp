@@ -0,0 +1,411 @@
+#include "vector_batch.h"
+#include "vector.h"
+#include "matrix.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace p;
+
+TEST(vector_batch, normalize_n) {
+  std::vector<vec3> v3;
+  std::vector<vec4> v4;
+  for (std::size_t i = 0; i < 11; ++i) {
+    const float f = float(i) - 5.0f;
+    v3.push_back(make_vec(f, 2.0f, 0.5f * f));
+    v4.push_back(make_vec(1.0f, f, -3.0f, f * f));
+  }
+
+  const std::vector<vec3> in3 = v3;
+  const std::vector<vec4> in4 = v4;
+  normalize_n(v3);
+  normalize_n(v4);
+
+  for (std::size_t i = 0; i < 11; ++i) {
+    const vec3 e3 = normalize(in3[i]);
+    for (std::size_t c = 0; c < 3; ++c)
+      EXPECT_NEAR(e3[c], v3[i][c], std::abs(e3[c]) * 9.6e-7f);
+
+    const vec4 e4 = normalize(in4[i]);
+    for (std::size_t c = 0; c < 4; ++c)
+      EXPECT_NEAR(e4[c], v4[i][c], std::abs(e4[c]) * 9.6e-7f);
+  }
+
+  // generic version, separate output
+  vec<double, 2> d[3] = {{{3.0, 4.0}}, {{0.0, 2.0}}, {{-1.0, 0.0}}};
+  vec<double, 2> out[3];
+  normalize_n(span<const vec<double, 2> >(d), span<vec<double, 2> >(out));
+  EXPECT_DOUBLE_EQ(0.6, out[0].x);
+  EXPECT_DOUBLE_EQ(0.8, out[0].y);
+  EXPECT_DOUBLE_EQ(1.0, out[1].y);
+  EXPECT_DOUBLE_EQ(-1.0, out[2].x);
+
+  normalize_n(span<vec3>());
+}
+
+TEST(vector_batch, dot_product_n) {
+  // enough for every kernel width, plus a tail
+  const std::size_t n = 37;
+  std::vector<vec3> a3(n), b3(n);
+  std::vector<vec4> a4(n), b4(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const float f = float(i) - 18.0f;
+    a3[i] = make_vec(f, 1.0f, -0.5f * f);
+    b3[i] = make_vec(2.0f, f * f, 3.0f);
+    a4[i] = make_vec(1.0f, f, 2.0f, -f);
+    b4[i] = make_vec(f, 0.25f, f * f, 4.0f);
+  }
+
+  std::vector<float> d3(n), d4(n);
+  dot_product_n(span<const vec3>(a3), span<const vec3>(b3), span<float>(d3));
+  dot_product_n(span<const vec4>(a4), span<const vec4>(b4), span<float>(d4));
+  for (std::size_t i = 0; i < n; ++i) {
+    const float e3 = dot_product(a3[i], b3[i]), e4 = dot_product(a4[i], b4[i]);
+    EXPECT_NEAR(e3, d3[i], std::abs(e3) * 1e-6f + 1e-6f) << i;
+    EXPECT_NEAR(e4, d4[i], std::abs(e4) * 1e-6f + 1e-6f) << i;
+  }
+
+  const ivec2 ia[2] = {{{1, 2}}, {{3, -4}}}, ib[2] = {{{5, 6}}, {{7, 8}}};
+  int id[2];
+  dot_product_n(span<const ivec2>(ia), span<const ivec2>(ib), span<int>(id));
+  EXPECT_EQ(17, id[0]);
+  EXPECT_EQ(-11, id[1]);
+}
+
+TEST(vector_batch, matrices) {
+  std::vector<mat4> m(5);
+  for (std::size_t i = 0; i < m.size(); ++i) {
+    m[i] = mat4(0.0f);
+    for (std::size_t j = 0; j < 4; ++j)
+      m[i].components[5*j] = float(i + j + 1);
+    m[i].components[3] = float(i);
+    m[i].components[1] = 0.5f;
+    m[i].components[15] = 1.0f;
+  }
+
+  std::vector<mat4> inv(m.size());
+  inverse_n(span<const mat4>(m), span<mat4>(inv));
+  std::vector<mat4> affine = m;
+  affine_inverse_n(span<mat4>(affine));
+  std::vector<mat4> t = m;
+  transpose_n(span<mat4>(t));
+
+  for (std::size_t i = 0; i < m.size(); ++i) {
+    const mat4 e = inverse(m[i]);
+    const mat4 et = transpose(m[i]);
+    for (std::size_t c = 0; c < 16; ++c) {
+      EXPECT_EQ(e.components[c], inv[i].components[c]);
+      EXPECT_NEAR(e.components[c], affine[i].components[c], 1e-6f);
+      EXPECT_EQ(et.components[c], t[i].components[c]);
+    }
+  }
+}
+
+TEST(vector_batch, transform_points) {
+  mat4 m(0.0f);
+  const float e[16] = {0.5f, -1.0f, 2.0f, 3.0f,
+                       1.5f, 0.25f, 0.0f, -4.0f,
+                       -2.0f, 1.0f, 1.0f, 0.5f,
+                       0.1f, 0.2f, 0.3f, 1.0f};
+  std::copy(e, e + 16, m.components);
+
+  // not a multiple of 4 or of the chunk size
+  const std::size_t n = 20011;
+  std::vector<vec3> p3(n);
+  std::vector<vec4> p4(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const float f = float(i % 101) - 50.0f;
+    p3[i] = make_vec(f, 0.25f * f, 3.0f - f);
+    p4[i] = make_vec(f, -f, 0.5f, 1.0f + 0.01f * f);
+  }
+
+  thread_pool serial(0), threaded(3);
+  std::vector<vec3> r3(n), t3(n);
+  std::vector<vec4> r4(n), t4(n);
+  transform_points(m, span<const vec3>(p3), span<vec3>(r3), serial);
+  transform_points(m, span<const vec3>(p3), span<vec3>(t3), threaded);
+  transform_points(m, span<const vec4>(p4), span<vec4>(r4), serial);
+  transform_points(m, span<const vec4>(p4), span<vec4>(t4), threaded);
+
+  for (std::size_t i = 0; i < n; ++i) {
+    const vec4 e3 = m * make_vec(p3[i].x, p3[i].y, p3[i].z, 1.0f);
+    const vec4 e4 = m * p4[i];
+    for (std::size_t c = 0; c < 3; ++c) {
+      EXPECT_NEAR(e3[c], r3[i][c], 1e-4f);
+      // bit identical whatever the thread count
+      EXPECT_EQ(r3[i][c], t3[i][c]);
+    }
+    for (std::size_t c = 0; c < 4; ++c) {
+      EXPECT_NEAR(e4[c], r4[i][c], 1e-4f);
+      EXPECT_EQ(r4[i][c], t4[i][c]);
+    }
+  }
+
+  // in place, on the shared pool
+  transform_points(m, span<vec3>(p3));
+  transform_points(m, span<vec4>(p4));
+  for (std::size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(r3[i].x, p3[i].x);
+    EXPECT_EQ(r3[i].z, p3[i].z);
+    EXPECT_EQ(r4[i].w, p4[i].w);
+  }
+}
+
+namespace {
+  template<typename V>
+  std::vector<V> make_cloud(std::size_t n) {
+    std::vector<V> v(n);
+    for (std::size_t i = 0; i < n; ++i)
+      for (std::size_t c = 0; c < V::size; ++c)
+        v[i][c] = float((i * 37 + c * 11) % 1009) * 0.125f - float(c * 20);
+    return v;
+  }
+}
+
+TEST(vector_batch, bounding_box) {
+  // several chunks and a tail that isn't a multiple of 4
+  const std::size_t n = 50003;
+  const std::vector<vec3> v3 = make_cloud<vec3>(n);
+  const std::vector<vec4> v4 = make_cloud<vec4>(n);
+
+  vec3 lo3 = v3[0], hi3 = v3[0];
+  vec4 lo4 = v4[0], hi4 = v4[0];
+  for (std::size_t i = 1; i < n; ++i) {
+    lo3 = min(lo3, v3[i]); hi3 = max(hi3, v3[i]);
+    lo4 = min(lo4, v4[i]); hi4 = max(hi4, v4[i]);
+  }
+
+  thread_pool pool(3);
+  const aabb<float, 3> b3 = bounding_box(v3, pool);
+  const aabb<float, 4> b4 = bounding_box(v4);
+  for (std::size_t c = 0; c < 3; ++c) {
+    EXPECT_EQ(lo3[c], b3.min[c]);
+    EXPECT_EQ(hi3[c], b3.max[c]);
+  }
+  for (std::size_t c = 0; c < 4; ++c) {
+    EXPECT_EQ(lo4[c], b4.min[c]);
+    EXPECT_EQ(hi4[c], b4.max[c]);
+  }
+
+  // a single point, and the generic version
+  const aabb<float, 3> one = bounding_box(span<const vec3>(&v3[7], 1));
+  EXPECT_EQ(v3[7].y, one.min.y);
+  EXPECT_EQ(v3[7].y, one.max.y);
+
+  std::vector<ivec2> iv(1000);
+  for (std::size_t i = 0; i < iv.size(); ++i)
+    iv[i] = make_vec(int(i % 17) - 3, int(i % 5) * 2);
+  const aabb<int, 2> bi = bounding_box(span<const ivec2>(iv), pool);
+  EXPECT_EQ(-3, bi.min.x); EXPECT_EQ(13, bi.max.x);
+  EXPECT_EQ(0, bi.min.y); EXPECT_EQ(8, bi.max.y);
+
+  const aabb<float, 3> empty = bounding_box(span<const vec3>());
+  EXPECT_GT(empty.min.x, empty.max.x);
+}
+
+TEST(vector_batch, sum_mean_reduce) {
+  const std::size_t n = 40001;
+  const std::vector<vec3> v3 = make_cloud<vec3>(n);
+  const std::vector<vec4> v4 = make_cloud<vec4>(n);
+
+  double e3[3] = {0, 0, 0}, e4[4] = {0, 0, 0, 0};
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t c = 0; c < 3; ++c) e3[c] += v3[i][c];
+    for (std::size_t c = 0; c < 4; ++c) e4[c] += v4[i][c];
+  }
+
+  thread_pool serial(0), threaded(3);
+  const vec3 s3 = sum(v3, serial);
+  const vec4 s4 = sum(v4, threaded);
+  const vec3 m3 = mean(v3, threaded);
+  for (std::size_t c = 0; c < 3; ++c) {
+    EXPECT_NEAR(e3[c], s3[c], std::abs(e3[c]) * 1e-5);
+    EXPECT_NEAR(e3[c] / n, m3[c], std::abs(e3[c] / n) * 1e-5);
+  }
+  for (std::size_t c = 0; c < 4; ++c)
+    EXPECT_NEAR(e4[c], s4[c], std::abs(e4[c]) * 1e-5);
+
+  // same bits whatever the thread count
+  const vec3 t3 = sum(v3, threaded);
+  EXPECT_EQ(s3.x, t3.x);
+  EXPECT_EQ(s3.y, t3.y);
+  EXPECT_EQ(s3.z, t3.z);
+
+  std::vector<ivec3> iv(n);
+  for (std::size_t i = 0; i < n; ++i)
+    iv[i] = make_vec(1, int(i % 3), -2);
+  const ivec3 is = sum(span<const ivec3>(iv), threaded);
+  EXPECT_EQ(int(n), is.x);
+  EXPECT_EQ(int(n - 1), is.y);
+  EXPECT_EQ(-2 * int(n), is.z);
+
+  // a user op: component-wise product of small values
+  std::vector<vec<double, 2> > d(20, make_vec(1.0, 0.5));
+  const vec<double, 2> prod = reduce(
+    span<const vec<double, 2> >(d), make_vec(3.0, 1.0),
+    std::multiplies<vec<double, 2> >(), threaded);
+  EXPECT_DOUBLE_EQ(3.0, prod.x);
+  EXPECT_DOUBLE_EQ(std::pow(0.5, 20), prod.y);
+
+  EXPECT_EQ(0.0f, sum(span<const vec3>()).x);
+}
+
+TEST(vector_batch, slerp_n) {
+  const std::size_t n = 11;
+  std::vector<quatf> a(n), b(n), out(n);
+  std::vector<float> t(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const vec3 axis = normalize(make_vec(1.0f, float(i) - 5.0f, 2.0f));
+    a[i] = axis_angle(axis, 0.1f * float(i));
+    b[i] = axis_angle(normalize(make_vec(float(i), 1.0f, -1.0f)), 2.5f - 0.2f * float(i));
+    if (i % 3 == 0)
+      b[i] = make_quat(-b[i].v); // takes the shorter arc
+    if (i == 7)
+      b[i] = a[i]; // nlerp fallback
+    t[i] = float(i) / float(n - 1);
+  }
+
+  slerp_n(span<const quatf>(a), span<const quatf>(b), span<const float>(t), span<quatf>(out));
+  for (std::size_t i = 0; i < n; ++i) {
+    const quatf expected = slerp(a[i], b[i], t[i]);
+    for (std::size_t j = 0; j < 4; ++j)
+      EXPECT_NEAR(expected[j], out[i][j], 1e-5f) << i;
+  }
+
+  slerp_n(span<const quatf>(a), span<const quatf>(b), 0.3f, span<quatf>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t j = 0; j < 4; ++j)
+      EXPECT_NEAR(slerp(a[i], b[i], 0.3f)[j], out[i][j], 1e-5f) << i;
+
+  nlerp_n(span<const quatf>(a), span<const quatf>(b), span<const float>(t), span<quatf>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t j = 0; j < 4; ++j)
+      EXPECT_NEAR(nlerp(a[i], b[i], t[i])[j], out[i][j], 1e-5f) << i;
+
+  // in place, and the generic version for double
+  nlerp_n(span<const quatf>(out), span<const quatf>(b), 1.0f, span<quatf>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_NEAR(1.0f, std::fabs(dot_product(out[i], b[i])), 1e-5f) << i;
+
+  std::vector<quatd> ad(n), bd(n), outd(n);
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t j = 0; j < 4; ++j) {
+      ad[i].v[j] = a[i][j];
+      bd[i].v[j] = b[i][j];
+    }
+  slerp_n(span<const quatd>(ad), span<const quatd>(bd), 0.5, span<quatd>(outd));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t j = 0; j < 4; ++j)
+      EXPECT_NEAR(slerp(a[i], b[i], 0.5f)[j], outd[i][j], 1e-5) << i;
+}
+
+TEST(vector_batch, slerp_n_accuracy) {
+  // every angle between the keys, against slerp in double
+  const std::size_t n = 400;
+  std::vector<quatf> a(n), b(n), out(n);
+  std::vector<float> t(n);
+  const vec<double, 3> axis = normalize(make_vec(1.0, -2.0, 0.5));
+  for (std::size_t i = 0; i < n; ++i) {
+    a[i] = make_quat(0.0f, 0.0f, 0.0f, 1.0f);
+    const quatd bd = axis_angle(axis, 6.28 * double(i) / double(n));
+    for (std::size_t j = 0; j < 4; ++j)
+      b[i].v[j] = float(bd[j]);
+    t[i] = float(i % 21) / 20.0f;
+  }
+
+  slerp_n(span<const quatf>(a), span<const quatf>(b), span<const float>(t), span<quatf>(out));
+  for (std::size_t i = 0; i < n; ++i) {
+    const quatd ad = make_quat(0.0, 0.0, 0.0, 1.0);
+    const quatd bd = make_quat(double(b[i][0]), double(b[i][1]), double(b[i][2]), double(b[i][3]));
+    const quatd expected = slerp(ad, bd, double(t[i]));
+    for (std::size_t j = 0; j < 4; ++j)
+      EXPECT_NEAR(expected[j], out[i][j], 2e-6) << i;
+  }
+}
+
+TEST(vector_batch, algorithm_n) {
+  const std::size_t n = 23; // not a multiple of 4
+  std::vector<float> a(n), b(n), t(n), out(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    a[i] = float(i) * 0.75f - 8.0f;
+    b[i] = float(i * i) * 0.1f;
+    t[i] = float(i % 5) / 4.0f;
+  }
+
+  lerp_n(span<const float>(a), span<const float>(b), 0.3f, span<float>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(lerp(a[i], b[i], 0.3f), out[i]) << i;
+
+  lerp_n(span<const float>(a), span<const float>(b), span<const float>(t), span<float>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(lerp(a[i], b[i], t[i]), out[i]) << i;
+
+  clamp_n(span<const float>(a), -2.0f, 3.0f, span<float>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(clamp(a[i], -2.0f, 3.0f), out[i]) << i;
+
+  out = a;
+  saturate_n(span<float>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(saturate(a[i]), out[i]) << i;
+
+  // generic types
+  std::vector<double> d(n), dout(n);
+  for (std::size_t i = 0; i < n; ++i)
+    d[i] = a[i];
+  clamp_n(span<const double>(d), -1.0, 1.0, span<double>(dout));
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(clamp(d[i], -1.0, 1.0), dout[i]) << i;
+
+  std::vector<ivec3> iv(n), ivout(n);
+  for (std::size_t i = 0; i < n; ++i)
+    iv[i] = make_vec(int(i) - 10, int(i), -int(i));
+  clamp_n(span<const ivec3>(iv), -5, 5, span<ivec3>(ivout));
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(clamp(iv[i].x, -5, 5), ivout[i].x) << i;
+}
+
+TEST(vector_batch, wrap_n) {
+  // angles across several turns, including every multiple of the width
+  std::vector<float> in, out;
+  for (int i = -2000; i <= 2000; ++i)
+    in.push_back(float(i) * 0.3f);
+  in.push_back(1e9f);
+  in.push_back(-1e-9f);
+  out.resize(in.size());
+
+  const float lower = -0.6f, upper = 0.9f, width = upper - lower;
+  wrap_n(span<const float>(in), lower, upper, span<float>(out));
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    EXPECT_GE(out[i], lower) << in[i];
+    EXPECT_LT(out[i], upper) << in[i];
+    // the same as wrap(), or a whole width away at the borders
+    const float diff = std::fabs(out[i] - wrap(in[i], lower, upper));
+    const float tolerance = 1e-7f * std::fabs(in[i]) + 1e-6f;
+    EXPECT_TRUE(diff < tolerance || std::fabs(diff - width) < tolerance) << in[i];
+  }
+
+  std::vector<vec3> v(7), vout(7);
+  for (std::size_t i = 0; i < v.size(); ++i)
+    v[i] = make_vec(float(i) * 100.0f, -float(i) * 50.0f, 359.5f);
+  wrap_n(span<const vec3>(v), 0.0f, 360.0f, span<vec3>(vout));
+  for (std::size_t i = 0; i < v.size(); ++i)
+    for (std::size_t c = 0; c < 3; ++c)
+      EXPECT_NEAR(wrap(v[i][c], 0.0f, 360.0f), vout[i][c], 1e-4f) << i;
+
+  // a value whose result rounds to upper itself when moved by one width
+  std::vector<float> border(5, 135.774994f);
+  wrap_n(span<float>(border), 60.3100014f, 75.4029999f);
+  for (std::size_t i = 0; i < border.size(); ++i) {
+    EXPECT_LT(border[i], 75.4029999f);
+    EXPECT_GE(border[i], 60.3100014f);
+  }
+
+  std::vector<vec3> vs(v);
+  saturate_n(span<vec3>(vs));
+  EXPECT_EQ(1.0f, vs[1].x);
+  EXPECT_EQ(0.0f, vs[1].y);
+}
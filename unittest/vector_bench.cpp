@@ -0,0 +1,796 @@
+#include "vector.h"
+#include "vector_expr.h"
+#include "vector_batch.h"
+#include "vector_soa.h"
+#include "vector_packed.h"
+#include "vector_color.h"
+#include "allocator.h"
+#include "kd_tree.h"
+#include "algorithm.h"
+#include "approx_math.h"
+#include "vector_blend.h"
+#include "bench_util.h"
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+using namespace p;
+
+#define P_BENCH_ALL_TYPES(fun) \
+  BENCHMARK_TEMPLATE(fun, vec2); BENCHMARK_TEMPLATE(fun, vec3);   \
+  BENCHMARK_TEMPLATE(fun, vec4); BENCHMARK_TEMPLATE(fun, ivec2);  \
+  BENCHMARK_TEMPLATE(fun, ivec3); BENCHMARK_TEMPLATE(fun, ivec4); \
+  BENCHMARK_TEMPLATE(fun, ubvec3); BENCHMARK_TEMPLATE(fun, ubvec4)
+
+#define P_BENCH_FLOAT_TYPES(fun) \
+  BENCHMARK_TEMPLATE(fun, vec2); BENCHMARK_TEMPLATE(fun, vec3);   \
+  BENCHMARK_TEMPLATE(fun, vec4)
+
+namespace {
+  // out[i] = op(a[i], b[i]) over the whole array
+  template<typename V, typename OpT>
+  void binary_bench(benchmark::State &state, OpT op) {
+    const std::vector<V> a = bench::make_array<V>(), b = bench::make_array<V>(5);
+    std::vector<V> out(bench::count);
+    for (auto _ : state) {
+      for (std::size_t i = 0; i < bench::count; ++i)
+        out[i] = op(a[i], b[i]);
+      benchmark::DoNotOptimize(out.data());
+      benchmark::ClobberMemory();
+    }
+    bench::set_counters(state);
+  }
+
+  // out[i] = op(a[i])
+  template<typename V, typename R, typename OpT>
+  void unary_bench(benchmark::State &state, OpT op) {
+    const std::vector<V> a = bench::make_array<V>();
+    std::vector<R> out(bench::count);
+    for (auto _ : state) {
+      for (std::size_t i = 0; i < bench::count; ++i)
+        out[i] = op(a[i]);
+      benchmark::DoNotOptimize(out.data());
+      benchmark::ClobberMemory();
+    }
+    bench::set_counters(state);
+  }
+
+  // op(a[i], b[i]) updating a in place
+  template<typename V, typename OpT>
+  void inplace_bench(benchmark::State &state, OpT op) {
+    std::vector<V> a = bench::make_array<V>();
+    const std::vector<V> b = bench::make_array<V>(5);
+    for (auto _ : state) {
+      for (std::size_t i = 0; i < bench::count; ++i)
+        op(a[i], b[i]);
+      benchmark::DoNotOptimize(a.data());
+      benchmark::ClobberMemory();
+    }
+    bench::set_counters(state);
+  }
+
+  template<typename V> struct add_op {V operator()(const V &a, const V &b) const {return a + b; }};
+  template<typename V> struct sub_op {V operator()(const V &a, const V &b) const {return a - b; }};
+  template<typename V> struct mul_op {V operator()(const V &a, const V &) const {return a * typename V::value_type(3); }};
+  template<typename V> struct div_op {V operator()(const V &a, const V &) const {return a / typename V::value_type(3); }};
+  template<typename V> struct vmul_op {V operator()(const V &a, const V &b) const {return a * b; }};
+  template<typename V> struct min_op {V operator()(const V &a, const V &b) const {return p::min(a, b); }};
+  template<typename V> struct max_op {V operator()(const V &a, const V &b) const {return p::max(a, b); }};
+  template<typename V> struct lerp_op {V operator()(const V &a, const V &b) const {return p::lerp(a, b, typename V::value_type(0.25)); }};
+  template<typename V> struct neg_op {V operator()(const V &a) const {return -a; }};
+  template<typename V> struct abs_op {V operator()(const V &a) const {return p::abs(a); }};
+  template<typename V> struct hmax_op {typename V::value_type operator()(const V &a) const {return p::max(a); }};
+  template<typename V> struct splat_op {V operator()(const V &a) const {return make_vec<V::size>(a[0]); }};
+  template<typename V> struct dot_op {typename V::value_type operator()(const V &a, const V &b) const {return dot_product(a, b); }};
+  template<typename V> struct cross_op {V operator()(const V &a, const V &b) const {return cross_product(a, b); }};
+  template<typename V> struct magnitude_op {typename V::value_type operator()(const V &a) const {return magnitude(a); }};
+  template<typename V> struct normalize_op {V operator()(const V &a) const {return normalize(a); }};
+  template<typename V> struct normalize_fast_op {V operator()(const V &a) const {return normalize_fast(a); }};
+  template<typename V> struct add_assign_op {void operator()(V &a, const V &b) const {a += b; }};
+  template<typename V> struct sub_assign_op {void operator()(V &a, const V &b) const {a -= b; }};
+  template<typename V> struct mul_assign_op {void operator()(V &a, const V &) const {a *= typename V::value_type(1); }};
+  template<typename V> struct div_assign_op {void operator()(V &a, const V &) const {a /= typename V::value_type(1); }};
+}
+
+// -- Operators
+template<typename V> static void BM_add(benchmark::State &state) {binary_bench<V>(state, add_op<V>()); }
+template<typename V> static void BM_sub(benchmark::State &state) {binary_bench<V>(state, sub_op<V>()); }
+template<typename V> static void BM_mul_scalar(benchmark::State &state) {binary_bench<V>(state, mul_op<V>()); }
+template<typename V> static void BM_div_scalar(benchmark::State &state) {binary_bench<V>(state, div_op<V>()); }
+template<typename V> static void BM_mul(benchmark::State &state) {binary_bench<V>(state, vmul_op<V>()); }
+template<typename V> static void BM_negate(benchmark::State &state) {unary_bench<V, V>(state, neg_op<V>()); }
+template<typename V> static void BM_add_assign(benchmark::State &state) {inplace_bench<V>(state, add_assign_op<V>()); }
+template<typename V> static void BM_sub_assign(benchmark::State &state) {inplace_bench<V>(state, sub_assign_op<V>()); }
+template<typename V> static void BM_mul_assign(benchmark::State &state) {inplace_bench<V>(state, mul_assign_op<V>()); }
+template<typename V> static void BM_div_assign(benchmark::State &state) {inplace_bench<V>(state, div_assign_op<V>()); }
+P_BENCH_ALL_TYPES(BM_add);
+P_BENCH_ALL_TYPES(BM_sub);
+P_BENCH_ALL_TYPES(BM_mul_scalar);
+P_BENCH_ALL_TYPES(BM_div_scalar);
+P_BENCH_ALL_TYPES(BM_mul);
+P_BENCH_ALL_TYPES(BM_negate);
+P_BENCH_ALL_TYPES(BM_add_assign);
+P_BENCH_ALL_TYPES(BM_sub_assign);
+P_BENCH_ALL_TYPES(BM_mul_assign);
+P_BENCH_ALL_TYPES(BM_div_assign);
+
+// -- Component-wise functions
+template<typename V> static void BM_min(benchmark::State &state) {binary_bench<V>(state, min_op<V>()); }
+template<typename V> static void BM_max(benchmark::State &state) {binary_bench<V>(state, max_op<V>()); }
+template<typename V> static void BM_max_component(benchmark::State &state) {unary_bench<V, typename V::value_type>(state, hmax_op<V>()); }
+template<typename V> static void BM_abs(benchmark::State &state) {unary_bench<V, V>(state, abs_op<V>()); }
+template<typename V> static void BM_make_vec_splat(benchmark::State &state) {unary_bench<V, V>(state, splat_op<V>()); }
+template<typename V> static void BM_lerp(benchmark::State &state) {binary_bench<V>(state, lerp_op<V>()); }
+P_BENCH_ALL_TYPES(BM_min);
+P_BENCH_ALL_TYPES(BM_max);
+P_BENCH_ALL_TYPES(BM_max_component);
+BENCHMARK_TEMPLATE(BM_abs, vec2); BENCHMARK_TEMPLATE(BM_abs, vec3); BENCHMARK_TEMPLATE(BM_abs, vec4);
+BENCHMARK_TEMPLATE(BM_abs, ivec2); BENCHMARK_TEMPLATE(BM_abs, ivec3); BENCHMARK_TEMPLATE(BM_abs, ivec4);
+P_BENCH_ALL_TYPES(BM_make_vec_splat);
+P_BENCH_FLOAT_TYPES(BM_lerp);
+
+// -- Geometry
+template<typename V> static void BM_dot_product(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>(), b = bench::make_array<V>(5);
+  std::vector<typename V::value_type> out(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = dot_op<V>()(a[i], b[i]);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+template<typename V> static void BM_cross_product(benchmark::State &state) {binary_bench<V>(state, cross_op<V>()); }
+template<typename V> static void BM_magnitude(benchmark::State &state) {unary_bench<V, typename V::value_type>(state, magnitude_op<V>()); }
+template<typename V> static void BM_normalize(benchmark::State &state) {unary_bench<V, V>(state, normalize_op<V>()); }
+template<typename V> static void BM_normalize_fast(benchmark::State &state) {unary_bench<V, V>(state, normalize_fast_op<V>()); }
+BENCHMARK_TEMPLATE(BM_dot_product, vec2); BENCHMARK_TEMPLATE(BM_dot_product, vec3); BENCHMARK_TEMPLATE(BM_dot_product, vec4);
+BENCHMARK_TEMPLATE(BM_dot_product, ivec2); BENCHMARK_TEMPLATE(BM_dot_product, ivec3); BENCHMARK_TEMPLATE(BM_dot_product, ivec4);
+BENCHMARK_TEMPLATE(BM_cross_product, vec3); BENCHMARK_TEMPLATE(BM_cross_product, ivec3);
+P_BENCH_FLOAT_TYPES(BM_magnitude);
+P_BENCH_FLOAT_TYPES(BM_normalize);
+P_BENCH_FLOAT_TYPES(BM_normalize_fast);
+
+// -- Batches
+template<typename V> static void BM_normalize_n(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  std::vector<V> out(bench::count);
+  for (auto _ : state) {
+    normalize_n(span<const V>(a), span<V>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+P_BENCH_FLOAT_TYPES(BM_normalize_n);
+
+template<typename V> static void BM_soa_normalize(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>();
+  const vec_soa<float, V::size> soa(a.data(), a.size());
+  vec_soa<float, V::size> out(a.size());
+  for (auto _ : state) {
+    normalize(soa, out);
+    benchmark::DoNotOptimize(out.component(0));
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+P_BENCH_FLOAT_TYPES(BM_soa_normalize);
+
+template<typename V> static void BM_soa_dot_product(benchmark::State &state) {
+  const std::vector<V> a = bench::make_array<V>(), b = bench::make_array<V>(5);
+  const vec_soa<float, V::size> sa(a.data(), a.size()), sb(b.data(), b.size());
+  std::vector<float> out(bench::count);
+  for (auto _ : state) {
+    dot_product(sa, sb, out.data());
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+P_BENCH_FLOAT_TYPES(BM_soa_dot_product);
+
+// -- Expressions
+namespace {
+  typedef vec<float, 64> vec64;
+
+  struct expr_fixture {
+    vec64 a, b, c, r;
+    float s, t;
+
+    expr_fixture() : s(1.5f), t(-0.5f) {
+      bench::fill(a, 0);
+      bench::fill(b, 1);
+      bench::fill(c, 2);
+    }
+  };
+}
+
+// r = a*s + b*t - c, three ways
+
+static void BM_expr_eager(benchmark::State &state) {
+  expr_fixture f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f.a);
+    f.r = f.a * f.s + f.b * f.t - f.c;
+    benchmark::DoNotOptimize(f.r);
+  }
+  bench::set_counters(state, vec64::size);
+}
+BENCHMARK(BM_expr_eager);
+
+static void BM_expr_lazy(benchmark::State &state) {
+  expr_fixture f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f.a);
+    f.r = lazy(f.a) * f.s + lazy(f.b) * f.t - f.c;
+    benchmark::DoNotOptimize(f.r);
+  }
+  bench::set_counters(state, vec64::size);
+}
+BENCHMARK(BM_expr_lazy);
+
+static void BM_expr_hand_loop(benchmark::State &state) {
+  expr_fixture f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f.a);
+    for (std::size_t i = 0; i < vec64::size; ++i)
+      f.r[i] = f.a[i] * f.s + f.b[i] * f.t - f.c[i];
+    benchmark::DoNotOptimize(f.r);
+  }
+  bench::set_counters(state, vec64::size);
+}
+BENCHMARK(BM_expr_hand_loop);
+
+// -- algorithm.h
+namespace {
+  template<typename T>
+  void scalar_bench(benchmark::State &state, T (*fun)(T)) {
+    std::vector<T> in(bench::count), out(bench::count);
+    for (std::size_t i = 0; i < bench::count; ++i)
+      in[i] = T(i % 37) / T(16) - T(1);
+    for (auto _ : state) {
+      for (std::size_t i = 0; i < bench::count; ++i)
+        out[i] = fun(in[i]);
+      benchmark::DoNotOptimize(out.data());
+      benchmark::ClobberMemory();
+    }
+    bench::set_counters(state);
+  }
+
+  float lerp_fun(float v) {return p::lerp(0.0f, 10.0f, v); }
+  float clamp_fun(float v) {return p::clamp(v, -0.5f, 0.5f); }
+  float saturate_fun(float v) {return p::saturate(v); }
+  float wrap_fun(float v) {return p::wrap(v, 0.0f, 0.3f); }
+}
+
+static void BM_lerp_scalar(benchmark::State &state) {scalar_bench(state, lerp_fun); }
+static void BM_clamp(benchmark::State &state) {scalar_bench(state, clamp_fun); }
+static void BM_saturate(benchmark::State &state) {scalar_bench(state, saturate_fun); }
+static void BM_wrap(benchmark::State &state) {scalar_bench(state, wrap_fun); }
+BENCHMARK(BM_lerp_scalar);
+BENCHMARK(BM_clamp);
+BENCHMARK(BM_saturate);
+BENCHMARK(BM_wrap);
+
+// the batch versions over the same values
+namespace {
+  template<typename F>
+  void batch_bench(benchmark::State &state, F fun) {
+    std::vector<float> in(bench::count), out(bench::count);
+    for (std::size_t i = 0; i < bench::count; ++i)
+      in[i] = float(i % 37) / 16.0f - 1.0f;
+    for (auto _ : state) {
+      fun(span<const float>(in), span<float>(out));
+      benchmark::DoNotOptimize(out.data());
+      benchmark::ClobberMemory();
+    }
+    bench::set_counters(state);
+  }
+
+  void lerp_batch(span<const float> in, span<float> out) {p::lerp_n(in, in, 0.25f, out); }
+  void clamp_batch(span<const float> in, span<float> out) {p::clamp_n(in, -0.5f, 0.5f, out); }
+  void saturate_batch(span<const float> in, span<float> out) {p::saturate_n(in, out); }
+  void wrap_batch(span<const float> in, span<float> out) {p::wrap_n(in, 0.0f, 0.3f, out); }
+}
+
+static void BM_lerp_n(benchmark::State &state) {batch_bench(state, lerp_batch); }
+static void BM_clamp_n(benchmark::State &state) {batch_bench(state, clamp_batch); }
+static void BM_saturate_n(benchmark::State &state) {batch_bench(state, saturate_batch); }
+static void BM_wrap_n(benchmark::State &state) {batch_bench(state, wrap_batch); }
+BENCHMARK(BM_lerp_n);
+BENCHMARK(BM_clamp_n);
+BENCHMARK(BM_saturate_n);
+BENCHMARK(BM_wrap_n);
+
+// packed storage: vec3 arrays to and from half/snorm16/unorm8
+template<typename S> static void BM_pack_n(benchmark::State &state) {
+  const std::vector<vec3> in = bench::make_array<vec3>();
+  std::vector<vec<S, 3> > out(bench::count);
+  for (auto _ : state) {
+    pack_n(span<const vec3>(in), span<vec<S, 3> >(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_pack_n, half);
+BENCHMARK_TEMPLATE(BM_pack_n, snorm16);
+BENCHMARK_TEMPLATE(BM_pack_n, unorm8);
+
+template<typename S> static void BM_unpack_n(benchmark::State &state) {
+  std::vector<vec<S, 3> > in(bench::count);
+  pack_n(span<const vec3>(bench::make_array<vec3>()), span<vec<S, 3> >(in));
+  std::vector<vec3> out(bench::count);
+  for (auto _ : state) {
+    unpack_n(span<const vec<S, 3> >(in), span<vec3>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_unpack_n, half);
+BENCHMARK_TEMPLATE(BM_unpack_n, snorm16);
+BENCHMARK_TEMPLATE(BM_unpack_n, unorm8);
+
+// 8-bit sRGB images; the loop is the exact curve per pixel for comparison
+static std::vector<vec4> make_linear_image() {
+  std::vector<vec4> l(bench::count);
+  unpack_n(span<const ubvec4>(bench::make_array<ubvec4>()), span<vec4>(l));
+  return l;
+}
+
+static void BM_linear_to_srgb8_n(benchmark::State &state) {
+  const std::vector<vec4> in = make_linear_image();
+  std::vector<ubvec4> out(bench::count);
+  for (auto _ : state) {
+    linear_to_srgb8_n(span<const vec4>(in), span<ubvec4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_linear_to_srgb8_n);
+
+static void BM_linear_to_srgb8_loop(benchmark::State &state) {
+  const std::vector<vec4> in = make_linear_image();
+  std::vector<ubvec4> out(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = pack<std::uint8_t>(linear_to_srgb(in[i]));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_linear_to_srgb8_loop);
+
+static void BM_srgb8_to_linear_n(benchmark::State &state) {
+  const std::vector<ubvec4> in = bench::make_array<ubvec4>();
+  std::vector<vec4> out(bench::count);
+  for (auto _ : state) {
+    srgb8_to_linear_n(span<const ubvec4>(in), span<vec4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_srgb8_to_linear_n);
+
+static void BM_to_rgba8_n(benchmark::State &state) {
+  const std::vector<ubvec4> in = bench::make_array<ubvec4>();
+  std::vector<std::uint32_t> out(bench::count);
+  for (auto _ : state) {
+    to_rgba8_n(span<const ubvec4>(in), span<std::uint32_t>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_to_rgba8_n);
+
+// per-frame scratch arrays: fresh std::vectors against an arena
+static void scratch_frame(const std::vector<vec3> &in, span<vec3> a, span<vec3> b) {
+  for (std::size_t i = 0; i < in.size(); ++i)
+    a[i] = in[i] * 2.0f;
+  for (std::size_t i = 0; i < in.size(); ++i)
+    b[i] = a[i] + in[i];
+}
+
+static void BM_scratch_vector(benchmark::State &state) {
+  const std::vector<vec3> in = bench::make_array<vec3>();
+  for (auto _ : state) {
+    std::vector<vec3> a(in.size()), b(in.size());
+    scratch_frame(in, span<vec3>(a), span<vec3>(b));
+    benchmark::DoNotOptimize(b.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_scratch_vector);
+
+static void BM_scratch_arena(benchmark::State &state) {
+  const std::vector<vec3> in = bench::make_array<vec3>();
+  arena scratch;
+  for (auto _ : state) {
+    scratch.reset();
+    span<vec3> a = scratch.allocate_n<vec3>(in.size());
+    span<vec3> b = scratch.allocate_n<vec3>(in.size());
+    scratch_frame(in, a, b);
+    benchmark::DoNotOptimize(b.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_scratch_arena);
+
+// reductions over a large cloud; arg is the thread count
+static std::vector<vec3> make_cloud() {
+  std::vector<vec3> v(1 << 20);
+  for (std::size_t i = 0; i < v.size(); ++i)
+    bench::fill(v[i], i);
+  return v;
+}
+
+static void BM_bounding_box(benchmark::State &state) {
+  const std::vector<vec3> v = make_cloud();
+  thread_pool pool(std::size_t(state.range(0)) - 1);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(bounding_box(v, pool));
+  bench::set_counters(state, v.size());
+}
+BENCHMARK(BM_bounding_box)->Arg(1)->Arg(4)->UseRealTime();
+
+// the serial loop bounding_box replaces
+static void BM_bounding_box_loop(benchmark::State &state) {
+  const std::vector<vec3> v = make_cloud();
+  for (auto _ : state) {
+    vec3 lo = v[0], hi = v[0];
+    for (std::size_t i = 1; i < v.size(); ++i) {
+      lo = min(lo, v[i]);
+      hi = max(hi, v[i]);
+    }
+    benchmark::DoNotOptimize(lo);
+    benchmark::DoNotOptimize(hi);
+  }
+  bench::set_counters(state, v.size());
+}
+BENCHMARK(BM_bounding_box_loop)->UseRealTime();
+
+static void BM_sum(benchmark::State &state) {
+  const std::vector<vec3> v = make_cloud();
+  thread_pool pool(std::size_t(state.range(0)) - 1);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(sum(v, pool));
+  bench::set_counters(state, v.size());
+}
+BENCHMARK(BM_sum)->Arg(1)->Arg(4)->UseRealTime();
+
+// spatial queries over 64k random points; arg is the thread count
+static std::vector<vec3> make_random_points(std::size_t n, std::uint32_t seed) {
+  std::vector<vec3> v(n);
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t c = 0; c < 3; ++c) {
+      seed = seed * 1664525u + 1013904223u;
+      v[i][c] = float(seed >> 8) / float(1 << 24);
+    }
+  return v;
+}
+
+static void BM_kd_build(benchmark::State &state) {
+  const std::vector<vec3> v = make_random_points(1 << 16, 1);
+  thread_pool pool(std::size_t(state.range(0)) - 1);
+  kd_tree tree;
+  for (auto _ : state)
+    tree.build(v, pool);
+  bench::set_counters(state, v.size());
+}
+BENCHMARK(BM_kd_build)->Arg(1)->Arg(4)->UseRealTime();
+
+static void BM_kd_nearest_k_n(benchmark::State &state) {
+  const std::vector<vec3> v = make_random_points(1 << 16, 1);
+  const std::vector<vec3> q = make_random_points(bench::count, 2);
+  thread_pool pool(std::size_t(state.range(0)) - 1);
+  const kd_tree tree(v, pool);
+  std::vector<kd_neighbor> out(q.size() * 8);
+  for (auto _ : state) {
+    tree.nearest_k_n(q, 8, out, pool);
+    benchmark::DoNotOptimize(out.data());
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_kd_nearest_k_n)->Arg(1)->Arg(4)->UseRealTime();
+
+// the nearest point by brute force, as done before the index
+static void BM_nearest_brute_force(benchmark::State &state) {
+  const std::vector<vec3> v = make_random_points(1 << 16, 1);
+  const std::vector<vec3> q = make_random_points(16, 2);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < q.size(); ++i) {
+      std::size_t best = 0;
+      float best_d = magnitude(v[0] - q[i]);
+      for (std::size_t j = 1; j < v.size(); ++j) {
+        const float d = magnitude(v[j] - q[i]);
+        if (d < best_d) {
+          best_d = d;
+          best = j;
+        }
+      }
+      benchmark::DoNotOptimize(best);
+    }
+  }
+  bench::set_counters(state, q.size());
+}
+BENCHMARK(BM_nearest_brute_force);
+
+static void BM_kd_nearest(benchmark::State &state) {
+  const std::vector<vec3> v = make_random_points(1 << 16, 1);
+  const std::vector<vec3> q = make_random_points(bench::count, 2);
+  const kd_tree tree((span<const vec3>(v)));
+  for (auto _ : state)
+    for (std::size_t i = 0; i < q.size(); ++i)
+      benchmark::DoNotOptimize(tree.nearest(q[i]));
+  bench::set_counters(state);
+}
+BENCHMARK(BM_kd_nearest);
+
+// -- Run time dispatch
+// the batch kernels at each instruction set level; arg is the p::isa, and
+// levels the CPU lacks are skipped
+namespace {
+  struct forced_isa {
+    forced_isa(benchmark::State &state) : saved(active_isa()) {
+      if (force_isa(isa(state.range(0))) != isa(state.range(0)))
+        state.SkipWithError("not supported by this CPU");
+    }
+    ~forced_isa() {force_isa(saved); }
+    isa saved;
+  };
+}
+
+template<typename V> static void BM_isa_normalize_n(benchmark::State &state) {
+  forced_isa level(state);
+  const std::vector<V> a = bench::make_array<V>();
+  std::vector<V> out(bench::count);
+  for (auto _ : state) {
+    normalize_n(span<const V>(a), span<V>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+
+template<typename V> static void BM_isa_dot_product_n(benchmark::State &state) {
+  forced_isa level(state);
+  const std::vector<V> a = bench::make_array<V>(), b = bench::make_array<V>(5);
+  std::vector<float> out(bench::count);
+  for (auto _ : state) {
+    dot_product_n(span<const V>(a), span<const V>(b), span<float>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+
+template<typename V> static void BM_isa_transform_points(benchmark::State &state) {
+  forced_isa level(state);
+  mat4 m;
+  bench::fill(m, 3);
+  const std::vector<V> a = bench::make_array<V>();
+  std::vector<V> out(bench::count);
+  thread_pool serial(0);
+  for (auto _ : state) {
+    transform_points(m, span<const V>(a), span<V>(out), serial);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+
+template<typename V> static void BM_isa_sum(benchmark::State &state) {
+  forced_isa level(state);
+  const std::vector<V> a = bench::make_array<V>();
+  thread_pool serial(0);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(sum(span<const V>(a), serial));
+  bench::set_counters(state);
+}
+
+template<typename V> static void BM_isa_bounding_box(benchmark::State &state) {
+  forced_isa level(state);
+  const std::vector<V> a = bench::make_array<V>();
+  thread_pool serial(0);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(bounding_box(span<const V>(a), serial));
+  bench::set_counters(state);
+}
+
+static void BM_isa_pack_half(benchmark::State &state) {
+  forced_isa level(state);
+  const std::vector<vec3> a = bench::make_array<vec3>();
+  std::vector<vec<half, 3> > out(bench::count);
+  for (auto _ : state) {
+    pack_n(span<const vec3>(a), span<vec<half, 3> >(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+
+#define P_BENCH_ISA(b) \
+  b->Arg(isa_sse2)->Arg(isa_avx2)->Arg(isa_avx512)
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_normalize_n, vec3));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_normalize_n, vec4));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_dot_product_n, vec3));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_dot_product_n, vec4));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_transform_points, vec3));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_transform_points, vec4));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_sum, vec3));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_sum, vec4));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_bounding_box, vec3));
+P_BENCH_ISA(BENCHMARK_TEMPLATE(BM_isa_bounding_box, vec4));
+P_BENCH_ISA(BENCHMARK(BM_isa_pack_half));
+
+// sin over an array of angles, per tier, against std::sin
+template<approx::accuracy A>
+static void BM_approx_sin_n(benchmark::State &state) {
+  std::vector<float> in(bench::count), out(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i)
+    in[i] = float(i) * 0.01f - 5.0f;
+  for (auto _ : state) {
+    approx::sin_n<A>(in, out);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_approx_sin_n, approx::fast);
+BENCHMARK_TEMPLATE(BM_approx_sin_n, approx::medium);
+BENCHMARK_TEMPLATE(BM_approx_sin_n, approx::precise);
+
+static void BM_std_sin_loop(benchmark::State &state) {
+  std::vector<float> in(bench::count), out(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i)
+    in[i] = float(i) * 0.01f - 5.0f;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = std::sin(in[i]);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_std_sin_loop);
+
+template<approx::accuracy A>
+static void BM_approx_exp_n(benchmark::State &state) {
+  std::vector<float> in(bench::count), out(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i)
+    in[i] = float(i) * 0.01f - 5.0f;
+  for (auto _ : state) {
+    approx::exp_n<A>(in, out);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_approx_exp_n, approx::fast);
+BENCHMARK_TEMPLATE(BM_approx_exp_n, approx::precise);
+
+static void BM_std_exp_loop(benchmark::State &state) {
+  std::vector<float> in(bench::count), out(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i)
+    in[i] = float(i) * 0.01f - 5.0f;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = std::exp(in[i]);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_std_exp_loop);
+
+template<approx::accuracy A>
+static void BM_approx_atan2_n(benchmark::State &state) {
+  std::vector<float> y(bench::count), x(bench::count), out(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i) {
+    y[i] = float(i % 37) - 18.0f;
+    x[i] = float(i % 23) - 11.5f;
+  }
+  for (auto _ : state) {
+    approx::atan2_n<A>(y, x, out);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK_TEMPLATE(BM_approx_atan2_n, approx::precise);
+
+static void BM_std_atan2_loop(benchmark::State &state) {
+  std::vector<float> y(bench::count), x(bench::count), out(bench::count);
+  for (std::size_t i = 0; i < bench::count; ++i) {
+    y[i] = float(i % 37) - 18.0f;
+    x[i] = float(i % 23) - 11.5f;
+  }
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = std::atan2(y[i], x[i]);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_std_atan2_loop);
+
+// alpha blending of two rows of pixels, at each level, against converting
+// every component to float and back
+static void BM_isa_blend_n(benchmark::State &state) {
+  forced_isa level(state);
+  const std::vector<ubvec4> a = bench::make_array<ubvec4>(), b = bench::make_array<ubvec4>(5);
+  std::vector<ubvec4> out(bench::count);
+  for (auto _ : state) {
+    blend_n(span<const ubvec4>(a), span<const ubvec4>(b), 77, span<ubvec4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+P_BENCH_ISA(BENCHMARK(BM_isa_blend_n));
+
+static void BM_float_blend_loop(benchmark::State &state) {
+  const std::vector<ubvec4> a = bench::make_array<ubvec4>(), b = bench::make_array<ubvec4>(5);
+  std::vector<ubvec4> out(bench::count);
+  const float t = 77.0f / 255.0f;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      for (std::size_t c = 0; c < 4; ++c)
+        out[i][c] = (unsigned char)(a[i][c] + (float(b[i][c]) - a[i][c]) * t + 0.5f);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_float_blend_loop);
+
+static void BM_isa_over_n(benchmark::State &state) {
+  forced_isa level(state);
+  const std::vector<ubvec4> a = bench::make_array<ubvec4>(), b = bench::make_array<ubvec4>(5);
+  std::vector<ubvec4> out(bench::count);
+  for (auto _ : state) {
+    over_n(span<const ubvec4>(a), span<const ubvec4>(b), span<ubvec4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+P_BENCH_ISA(BENCHMARK(BM_isa_over_n));
+
+// saturating add of rows against the operator, which wraps around
+static void BM_saturating_add_n(benchmark::State &state) {
+  const std::vector<ubvec4> a = bench::make_array<ubvec4>(), b = bench::make_array<ubvec4>(5);
+  std::vector<ubvec4> out(bench::count);
+  for (auto _ : state) {
+    saturating_add_n(span<const ubvec4>(a), span<const ubvec4>(b), span<ubvec4>(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_saturating_add_n);
+
+static void BM_saturating_add_loop(benchmark::State &state) {
+  const std::vector<ubvec4> a = bench::make_array<ubvec4>(), b = bench::make_array<ubvec4>(5);
+  std::vector<ubvec4> out(bench::count);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < bench::count; ++i)
+      out[i] = saturating_add(a[i], b[i]);
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  bench::set_counters(state);
+}
+BENCHMARK(BM_saturating_add_loop);
@@ -0,0 +1,104 @@
+#include "vector_binary.h"
+#include "vector.h"
+#include "matrix.h"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace p;
+
+namespace {
+  std::string temp_path(const char *name) {
+    return testing::TempDir() + name;
+  }
+}
+
+TEST(vector_binary, round_trip) {
+  const std::string path = temp_path("p_round_trip.pvec");
+
+  std::vector<vec3> points;
+  for (int i = 0; i < 1000; ++i)
+    points.push_back(make_vec(float(i), -float(i), 0.5f * i));
+
+  {
+    binary_writer<vec3> out(path.c_str());
+    EXPECT_TRUE(out.write(span<const vec3>(&points[0], 600)));
+    EXPECT_TRUE(out.write(span<const vec3>(&points[600], 400)));
+    EXPECT_TRUE(out.close());
+    EXPECT_EQ(1000u, out.size());
+  }
+
+  mapped_array in(path.c_str());
+  ASSERT_TRUE(in.is_open());
+  EXPECT_EQ(binary_ok, in.error());
+  EXPECT_EQ(3u, in.header().width);
+  EXPECT_EQ(1u, in.header().height);
+  EXPECT_TRUE(in.holds<vec3>());
+  EXPECT_FALSE(in.holds<vec4>());
+  EXPECT_FALSE(in.holds<ivec3>());
+  EXPECT_TRUE(in.view<vec4>().empty());
+
+  const span<const vec3> view = in.view<vec3>();
+  ASSERT_EQ(1000u, view.size());
+  EXPECT_EQ(0u, reinterpret_cast<std::size_t>(view.data()) % 16);
+  for (std::size_t i = 0; i < view.size(); ++i) {
+    EXPECT_EQ(points[i].x, view[i].x);
+    EXPECT_EQ(points[i].z, view[i].z);
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST(vector_binary, matrices) {
+  const std::string path = temp_path("p_matrices.pvec");
+
+  mat4 m[2] = {mat4(1.0f), mat4(2.0f)};
+  m[1].components[5] = -3.0f;
+  EXPECT_EQ(binary_ok, write_binary(path.c_str(), span<const mat4>(m)));
+
+  mapped_array in(path.c_str());
+  EXPECT_FALSE(in.holds<mat3>());
+  EXPECT_FALSE((in.holds<vec<float, 16> >()));
+
+  const span<const mat4> view = in.view<mat4>();
+  ASSERT_EQ(2u, view.size());
+  EXPECT_EQ(4u, in.header().height);
+  EXPECT_EQ(1.0f, view[0].components[15]);
+  EXPECT_EQ(-3.0f, view[1].components[5]);
+
+  std::remove(path.c_str());
+}
+
+TEST(vector_binary, errors) {
+  mapped_array missing(temp_path("p_does_not_exist.pvec").c_str());
+  EXPECT_FALSE(missing.is_open());
+  EXPECT_EQ(binary_io_error, missing.error());
+
+  const std::string path = temp_path("p_garbage.pvec");
+  {
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    const char text[] = "this is not a binary vector file at all, just text";
+    std::fwrite(text, sizeof text, 1, f);
+    std::fclose(f);
+  }
+  mapped_array garbage(path.c_str());
+  EXPECT_EQ(binary_bad_header, garbage.error());
+
+  {
+    // header claims more elements than there are
+    binary_header h = detail::make_binary_header<ivec2>(100);
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    char pad[64] = {0};
+    std::memcpy(pad, &h, sizeof h);
+    std::fwrite(pad, sizeof pad, 1, f);
+    std::fclose(f);
+  }
+  mapped_array truncated(path.c_str());
+  EXPECT_EQ(binary_truncated, truncated.error());
+  EXPECT_TRUE(truncated.view<ivec2>().empty());
+
+  std::remove(path.c_str());
+}
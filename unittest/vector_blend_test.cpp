@@ -0,0 +1,149 @@
+#include "vector_blend.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace p;
+
+namespace {
+  struct isa_guard {
+    isa_guard() : saved(active_isa()) {}
+    ~isa_guard() {force_isa(saved); }
+    isa saved;
+  };
+
+  std::vector<std::uint8_t> random_bytes(std::size_t n, std::uint32_t seed) {
+    std::vector<std::uint8_t> v(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      seed = seed * 1664525u + 1013904223u;
+      v[i] = std::uint8_t(seed >> 24);
+    }
+    return v;
+  }
+
+  // every _n function at the current level against the single versions,
+  // for every length of tail
+  void expect_rows_match() {
+    for (std::size_t n = 0; n < 300; n += n < 70 ? 1 : 37) {
+      const std::vector<std::uint8_t> a = random_bytes(4 * n, 1), b = random_bytes(4 * n, 2);
+      std::vector<std::uint8_t> add(n), sub(n), avg(n), mul(n), mix(n);
+      const span<const std::uint8_t> sa(a.data(), n), sb(b.data(), n);
+      saturating_add_n(sa, sb, add);
+      saturating_sub_n(sa, sb, sub);
+      average_n(sa, sb, avg);
+      mul_high_n(sa, sb, mul);
+      blend_n(sa, sb, std::uint8_t(n), mix);
+      for (std::size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(saturating_add(a[i], b[i]), add[i]) << n;
+        EXPECT_EQ(saturating_sub(a[i], b[i]), sub[i]) << n;
+        EXPECT_EQ(average(a[i], b[i]), avg[i]) << n;
+        EXPECT_EQ(mul_high(a[i], b[i]), mul[i]) << n;
+        EXPECT_EQ(blend(a[i], b[i], std::uint8_t(n)), mix[i]) << n;
+      }
+
+      const span<const ubvec4> src(reinterpret_cast<const ubvec4 *>(a.data()), n),
+        dst(reinterpret_cast<const ubvec4 *>(b.data()), n);
+      std::vector<ubvec4> out(n);
+      over_n(src, dst, span<ubvec4>(out));
+      for (std::size_t i = 0; i < n; ++i) {
+        const ubvec4 e = over(src[i], dst[i]);
+        for (std::size_t c = 0; c < 4; ++c)
+          EXPECT_EQ(e[c], out[i][c]) << n;
+      }
+    }
+  }
+}
+
+TEST(vector_blend, scalar_ops) {
+  for (unsigned a = 0; a < 256; ++a) {
+    for (unsigned b = 0; b < 256; ++b) {
+      const std::uint8_t x = std::uint8_t(a), y = std::uint8_t(b);
+      EXPECT_EQ(std::min(a + b, 255u), saturating_add(x, y));
+      EXPECT_EQ(a > b ? a - b : 0u, saturating_sub(x, y));
+      EXPECT_EQ((a + b + 1) / 2, average(x, y));
+      EXPECT_EQ(a * b / 256, mul_high(x, y));
+      // exact rounding of a + (b - a) * t / 255, t taken from a
+      const double exact = (double(a) * (255 - a) + double(b) * a) / 255.0;
+      EXPECT_EQ(unsigned(std::floor(exact + 0.5)), blend(x, y, x));
+    }
+  }
+  EXPECT_EQ(10, blend(std::uint8_t(10), std::uint8_t(200), 0));
+  EXPECT_EQ(200, blend(std::uint8_t(10), std::uint8_t(200), 255));
+
+  EXPECT_EQ(INT_MAX, saturating_add(INT_MAX, 1));
+  EXPECT_EQ(INT_MIN, saturating_add(INT_MIN, -5));
+  EXPECT_EQ(INT_MIN, saturating_sub(-2, INT_MAX));
+  EXPECT_EQ(INT_MAX, saturating_sub(0, INT_MIN));
+  EXPECT_EQ(INT_MAX, average(INT_MAX, INT_MAX));
+  EXPECT_EQ(0, average(INT_MIN, INT_MAX));
+  EXPECT_EQ(0x3fffffff, mul_high(INT_MAX, INT_MAX));
+  EXPECT_EQ(-1, mul_high(-1, 1));
+
+  const std::uint32_t u_max = UINT32_MAX;
+  EXPECT_EQ(u_max, saturating_add(u_max, std::uint32_t(1)));
+  EXPECT_EQ(u_max, saturating_add(u_max, u_max));
+  EXPECT_EQ(0u, saturating_sub(std::uint32_t(1), u_max));
+  EXPECT_EQ(u_max - 1, saturating_sub(u_max, std::uint32_t(1)));
+  EXPECT_EQ(u_max, average(u_max, u_max));
+  EXPECT_EQ(0x80000000u, average(u_max, std::uint32_t(0)));
+  EXPECT_EQ(u_max - 1, mul_high(u_max, u_max));
+}
+
+TEST(vector_blend, vectors) {
+  const ubvec3 a = make_vec<unsigned char>(200, 10, 128), b = make_vec<unsigned char>(100, 20, 128);
+  const ubvec3 s = saturating_add(a, b), d = saturating_sub(a, b), m = blend(a, b, 51);
+  EXPECT_EQ(44, (a + b)[0]);
+  EXPECT_EQ(255, s[0]);
+  EXPECT_EQ(30, s[1]);
+  EXPECT_EQ(100, d[0]);
+  EXPECT_EQ(0, d[1]);
+  EXPECT_EQ(180, m[0]);
+  EXPECT_EQ(12, m[1]);
+  EXPECT_EQ(128, m[2]);
+  EXPECT_EQ(150, average(a, b)[0]);
+  EXPECT_EQ(64, mul_high(a, b)[2]);
+
+  const ivec3 i = make_vec(INT_MAX, INT_MIN, 7);
+  const ivec3 si = saturating_add(i, make_vec(1, -1, 1)), di = saturating_sub(i, make_vec(-1, 1, 9));
+  EXPECT_EQ(INT_MAX, si[0]);
+  EXPECT_EQ(INT_MIN, si[1]);
+  EXPECT_EQ(8, si[2]);
+  EXPECT_EQ(INT_MAX, di[0]);
+  EXPECT_EQ(INT_MIN, di[1]);
+  EXPECT_EQ(-2, di[2]);
+
+  // opaque src hides dst, transparent src keeps it
+  const ubvec4 dst = make_vec<unsigned char>(40, 80, 120, 255);
+  const ubvec4 opaque = make_vec<unsigned char>(1, 2, 3, 255), clear = make_vec<unsigned char>(0, 0, 0, 0);
+  const ubvec4 half_red = make_vec<unsigned char>(128, 0, 0, 128);
+  for (std::size_t c = 0; c < 4; ++c) {
+    EXPECT_EQ(opaque[c], over(opaque, dst)[c]);
+    EXPECT_EQ(dst[c], over(clear, dst)[c]);
+  }
+  EXPECT_EQ(128 + 20, over(half_red, dst)[0]);
+  EXPECT_EQ(255, over(half_red, dst)[3]);
+}
+
+TEST(vector_blend, rows_at_every_level) {
+  isa_guard guard;
+  force_isa(compiled_isa());
+  expect_rows_match();
+  for (int level = compiled_isa() + 1; level <= detected_isa(); ++level) {
+    if (force_isa(isa(level)) != isa(level))
+      continue;
+    expect_rows_match();
+  }
+
+  // in place, on pixels
+  std::vector<ubvec3> row(33, make_vec<unsigned char>(250, 5, 100));
+  const std::vector<ubvec3> more(33, make_vec<unsigned char>(10, 10, 10));
+  saturating_add_n(span<const ubvec3>(row), span<const ubvec3>(more), span<ubvec3>(row));
+  blend_n(span<const ubvec3>(row), span<const ubvec3>(more), 255, span<ubvec3>(row));
+  EXPECT_EQ(10, row[32][0]);
+  saturating_sub_n(span<const ubvec3>(row), span<const ubvec3>(more), span<ubvec3>(row));
+  EXPECT_EQ(0, row[32][2]);
+}
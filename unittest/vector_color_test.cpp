@@ -0,0 +1,104 @@
+#include "vector_color.h"
+#include "vector.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace p;
+
+TEST(vector_color, srgb) {
+  EXPECT_FLOAT_EQ(0.0f, srgb_to_linear(0.0f));
+  EXPECT_FLOAT_EQ(1.0f, srgb_to_linear(1.0f));
+  EXPECT_NEAR(0.21404114, srgb_to_linear(0.5), 1e-8);
+  EXPECT_NEAR(0.5, linear_to_srgb(srgb_to_linear(0.5)), 1e-12);
+  EXPECT_NEAR(0.01, linear_to_srgb(srgb_to_linear(0.01)), 1e-12);
+
+  const vec4 c = srgb_to_linear(make_vec(1.0f, 0.5f, 0.0f, 0.5f));
+  EXPECT_FLOAT_EQ(0.5f, c.a);
+  EXPECT_NEAR(0.21404114f, c.g, 1e-6f);
+  EXPECT_NEAR(0.5f, linear_to_srgb(c).g, 1e-6f);
+}
+
+TEST(vector_color, srgb8) {
+  // 8-bit values come back unchanged
+  for (int i = 0; i < 256; ++i) {
+    const float l = srgb8_to_linear(std::uint8_t(i));
+    EXPECT_FLOAT_EQ(float(srgb_to_linear(i / 255.0)), l) << i;
+    EXPECT_EQ(i, linear_to_srgb8(l)) << i;
+  }
+
+  // and everything else is close to the exact curve
+  for (std::uint32_t u = 0; u <= 0x3f800000u; u += 997) {
+    const float l = detail::bits_float(u);
+    const double exact = 255.0 * linear_to_srgb(double(l));
+    EXPECT_LT(std::fabs(linear_to_srgb8(l) - exact), 0.545) << l;
+  }
+
+  EXPECT_EQ(0, linear_to_srgb8(-1.0f));
+  EXPECT_EQ(0, linear_to_srgb8(std::numeric_limits<float>::quiet_NaN()));
+  EXPECT_EQ(255, linear_to_srgb8(1.0f));
+  EXPECT_EQ(255, linear_to_srgb8(std::numeric_limits<float>::infinity()));
+}
+
+TEST(vector_color, srgb8_n) {
+  // odd counts so that the kernels have a scalar tail
+  const std::size_t n = 37;
+  std::vector<vec4> l(n);
+  for (std::size_t i = 0; i < n; ++i)
+    l[i] = make_vec(float(i) / 36.0f, std::sin(float(i)) * 1.1f,
+                    float(i) * 1e-4f, 1.0f - float(i) / 40.0f);
+  l[3].y = std::numeric_limits<float>::quiet_NaN();
+
+  std::vector<ubvec4> s(n);
+  linear_to_srgb8_n(span<const vec4>(l), span<ubvec4>(s));
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t c = 0; c < 3; ++c)
+      EXPECT_EQ(linear_to_srgb8(l[i][c]), s[i][c]) << i;
+    EXPECT_EQ(pack<std::uint8_t>(l[i]).a, s[i].a) << i;
+  }
+
+  std::vector<vec4> back(n);
+  srgb8_to_linear_n(span<const ubvec4>(s), span<vec4>(back));
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t c = 0; c < 3; ++c)
+      EXPECT_EQ(srgb8_to_linear(s[i][c]), back[i][c]) << i;
+    EXPECT_EQ(unpack(s[i]).a, back[i].a) << i;
+  }
+
+  std::vector<vec3> l3(n);
+  for (std::size_t i = 0; i < n; ++i)
+    l3[i] = make_vec(l[i].x, l[i].y, l[i].a);
+  std::vector<ubvec3> s3(n);
+  linear_to_srgb8_n(span<const vec3>(l3), span<ubvec3>(s3));
+  std::vector<vec3> back3(n);
+  srgb8_to_linear_n(span<const ubvec3>(s3), span<vec3>(back3));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t c = 0; c < 3; ++c) {
+      EXPECT_EQ(linear_to_srgb8(l3[i][c]), s3[i][c]) << i;
+      EXPECT_EQ(srgb8_to_linear(s3[i][c]), back3[i][c]) << i;
+    }
+}
+
+TEST(vector_color, rgba8) {
+  const ubvec4 c = {{0xC0, 0x0F, 0xFE, 0xEE}};
+  EXPECT_EQ(0xC00FFEEEu, to_rgba8(c));
+  EXPECT_EQ(0xC00FFEEEu, to_rgba8(from_rgba8(0xC00FFEEEu)));
+
+  const std::size_t n = 7;
+  std::vector<ubvec4> v(n);
+  for (std::size_t i = 0; i < n; ++i)
+    v[i] = make_vec<std::uint8_t>(std::uint8_t(i), std::uint8_t(16 * i),
+                                  std::uint8_t(255 - i), std::uint8_t(i * i));
+
+  std::vector<std::uint32_t> packed(n);
+  to_rgba8_n(span<const ubvec4>(v), span<std::uint32_t>(packed));
+  std::vector<ubvec4> back(n);
+  from_rgba8_n(span<const std::uint32_t>(packed), span<ubvec4>(back));
+  for (std::size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(to_rgba8(v[i]), packed[i]) << i;
+    EXPECT_EQ(to_rgba8(v[i]), to_rgba8(back[i])) << i;
+  }
+}
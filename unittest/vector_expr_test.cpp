@@ -0,0 +1,41 @@
+#include "vector_expr.h"
+#include "vector.h"
+#include <gtest/gtest.h>
+
+using namespace p;
+
+TEST(vector_expr, evaluate) {
+  const vec3 a = {1.0f, 2.0f, 3.0f};
+  const vec3 b = {-1.0f, 0.5f, 4.0f};
+  const vec3 c = {0.25f, 0.25f, 0.25f};
+
+  const vec3 r = lazy(a) * 2.0f + lazy(b) * 3.0f - c;
+  const vec3 expected = a * 2.0f + b * 3.0f - c;
+  EXPECT_FLOAT_EQ(expected.x, r.x);
+  EXPECT_FLOAT_EQ(expected.y, r.y);
+  EXPECT_FLOAT_EQ(expected.z, r.z);
+
+  const vec3 n = -(a - lazy(b)) / 2.0f;
+  EXPECT_FLOAT_EQ(-1.0f, n.x);
+  EXPECT_FLOAT_EQ(-0.75f, n.y);
+  EXPECT_FLOAT_EQ(0.5f, n.z);
+
+  EXPECT_FLOAT_EQ(dot_product(a + b, c), dot_product(eval(lazy(a) + b), c));
+}
+
+TEST(vector_expr, compound) {
+  vec<int, 6> v = make_vec<6>(10);
+  const vec<int, 6> w = make_vec<6>(3);
+
+  v += lazy(w) * 2;
+  EXPECT_EQ(16, v[0]);
+  EXPECT_EQ(16, v[5]);
+
+  // lhs appearing on the right is fine, every component is read first
+  v -= lazy(v) / 2 - w;
+  EXPECT_EQ(11, v[0]);
+  EXPECT_EQ(11, v[5]);
+
+  v = lazy(v) + w;
+  EXPECT_EQ(14, v[3]);
+}
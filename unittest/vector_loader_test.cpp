@@ -0,0 +1,201 @@
+#include "vector_loader.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <ios>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using namespace p;
+
+namespace {
+  // one vector per line, with keywords, blank lines and odd spacing
+  std::string make_text(std::size_t lines, std::uint32_t seed) {
+    std::ostringstream s;
+    for (std::size_t i = 0; i < lines; ++i) {
+      seed = seed * 1664525u + 1013904223u;
+      if (seed % 50 == 0)
+        s << "zero\n";
+      else if (seed % 50 == 1)
+        s << "\n  \t\n";
+      else
+        s << float(seed % 20000) / 64.0f - 150.0f << ' ' << int(seed >> 20) % 1000
+          << "  " << float(seed >> 8) * 1e-6f << (seed % 3 ? "\n" : "\r\n");
+    }
+    return s.str();
+  }
+
+  struct loaded {
+    std::vector<vec3> vectors;
+    std::size_t batches;
+    parse_result result;
+  };
+
+  loaded load(std::istream &in, thread_pool &pool, std::size_t chunk_size,
+              load_format format = load_as_vectors) {
+    vector_loader<float, 3> loader(in, format, pool, chunk_size);
+    loaded l;
+    l.batches = 0;
+    for (span<const vec3> batch; loader.next(batch); ++l.batches)
+      l.vectors.insert(l.vectors.end(), batch.begin(), batch.end());
+    l.result = loader.result();
+    // stays finished
+    span<const vec3> batch;
+    EXPECT_FALSE(loader.next(batch));
+    return l;
+  }
+
+  loaded load(const std::string &text, thread_pool &pool, std::size_t chunk_size,
+              load_format format = load_as_vectors) {
+    std::istringstream in(text);
+    return load(in, pool, chunk_size, format);
+  }
+
+  /**
+   * Hands out text, then fails the way a file removed under the reader
+   * does: the istream catches the exception and sets badbit.
+   */
+  struct failing_buf : std::streambuf {
+    explicit failing_buf(const std::string &text) : text(text) {
+      char *begin = &this->text[0];
+      setg(begin, begin, begin + this->text.size());
+    }
+    int_type underflow() {throw std::ios_base::failure("device removed"); }
+    std::string text;
+  };
+}
+
+TEST(vector_loader, matches_parse_vectors) {
+  const std::string text = make_text(20000, 1);
+  std::vector<vec3> expected(20000);
+  const parse_result r = parse_vectors(text.data(), text.data() + text.size(),
+                                       span<vec3>(expected));
+  ASSERT_EQ(parse_ok, r.error);
+  expected.resize(r.count);
+
+  thread_pool serial(0), pool(3);
+  const std::size_t chunk_sizes[] = {1, 100, 4096, 1 << 20};
+  for (std::size_t c = 0; c < 4; ++c) {
+    for (int t = 0; t < 2; ++t) {
+      const loaded l = load(text, t ? pool : serial, chunk_sizes[c]);
+      EXPECT_EQ(parse_ok, l.result.error);
+      EXPECT_EQ(r.count, l.result.count);
+      EXPECT_EQ(r.offset, l.result.offset);
+      ASSERT_EQ(expected.size(), l.vectors.size()) << chunk_sizes[c];
+      for (std::size_t i = 0; i < expected.size(); ++i)
+        for (std::size_t j = 0; j < 3; ++j)
+          EXPECT_EQ(expected[i][j], l.vectors[i][j]) << i;
+      if (chunk_sizes[c] == 4096) {
+        EXPECT_LT(10u, l.batches);
+      }
+    }
+  }
+
+  std::size_t total = 0;
+  std::istringstream in(text);
+  const parse_result cb = load_vectors<float, 3>(in, [&](span<const vec3> batch) {
+    EXPECT_EQ(expected[total][0], batch[0][0]);
+    total += batch.size();
+  }, pool);
+  EXPECT_EQ(r.count, cb.count);
+  EXPECT_EQ(r.count, total);
+}
+
+TEST(vector_loader, errors) {
+  thread_pool pool(2);
+  std::string text = make_text(3000, 2);
+  const std::size_t bad = text.size() / 2;
+  text[text.find('\n', bad) + 1] = 'x';
+
+  std::vector<vec3> expected(3000);
+  const parse_result r = parse_vectors(text.data(), text.data() + text.size(),
+                                       span<vec3>(expected));
+  ASSERT_EQ(parse_invalid, r.error);
+  const loaded l = load(text, pool, 256);
+  EXPECT_EQ(parse_invalid, l.result.error);
+  EXPECT_EQ(r.offset, l.result.offset);
+  EXPECT_EQ(r.count, l.result.count);
+  EXPECT_EQ(r.count, l.vectors.size());
+
+  // a vector cut short by the end of the stream
+  const char short_text[] = "1 2 3\n4 5";
+  vec3 two[2];
+  const parse_result rs = parse_vectors(short_text, short_text + 9, span<vec3>(two));
+  const loaded cut = load(short_text, pool, 4);
+  EXPECT_EQ(parse_incomplete, cut.result.error);
+  EXPECT_EQ(1u, cut.vectors.size());
+  EXPECT_EQ(rs.offset, cut.result.offset);
+
+  const loaded empty = load("", pool, 16);
+  EXPECT_EQ(parse_ok, empty.result.error);
+  EXPECT_EQ(0u, empty.vectors.size());
+  EXPECT_EQ(0u, empty.batches);
+}
+
+TEST(vector_loader, colors_and_long_lines) {
+  thread_pool pool(1);
+  const loaded l = load("0xFF0080\nred\n0x00ff00 null\n1 0.5 0.25", pool, 3, load_as_colors);
+  EXPECT_EQ(parse_ok, l.result.error);
+  ASSERT_EQ(5u, l.vectors.size());
+  EXPECT_FLOAT_EQ(128.0f / 255.0f, l.vectors[0][2]);
+  EXPECT_FLOAT_EQ(1.0f, l.vectors[1][0]);
+  EXPECT_FLOAT_EQ(1.0f, l.vectors[2][1]);
+  EXPECT_FLOAT_EQ(0.0f, l.vectors[3][1]);
+  EXPECT_FLOAT_EQ(0.25f, l.vectors[4][2]);
+
+  // hex is only accepted as a color
+  EXPECT_EQ(parse_invalid, load("0xFF0080\n", pool, 3).result.error);
+
+  // many vectors on one line much longer than a chunk
+  std::string line;
+  for (int i = 0; i < 500; ++i)
+    line += "1 2 3 ";
+  const loaded big = load(line + "\n4 5 6\n", pool, 16);
+  EXPECT_EQ(501u, big.vectors.size());
+  EXPECT_FLOAT_EQ(6.0f, big.vectors[500][2]);
+}
+
+TEST(vector_loader, read_errors) {
+  // the whole test runs on another thread, so that a worker left waiting
+  // fails it instead of hanging
+  std::future<void> f = std::async(std::launch::async, [] {
+    const std::string text = make_text(5000, 3);
+    std::vector<vec3> expected(5000);
+    const parse_result r = parse_vectors(text.data(), text.data() + text.size(),
+                                         span<vec3>(expected));
+    ASSERT_EQ(parse_ok, r.error);
+
+    thread_pool pool(3);
+    // a directory opens but cannot be read
+    std::ifstream dir(".", std::ios::binary);
+    const loaded d = load(dir, pool, 256);
+    EXPECT_EQ(parse_read_error, d.result.error);
+    EXPECT_EQ(0u, d.vectors.size());
+
+    // failing half way, after several rounds of chunks were handed out
+    failing_buf buf(text.substr(0, text.size() / 2));
+    std::istream in(&buf);
+    const loaded l = load(in, pool, 512);
+    EXPECT_EQ(parse_read_error, l.result.error);
+    EXPECT_LT(10u, l.batches);
+    EXPECT_EQ(l.vectors.size(), l.result.count);
+    ASSERT_LT(l.vectors.size(), r.count);
+    for (std::size_t i = 0; i < l.vectors.size(); ++i)
+      for (std::size_t j = 0; j < 3; ++j)
+        EXPECT_EQ(expected[i][j], l.vectors[i][j]) << i;
+
+    // every worker is idle again: the pool runs new work, and its
+    // destructor joins them
+    std::atomic<std::size_t> chunks(0);
+    pool.parallel_for(64, 1, [&](std::size_t, std::size_t) {++chunks; });
+    EXPECT_EQ(64u, chunks.load());
+  });
+  ASSERT_EQ(std::future_status::ready, f.wait_for(std::chrono::seconds(30)));
+  f.get();
+}
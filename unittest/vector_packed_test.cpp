@@ -0,0 +1,186 @@
+#include "vector_packed.h"
+#include "vector.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace p;
+
+TEST(vector_packed, half) {
+  EXPECT_EQ(2u, sizeof(half));
+  EXPECT_EQ(6u, sizeof(hvec3));
+
+  // exact values
+  const float exact[] = {0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, 6.103515625e-05f,
+                         5.9604644775390625e-08f, 1024.0f, -0.099975586f};
+  for (std::size_t i = 0; i < sizeof exact / sizeof *exact; ++i)
+    EXPECT_EQ(exact[i], float(half(exact[i]))) << exact[i];
+
+  EXPECT_EQ(0x3c00, half(1.0f).bits);
+  EXPECT_EQ(0xc000, half(-2.0f).bits);
+  EXPECT_EQ(0x7bff, half(65504.0f).bits);
+  EXPECT_EQ(0x0001, half(5.9604644775390625e-08f).bits);
+  EXPECT_EQ(0x8000, half(-0.0f).bits);
+
+  // round to nearest even, in the normal and the subnormal range
+  EXPECT_EQ(0x3c00, half(1.0f + 1.0f / 2048).bits);       // tie, down to even
+  EXPECT_EQ(0x3c02, half(1.0f + 3.0f / 2048).bits);       // tie, up to even
+  EXPECT_EQ(0x3c01, half(1.0f + 1.0f / 2048 + 1e-6f).bits);
+  EXPECT_EQ(0x0000, half(2.98e-08f).bits);
+  EXPECT_EQ(0x0001, half(2.99e-08f).bits);
+
+  // overflow and the special values
+  EXPECT_EQ(0x7bff, half(65519.0f).bits);
+  EXPECT_EQ(0x7c00, half(65520.0f).bits);
+  EXPECT_EQ(0xfc00, half(-1e10f).bits);
+  EXPECT_EQ(0x7c00, half(std::numeric_limits<float>::infinity()).bits);
+  EXPECT_TRUE(std::isinf(float(half::from_bits(0x7c00))));
+  EXPECT_TRUE(std::isnan(float(half(std::numeric_limits<float>::quiet_NaN()))));
+
+  // every half survives the round trip through float
+  for (std::uint32_t b = 0; b < 0x10000; ++b) {
+    const half h = half::from_bits(std::uint16_t(b));
+    if (std::isnan(float(h)))
+      continue;
+    EXPECT_EQ(h.bits, half(float(h)).bits) << b;
+  }
+}
+
+TEST(vector_packed, normalized) {
+  EXPECT_EQ(32767, snorm16(1.0f).value);
+  EXPECT_EQ(-32767, snorm16(-1.0f).value);
+  EXPECT_EQ(-32767, snorm16(-3.0f).value);
+  EXPECT_EQ(0, snorm16(0.0f).value);
+  EXPECT_EQ(16384, snorm16(0.5f).value);
+  EXPECT_EQ(1.0f, float(snorm16(1.0f)));
+  snorm16 lowest;
+  lowest.value = -32768;
+  EXPECT_EQ(-1.0f, float(lowest));
+
+  EXPECT_EQ(255, unorm8(1.0f).value);
+  EXPECT_EQ(0, unorm8(-1.0f).value);
+  EXPECT_EQ(128, unorm8(0.5f).value);
+  EXPECT_EQ(1.0f, float(unorm8(2.0f)));
+
+  for (int i = -32768; i <= 32767; ++i) {
+    const std::int16_t v = std::int16_t(std::max(i, -32767));
+    EXPECT_EQ(v, detail::float_to_snorm16(detail::snorm16_to_float(std::int16_t(i)))) << i;
+  }
+  for (int i = 0; i < 256; ++i)
+    EXPECT_EQ(i, detail::float_to_unorm8(detail::unorm8_to_float(std::uint8_t(i)))) << i;
+}
+
+TEST(vector_packed, operators) {
+  const hvec3 a = {1.0f, 2.0f, 3.0f};
+  const hvec3 b = {0.5f, 0.25f, -1.0f};
+  const hvec3 c = a + b * 2.0f;
+  EXPECT_EQ(2.0f, float(c.x));
+  EXPECT_EQ(2.5f, float(c.y));
+  EXPECT_EQ(1.0f, float(c.z));
+
+  hvec3 d = a;
+  d *= 0.5f;
+  d += b;
+  EXPECT_EQ(1.0f, float(d.x));
+  EXPECT_EQ(-1.0f, float((-d).x));
+  EXPECT_EQ(-2.0f, float(dot_product(a, b)));
+
+  const vec<snorm16, 3> n = pack<snorm16>(normalize(make_vec(1.0f, 2.0f, 2.0f)));
+  const vec3 nf = unpack(n);
+  EXPECT_NEAR(1.0f / 3.0f, nf.x, 1.0f / 32767);
+  EXPECT_NEAR(2.0f / 3.0f, nf.z, 1.0f / 32767);
+
+  const vec<unorm8, 4> u = pack<unorm8>(make_vec(0.0f, 0.2f, 0.6f, 1.0f));
+  EXPECT_EQ(51, u.y.value);
+  EXPECT_EQ(153, u.z.value);
+  const vec<unorm8, 4> half_u = u * 0.5f;
+  EXPECT_EQ(128, half_u.w.value);
+
+  const ubvec4 raw = pack<std::uint8_t>(make_vec(0.0f, 0.2f, 0.6f, 1.0f));
+  EXPECT_EQ(153, raw.z);
+  EXPECT_FLOAT_EQ(0.6f, unpack(raw).z);
+}
+
+TEST(vector_packed, pack_n) {
+  // odd counts so that every kernel has a scalar tail
+  const std::size_t n = 37;
+  std::vector<vec3> in(n);
+  for (std::size_t i = 0; i < n; ++i)
+    in[i] = make_vec(std::sin(float(i)) * 1.2f, float(i) / 37.0f - 0.5f,
+                     float(i) * 1000.0f + 0.3f);
+
+  std::vector<hvec3> h(n);
+  std::vector<vec<snorm16, 3> > s(n);
+  std::vector<vec<unorm8, 3> > u(n);
+  std::vector<ubvec3> raw(n);
+  pack_n(span<const vec3>(in), span<hvec3>(h));
+  pack_n(span<const vec3>(in), span<vec<snorm16, 3> >(s));
+  pack_n(span<const vec3>(in), span<vec<unorm8, 3> >(u));
+  pack_n(span<const vec3>(in), span<ubvec3>(raw));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t c = 0; c < 3; ++c) {
+      EXPECT_EQ(half(in[i][c]).bits, h[i][c].bits) << i;
+      EXPECT_EQ(snorm16(in[i][c]).value, s[i][c].value) << i;
+      EXPECT_EQ(unorm8(in[i][c]).value, u[i][c].value) << i;
+      EXPECT_EQ(u[i][c].value, raw[i][c]) << i;
+    }
+
+  std::vector<vec3> out(n);
+  unpack_n(span<const hvec3>(h), span<vec3>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t c = 0; c < 3; ++c)
+      EXPECT_EQ(float(h[i][c]), out[i][c]) << i;
+
+  unpack_n(span<const vec<snorm16, 3> >(s), span<vec3>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t c = 0; c < 3; ++c)
+      EXPECT_EQ(float(s[i][c]), out[i][c]) << i;
+
+  unpack_n(span<const ubvec3>(raw), span<vec3>(out));
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t c = 0; c < 3; ++c)
+      EXPECT_EQ(float(u[i][c]), out[i][c]) << i;
+
+  // every half through the batch kernels, and floats around the edges of
+  // the half range
+  std::vector<half> all(0x10000);
+  for (std::uint32_t b = 0; b < 0x10000; ++b)
+    all[b] = half::from_bits(std::uint16_t(b));
+  std::vector<float> wide(all.size());
+  unpack_n(span<const half>(all), span<float>(wide));
+  for (std::uint32_t b = 0; b < 0x10000; ++b) {
+    const float expected = all[b];
+    if (std::isnan(expected)) {
+      EXPECT_TRUE(std::isnan(wide[b])) << b;
+    } else {
+      EXPECT_EQ(detail::float_bits(expected), detail::float_bits(wide[b])) << b;
+    }
+  }
+  const float edges[] = {65504.0f, 65519.0f, 65520.0f, 1e9f, 6.1035156e-5f,
+                         6.0975552e-5f, 2.9802322e-8f, 2.9802326e-8f, 1e-9f,
+                         0.0f, std::numeric_limits<float>::infinity(),
+                         std::numeric_limits<float>::quiet_NaN()};
+  for (std::size_t k = 0; k < sizeof edges / sizeof edges[0]; ++k) {
+    wide.push_back(edges[k]);
+    wide.push_back(-edges[k]);
+  }
+  std::vector<half> narrow(wide.size());
+  pack_n(span<const float>(wide), span<half>(narrow));
+  for (std::size_t i = 0; i < wide.size(); ++i) {
+    if (!std::isnan(wide[i])) {
+      EXPECT_EQ(half(wide[i]).bits, narrow[i].bits) << i;
+    }
+  }
+
+  // single components, with values around the rounding ties
+  std::vector<float> f(101);
+  for (std::size_t i = 0; i < f.size(); ++i)
+    f[i] = (float(i) - 50.0f) / 50.0f + 0.5f / 32767.0f;
+  std::vector<std::int16_t> i16(f.size());
+  pack_n(span<const float>(f), span<std::int16_t>(i16));
+  for (std::size_t i = 0; i < f.size(); ++i)
+    EXPECT_EQ(detail::float_to_snorm16(f[i]), i16[i]) << i;
+}
@@ -0,0 +1,101 @@
+#include "vector_soa.h"
+#include "vector.h"
+#include <gtest/gtest.h>
+
+#include <cstddef>
+
+using namespace p;
+
+TEST(vector_soa, convert) {
+  vec3 aos[5];
+  for (std::size_t i = 0; i < 5; ++i)
+    aos[i] = make_vec(float(i), float(i) * 2.0f, -float(i));
+
+  vec3_soa soa(aos, 5);
+  ASSERT_EQ(5u, soa.size());
+  EXPECT_FLOAT_EQ(3.0f, soa.component(0)[3]);
+  EXPECT_FLOAT_EQ(6.0f, soa.component(1)[3]);
+  EXPECT_FLOAT_EQ(-3.0f, soa.component(2)[3]);
+  EXPECT_EQ(0u, reinterpret_cast<std::size_t>(soa.component(1)) % vec3_soa::alignment);
+
+  vec3 back[5];
+  soa.copy_to(back);
+  for (std::size_t i = 0; i < 5; ++i) {
+    EXPECT_FLOAT_EQ(aos[i].x, back[i].x);
+    EXPECT_FLOAT_EQ(aos[i].y, back[i].y);
+    EXPECT_FLOAT_EQ(aos[i].z, back[i].z);
+  }
+}
+
+TEST(vector_soa, proxy) {
+  vec3_soa soa(3);
+  soa[1] = make_vec(1.0f, 2.0f, 3.0f);
+  soa[2] = soa[1];
+  soa[2][0] = 10.0f;
+
+  const vec3 v = soa[2];
+  EXPECT_FLOAT_EQ(10.0f, v.x);
+  EXPECT_FLOAT_EQ(2.0f, v.y);
+  EXPECT_FLOAT_EQ(3.0f, v.z);
+
+  const vec3 zero = soa[0];
+  EXPECT_FLOAT_EQ(0.0f, zero.x);
+
+  soa.resize(100);
+  const vec3 kept = soa[1];
+  EXPECT_FLOAT_EQ(1.0f, kept.x);
+  EXPECT_FLOAT_EQ(3.0f, kept.z);
+}
+
+TEST(vector_soa, kernels) {
+  const std::size_t n = 11;
+  vec3 a[n], b[n];
+  for (std::size_t i = 0; i < n; ++i) {
+    a[i] = make_vec(float(i) + 1.0f, 2.0f, -1.0f);
+    b[i] = make_vec(0.5f, float(i), 3.0f);
+  }
+
+  const vec3_soa sa(a, n), sb(b, n);
+  vec3_soa out;
+  float dots[n];
+
+  dot_product(sa, sb, dots);
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_FLOAT_EQ(dot_product(a[i], b[i]), dots[i]);
+
+  cross_product(sa, sb, out);
+  for (std::size_t i = 0; i < n; ++i) {
+    const vec3 expected = cross_product(a[i], b[i]);
+    const vec3 v = out[i];
+    EXPECT_FLOAT_EQ(expected.x, v.x);
+    EXPECT_FLOAT_EQ(expected.y, v.y);
+    EXPECT_FLOAT_EQ(expected.z, v.z);
+  }
+
+  normalize(sa, out);
+  for (std::size_t i = 0; i < n; ++i) {
+    const vec3 expected = normalize(a[i]);
+    const vec3 v = out[i];
+    EXPECT_FLOAT_EQ(expected.x, v.x);
+    EXPECT_FLOAT_EQ(expected.y, v.y);
+    EXPECT_FLOAT_EQ(expected.z, v.z);
+  }
+
+  add(sa, sb, out);
+  scale(out, 2.0f, out);
+  EXPECT_FLOAT_EQ(3.0f, out[0][0]);
+  EXPECT_FLOAT_EQ(4.0f + 2.0f * 10.0f, out[10][1]);
+
+  p::min(sa, sb, out);
+  EXPECT_FLOAT_EQ(0.5f, out[3][0]);
+  EXPECT_FLOAT_EQ(2.0f, out[3][1]);
+  EXPECT_FLOAT_EQ(-1.0f, out[3][2]);
+
+  p::max(sa, sb, out);
+  EXPECT_FLOAT_EQ(4.0f, out[3][0]);
+  EXPECT_FLOAT_EQ(3.0f, out[3][1]);
+
+  lerp(sa, sb, 0.25f, out);
+  EXPECT_FLOAT_EQ(0.0f, out[0][2]);
+  EXPECT_FLOAT_EQ(0.75f * 2.0f + 0.25f * 4.0f, out[4][1]);
+}
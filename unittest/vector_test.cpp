@@ -5,9 +5,22 @@
 
 #include <string>
 #include <sstream>
+#include <utility>
 
 using namespace p;
 
+namespace {
+  // whether v * s and v /= s compile
+  template<typename V, typename S, typename = void>
+  struct scales_by {static const bool value = false; };
+
+  template<typename V, typename S>
+  struct scales_by<V, S, decltype(void(std::declval<V>() * std::declval<S>()),
+                                  void(std::declval<V &>() /= std::declval<S>()))> {
+    static const bool value = true;
+  };
+}
+
 #pragma mark - Operators
 TEST(utils_vector, mul) {
   vec3 v = {1.0f, 2.0f, 3.0f};
@@ -19,6 +32,27 @@ TEST(utils_vector, mul) {
   EXPECT_FLOAT_EQ(18.0f, v.z);
 }
 
+TEST(utils_vector, mixed_scalar) {
+  // a scalar that would lose its value converted to the component type
+  // is refused, rather than ivec3(3) * 1.5 giving 3
+  static_assert(!scales_by<ivec3, double>::value, "int vector times double");
+  static_assert(!scales_by<ivec3, float>::value, "int vector times float");
+  static_assert(!scales_by<vec3, double>::value, "float vector times double");
+  static_assert(!scales_by<ubvec4, int>::value, "byte vector times int");
+  static_assert(scales_by<vec3, float>::value, "float vector times float");
+  static_assert(scales_by<vec<double, 3>, float>::value, "double vector times float");
+  static_assert(scales_by<ivec3, short>::value, "int vector times short");
+
+  ivec3 v = make_vec(3, -6, 9);
+  v *= short(2);
+  v = v / 3;
+  EXPECT_EQ(2, v.x);
+  EXPECT_EQ(-4, v.y);
+  EXPECT_EQ(6, v.z);
+  const vec<double, 2> d = make_vec(1.0, 3.0) * 0.5f;
+  EXPECT_DOUBLE_EQ(1.5, d.y);
+}
+
 TEST(utils_vector, negation) {
   vec3 v = {1.0f, 2.0f, 3.0f};
   vec3 v2 = -v;
@@ -48,6 +82,44 @@ TEST(utils_vector, add) {
   EXPECT_FLOAT_EQ(10.2f, v.z);
 }
 
+TEST(utils_vector, vec4_ops) {
+  vec4 v1 = {1.0f, 2.0f, 3.0f, 4.0f};
+  vec4 v2 = {8.0f, -2.0f, 0.5f, 4.0f};
+
+  vec4 v = (v1 + v2) * 2.0f - v1;
+  EXPECT_FLOAT_EQ(17.0f, v.x);
+  EXPECT_FLOAT_EQ(-2.0f, v.y);
+  EXPECT_FLOAT_EQ(4.0f, v.z);
+  EXPECT_FLOAT_EQ(12.0f, v.w);
+
+  v /= 4.0f;
+  EXPECT_FLOAT_EQ(4.25f, v.x);
+  EXPECT_FLOAT_EQ(3.0f, v.w);
+
+  const vec4 &lo = p::min(v1, v2);
+  const vec4 &hi = p::max(v1, v2);
+  EXPECT_FLOAT_EQ(1.0f, lo.x);
+  EXPECT_FLOAT_EQ(-2.0f, lo.y);
+  EXPECT_FLOAT_EQ(8.0f, hi.x);
+  EXPECT_FLOAT_EQ(3.0f, hi.z);
+  EXPECT_FLOAT_EQ(4.0f, hi.w);
+
+  EXPECT_FLOAT_EQ(21.5f, dot_product(v1, v2));
+}
+
+TEST(utils_vector, vec3_padding) {
+  // the padded lane must not leak into the neighbouring memory
+  float buf[4] = {1.0f, 2.0f, 3.0f, 42.0f};
+  vec3 &v = *reinterpret_cast<vec3 *>(buf);
+  v = v / make_vec(1.0f, 2.0f, 4.0f);
+  v += make_vec(1.0f, 1.0f, 1.0f);
+
+  EXPECT_FLOAT_EQ(2.0f, buf[0]);
+  EXPECT_FLOAT_EQ(2.0f, buf[1]);
+  EXPECT_FLOAT_EQ(1.75f, buf[2]);
+  EXPECT_FLOAT_EQ(42.0f, buf[3]);
+}
+
 TEST(utils_vector, pod) {
   float buf[6] = {-1.0f, 2.0f, 4.0f, 8.0f, 20.0f, -3.0f};
   
@@ -117,6 +189,90 @@ TEST(utils_vector, lerp) {
   
 }
 
+namespace {
+  struct palette {
+    vec3 colors[5];
+  };
+
+  constexpr palette make_palette() {
+    palette ret = {};
+    const vec3 from = {0.0f, 0.5f, 1.0f};
+    const vec3 to = {1.0f, 0.5f, 0.0f};
+    for (std::size_t i = 0; i < 5; ++i)
+      ret.colors[i] = lerp(from, to, float(i) / 4.0f);
+    return ret;
+  }
+}
+
+TEST(utils_vector, constexpr_ops) {
+  constexpr vec3 a = {1.0f, 2.0f, 3.0f};
+  constexpr vec3 b = {4.0f, 0.0f, -1.0f};
+
+  static_assert(dot_product(a, b) == 1.0f, "dot_product");
+  static_assert(cross_product(a, b)[0] == -2.0f, "cross_product");
+  static_assert(cross_product(a, b)[1] == 13.0f, "cross_product");
+  static_assert(cross_product(a, b)[2] == -8.0f, "cross_product");
+  static_assert((a + b * 2.0f)[0] == 9.0f, "operators");
+  static_assert((-a)[2] == -3.0f, "negation");
+  static_assert(min(a, b)[2] == -1.0f && max(a, b)[0] == 4.0f, "min/max");
+  static_assert(max(a) == 3.0f, "max");
+  static_assert(make_vec<4>(2.0f)[3] == 2.0f, "make_vec");
+
+  constexpr vec4 c = {1.0f, 2.0f, 3.0f, 4.0f};
+  static_assert(dot_product(c, c) == 30.0f, "dot_product");
+  static_assert((c / 2.0f)[3] == 2.0f, "operators");
+
+  constexpr palette table = make_palette();
+  static_assert(table.colors[0][0] == 0.0f && table.colors[4][0] == 1.0f, "lerp");
+  static_assert(table.colors[2][2] == 0.5f, "lerp");
+
+  // the same code at run time
+  const vec3 mid = lerp(make_vec(0.0f, 0.5f, 1.0f), make_vec(1.0f, 0.5f, 0.0f), 0.25f);
+  EXPECT_FLOAT_EQ(table.colors[1].x, mid.x);
+  EXPECT_FLOAT_EQ(table.colors[1].z, mid.z);
+}
+
+TEST(utils_vector, constexpr_algorithm) {
+  static_assert(clamp(5, 0, 3) == 3, "clamp");
+  static_assert(clamp(-1.0, std::make_pair(0.0, 1.0)) == 0.0, "clamp");
+  static_assert(saturate(1.5f) == 1.0f, "saturate");
+  static_assert(wrap(370.0, 0.0, 360.0) == 10.0, "wrap");
+  static_assert(wrap(-10.0f, 0.0f, 360.0f) == 350.0f, "wrap");
+
+  EXPECT_DOUBLE_EQ(10.0, wrap(370.0, 0.0, 360.0));
+  EXPECT_FLOAT_EQ(350.0f, wrap(-10.0f, 0.0f, 360.0f));
+}
+
+TEST(utils_vector, algorithm) {
+  const vec4 v = {-0.5f, 0.25f, 1.5f, 3.0f};
+
+  const vec4 c = clamp(v, 0.0f, 2.0f);
+  EXPECT_EQ(0.0f, c.x); EXPECT_EQ(0.25f, c.y); EXPECT_EQ(1.5f, c.z); EXPECT_EQ(2.0f, c.w);
+
+  const vec4 lo = {0.0f, 0.5f, 0.0f, 0.0f}, hi = {1.0f, 1.0f, 1.0f, 5.0f};
+  const vec4 cv = clamp(v, lo, hi);
+  EXPECT_EQ(0.0f, cv.x); EXPECT_EQ(0.5f, cv.y); EXPECT_EQ(1.0f, cv.z); EXPECT_EQ(3.0f, cv.w);
+
+  const vec3 s = saturate(make_vec(-1.0f, 0.5f, 2.0f));
+  EXPECT_EQ(0.0f, s.x); EXPECT_EQ(0.5f, s.y); EXPECT_EQ(1.0f, s.z);
+
+  const ivec3 si = clamp(make_vec(-4, 2, 9), 0, 5);
+  EXPECT_EQ(0, si.x); EXPECT_EQ(2, si.y); EXPECT_EQ(5, si.z);
+
+  const vec3 w = wrap(make_vec(370.0f, -10.0f, 90.0f), 0.0f, 360.0f);
+  EXPECT_FLOAT_EQ(10.0f, w.x); EXPECT_FLOAT_EQ(350.0f, w.y); EXPECT_FLOAT_EQ(90.0f, w.z);
+
+  const vec2 wv = wrap(make_vec(2.5f, 2.5f), make_vec(0.0f, -1.0f), make_vec(1.0f, 1.0f));
+  EXPECT_FLOAT_EQ(0.5f, wv.x); EXPECT_FLOAT_EQ(0.5f, wv.y);
+
+  const vec3 l = lerp(make_vec(0.0f, 10.0f, 2.0f), make_vec(10.0f, 20.0f, 4.0f),
+                      make_vec(0.5f, 0.0f, 1.0f));
+  EXPECT_FLOAT_EQ(5.0f, l.x); EXPECT_FLOAT_EQ(10.0f, l.y); EXPECT_FLOAT_EQ(4.0f, l.z);
+
+  static_assert(clamp(make_vec(3.0f, -1.0f), 0.0f, 1.0f)[0] == 1.0f, "constexpr clamp");
+  static_assert(saturate(make_vec(3.0f, -1.0f))[1] == 0.0f, "constexpr saturate");
+}
+
 // TODO: benchmark
 
 TEST(utils_vector, dotproduct) {
@@ -154,6 +310,34 @@ TEST(utils_vector, normalize) {
   // TODO: for vec3 also
 }
 
+TEST(utils_vector, rsqrt) {
+  for (float x = 1e-6f; x < 1e6f; x *= 1.37f) {
+    const float exact = 1.0f / std::sqrt(x);
+    EXPECT_NEAR(exact, p::rsqrt(x), exact * 4.8e-7f);
+    EXPECT_NEAR(exact, p::rsqrt_estimate(x), exact * 0.004f);
+  }
+
+  EXPECT_DOUBLE_EQ(0.5, p::rsqrt(4.0));
+}
+
+TEST(utils_vector, normalize_fast) {
+  using p::normalize_fast;
+
+  for (float f = -4.0f; f < 4.0f; f += 0.37f) {
+    const vec3 v = {f, 1.0f - f * 2.0f, 0.25f};
+    const vec3 exact = normalize(v);
+    const vec3 n = normalize_fast(v);
+    for (std::size_t i = 0; i < 3; ++i)
+      EXPECT_NEAR(exact[i], n[i], std::abs(exact[i]) * 9.6e-7f);
+
+    const vec4 v4 = {f, 3.0f, -f, 0.5f};
+    const vec4 exact4 = normalize(v4);
+    const vec4 n4 = normalize_fast(v4);
+    for (std::size_t i = 0; i < 4; ++i)
+      EXPECT_NEAR(exact4[i], n4[i], std::abs(exact4[i]) * 9.6e-7f);
+  }
+}
+
 // TODO: normalized, magnitude
 
 TEST(utils_vector, string) {
@@ -227,12 +411,158 @@ TEST(utils_vector, color_parse) {
   }
 }
 
+TEST(utils_vector, parse_memory) {
+  {
+    const char text[] = "  1 2.5 -3\n+4 5e1 6 \n NULL\tZero 7 8 9";
+    vec3 v[8];
+    const parse_result r = parse_vectors(text, text + sizeof text - 1, span<vec3>(v));
+    EXPECT_EQ(parse_ok, r.error);
+    ASSERT_EQ(5u, r.count);
+    EXPECT_EQ(sizeof text - 1, r.offset);
+    EXPECT_FLOAT_EQ(2.5f, v[0].y);
+    EXPECT_FLOAT_EQ(-3.0f, v[0].z);
+    EXPECT_FLOAT_EQ(4.0f, v[1].x);
+    EXPECT_FLOAT_EQ(50.0f, v[1].y);
+    EXPECT_FLOAT_EQ(0.0f, v[2].x);
+    EXPECT_FLOAT_EQ(0.0f, v[3].z);
+    EXPECT_FLOAT_EQ(9.0f, v[4].z);
+  }
+
+  {
+    // stops when the output is full; offset is where to resume
+    const char text[] = "1 2 3 4 5 6";
+    ivec2 v[2];
+    const parse_result r = parse_vectors(text, text + sizeof text - 1, span<ivec2>(v));
+    EXPECT_EQ(parse_ok, r.error);
+    EXPECT_EQ(2u, r.count);
+    EXPECT_EQ(7u, r.offset);
+    EXPECT_EQ(4, v[1].y);
+  }
+
+  {
+    const char text[] = "1 2 3 4 x5 6";
+    vec2 v[3];
+    const parse_result r = parse_vectors(text, text + sizeof text - 1, span<vec2>(v));
+    EXPECT_EQ(parse_invalid, r.error);
+    EXPECT_EQ(2u, r.count);
+    EXPECT_EQ(8u, r.offset);
+  }
+
+  {
+    // one sign only
+    const char text[] = "1 +2 3 +-5";
+    vec2 v[2];
+    const parse_result r = parse_vectors(text, text + sizeof text - 1, span<vec2>(v));
+    EXPECT_EQ(parse_invalid, r.error);
+    EXPECT_EQ(1u, r.count);
+    EXPECT_EQ(7u, r.offset);
+
+    const char bytes[] = "+-0 +-1";
+    vec<unsigned char, 2> b[1];
+    EXPECT_EQ(parse_invalid, parse_vectors(bytes, bytes + sizeof bytes - 1,
+                                           span<vec<unsigned char, 2> >(b)).error);
+  }
+
+  {
+    const char text[] = "1 2 3 4 5";
+    vec2 v[3];
+    const parse_result r = parse_vectors(text, text + sizeof text - 1, span<vec2>(v));
+    EXPECT_EQ(parse_incomplete, r.error);
+    EXPECT_EQ(2u, r.count);
+    EXPECT_EQ(9u, r.offset);
+  }
+
+  {
+    const char text[] = "12 300 4";
+    ubvec3 v[1];
+    const parse_result r = parse_vectors(text, text + sizeof text - 1, span<ubvec3>(v));
+    EXPECT_EQ(parse_out_of_range, r.error);
+    EXPECT_EQ(3u, r.offset);
+  }
+
+  {
+    const char text[] = "red 0xFF0088 marsvin";
+    vec3 c[3];
+    const parse_result r = parse_colors(text, text + sizeof text - 1, span<vec3>(c));
+    EXPECT_EQ(parse_invalid, r.error);
+    EXPECT_EQ(2u, r.count);
+    EXPECT_EQ(13u, r.offset);
+    EXPECT_FLOAT_EQ(1.0f, c[0].r);
+    EXPECT_FLOAT_EQ(0.0f, c[0].g);
+    EXPECT_FLOAT_EQ(1.0f, c[1].r);
+    EXPECT_FLOAT_EQ(0.0f, c[1].g);
+    EXPECT_NEAR(0.53333f, c[1].b, 0.0001f);
+
+    ubvec4 u[1];
+    const char hex[] = "0xC00FFEEE";
+    parse_colors(hex, hex + sizeof hex - 1, span<ubvec4>(u));
+    EXPECT_EQ(0xC0, u[0].r);
+    EXPECT_EQ(0x0F, u[0].g);
+    EXPECT_EQ(0xFE, u[0].b);
+    EXPECT_EQ(0xEE, u[0].a);
+  }
+}
+
 TEST(utils_vector, color_print) {
-  
   {
     std::stringstream ss;
+    ss << color_writer(make_vec(1.0f, 0.53333333f, 0.0f));
+    EXPECT_STREQ("0xFF8800", ss.str().c_str());
+  }
+
+  {
+    std::stringstream ss;
+    const ubvec4 c = {0xC0, 0x0F, 0xFE, 0x0E};
+    ss << std::hex << c;
+    EXPECT_STREQ("0xC00FFE0E", ss.str().c_str());
+  }
+
+  {
+    // every 8-bit value survives a round trip through floats
+    for (int i = 0; i < 256; ++i) {
+      const ubvec3 b = {(unsigned char)i, 0, 0};
+      vec3 f;
+      std::stringstream ss;
+      ss << color_writer(b);
+      ss >> color_reader(f);
+      std::stringstream out;
+      out << color_writer(f);
+      EXPECT_EQ(ss.str(), out.str());
+    }
+  }
+}
+
+TEST(utils_vector, format_memory) {
+  {
+    const vec3 v[2] = {{{3.0f, 0.1f, -1.5f}}, {{1e-7f, 123456.7f, 0.0f}}};
+    char buf[64];
+    const format_result r = format_vectors(span<const vec3>(v), buf, buf + sizeof buf);
+    EXPECT_EQ(2u, r.count);
+    EXPECT_EQ("3 0.1 -1.5\n1e-07 123456.7 0\n", std::string(buf, r.size));
+
+    // shortest form reads back exactly
+    vec3 back[2];
+    parse_vectors(buf, buf + r.size, span<vec3>(back));
+    EXPECT_EQ(v[1].x, back[1].x);
+    EXPECT_EQ(v[1].y, back[1].y);
   }
 
+  {
+    // stops at the last vector that fits
+    const ubvec3 v[2] = {{{255, 0, 7}}, {{1, 2, 3}}};
+    char buf[12];
+    const format_result r = format_vectors(span<const ubvec3>(v), buf, buf + sizeof buf);
+    EXPECT_EQ(1u, r.count);
+    EXPECT_EQ("255 0 7\n", std::string(buf, r.size));
+  }
+
+  {
+    const vec4 c[2] = {{{1.0f, 0.0f, 0.5f, 1.0f}}, {{0.0f, 0.0f, 0.0f, 0.0f}}};
+    char buf[32];
+    const format_result r = format_colors(span<const vec4>(c), buf, buf + sizeof buf);
+    EXPECT_EQ(2u, r.count);
+    EXPECT_EQ("0xFF0080FF\n0x00000000\n", std::string(buf, r.size));
+  }
 }
 
 // TODO: performance tests, crossproduct
@@ -10,7 +10,21 @@
  *
  * Operations that can be done on vectors:
  *   - + * / += -= *= /= min max transform dot_product cross_product normalize
- *   magnitude
+ *   normalize_fast magnitude rsqrt
+ *   lerp clamp saturate wrap (from algorithm.h, component-wise)
+ *
+ * vec<float, 4> and vec<float, 3> use the SIMD registers from simd.h for the
+ * arithmetic operators, min/max and dot_product. vec<float, 3> keeps its
+ * three-float layout and is padded to four lanes only while in a register.
+ * Define P_NO_SIMD to get the plain component-wise code everywhere, and
+ * P_ALIGNED_VEC to align vec<float, 4> to 16 bytes (see config.h).
+ *
+ * Define P_INSTRUMENT to count the operations per type (see instrument.h).
+ *
+ * make_vec, the operators, transform, min, max, foldl, dot_product and
+ * cross_product are constexpr (see config.h), so tables of vectors can be
+ * computed at compile time. Constant expressions must access components
+ * through [], not .x/.r/.s, which are the other members of a union.
  * -------------------------------------------------------------------------- */
 
 #ifndef P_UTILS_VECTOR_H
@@ -24,10 +38,14 @@
 #include <memory>
 #include <cstring>
 #include <string>
+#include <utility>
 
-namespace p {
-  // TODO: make sure clamp, lerp, etc. work with vectors
+#include "algorithm.h"
+#include "config.h"
+#include "instrument.h"
+#include "simd.h"
 
+namespace p {
   /**
    * The general case.
    */
@@ -36,8 +54,8 @@ namespace p {
     typedef T value_type;
     static const std::size_t size = N;
   
-    inline T &operator [](std::size_t pos) {return components[pos];}
-    inline T operator [](std::size_t pos) const {return components[pos];}
+    P_CONSTEXPR T &operator [](std::size_t pos) {return components[pos];}
+    P_CONSTEXPR T operator [](std::size_t pos) const {return components[pos];}
   
     T components[size];
   };
@@ -56,13 +74,13 @@ namespace p {
     typedef T value_type;
     static const std::size_t size = 2;
     
-    inline T &operator [](std::size_t pos) {return components[pos];}
-    inline T operator [](std::size_t pos) const {return components[pos];}
+    P_CONSTEXPR T &operator [](std::size_t pos) {return components[pos];}
+    P_CONSTEXPR T operator [](std::size_t pos) const {return components[pos];}
     
     union {
+      struct {T components[size]; };
       struct {T x, y; };
       struct {T s, t; };
-      struct {T components[size]; };
     };
   };
 
@@ -75,15 +93,15 @@ namespace p {
     typedef T value_type;
     static const std::size_t size = 3;
 
-    inline T &operator [](std::size_t pos) {return components[pos];}
-    inline T operator [](std::size_t pos) const {return components[pos];}
+    P_CONSTEXPR T &operator [](std::size_t pos) {return components[pos];}
+    P_CONSTEXPR T operator [](std::size_t pos) const {return components[pos];}
 
 
     union {
+      struct {T components[size]; };
       struct {T x, y, z; };
       struct {T s, t, p; };
       struct {T r, g, b; };
-      struct {T components[size]; };
     };
   };
   
@@ -91,139 +109,377 @@ namespace p {
    * Specialization of vector for 4 components, which must be POD type.
    */
   template<typename T>
-  struct vec<T, 4> {
+  struct alignas(detail::vec_alignment<T, 4>::value) vec<T, 4> {
     typedef T value_type;
     static const int size = 4;
     
-    inline T &operator [](std::size_t pos) {return components[pos];}
-    inline T operator [](std::size_t pos) const {return components[pos];}
+    P_CONSTEXPR T &operator [](std::size_t pos) {return components[pos];}
+    P_CONSTEXPR T operator [](std::size_t pos) const {return components[pos];}
     
     union {
+      struct {T components[size]; };
       struct {T x, y, z, w; };
       struct {T s, t, p, q; };
       struct {T r, g, b, a; };
-      struct {T components[size]; };
     };    
   };
 
 
   template<typename T>
-  inline vec<T, 2> make_vec(T x, T y) {
+  P_CONSTEXPR vec<T, 2> make_vec(T x, T y) {
     const vec<T, 2> r = {x, y}; return r;
   }
   template<typename T>
-  inline vec<T, 3> make_vec(T x, T y, T z) {
+  P_CONSTEXPR vec<T, 3> make_vec(T x, T y, T z) {
     const vec<T, 3> r = {x, y, z}; return r;
   }
   template<typename T>
-  inline vec<T, 4> make_vec(T x, T y, T z, T w) {
+  P_CONSTEXPR vec<T, 4> make_vec(T x, T y, T z, T w) {
     const vec<T, 4> r = {x, y, z, w}; return r;
   }
 
   namespace detail {
     template<std::size_t sz, typename T>
     struct scalar_helper {
-      static vec<T, sz> make(T s) {
-        vec<T, sz> r;
-        T *beg = reinterpret_cast<T *>(&r);
-        T *end = beg + sz;
-        std::fill(beg, end, s);
+      static P_CONSTEXPR vec<T, sz> make(T s) {
+        vec<T, sz> r = {};
+        for (std::size_t i = 0; i < sz; ++i)
+          r[i] = s;
         return r;
       }
     };
     
     template<typename T>
-    struct scalar_helper<2, T> {static vec<T, 2> make(T s) {return make_vec<T>(s, s); }};
+    struct scalar_helper<2, T> {static P_CONSTEXPR vec<T, 2> make(T s) {return make_vec<T>(s, s); }};
     template<typename T>
-    struct scalar_helper<3, T> {static vec<T, 3> make(T s) {return make_vec<T>(s, s, s); }};
+    struct scalar_helper<3, T> {static P_CONSTEXPR vec<T, 3> make(T s) {return make_vec<T>(s, s, s); }};
     template<typename T>
-    struct scalar_helper<4, T> {static vec<T, 4> make(T s) {return make_vec<T>(s, s, s, s); }};
+    struct scalar_helper<4, T> {static P_CONSTEXPR vec<T, 4> make(T s) {return make_vec<T>(s, s, s, s); }};
+
+    /**
+     * The return type R of the scalar operators, when S converts to T
+     * without narrowing, as in T{s}; so that ivec3(3) * 1.5 does not
+     * compile rather than silently multiplying by 1.
+     */
+    template<typename T, typename S, typename R, typename = void>
+    struct if_scalar_of {};
+
+    template<typename T, typename S, typename R>
+    struct if_scalar_of<T, S, R, decltype(void(T{std::declval<S>()}))> {typedef R type; };
   }
   
-  template<std::size_t sz, typename T> vec<T, sz> make_vec(T s) {return detail::scalar_helper<sz, T>::make(s); }
-  template<std::size_t sz, typename T> vec<T, sz> make_vec(const vec<T, sz> &s) {return s; }
+  template<std::size_t sz, typename T> P_CONSTEXPR vec<T, sz> make_vec(T s) {
+    P_INSTRUMENT_COUNT(op_splat, T, sz, 1);
+    return detail::scalar_helper<sz, T>::make(s);
+  }
+  template<std::size_t sz, typename T> P_CONSTEXPR vec<T, sz> make_vec(const vec<T, sz> &s) {return s; }
+
+
+  namespace detail {
+    template<typename T, std::size_t size, typename opT>
+    P_CONSTEXPR vec<T, size> transform_n(const vec<T, size> &lhs,
+                                         const vec<T, size> &rhs, opT op) {
+      vec<T, size> ret = {};
+      for (std::size_t i = 0; i < size; ++i)
+        ret[i] = op(lhs[i], rhs[i]);
+      return ret;
+    }
+
+    template<typename T, std::size_t size, typename opT>
+    P_CONSTEXPR vec<T, size> transform_n(const vec<T, size> &lhs, T rhs, opT op) {
+      vec<T, size> ret = {};
+      for (std::size_t i = 0; i < size; ++i)
+        ret[i] = op(lhs[i], rhs);
+      return ret;
+    }
+  }
 
-  
   template<typename T, std::size_t size, typename opT>
-  inline vec<T, size> transform(const vec<T, size> &lhs,
-                                const vec<T, size> &rhs, opT op) {
-    vec<T, size> ret;
-    std::transform(lhs.components, lhs.components + size,
-                   rhs.components, ret.components, op);
-    return ret;
+  P_CONSTEXPR vec<T, size> transform(const vec<T, size> &lhs,
+                                     const vec<T, size> &rhs, opT op) {
+    P_INSTRUMENT_TRANSFORM(opT, T, size, 1);
+    return detail::transform_n(lhs, rhs, op);
+  }
+
+  /**
+   * Applies op to every component of lhs and the scalar rhs.
+   */
+  template<typename T, std::size_t size, typename opT>
+  P_CONSTEXPR vec<T, size> transform(const vec<T, size> &lhs, T rhs, opT op) {
+    P_INSTRUMENT_TRANSFORM(opT, T, size, 1);
+    return detail::transform_n(lhs, rhs, op);
   }
   
   template<typename T>
   struct min_fun {
-    T operator()(T lhs, T rhs) const {using std::min; return min(lhs, rhs); }
+    P_CONSTEXPR T operator()(T lhs, T rhs) const {using std::min; return min(lhs, rhs); }
   };
   
   template<typename T>
   struct max_fun {
-    T operator()(T lhs, T rhs) const {using std::max; return max(lhs, rhs); }
+    P_CONSTEXPR T operator()(T lhs, T rhs) const {using std::max; return max(lhs, rhs); }
   };
   
   template<typename T, std::size_t size, typename OpT>
-  inline T foldl(const vec<T, size> &v, OpT op) {
+  P_CONSTEXPR T foldl(const vec<T, size> &v, OpT op) {
     T val = v[0];
     for (std::size_t i = 1; i < size; ++i)
       val = op(val, v[i]);
 
     return val;
   };
+
+#if defined(P_SIMD)
+  namespace detail {
+    /**
+     * Maps the functors used by the operators to SIMD instructions. Only
+     * functors with a specialization here take the SIMD path in transform().
+     */
+    template<typename OpT> struct simd_op {};
+
+    template<> struct simd_op<std::plus<float> > {
+      typedef float value_type;
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::add(a, b); }
+    };
+    template<> struct simd_op<std::minus<float> > {
+      typedef float value_type;
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::sub(a, b); }
+    };
+    template<> struct simd_op<std::multiplies<float> > {
+      typedef float value_type;
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::mul(a, b); }
+    };
+    template<> struct simd_op<std::divides<float> > {
+      typedef float value_type;
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::div(a, b); }
+    };
+    template<> struct simd_op<min_fun<float> > {
+      typedef float value_type;
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::min(a, b); }
+    };
+    template<> struct simd_op<max_fun<float> > {
+      typedef float value_type;
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::max(a, b); }
+    };
+  }
+
+  namespace detail {
+    template<typename OpT>
+    inline vec<float, 4> simd_transform(const vec<float, 4> &lhs,
+                                        const vec<float, 4> &rhs, OpT) {
+      vec<float, 4> ret;
+      simd::store(ret.components,
+                  simd_op<OpT>::apply(simd::load(lhs.components),
+                                      simd::load(rhs.components)));
+      return ret;
+    }
+
+    /**
+     * The fourth lane is padded with 0 on the left and 1 on the right so
+     * that none of the operations produce a NaN in it.
+     */
+    template<typename OpT>
+    inline vec<float, 3> simd_transform(const vec<float, 3> &lhs,
+                                        const vec<float, 3> &rhs, OpT) {
+      vec<float, 3> ret;
+      simd::store3(ret.components,
+                   simd_op<OpT>::apply(simd::load3(lhs.components, 0.0f),
+                                       simd::load3(rhs.components, 1.0f)));
+      return ret;
+    }
+
+    template<typename OpT>
+    inline vec<float, 4> simd_transform(const vec<float, 4> &lhs, float rhs, OpT) {
+      vec<float, 4> ret;
+      simd::store(ret.components,
+                  simd_op<OpT>::apply(simd::load(lhs.components),
+                                      simd::splat(rhs)));
+      return ret;
+    }
+
+    template<typename OpT>
+    inline vec<float, 3> simd_transform(const vec<float, 3> &lhs, float rhs, OpT) {
+      vec<float, 3> ret;
+      simd::store3(ret.components,
+                   simd_op<OpT>::apply(simd::load3(lhs.components, 0.0f),
+                                       simd::set(rhs, rhs, rhs, 1.0f)));
+      return ret;
+    }
+  }
+
+  /*
+   * The SIMD overloads fall back on the component-wise code in constant
+   * expressions.
+   */
+  template<typename OpT>
+  P_CONSTEXPR_DISPATCH vec<typename detail::simd_op<OpT>::value_type, 4>
+  transform(const vec<float, 4> &lhs, const vec<float, 4> &rhs, OpT op) {
+    P_INSTRUMENT_TRANSFORM(OpT, float, 4, 1);
+    if (P_CONSTANT_EVALUATED())
+      return detail::transform_n(lhs, rhs, op);
+    return detail::simd_transform(lhs, rhs, op);
+  }
+
+  template<typename OpT>
+  P_CONSTEXPR_DISPATCH vec<typename detail::simd_op<OpT>::value_type, 4>
+  transform(const vec<float, 4> &lhs, float rhs, OpT op) {
+    P_INSTRUMENT_TRANSFORM(OpT, float, 4, 1);
+    if (P_CONSTANT_EVALUATED())
+      return detail::transform_n(lhs, rhs, op);
+    return detail::simd_transform(lhs, rhs, op);
+  }
+
+  template<typename OpT>
+  P_CONSTEXPR_DISPATCH vec<typename detail::simd_op<OpT>::value_type, 3>
+  transform(const vec<float, 3> &lhs, const vec<float, 3> &rhs, OpT op) {
+    P_INSTRUMENT_TRANSFORM(OpT, float, 3, 1);
+    if (P_CONSTANT_EVALUATED())
+      return detail::transform_n(lhs, rhs, op);
+    return detail::simd_transform(lhs, rhs, op);
+  }
+
+  template<typename OpT>
+  P_CONSTEXPR_DISPATCH vec<typename detail::simd_op<OpT>::value_type, 3>
+  transform(const vec<float, 3> &lhs, float rhs, OpT op) {
+    P_INSTRUMENT_TRANSFORM(OpT, float, 3, 1);
+    if (P_CONSTANT_EVALUATED())
+      return detail::transform_n(lhs, rhs, op);
+    return detail::simd_transform(lhs, rhs, op);
+  }
+#endif // P_SIMD
+
+  namespace detail {
+    /**
+     * In-place transform used by the compound assignment operators.
+     */
+    template<typename T, std::size_t size, typename opT>
+    P_CONSTEXPR vec<T, size> &transform_assign(vec<T, size> &lhs,
+                                               const vec<T, size> &rhs, opT op) {
+      P_INSTRUMENT_TRANSFORM(opT, T, size, 0);
+      for (std::size_t i = 0; i < size; ++i)
+        lhs[i] = op(lhs[i], rhs[i]);
+      return lhs;
+    }
+
+    template<typename T, std::size_t size, typename opT>
+    P_CONSTEXPR vec<T, size> &transform_assign(vec<T, size> &lhs, T rhs, opT op) {
+      P_INSTRUMENT_TRANSFORM(opT, T, size, 0);
+      for (std::size_t i = 0; i < size; ++i)
+        lhs[i] = op(lhs[i], rhs);
+      return lhs;
+    }
+
+#if defined(P_SIMD)
+    // a vec4/vec3 goes through a register either way; reuse transform()
+    template<typename OpT>
+    P_CONSTEXPR_DISPATCH vec<typename simd_op<OpT>::value_type, 4> &
+    transform_assign(vec<float, 4> &lhs, const vec<float, 4> &rhs, OpT op) {
+      return lhs = transform(lhs, rhs, op);
+    }
+
+    template<typename OpT>
+    P_CONSTEXPR_DISPATCH vec<typename simd_op<OpT>::value_type, 4> &
+    transform_assign(vec<float, 4> &lhs, float rhs, OpT op) {
+      return lhs = transform(lhs, rhs, op);
+    }
+
+    template<typename OpT>
+    P_CONSTEXPR_DISPATCH vec<typename simd_op<OpT>::value_type, 3> &
+    transform_assign(vec<float, 3> &lhs, const vec<float, 3> &rhs, OpT op) {
+      return lhs = transform(lhs, rhs, op);
+    }
+
+    template<typename OpT>
+    P_CONSTEXPR_DISPATCH vec<typename simd_op<OpT>::value_type, 3> &
+    transform_assign(vec<float, 3> &lhs, float rhs, OpT op) {
+      return lhs = transform(lhs, rhs, op);
+    }
+#endif // P_SIMD
+  }
   
   
   /**
    * Unary minus; component-wise negation.
    */
   template<typename T, std::size_t size>
-  inline vec<T, size> operator -(const vec<T, size> &rhs) {
-    vec<T, size> ret;
+  P_CONSTEXPR vec<T, size> operator -(const vec<T, size> &rhs) {
+    P_INSTRUMENT_COUNT(op_flop, T, size, size);
+    P_INSTRUMENT_COUNT(op_temporary, T, size, 1);
+    vec<T, size> ret = {};
     for (std::size_t i = 0; i < size; ++i)
       ret[i] = -rhs[i];
     return ret;
   }
 
   template<typename T, std::size_t size> 
-  inline vec<T, size> operator +(const vec<T, size> &lhs,
-                                 const vec<T, size> &rhs) {
+  P_CONSTEXPR vec<T, size> operator +(const vec<T, size> &lhs,
+                                      const vec<T, size> &rhs) {
     return transform(lhs, rhs, std::plus<T>());
   }
 
   template<typename T, std::size_t size> 
-  inline vec<T, size> operator -(const vec<T, size>& lhs,
-                                 const vec<T, size>& rhs) {
+  P_CONSTEXPR vec<T, size> operator -(const vec<T, size>& lhs,
+                                      const vec<T, size>& rhs) {
     return transform(lhs, rhs, std::minus<T>());
   }
 
   template<typename T, std::size_t size, typename scalarT> 
-  inline vec<T, size> operator *(const vec<T, size> &lhs, scalarT rhs) {
-    return transform(lhs, make_vec<size>(rhs), std::multiplies<T>());
+  P_CONSTEXPR typename detail::if_scalar_of<T, scalarT, vec<T, size> >::type
+  operator *(const vec<T, size> &lhs, scalarT rhs) {
+    return transform(lhs, T(rhs), std::multiplies<T>());
   }
 
   template<typename T, std::size_t size, typename scalarT> 
-  inline vec<T, size> operator /(const vec<T, size>& lhs, scalarT rhs) {
-    return transform(lhs, make_vec<size>(rhs), std::divides<T>());
+  P_CONSTEXPR typename detail::if_scalar_of<T, scalarT, vec<T, size> >::type
+  operator /(const vec<T, size>& lhs, scalarT rhs) {
+    return transform(lhs, T(rhs), std::divides<T>());
+  }
+
+  /**
+   * Component-wise product and quotient.
+   */
+  template<typename T, std::size_t size> 
+  P_CONSTEXPR vec<T, size> operator *(const vec<T, size> &lhs,
+                                      const vec<T, size> &rhs) {
+    return transform(lhs, rhs, std::multiplies<T>());
+  }
+
+  template<typename T, std::size_t size> 
+  P_CONSTEXPR vec<T, size> operator /(const vec<T, size> &lhs,
+                                      const vec<T, size> &rhs) {
+    return transform(lhs, rhs, std::divides<T>());
   }
   
   template<typename T, std::size_t size> 
-  inline vec<T, size>& operator +=(vec<T, size>& lhs, const vec<T, size>& rhs) {
-    lhs = lhs + rhs; return lhs;
+  P_CONSTEXPR vec<T, size>& operator +=(vec<T, size>& lhs, const vec<T, size>& rhs) {
+    return detail::transform_assign(lhs, rhs, std::plus<T>());
   }
   
   template<typename T, std::size_t size> 
-  inline vec<T, size>& operator -=(vec<T, size>& lhs, const vec<T, size>& rhs) {
-    lhs = lhs - rhs; return lhs;
+  P_CONSTEXPR vec<T, size>& operator -=(vec<T, size>& lhs, const vec<T, size>& rhs) {
+    return detail::transform_assign(lhs, rhs, std::minus<T>());
   }
 
   template<typename T, std::size_t size, typename scalarT> 
-  inline vec<T, size>& operator *=(vec<T, size>& lhs, scalarT rhs) {
-    lhs = lhs * make_vec<size, T>(rhs); return lhs;
+  P_CONSTEXPR typename detail::if_scalar_of<T, scalarT, vec<T, size> &>::type
+  operator *=(vec<T, size>& lhs, scalarT rhs) {
+    return detail::transform_assign(lhs, T(rhs), std::multiplies<T>());
   }
 
   template<typename T, std::size_t size, typename scalarT> 
-  inline vec<T, size>& operator /=(vec<T, size>& lhs, scalarT rhs) {
-    lhs = lhs / make_vec<size, T>(rhs); return lhs;
+  P_CONSTEXPR typename detail::if_scalar_of<T, scalarT, vec<T, size> &>::type
+  operator /=(vec<T, size>& lhs, scalarT rhs) {
+    return detail::transform_assign(lhs, T(rhs), std::divides<T>());
+  }
+
+  template<typename T, std::size_t size> 
+  P_CONSTEXPR vec<T, size>& operator *=(vec<T, size>& lhs, const vec<T, size>& rhs) {
+    return detail::transform_assign(lhs, rhs, std::multiplies<T>());
+  }
+
+  template<typename T, std::size_t size> 
+  P_CONSTEXPR vec<T, size>& operator /=(vec<T, size>& lhs, const vec<T, size>& rhs) {
+    return detail::transform_assign(lhs, rhs, std::divides<T>());
   }
 
   
@@ -231,7 +487,7 @@ namespace p {
    * Component-wise minimum.
    */
   template<typename T, std::size_t size>
-  inline vec<T, size> min(const vec<T, size> &v1, const vec<T, size> &v2) {
+  P_CONSTEXPR vec<T, size> min(const vec<T, size> &v1, const vec<T, size> &v2) {
     return transform(v1, v2, min_fun<T>());
   }
 
@@ -239,16 +495,62 @@ namespace p {
    * Component-wise maximum.
    */
   template<typename T, std::size_t size>
-  inline vec<T, size> max(const vec<T, size> &v1, const vec<T, size> &v2) {
+  P_CONSTEXPR vec<T, size> max(const vec<T, size> &v1, const vec<T, size> &v2) {
     return transform(v1, v2, max_fun<T>());
   }
 
   template<typename T, std::size_t size>
-  inline T max(const vec<T, size> &v) {
+  P_CONSTEXPR T max(const vec<T, size> &v) {
     using std::max;
     return foldl(v, max_fun<T>());
   }
 
+  /**
+   * Component-wise lerp; lerp(begin, end, scalar) works on vectors as is.
+   */
+  template<typename T, std::size_t size>
+  P_CONSTEXPR vec<T, size> lerp(const vec<T, size> &begin, const vec<T, size> &end,
+                                const vec<T, size> &amount) {
+    return begin * (make_vec<size>(T(1)) - amount) + end * amount;
+  }
+
+  /**
+   * Component-wise clamp to one range for all components, or to a range
+   * per component.
+   */
+  template<typename T, std::size_t size>
+  P_CONSTEXPR vec<T, size> clamp(const vec<T, size> &v, T vmin, T vmax) {
+    return transform(transform(v, vmax, min_fun<T>()), vmin, max_fun<T>());
+  }
+
+  template<typename T, std::size_t size>
+  P_CONSTEXPR vec<T, size> clamp(const vec<T, size> &v, const vec<T, size> &vmin,
+                                 const vec<T, size> &vmax) {
+    return max(min(v, vmax), vmin);
+  }
+
+  template<typename T, std::size_t size>
+  P_CONSTEXPR vec<T, size> saturate(const vec<T, size> &v) {
+    return clamp(v, T(0), T(1));
+  }
+
+  template<typename T, std::size_t size>
+  P_CONSTEXPR_DISPATCH vec<T, size> wrap(const vec<T, size> &v, T lower, T upper) {
+    vec<T, size> ret = {};
+    for (std::size_t i = 0; i < size; ++i)
+      ret[i] = wrap(v[i], lower, upper);
+    return ret;
+  }
+
+  template<typename T, std::size_t size>
+  P_CONSTEXPR_DISPATCH vec<T, size> wrap(const vec<T, size> &v, const vec<T, size> &lower,
+                                         const vec<T, size> &upper) {
+    vec<T, size> ret = {};
+    for (std::size_t i = 0; i < size; ++i)
+      ret[i] = wrap(v[i], lower[i], upper[i]);
+    return ret;
+  }
+
   template<typename T, std::size_t size>
   inline vec<T, size> abs(const vec<T, size> &v) {
     using std::abs;
@@ -259,33 +561,89 @@ namespace p {
   }
   
   template<typename T, std::size_t size>
-  inline T dot_product(const vec<T, size> &v1, const vec<T, size> &v2) {
-    return std::inner_product(v1.components, v1.components + size,
-                              v2.components, T());
+  P_CONSTEXPR T dot_product(const vec<T, size> &v1, const vec<T, size> &v2) {
+    P_INSTRUMENT_COUNT(op_flop, T, size, 2*size - 1);
+    T sum = T();
+    for (std::size_t i = 0; i < size; ++i)
+      sum += v1[i] * v2[i];
+    return sum;
   }
+
+#if defined(P_SIMD)
+  P_CONSTEXPR_DISPATCH float dot_product(const vec<float, 4> &v1, const vec<float, 4> &v2) {
+    P_INSTRUMENT_COUNT(op_flop, float, 4, 7);
+    if (P_CONSTANT_EVALUATED())
+      return ((v1[0]*v2[0] + v1[1]*v2[1]) + v1[2]*v2[2]) + v1[3]*v2[3];
+    return simd::dot(simd::load(v1.components), simd::load(v2.components));
+  }
+
+  P_CONSTEXPR_DISPATCH float dot_product(const vec<float, 3> &v1, const vec<float, 3> &v2) {
+    P_INSTRUMENT_COUNT(op_flop, float, 3, 5);
+    if (P_CONSTANT_EVALUATED())
+      return (v1[0]*v2[0] + v1[1]*v2[1]) + v1[2]*v2[2];
+    return simd::dot(simd::load3(v1.components), simd::load3(v2.components));
+  }
+#endif // P_SIMD
   
   template<typename T>
-  inline vec<T, 3> cross_product(const vec<T, 3> &v1, const vec<T, 3> &v2) {
-    return vec<T, 3>(v1.y * v2.z - v2.y * v1.z,
-                     v1.z * v2.x - v2.z * v1.x,
-                     v1.x * v2.y - v2.x * v1.y);
+  P_CONSTEXPR vec<T, 3> cross_product(const vec<T, 3> &v1, const vec<T, 3> &v2) {
+    P_INSTRUMENT_COUNT(op_flop, T, 3, 9);
+    P_INSTRUMENT_COUNT(op_temporary, T, 3, 1);
+    return make_vec<T>(v1[1] * v2[2] - v2[1] * v1[2],
+                       v1[2] * v2[0] - v2[2] * v1[0],
+                       v1[0] * v2[1] - v2[0] * v1[1]);
   }
   
   template<typename T, std::size_t size>
   inline T magnitude(const vec<T, size> &v) {
     T sumSquared = dot_product(v, v);
+    P_INSTRUMENT_COUNT(op_sqrt, T, size, 1);
     return sqrt(sumSquared);
   }
   
+  /**
+   * Reciprocal square root, 1/sqrt(x).
+   */
+  template<typename T>
+  inline T rsqrt(T x) {
+    P_INSTRUMENT_COUNT(op_sqrt, T, 1, 1);
+    P_INSTRUMENT_COUNT(op_div, T, 1, 1);
+    using std::sqrt;
+    return T(1) / sqrt(x);
+  }
+
+  /**
+   * For floats, the hardware estimate refined with Newton-Raphson; relative
+   * error below 2^-21. Exact when built without SIMD.
+   */
+  inline float rsqrt(float x) {
+    P_INSTRUMENT_COUNT(op_sqrt, float, 1, 1);
+    return simd::first(simd::rsqrt(simd::splat(x)));
+  }
+
+  /**
+   * The raw hardware estimate of 1/sqrt(x); relative error at most
+   * 1.5 * 2^-12 with SSE and 2^-8 with NEON.
+   */
+  inline float rsqrt_estimate(float x) {
+    P_INSTRUMENT_COUNT(op_sqrt, float, 1, 1);
+    return simd::first(simd::rsqrt_estimate(simd::splat(x)));
+  }
+
+  /**
+   * Normalizes through rsqrt of the squared length, with no sqrt or
+   * division. For float vectors every component is within 2^-20 (relative)
+   * of normalize(). A zero vector gives NaNs, like normalize().
+   */
   template<typename T>
   inline T normalize_fast(const T &v) {
-    T ret = v / magnitude(v);
-    return ret;
+    return v * rsqrt(dot_product(v, v));
   }
 
   template<typename T>
   inline T normalize(const T &v) {
-    return normalize_fast(v);
+    T ret = v / magnitude(v);
+    return ret;
   }
   
   typedef vec<float, 2> vec2;
@@ -0,0 +1,1042 @@
+/* -- vector_batch.h -------------------------------------------------*- c++ -*-
+ * Operations over arrays of vectors and matrices. The arrays are passed as
+ * p::span, so std::vectors, built-in arrays and pointer/count pairs all
+ * work.
+ *
+ * Operations:
+ *   normalize_n, dot_product_n
+ *   transpose_n, inverse_n, affine_inverse_n
+ *   transform_points (split over a thread_pool, see parallel.h)
+ *   reduce, sum, mean, bounding_box (likewise)
+ *   slerp_n, nlerp_n (quaternions, with one t per element or for all)
+ *   lerp_n, clamp_n, saturate_n, wrap_n (algorithm.h over arrays)
+ *
+ * Output spans must have the same size as the input, and may be the same
+ * memory. The vec3/vec4 float versions work on four vectors at a time in
+ * the SIMD registers from simd.h. On x86 normalize_n, dot_product_n,
+ * transform_points, sum and bounding_box also have AVX2 and AVX-512
+ * versions (vector_batch_x86.h), chosen at run time by cpu.h.
+ *
+ * std::vector<vec3> normals = ...;
+ * p::normalize_n(normals);
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_BATCH_H
+#define P_UTILS_VECTOR_BATCH_H
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "algorithm.h"
+#include "vector.h"
+#include "matrix.h"
+#include "quaternion.h"
+#include "simd.h"
+#include "span.h"
+#include "parallel.h"
+#include "cpu.h"
+#include "vector_batch_x86.h"
+
+namespace p {
+  namespace detail {
+    /**
+     * Normalizes four vectors held one per register. They are transposed
+     * so that all four lengths come out of a single rsqrt.
+     */
+    inline void normalize4(simd::f32x4 &v0, simd::f32x4 &v1,
+                           simd::f32x4 &v2, simd::f32x4 &v3) {
+      simd::transpose(v0, v1, v2, v3);
+      const simd::f32x4 len2 =
+        simd::add(simd::add(simd::mul(v0, v0), simd::mul(v1, v1)),
+                  simd::add(simd::mul(v2, v2), simd::mul(v3, v3)));
+      const simd::f32x4 inv = simd::rsqrt(len2);
+      v0 = simd::mul(v0, inv);
+      v1 = simd::mul(v1, inv);
+      v2 = simd::mul(v2, inv);
+      v3 = simd::mul(v3, inv);
+      simd::transpose(v0, v1, v2, v3);
+    }
+  }
+
+  /**
+   * Writes normalize_fast() of every vector in `in` to `out`.
+   */
+  template<typename T, std::size_t size>
+  inline void normalize_n(span<const vec<T, size> > in,
+                          span<vec<T, size> > out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = normalize_fast(in[i]);
+  }
+
+  template<typename T, std::size_t size>
+  inline void normalize_n(span<vec<T, size> > v) {
+    normalize_n(span<const vec<T, size> >(v), v);
+  }
+
+  inline void normalize_n(span<const vec3> in, span<vec3> out) {
+    assert(in.size() == out.size());
+    const std::size_t n = in.size();
+    const float *src = reinterpret_cast<const float *>(in.data());
+    float *dst = reinterpret_cast<float *>(out.data());
+
+    std::size_t i = detail::normalize3_wide(src, dst, n);
+    src += 3*i;
+    dst += 3*i;
+    for (; i + 4 <= n; i += 4, src += 12, dst += 12) {
+      simd::f32x4 v0 = simd::load3(src), v1 = simd::load3(src + 3);
+      simd::f32x4 v2 = simd::load3(src + 6), v3 = simd::load3(src + 9);
+      detail::normalize4(v0, v1, v2, v3);
+      simd::store3(dst, v0); simd::store3(dst + 3, v1);
+      simd::store3(dst + 6, v2); simd::store3(dst + 9, v3);
+    }
+
+    for (; i < n; ++i)
+      out[i] = normalize_fast(in[i]);
+  }
+
+  inline void normalize_n(span<vec3> v) {
+    normalize_n(span<const vec3>(v), v);
+  }
+
+  inline void normalize_n(span<const vec4> in, span<vec4> out) {
+    assert(in.size() == out.size());
+    const std::size_t n = in.size();
+    const float *src = reinterpret_cast<const float *>(in.data());
+    float *dst = reinterpret_cast<float *>(out.data());
+
+    std::size_t i = detail::normalize4_wide(src, dst, n);
+    src += 4*i;
+    dst += 4*i;
+    for (; i + 4 <= n; i += 4, src += 16, dst += 16) {
+      simd::f32x4 v0 = simd::load(src), v1 = simd::load(src + 4);
+      simd::f32x4 v2 = simd::load(src + 8), v3 = simd::load(src + 12);
+      detail::normalize4(v0, v1, v2, v3);
+      simd::store(dst, v0); simd::store(dst + 4, v1);
+      simd::store(dst + 8, v2); simd::store(dst + 12, v3);
+    }
+
+    for (; i < n; ++i)
+      out[i] = normalize_fast(in[i]);
+  }
+
+  inline void normalize_n(span<vec4> v) {
+    normalize_n(span<const vec4>(v), v);
+  }
+
+  template<typename T, std::size_t N>
+  inline void transpose_n(span<const mat<T, N, N> > in, span<mat<T, N, N> > out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = transpose(in[i]);
+  }
+
+  template<typename T, std::size_t N>
+  inline void transpose_n(span<mat<T, N, N> > m) {
+    transpose_n(span<const mat<T, N, N> >(m), m);
+  }
+
+  template<typename T, std::size_t N>
+  inline void inverse_n(span<const mat<T, N, N> > in, span<mat<T, N, N> > out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = inverse(in[i]);
+  }
+
+  template<typename T, std::size_t N>
+  inline void inverse_n(span<mat<T, N, N> > m) {
+    inverse_n(span<const mat<T, N, N> >(m), m);
+  }
+
+  template<typename T, std::size_t N>
+  inline void affine_inverse_n(span<const mat<T, N, N> > in, span<mat<T, N, N> > out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = affine_inverse(in[i]);
+  }
+
+  template<typename T, std::size_t N>
+  inline void affine_inverse_n(span<mat<T, N, N> > m) {
+    affine_inverse_n(span<const mat<T, N, N> >(m), m);
+  }
+
+  namespace detail {
+    // points per parallel chunk: input and output of a chunk of vec4 stay
+    // within 256 KiB, a typical L2. A multiple of 4 so that chunks split
+    // on SIMD group boundaries.
+    const std::size_t transform_chunk = 8192;
+
+    /**
+     * Four packed vec3 (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) to and
+     * from one register per component.
+     */
+    inline void deinterleave3(simd::f32x4 a, simd::f32x4 b, simd::f32x4 c,
+                              simd::f32x4 &x, simd::f32x4 &y, simd::f32x4 &z) {
+      const simd::f32x4 yz = simd::shuffle<1, 2, 0, 1>(a, b);
+      x = simd::shuffle<0, 3, 0, 3>(a, simd::shuffle<2, 3, 0, 1>(b, c));
+      y = simd::shuffle<0, 2, 0, 2>(yz, simd::shuffle<3, 3, 2, 2>(b, c));
+      z = simd::shuffle<1, 3, 0, 3>(yz, c);
+    }
+
+    inline void interleave3(simd::f32x4 x, simd::f32x4 y, simd::f32x4 z,
+                            simd::f32x4 &a, simd::f32x4 &b, simd::f32x4 &c) {
+      a = simd::shuffle<0, 2, 0, 2>(simd::shuffle<0, 1, 0, 1>(x, y),
+                                    simd::shuffle<0, 0, 1, 1>(z, x));
+      b = simd::shuffle<0, 2, 0, 2>(simd::shuffle<1, 1, 1, 1>(y, z),
+                                    simd::shuffle<2, 2, 2, 2>(x, y));
+      c = simd::shuffle<0, 2, 0, 2>(simd::shuffle<2, 2, 3, 3>(z, x),
+                                    simd::shuffle<3, 3, 3, 3>(y, z));
+    }
+
+    /**
+     * out = m * (p, 1) for points [begin, end). Four points at a time are
+     * split into x, y and z registers, so every output component is three
+     * multiply-adds with splatted matrix elements.
+     */
+    inline void transform_points3(const mat4 &m, const vec3 *in, vec3 *out,
+                                  std::size_t begin, std::size_t end) {
+      const float *e = m.components;
+      simd::f32x4 k[12];
+      for (std::size_t r = 0; r < 3; ++r)
+        for (std::size_t c = 0; c < 4; ++c)
+          k[4*r + c] = simd::splat(e[4*r + c]);
+
+      std::size_t i = transform_points3_wide(m, in, out, begin, end);
+      for (; i + 4 <= end; i += 4) {
+        const float *src = in[i].components;
+        simd::f32x4 x, y, z;
+        deinterleave3(simd::load(src), simd::load(src + 4), simd::load(src + 8),
+                      x, y, z);
+
+        simd::f32x4 o[3];
+        for (std::size_t r = 0; r < 3; ++r) {
+          simd::f32x4 s = simd::add(simd::mul(k[4*r], x), simd::mul(k[4*r + 1], y));
+          s = simd::add(s, simd::mul(k[4*r + 2], z));
+          o[r] = simd::add(s, k[4*r + 3]);
+        }
+
+        simd::f32x4 a, b, c;
+        interleave3(o[0], o[1], o[2], a, b, c);
+        float *dst = out[i].components;
+        simd::store(dst, a);
+        simd::store(dst + 4, b);
+        simd::store(dst + 8, c);
+      }
+
+      // same operation order as above
+      for (; i < end; ++i) {
+        const vec3 p = in[i];
+        vec3 r;
+        for (std::size_t j = 0; j < 3; ++j)
+          r[j] = ((e[4*j] * p.x + e[4*j + 1] * p.y) + e[4*j + 2] * p.z) + e[4*j + 3];
+        out[i] = r;
+      }
+    }
+
+    /**
+     * out = m * v for [begin, end), as a sum of the matrix columns
+     * weighted by the components of v.
+     */
+    inline void transform_points4(const mat4 &m, const vec4 *in, vec4 *out,
+                                  std::size_t begin, std::size_t end) {
+      simd::f32x4 c0 = simd::load(m.components);
+      simd::f32x4 c1 = simd::load(m.components + 4);
+      simd::f32x4 c2 = simd::load(m.components + 8);
+      simd::f32x4 c3 = simd::load(m.components + 12);
+      simd::transpose(c0, c1, c2, c3);
+
+      for (std::size_t i = transform_points4_wide(m, in, out, begin, end); i < end; ++i) {
+        const simd::f32x4 v = simd::load(in[i].components);
+        simd::f32x4 s = simd::add(simd::mul(c0, simd::swizzle<0, 0, 0, 0>(v)),
+                                  simd::mul(c1, simd::swizzle<1, 1, 1, 1>(v)));
+        s = simd::add(s, simd::mul(c2, simd::swizzle<2, 2, 2, 2>(v)));
+        s = simd::add(s, simd::mul(c3, simd::swizzle<3, 3, 3, 3>(v)));
+        simd::store(out[i].components, s);
+      }
+    }
+  }
+
+  /**
+   * Writes m * (p, 1) of every point p in `in` to `out`, dropping w (no
+   * perspective divide; use the vec4 version for projections). Large
+   * arrays are split over `pool`; the result doesn't depend on how many
+   * threads it has. in and out may be the same array.
+   */
+  inline void transform_points(const mat4 &m, span<const vec3> in, span<vec3> out,
+                               thread_pool &pool = thread_pool::shared()) {
+    assert(in.size() == out.size());
+    const vec3 *src = in.data();
+    vec3 *dst = out.data();
+    pool.parallel_for(in.size(), detail::transform_chunk,
+                      [&](std::size_t begin, std::size_t end) {
+                        detail::transform_points3(m, src, dst, begin, end);
+                      });
+  }
+
+  inline void transform_points(const mat4 &m, span<vec3> v,
+                               thread_pool &pool = thread_pool::shared()) {
+    transform_points(m, span<const vec3>(v), v, pool);
+  }
+
+  /**
+   * Writes m * v of every v in `in` to `out`; otherwise as above.
+   */
+  inline void transform_points(const mat4 &m, span<const vec4> in, span<vec4> out,
+                               thread_pool &pool = thread_pool::shared()) {
+    assert(in.size() == out.size());
+    const vec4 *src = in.data();
+    vec4 *dst = out.data();
+    pool.parallel_for(in.size(), detail::transform_chunk,
+                      [&](std::size_t begin, std::size_t end) {
+                        detail::transform_points4(m, src, dst, begin, end);
+                      });
+  }
+
+  inline void transform_points(const mat4 &m, span<vec4> v,
+                               thread_pool &pool = thread_pool::shared()) {
+    transform_points(m, span<const vec4>(v), v, pool);
+  }
+
+  /**
+   * Writes dot_product(a[i], b[i]) to out[i].
+   */
+  template<typename T, std::size_t size>
+  inline void dot_product_n(span<const vec<T, size> > a, span<const vec<T, size> > b,
+                            span<T> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    for (std::size_t i = 0; i < a.size(); ++i)
+      out[i] = dot_product(a[i], b[i]);
+  }
+
+  inline void dot_product_n(span<const vec3> a, span<const vec3> b, span<float> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    const std::size_t n = a.size();
+    const float *pa = reinterpret_cast<const float *>(a.data());
+    const float *pb = reinterpret_cast<const float *>(b.data());
+
+    std::size_t i = detail::dot3_wide(pa, pb, out.data(), n);
+    for (; i + 4 <= n; i += 4) {
+      simd::f32x4 ax, ay, az, bx, by, bz;
+      detail::deinterleave3(simd::load(pa + 3*i), simd::load(pa + 3*i + 4),
+                            simd::load(pa + 3*i + 8), ax, ay, az);
+      detail::deinterleave3(simd::load(pb + 3*i), simd::load(pb + 3*i + 4),
+                            simd::load(pb + 3*i + 8), bx, by, bz);
+      simd::store(out.data() + i,
+                  simd::add(simd::add(simd::mul(ax, bx), simd::mul(ay, by)),
+                            simd::mul(az, bz)));
+    }
+
+    for (; i < n; ++i)
+      out[i] = dot_product(a[i], b[i]);
+  }
+
+  inline void dot_product_n(span<const vec4> a, span<const vec4> b, span<float> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    const std::size_t n = a.size();
+    const float *pa = reinterpret_cast<const float *>(a.data());
+    const float *pb = reinterpret_cast<const float *>(b.data());
+
+    std::size_t i = detail::dot4_wide(pa, pb, out.data(), n);
+    for (; i + 4 <= n; i += 4) {
+      simd::f32x4 a0 = simd::load(pa + 4*i), a1 = simd::load(pa + 4*i + 4);
+      simd::f32x4 a2 = simd::load(pa + 4*i + 8), a3 = simd::load(pa + 4*i + 12);
+      simd::f32x4 b0 = simd::load(pb + 4*i), b1 = simd::load(pb + 4*i + 4);
+      simd::f32x4 b2 = simd::load(pb + 4*i + 8), b3 = simd::load(pb + 4*i + 12);
+      simd::transpose(a0, a1, a2, a3);
+      simd::transpose(b0, b1, b2, b3);
+      simd::store(out.data() + i,
+                  simd::add(simd::add(simd::add(simd::mul(a0, b0), simd::mul(a1, b1)),
+                                      simd::mul(a2, b2)),
+                            simd::mul(a3, b3)));
+    }
+
+    for (; i < n; ++i)
+      out[i] = dot_product(a[i], b[i]);
+  }
+
+  /**
+   * Axis aligned box; the result of bounding_box().
+   */
+  template<typename T, std::size_t N>
+  struct aabb {
+    vec<T, N> min, max;
+  };
+
+  namespace detail {
+    // elements per parallel chunk of a reduction; 256 KiB of vec4
+    const std::size_t reduce_chunk = 16384;
+
+    /**
+     * Reduces [0, n) by computing kernel(begin, end) for every chunk on
+     * the pool and combining the partial results pairwise, in a tree
+     * whose shape only depends on n.
+     */
+    template<typename R, typename KernelT, typename CombineT>
+    inline R parallel_reduce(std::size_t n, thread_pool &pool,
+                             KernelT kernel, CombineT combine) {
+      assert(n > 0);
+      std::vector<R> parts((n + reduce_chunk - 1) / reduce_chunk);
+      pool.parallel_for(n, reduce_chunk, [&](std::size_t begin, std::size_t end) {
+        parts[begin / reduce_chunk] = kernel(begin, end);
+      });
+
+      for (std::size_t step = 1; step < parts.size(); step *= 2)
+        for (std::size_t i = 0; i + step < parts.size(); i += 2*step)
+          parts[i] = combine(parts[i], parts[i + step]);
+      return parts[0];
+    }
+
+    struct reduce_add {
+      static float identity() {return 0.0f; }
+      static float apply(float a, float b) {return a + b; }
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::add(a, b); }
+    };
+
+    struct reduce_min {
+      static float identity() {return std::numeric_limits<float>::infinity(); }
+      static float apply(float a, float b) {return b < a ? b : a; }
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::min(a, b); }
+    };
+
+    struct reduce_max {
+      static float identity() {return -std::numeric_limits<float>::infinity(); }
+      static float apply(float a, float b) {return a < b ? b : a; }
+      static simd::f32x4 apply(simd::f32x4 a, simd::f32x4 b) {return simd::max(a, b); }
+    };
+
+    template<typename OpT>
+    inline float fold_lanes(simd::f32x4 v) {
+      float l[4];
+      simd::store(l, v);
+      return OpT::apply(OpT::apply(l[0], l[1]), OpT::apply(l[2], l[3]));
+    }
+
+    /**
+     * Folds the vec4s [begin, end) one register per element.
+     */
+    template<typename OpT>
+    inline vec4 fold4(const vec4 *v, std::size_t begin, std::size_t end) {
+      simd::f32x4 acc = simd::splat(OpT::identity());
+      for (std::size_t i = begin; i < end; ++i)
+        acc = OpT::apply(acc, simd::load(v[i].components));
+      vec4 ret;
+      simd::store(ret.components, acc);
+      return ret;
+    }
+
+    /**
+     * Folds the vec3s [begin, end). Four packed vec3 fill three registers
+     * whose lanes always hold the same components (x y z x | y z x y |
+     * z x y z), so they are accumulated as they are and only sorted out
+     * by component at the end.
+     */
+    template<typename OpT>
+    inline vec3 fold3(const vec3 *v, std::size_t begin, std::size_t end) {
+      simd::f32x4 a = simd::splat(OpT::identity()), b = a, c = a;
+      std::size_t i = begin;
+      for (; i + 4 <= end; i += 4) {
+        const float *src = v[i].components;
+        a = OpT::apply(a, simd::load(src));
+        b = OpT::apply(b, simd::load(src + 4));
+        c = OpT::apply(c, simd::load(src + 8));
+      }
+
+      simd::f32x4 x, y, z;
+      deinterleave3(a, b, c, x, y, z);
+      vec3 ret = make_vec(fold_lanes<OpT>(x), fold_lanes<OpT>(y), fold_lanes<OpT>(z));
+      for (; i < end; ++i)
+        for (std::size_t j = 0; j < 3; ++j)
+          ret[j] = OpT::apply(ret[j], v[i][j]);
+      return ret;
+    }
+
+    /**
+     * Single pass min and max of [begin, end), laid out as in fold3.
+     */
+    inline aabb<float, 3> bounds3(const vec3 *v, std::size_t begin, std::size_t end) {
+      simd::f32x4 lo[3], hi[3];
+      for (std::size_t k = 0; k < 3; ++k) {
+        lo[k] = simd::splat(reduce_min::identity());
+        hi[k] = simd::splat(reduce_max::identity());
+      }
+
+      std::size_t i = begin;
+      for (; i + 4 <= end; i += 4) {
+        const float *src = v[i].components;
+        for (std::size_t k = 0; k < 3; ++k) {
+          const simd::f32x4 x = simd::load(src + 4*k);
+          lo[k] = simd::min(lo[k], x);
+          hi[k] = simd::max(hi[k], x);
+        }
+      }
+
+      simd::f32x4 x, y, z;
+      aabb<float, 3> ret;
+      deinterleave3(lo[0], lo[1], lo[2], x, y, z);
+      ret.min = make_vec(fold_lanes<reduce_min>(x), fold_lanes<reduce_min>(y),
+                         fold_lanes<reduce_min>(z));
+      deinterleave3(hi[0], hi[1], hi[2], x, y, z);
+      ret.max = make_vec(fold_lanes<reduce_max>(x), fold_lanes<reduce_max>(y),
+                         fold_lanes<reduce_max>(z));
+      for (; i < end; ++i) {
+        ret.min = min(ret.min, v[i]);
+        ret.max = max(ret.max, v[i]);
+      }
+      return ret;
+    }
+
+    inline aabb<float, 4> bounds4(const vec4 *v, std::size_t begin, std::size_t end) {
+      simd::f32x4 lo = simd::splat(reduce_min::identity());
+      simd::f32x4 hi = simd::splat(reduce_max::identity());
+      for (std::size_t i = begin; i < end; ++i) {
+        const simd::f32x4 x = simd::load(v[i].components);
+        lo = simd::min(lo, x);
+        hi = simd::max(hi, x);
+      }
+      aabb<float, 4> ret;
+      simd::store(ret.min.components, lo);
+      simd::store(ret.max.components, hi);
+      return ret;
+    }
+
+    template<typename T, std::size_t N>
+    inline aabb<T, N> empty_box() {
+      const aabb<T, N> r = {make_vec<N>(std::numeric_limits<T>::max()),
+                            make_vec<N>(std::numeric_limits<T>::lowest())};
+      return r;
+    }
+
+    template<typename T, std::size_t N>
+    inline aabb<T, N> merge(const aabb<T, N> &a, const aabb<T, N> &b) {
+      const aabb<T, N> r = {min(a.min, b.min), max(a.max, b.max)};
+      return r;
+    }
+  }
+
+  /**
+   * Folds all vectors of v with op, which must be associative: the array
+   * is split into chunks that are folded in parallel on pool and then
+   * combined in a fixed tree order, so the result is reproducible for a
+   * given input. Returns init combined with the fold; init if v is empty.
+   *
+   * reduce(points, p::make_vec<3>(0.0f), std::plus<vec3>())
+   */
+  template<typename T, std::size_t N, typename OpT>
+  inline vec<T, N> reduce(span<const vec<T, N> > v, const vec<T, N> &init, OpT op,
+                          thread_pool &pool = thread_pool::shared()) {
+    if (v.empty())
+      return init;
+    const vec<T, N> *p = v.data();
+    return op(init, detail::parallel_reduce<vec<T, N> >(
+      v.size(), pool,
+      [p, &op](std::size_t begin, std::size_t end) {
+        vec<T, N> r = p[begin];
+        for (std::size_t i = begin + 1; i < end; ++i)
+          r = op(r, p[i]);
+        return r;
+      },
+      op));
+  }
+
+  /**
+   * Component-wise sum of all vectors.
+   */
+  template<typename T, std::size_t N>
+  inline vec<T, N> sum(span<const vec<T, N> > v,
+                       thread_pool &pool = thread_pool::shared()) {
+    return reduce(v, make_vec<N>(T()), std::plus<vec<T, N> >(), pool);
+  }
+
+  /**
+   * Component-wise mean; undefined for an empty array.
+   */
+  template<typename T, std::size_t N>
+  inline vec<T, N> mean(span<const vec<T, N> > v,
+                        thread_pool &pool = thread_pool::shared()) {
+    return sum(v, pool) / T(v.size());
+  }
+
+  /**
+   * The smallest aabb containing every vector. For an empty array min is
+   * the largest and max the lowest value of T.
+   */
+  template<typename T, std::size_t N>
+  inline aabb<T, N> bounding_box(span<const vec<T, N> > v,
+                                 thread_pool &pool = thread_pool::shared()) {
+    if (v.empty())
+      return detail::empty_box<T, N>();
+
+    const vec<T, N> *p = v.data();
+    return detail::parallel_reduce<aabb<T, N> >(
+      v.size(), pool,
+      [p](std::size_t begin, std::size_t end) {
+        aabb<T, N> r = {p[begin], p[begin]};
+        for (std::size_t i = begin + 1; i < end; ++i) {
+          r.min = min(r.min, p[i]);
+          r.max = max(r.max, p[i]);
+        }
+        return r;
+      },
+      detail::merge<T, N>);
+  }
+
+  inline vec3 sum(span<const vec3> v, thread_pool &pool = thread_pool::shared()) {
+    if (v.empty())
+      return make_vec<3>(0.0f);
+    const vec3 *p = v.data();
+    return detail::parallel_reduce<vec3>(
+      v.size(), pool,
+      [p](std::size_t begin, std::size_t end) {
+        vec3 r;
+        if (!detail::sum3_wide(p, begin, end, r))
+          r = detail::fold3<detail::reduce_add>(p, begin, end);
+        return r;
+      },
+      std::plus<vec3>());
+  }
+
+  inline vec3 mean(span<const vec3> v, thread_pool &pool = thread_pool::shared()) {
+    return sum(v, pool) / float(v.size());
+  }
+
+  inline aabb<float, 3> bounding_box(span<const vec3> v,
+                                    thread_pool &pool = thread_pool::shared()) {
+    if (v.empty())
+      return detail::empty_box<float, 3>();
+    const vec3 *p = v.data();
+    return detail::parallel_reduce<aabb<float, 3> >(
+      v.size(), pool,
+      [p](std::size_t begin, std::size_t end) {
+        aabb<float, 3> r;
+        if (!detail::bounds3_wide(p, begin, end, r.min, r.max))
+          r = detail::bounds3(p, begin, end);
+        return r;
+      },
+      detail::merge<float, 3>);
+  }
+
+  inline vec4 sum(span<const vec4> v, thread_pool &pool = thread_pool::shared()) {
+    if (v.empty())
+      return make_vec<4>(0.0f);
+    const vec4 *p = v.data();
+    return detail::parallel_reduce<vec4>(
+      v.size(), pool,
+      [p](std::size_t begin, std::size_t end) {
+        vec4 r;
+        if (!detail::sum4_wide(p, begin, end, r))
+          r = detail::fold4<detail::reduce_add>(p, begin, end);
+        return r;
+      },
+      std::plus<vec4>());
+  }
+
+  inline vec4 mean(span<const vec4> v, thread_pool &pool = thread_pool::shared()) {
+    return sum(v, pool) / float(v.size());
+  }
+
+  inline aabb<float, 4> bounding_box(span<const vec4> v,
+                                    thread_pool &pool = thread_pool::shared()) {
+    if (v.empty())
+      return detail::empty_box<float, 4>();
+    const vec4 *p = v.data();
+    return detail::parallel_reduce<aabb<float, 4> >(
+      v.size(), pool,
+      [p](std::size_t begin, std::size_t end) {
+        aabb<float, 4> r;
+        if (!detail::bounds4_wide(p, begin, end, r.min, r.max))
+          r = detail::bounds4(p, begin, end);
+        return r;
+      },
+      detail::merge<float, 4>);
+  }
+
+  namespace detail {
+    /**
+     * sin(t * theta) / sin(theta) with cos(theta) = xm1 + 1 in [0, 1], for
+     * four lanes, as a product of 12 factors that only needs mul and add
+     * (D. Eberly, "A Fast and Accurate Algorithm for Computing SLERP").
+     * The last factor is scaled so that the error stays below 1e-6.
+     */
+    inline simd::f32x4 slerp_weight(simd::f32x4 t, simd::f32x4 xm1) {
+      static const float u[12] = {
+        0.333333333f, 0.1f, 0.0476190476f, 0.0277777778f, 0.0181818182f,
+        0.0128205128f, 0.00952380952f, 0.00735294118f, 0.00584795322f,
+        0.00476190476f, 0.00395256917f, 0.00631333333f
+      };
+      static const float v[12] = {
+        0.333333333f, 0.4f, 0.428571429f, 0.444444444f, 0.454545455f,
+        0.461538462f, 0.466666667f, 0.470588235f, 0.473684211f,
+        0.476190476f, 0.47826087f, 0.90912f
+      };
+      const simd::f32x4 one = simd::splat(1.0f);
+      const simd::f32x4 t2 = simd::mul(t, t);
+      simd::f32x4 r = one;
+      for (int i = 11; i >= 0; --i) {
+        const simd::f32x4 b = simd::mul(
+          simd::sub(simd::mul(simd::splat(u[i]), t2), simd::splat(v[i])), xm1);
+        r = simd::add(one, simd::mul(b, r));
+      }
+      return simd::mul(t, r);
+    }
+
+    /**
+     * Four quaternions at a time, transposed so that each register holds
+     * one component of all four. t advances by t_step per element, so 0
+     * uses the same t for all.
+     */
+    inline void interp_n(span<const quatf> q1, span<const quatf> q2,
+                         const float *t, std::size_t t_step, bool spherical,
+                         span<quatf> out) {
+      assert(q1.size() == q2.size() && q1.size() == out.size());
+      const std::size_t n = q1.size();
+      const float *a = reinterpret_cast<const float *>(q1.data());
+      const float *b = reinterpret_cast<const float *>(q2.data());
+      float *dst = reinterpret_cast<float *>(out.data());
+      const simd::f32x4 one = simd::splat(1.0f);
+
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4, a += 16, b += 16, dst += 16) {
+        simd::f32x4 ax = simd::load(a), ay = simd::load(a + 4);
+        simd::f32x4 az = simd::load(a + 8), aw = simd::load(a + 12);
+        simd::f32x4 bx = simd::load(b), by = simd::load(b + 4);
+        simd::f32x4 bz = simd::load(b + 8), bw = simd::load(b + 12);
+        simd::transpose(ax, ay, az, aw);
+        simd::transpose(bx, by, bz, bw);
+
+        // the shorter arc: flip q2 where the dot product is negative
+        float d[4], sign[4];
+        simd::store(d, simd::add(simd::add(simd::mul(ax, bx), simd::mul(ay, by)),
+                                 simd::add(simd::mul(az, bz), simd::mul(aw, bw))));
+        for (std::size_t k = 0; k < 4; ++k) {
+          sign[k] = d[k] < 0.0f ? -1.0f : 1.0f;
+          d[k] *= sign[k];
+        }
+
+        const simd::f32x4 tv = t_step ? simd::load(t + i) : simd::splat(*t);
+        simd::f32x4 w1 = simd::sub(one, tv), w2 = tv;
+        if (spherical) {
+          const simd::f32x4 xm1 = simd::sub(simd::load(d), one);
+          w1 = slerp_weight(w1, xm1);
+          w2 = slerp_weight(w2, xm1);
+        }
+        w2 = simd::mul(w2, simd::load(sign));
+
+        simd::f32x4 rx = simd::add(simd::mul(ax, w1), simd::mul(bx, w2));
+        simd::f32x4 ry = simd::add(simd::mul(ay, w1), simd::mul(by, w2));
+        simd::f32x4 rz = simd::add(simd::mul(az, w1), simd::mul(bz, w2));
+        simd::f32x4 rw = simd::add(simd::mul(aw, w1), simd::mul(bw, w2));
+        if (!spherical) {
+          const simd::f32x4 inv = simd::rsqrt(
+            simd::add(simd::add(simd::mul(rx, rx), simd::mul(ry, ry)),
+                      simd::add(simd::mul(rz, rz), simd::mul(rw, rw))));
+          rx = simd::mul(rx, inv);
+          ry = simd::mul(ry, inv);
+          rz = simd::mul(rz, inv);
+          rw = simd::mul(rw, inv);
+        }
+
+        simd::transpose(rx, ry, rz, rw);
+        simd::store(dst, rx); simd::store(dst + 4, ry);
+        simd::store(dst + 8, rz); simd::store(dst + 12, rw);
+      }
+
+      for (; i < n; ++i) {
+        const float ti = t[i * t_step];
+        out[i] = spherical ? slerp(q1[i], q2[i], ti) : nlerp(q1[i], q2[i], ti);
+      }
+    }
+  }
+
+  /**
+   * Writes slerp(q1[i], q2[i], t[i]) to out[i], e.g. to sample the
+   * keyframes of many animated joints at once.
+   */
+  template<typename T>
+  inline void slerp_n(span<const quat<T> > q1, span<const quat<T> > q2,
+                      span<const T> t, span<quat<T> > out) {
+    assert(q1.size() == q2.size() && q1.size() == t.size() &&
+           q1.size() == out.size());
+    for (std::size_t i = 0; i < q1.size(); ++i)
+      out[i] = slerp(q1[i], q2[i], t[i]);
+  }
+
+  /**
+   * Writes slerp(q1[i], q2[i], t) to out[i].
+   */
+  template<typename T>
+  inline void slerp_n(span<const quat<T> > q1, span<const quat<T> > q2, T t,
+                      span<quat<T> > out) {
+    assert(q1.size() == q2.size() && q1.size() == out.size());
+    for (std::size_t i = 0; i < q1.size(); ++i)
+      out[i] = slerp(q1[i], q2[i], t);
+  }
+
+  template<typename T>
+  inline void nlerp_n(span<const quat<T> > q1, span<const quat<T> > q2,
+                      span<const T> t, span<quat<T> > out) {
+    assert(q1.size() == q2.size() && q1.size() == t.size() &&
+           q1.size() == out.size());
+    for (std::size_t i = 0; i < q1.size(); ++i)
+      out[i] = nlerp(q1[i], q2[i], t[i]);
+  }
+
+  template<typename T>
+  inline void nlerp_n(span<const quat<T> > q1, span<const quat<T> > q2, T t,
+                      span<quat<T> > out) {
+    assert(q1.size() == q2.size() && q1.size() == out.size());
+    for (std::size_t i = 0; i < q1.size(); ++i)
+      out[i] = nlerp(q1[i], q2[i], t);
+  }
+
+  inline void slerp_n(span<const quatf> q1, span<const quatf> q2,
+                      span<const float> t, span<quatf> out) {
+    assert(t.size() == q1.size());
+    detail::interp_n(q1, q2, t.data(), 1, true, out);
+  }
+
+  inline void slerp_n(span<const quatf> q1, span<const quatf> q2, float t,
+                      span<quatf> out) {
+    detail::interp_n(q1, q2, &t, 0, true, out);
+  }
+
+  inline void nlerp_n(span<const quatf> q1, span<const quatf> q2,
+                      span<const float> t, span<quatf> out) {
+    assert(t.size() == q1.size());
+    detail::interp_n(q1, q2, t.data(), 1, false, out);
+  }
+
+  inline void nlerp_n(span<const quatf> q1, span<const quatf> q2, float t,
+                      span<quatf> out) {
+    detail::interp_n(q1, q2, &t, 0, false, out);
+  }
+
+  namespace detail {
+    /**
+     * Applies op to four floats at a time. The last, partial group goes
+     * through op as well, padded, so every element gets the same
+     * arithmetic.
+     */
+    template<typename OpT>
+    inline void map_floats(const float *in, float *out, std::size_t n, const OpT &op) {
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4)
+        simd::store(out + i, op(simd::load(in + i)));
+      if (i < n) {
+        float tmp[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        std::copy(in + i, in + n, tmp);
+        simd::store(tmp, op(simd::load(tmp)));
+        std::copy(tmp, tmp + (n - i), out + i);
+      }
+    }
+
+    struct clamp_op {
+      clamp_op(float vmin, float vmax) : lo(simd::splat(vmin)), hi(simd::splat(vmax)) {}
+      simd::f32x4 operator()(simd::f32x4 x) const {
+        return simd::max(simd::min(x, hi), lo);
+      }
+      simd::f32x4 lo, hi;
+    };
+
+    /**
+     * wrap() with the reciprocal of the range width computed once. x - lower
+     * times the reciprocal can round across an integer where the quotient
+     * wouldn't, so results equal to upper or below lower are moved back by
+     * one width. Moving up can round to upper itself, hence the last min.
+     */
+    struct wrap_op {
+      wrap_op(float lower, float upper)
+        : lower(simd::splat(lower)), upper(simd::splat(upper)),
+          below_upper(simd::splat(std::nextafter(upper, lower))),
+          width(simd::splat(upper - lower)), inv(simd::splat(1.0f / (upper - lower))) {}
+      simd::f32x4 operator()(simd::f32x4 x) const {
+        const simd::f32x4 times = simd::floor(simd::mul(simd::sub(x, lower), inv));
+        simd::f32x4 r = simd::sub(x, simd::mul(times, width));
+        r = simd::select(simd::less(r, upper), r, simd::sub(r, width));
+        r = simd::select(simd::less(r, lower), simd::add(r, width), r);
+        return simd::min(r, below_upper);
+      }
+      simd::f32x4 lower, upper, below_upper, width, inv;
+    };
+
+    template<typename T, std::size_t N>
+    inline span<const T> flatten(span<const vec<T, N> > v) {
+      return span<const T>(reinterpret_cast<const T *>(v.data()), v.size() * N);
+    }
+
+    template<typename T, std::size_t N>
+    inline span<T> flatten(span<vec<T, N> > v) {
+      return span<T>(reinterpret_cast<T *>(v.data()), v.size() * N);
+    }
+  }
+
+  /**
+   * out[i] = lerp(begin[i], end[i], amount), or with amount[i].
+   */
+  template<typename T, typename Scalar>
+  inline void lerp_n(span<const T> begin, span<const T> end, Scalar amount,
+                     span<T> out) {
+    assert(begin.size() == end.size() && begin.size() == out.size());
+    for (std::size_t i = 0; i < begin.size(); ++i)
+      out[i] = lerp(begin[i], end[i], amount);
+  }
+
+  template<typename T, typename Scalar>
+  inline void lerp_n(span<const T> begin, span<const T> end, span<const Scalar> amount,
+                     span<T> out) {
+    assert(begin.size() == end.size() && begin.size() == amount.size() &&
+           begin.size() == out.size());
+    for (std::size_t i = 0; i < begin.size(); ++i)
+      out[i] = lerp(begin[i], end[i], amount[i]);
+  }
+
+  /**
+   * out[i] = clamp(in[i], vmin, vmax); vectors are clamped component-wise.
+   */
+  template<typename T>
+  inline void clamp_n(span<const T> in, T vmin, T vmax, span<T> out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = clamp(in[i], vmin, vmax);
+  }
+
+  template<typename T, std::size_t N>
+  inline void clamp_n(span<const vec<T, N> > in, T vmin, T vmax, span<vec<T, N> > out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = clamp(in[i], vmin, vmax);
+  }
+
+  template<typename T>
+  inline void clamp_n(span<T> v, T vmin, T vmax) {
+    clamp_n(span<const T>(v), vmin, vmax, v);
+  }
+
+  template<typename T, std::size_t N>
+  inline void clamp_n(span<vec<T, N> > v, T vmin, T vmax) {
+    clamp_n(span<const vec<T, N> >(v), vmin, vmax, v);
+  }
+
+  template<typename T>
+  inline void saturate_n(span<const T> in, span<T> out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = saturate(in[i]);
+  }
+
+  template<typename T>
+  inline void saturate_n(span<T> v) {
+    saturate_n(span<const T>(v), v);
+  }
+
+  /**
+   * out[i] = wrap(in[i], lower, upper). The float versions multiply by a
+   * reciprocal, so they can differ from wrap() by one whole range width
+   * right at the borders; their results are always in [lower, upper),
+   * never equal to upper.
+   */
+  template<typename T>
+  inline void wrap_n(span<const T> in, T lower, T upper, span<T> out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = wrap(in[i], lower, upper);
+  }
+
+  template<typename T, std::size_t N>
+  inline void wrap_n(span<const vec<T, N> > in, T lower, T upper, span<vec<T, N> > out) {
+    assert(in.size() == out.size());
+    for (std::size_t i = 0; i < in.size(); ++i)
+      out[i] = wrap(in[i], lower, upper);
+  }
+
+  template<typename T>
+  inline void wrap_n(span<T> v, T lower, T upper) {
+    wrap_n(span<const T>(v), lower, upper, v);
+  }
+
+  template<typename T, std::size_t N>
+  inline void wrap_n(span<vec<T, N> > v, T lower, T upper) {
+    wrap_n(span<const vec<T, N> >(v), lower, upper, v);
+  }
+
+  /*
+   * float arrays, and arrays of float vectors seen as float arrays, four
+   * lanes at a time with no branches.
+   */
+  inline void lerp_n(span<const float> begin, span<const float> end, float amount,
+                     span<float> out) {
+    assert(begin.size() == end.size() && begin.size() == out.size());
+    const std::size_t n = begin.size();
+    const float *a = begin.data(), *b = end.data();
+    float *dst = out.data();
+    const simd::f32x4 wa = simd::splat(1.0f - amount), wb = simd::splat(amount);
+
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+      simd::store(dst + i, simd::add(simd::mul(simd::load(a + i), wa),
+                                     simd::mul(simd::load(b + i), wb)));
+    for (; i < n; ++i)
+      dst[i] = lerp(a[i], b[i], amount);
+  }
+
+  inline void lerp_n(span<const float> begin, span<const float> end,
+                     span<const float> amount, span<float> out) {
+    assert(begin.size() == end.size() && begin.size() == amount.size() &&
+           begin.size() == out.size());
+    const std::size_t n = begin.size();
+    const float *a = begin.data(), *b = end.data(), *t = amount.data();
+    float *dst = out.data();
+    const simd::f32x4 one = simd::splat(1.0f);
+
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const simd::f32x4 wb = simd::load(t + i);
+      simd::store(dst + i, simd::add(simd::mul(simd::load(a + i), simd::sub(one, wb)),
+                                     simd::mul(simd::load(b + i), wb)));
+    }
+    for (; i < n; ++i)
+      dst[i] = lerp(a[i], b[i], t[i]);
+  }
+
+  template<std::size_t N>
+  inline void lerp_n(span<const vec<float, N> > begin, span<const vec<float, N> > end,
+                     float amount, span<vec<float, N> > out) {
+    lerp_n(detail::flatten(begin), detail::flatten(end), amount, detail::flatten(out));
+  }
+
+  inline void clamp_n(span<const float> in, float vmin, float vmax, span<float> out) {
+    assert(in.size() == out.size());
+    detail::map_floats(in.data(), out.data(), in.size(), detail::clamp_op(vmin, vmax));
+  }
+
+  template<std::size_t N>
+  inline void clamp_n(span<const vec<float, N> > in, float vmin, float vmax,
+                      span<vec<float, N> > out) {
+    clamp_n(detail::flatten(in), vmin, vmax, detail::flatten(out));
+  }
+
+  inline void saturate_n(span<const float> in, span<float> out) {
+    clamp_n(in, 0.0f, 1.0f, out);
+  }
+
+  template<std::size_t N>
+  inline void saturate_n(span<const vec<float, N> > in, span<vec<float, N> > out) {
+    clamp_n(detail::flatten(in), 0.0f, 1.0f, detail::flatten(out));
+  }
+
+  inline void wrap_n(span<const float> in, float lower, float upper, span<float> out) {
+    assert(in.size() == out.size());
+    detail::map_floats(in.data(), out.data(), in.size(), detail::wrap_op(lower, upper));
+  }
+
+  template<std::size_t N>
+  inline void wrap_n(span<const vec<float, N> > in, float lower, float upper,
+                     span<vec<float, N> > out) {
+    wrap_n(detail::flatten(in), lower, upper, detail::flatten(out));
+  }
+} // !p
+
+#endif // !P_UTILS_VECTOR_BATCH_H
@@ -0,0 +1,607 @@
+/* -- vector_batch_x86.h ---------------------------------------------*- c++ -*-
+ * AVX2 and AVX-512 versions of the vector_batch.h kernels, compiled with
+ * target attributes (see cpu.h) and called only when active_isa() allows.
+ * Include vector_batch.h rather than this header.
+ *
+ * The element-wise kernels do whole groups of 8 (AVX2) or 16 (AVX-512)
+ * vectors and return where they stopped; the caller's SSE2 and scalar
+ * loops do the rest. The reductions cover their whole range.
+ *
+ * Most of them treat a 256 or 512 bit register as two or four independent
+ * 128 bit lanes, since the AVX shuffles stay within lanes: four packed vec3
+ * or vec4 per lane go through the same transposes as the SSE2 code.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_BATCH_X86_H
+#define P_UTILS_VECTOR_BATCH_X86_H
+
+#include <cstddef>
+#include <limits>
+
+#include "cpu.h"
+#include "vector.h"
+#include "matrix.h"
+
+#if defined(P_DISPATCH_X86)
+
+namespace p {
+  namespace detail {
+    namespace avx2 {
+      /**
+       * simd::shuffle within each lane.
+       */
+      template<int i0, int i1, int i2, int i3>
+      P_TARGET_AVX2 inline __m256 shuffle(__m256 a, __m256 b) {
+        return _mm256_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0));
+      }
+
+      /**
+       * Transposes the 4x4 block held in each lane of r0..r3.
+       */
+      P_TARGET_AVX2 inline void transpose(__m256 &r0, __m256 &r1, __m256 &r2, __m256 &r3) {
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+        const __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+        r0 = shuffle<0, 1, 0, 1>(t0, t2);
+        r1 = shuffle<2, 3, 2, 3>(t0, t2);
+        r2 = shuffle<0, 1, 0, 1>(t1, t3);
+        r3 = shuffle<2, 3, 2, 3>(t1, t3);
+      }
+
+      /**
+       * Eight packed vec3 to and from one register per component, in order.
+       * The lanes are regrouped so that each holds four whole vec3, which
+       * then go through the shuffles of the SSE2 detail::deinterleave3.
+       */
+      P_TARGET_AVX2 inline void deinterleave3(__m256 a, __m256 b, __m256 c,
+                                              __m256 &x, __m256 &y, __m256 &z) {
+        const __m256 p0 = _mm256_permute2f128_ps(a, b, 0x30);
+        const __m256 p1 = _mm256_permute2f128_ps(a, c, 0x21);
+        const __m256 p2 = _mm256_permute2f128_ps(b, c, 0x30);
+        const __m256 yz = shuffle<1, 2, 0, 1>(p0, p1);
+        x = shuffle<0, 3, 0, 3>(p0, shuffle<2, 3, 0, 1>(p1, p2));
+        y = shuffle<0, 2, 0, 2>(yz, shuffle<3, 3, 2, 2>(p1, p2));
+        z = shuffle<1, 3, 0, 3>(yz, p2);
+      }
+
+      P_TARGET_AVX2 inline void interleave3(__m256 x, __m256 y, __m256 z,
+                                            __m256 &a, __m256 &b, __m256 &c) {
+        const __m256 p0 = shuffle<0, 2, 0, 2>(shuffle<0, 1, 0, 1>(x, y),
+                                              shuffle<0, 0, 1, 1>(z, x));
+        const __m256 p1 = shuffle<0, 2, 0, 2>(shuffle<1, 1, 1, 1>(y, z),
+                                              shuffle<2, 2, 2, 2>(x, y));
+        const __m256 p2 = shuffle<0, 2, 0, 2>(shuffle<2, 2, 3, 3>(z, x),
+                                              shuffle<3, 3, 3, 3>(y, z));
+        a = _mm256_permute2f128_ps(p0, p1, 0x20);
+        b = _mm256_permute2f128_ps(p2, p0, 0x30);
+        c = _mm256_permute2f128_ps(p1, p2, 0x31);
+      }
+
+      /**
+       * simd::rsqrt with the Newton-Raphson step fused.
+       */
+      P_TARGET_AVX2 inline __m256 rsqrt(__m256 a) {
+        const __m256 y = _mm256_rsqrt_ps(a);
+        const __m256 half_a = _mm256_mul_ps(_mm256_set1_ps(0.5f), a);
+        return _mm256_mul_ps(y, _mm256_fnmadd_ps(_mm256_mul_ps(half_a, y), y,
+                                                 _mm256_set1_ps(1.5f)));
+      }
+
+      /**
+       * Sums the eight lanes pairwise.
+       */
+      P_TARGET_AVX2 inline float hsum(__m256 v) {
+        float l[8];
+        _mm256_storeu_ps(l, v);
+        return ((l[0] + l[1]) + (l[2] + l[3])) + ((l[4] + l[5]) + (l[6] + l[7]));
+      }
+
+      P_TARGET_AVX2 inline float hmin(__m256 v) {
+        float l[8];
+        _mm256_storeu_ps(l, v);
+        float r = l[0];
+        for (std::size_t i = 1; i < 8; ++i)
+          r = l[i] < r ? l[i] : r;
+        return r;
+      }
+
+      P_TARGET_AVX2 inline float hmax(__m256 v) {
+        float l[8];
+        _mm256_storeu_ps(l, v);
+        float r = l[0];
+        for (std::size_t i = 1; i < 8; ++i)
+          r = r < l[i] ? l[i] : r;
+        return r;
+      }
+
+      /**
+       * Two copies of a 128 bit register.
+       */
+      P_TARGET_AVX2 inline __m256 twice(__m128 v) {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(v), v, 1);
+      }
+
+      P_TARGET_AVX2 inline std::size_t normalize3(const float *src, float *dst,
+                                                  std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8, src += 24, dst += 24) {
+          __m256 x, y, z;
+          deinterleave3(_mm256_loadu_ps(src), _mm256_loadu_ps(src + 8),
+                        _mm256_loadu_ps(src + 16), x, y, z);
+          const __m256 inv = rsqrt(_mm256_fmadd_ps(z, z, _mm256_fmadd_ps(
+            y, y, _mm256_mul_ps(x, x))));
+          __m256 a, b, c;
+          interleave3(_mm256_mul_ps(x, inv), _mm256_mul_ps(y, inv),
+                      _mm256_mul_ps(z, inv), a, b, c);
+          _mm256_storeu_ps(dst, a);
+          _mm256_storeu_ps(dst + 8, b);
+          _mm256_storeu_ps(dst + 16, c);
+        }
+        return i;
+      }
+
+      P_TARGET_AVX2 inline std::size_t normalize4(const float *src, float *dst,
+                                                  std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8, src += 32, dst += 32) {
+          __m256 x = _mm256_loadu_ps(src), y = _mm256_loadu_ps(src + 8);
+          __m256 z = _mm256_loadu_ps(src + 16), w = _mm256_loadu_ps(src + 24);
+          transpose(x, y, z, w);
+          const __m256 inv = rsqrt(_mm256_fmadd_ps(w, w, _mm256_fmadd_ps(
+            z, z, _mm256_fmadd_ps(y, y, _mm256_mul_ps(x, x)))));
+          x = _mm256_mul_ps(x, inv);
+          y = _mm256_mul_ps(y, inv);
+          z = _mm256_mul_ps(z, inv);
+          w = _mm256_mul_ps(w, inv);
+          transpose(x, y, z, w);
+          _mm256_storeu_ps(dst, x);
+          _mm256_storeu_ps(dst + 8, y);
+          _mm256_storeu_ps(dst + 16, z);
+          _mm256_storeu_ps(dst + 24, w);
+        }
+        return i;
+      }
+
+      P_TARGET_AVX2 inline std::size_t dot3(const float *a, const float *b, float *out,
+                                            std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8, a += 24, b += 24) {
+          __m256 ax, ay, az, bx, by, bz;
+          deinterleave3(_mm256_loadu_ps(a), _mm256_loadu_ps(a + 8),
+                        _mm256_loadu_ps(a + 16), ax, ay, az);
+          deinterleave3(_mm256_loadu_ps(b), _mm256_loadu_ps(b + 8),
+                        _mm256_loadu_ps(b + 16), bx, by, bz);
+          _mm256_storeu_ps(out + i, _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(
+            ay, by, _mm256_mul_ps(ax, bx))));
+        }
+        return i;
+      }
+
+      P_TARGET_AVX2 inline std::size_t dot4(const float *a, const float *b, float *out,
+                                            std::size_t n) {
+        // the lanes hold vectors 0 2 4 6 and 1 3 5 7 after the transpose
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8, a += 32, b += 32) {
+          __m256 ax = _mm256_loadu_ps(a), ay = _mm256_loadu_ps(a + 8);
+          __m256 az = _mm256_loadu_ps(a + 16), aw = _mm256_loadu_ps(a + 24);
+          __m256 bx = _mm256_loadu_ps(b), by = _mm256_loadu_ps(b + 8);
+          __m256 bz = _mm256_loadu_ps(b + 16), bw = _mm256_loadu_ps(b + 24);
+          transpose(ax, ay, az, aw);
+          transpose(bx, by, bz, bw);
+          const __m256 d = _mm256_fmadd_ps(aw, bw, _mm256_fmadd_ps(
+            az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx))));
+          _mm256_storeu_ps(out + i, _mm256_permutevar8x32_ps(d, order));
+        }
+        return i;
+      }
+
+      P_TARGET_AVX2 inline std::size_t transform_points3(const mat4 &m, const vec3 *in,
+                                                         vec3 *out, std::size_t begin,
+                                                         std::size_t end) {
+        __m256 k[12];
+        for (std::size_t j = 0; j < 12; ++j)
+          k[j] = _mm256_set1_ps(m.components[j]);
+
+        std::size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+          const float *src = in[i].components;
+          __m256 x, y, z;
+          deinterleave3(_mm256_loadu_ps(src), _mm256_loadu_ps(src + 8),
+                        _mm256_loadu_ps(src + 16), x, y, z);
+          __m256 o[3];
+          for (std::size_t r = 0; r < 3; ++r)
+            o[r] = _mm256_fmadd_ps(k[4*r + 2], z, _mm256_fmadd_ps(
+              k[4*r + 1], y, _mm256_fmadd_ps(k[4*r], x, k[4*r + 3])));
+          __m256 a, b, c;
+          interleave3(o[0], o[1], o[2], a, b, c);
+          float *dst = out[i].components;
+          _mm256_storeu_ps(dst, a);
+          _mm256_storeu_ps(dst + 8, b);
+          _mm256_storeu_ps(dst + 16, c);
+        }
+        return i;
+      }
+
+      P_TARGET_AVX2 inline std::size_t transform_points4(const mat4 &m, const vec4 *in,
+                                                         vec4 *out, std::size_t begin,
+                                                         std::size_t end) {
+        __m128 r0 = _mm_loadu_ps(m.components), r1 = _mm_loadu_ps(m.components + 4);
+        __m128 r2 = _mm_loadu_ps(m.components + 8), r3 = _mm_loadu_ps(m.components + 12);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        const __m256 c0 = twice(r0), c1 = twice(r1), c2 = twice(r2), c3 = twice(r3);
+
+        std::size_t i = begin;
+        for (; i + 2 <= end; i += 2) {
+          const __m256 v = _mm256_loadu_ps(in[i].components);
+          __m256 s = _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00));
+          s = _mm256_fmadd_ps(c1, _mm256_permute_ps(v, 0x55), s);
+          s = _mm256_fmadd_ps(c2, _mm256_permute_ps(v, 0xaa), s);
+          s = _mm256_fmadd_ps(c3, _mm256_permute_ps(v, 0xff), s);
+          _mm256_storeu_ps(out[i].components, s);
+        }
+        return i;
+      }
+
+      /**
+       * Eight packed vec3 fill three registers whose lanes always hold the
+       * same components, as in detail::fold3.
+       */
+      P_TARGET_AVX2 inline vec3 sum3(const vec3 *v, std::size_t begin, std::size_t end) {
+        __m256 a = _mm256_setzero_ps(), b = a, c = a;
+        std::size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+          const float *src = v[i].components;
+          a = _mm256_add_ps(a, _mm256_loadu_ps(src));
+          b = _mm256_add_ps(b, _mm256_loadu_ps(src + 8));
+          c = _mm256_add_ps(c, _mm256_loadu_ps(src + 16));
+        }
+
+        __m256 x, y, z;
+        deinterleave3(a, b, c, x, y, z);
+        vec3 ret = {{hsum(x), hsum(y), hsum(z)}};
+        for (; i < end; ++i)
+          for (std::size_t j = 0; j < 3; ++j)
+            ret[j] += v[i][j];
+        return ret;
+      }
+
+      P_TARGET_AVX2 inline void bounds3(const vec3 *v, std::size_t begin, std::size_t end,
+                                        vec3 &lo, vec3 &hi) {
+        __m256 l[3], h[3];
+        for (std::size_t k = 0; k < 3; ++k) {
+          l[k] = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+          h[k] = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+        }
+
+        std::size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+          const float *src = v[i].components;
+          for (std::size_t k = 0; k < 3; ++k) {
+            const __m256 x = _mm256_loadu_ps(src + 8*k);
+            l[k] = _mm256_min_ps(x, l[k]);
+            h[k] = _mm256_max_ps(x, h[k]);
+          }
+        }
+
+        __m256 x, y, z;
+        deinterleave3(l[0], l[1], l[2], x, y, z);
+        lo = make_vec(hmin(x), hmin(y), hmin(z));
+        deinterleave3(h[0], h[1], h[2], x, y, z);
+        hi = make_vec(hmax(x), hmax(y), hmax(z));
+        for (; i < end; ++i) {
+          lo = min(lo, v[i]);
+          hi = max(hi, v[i]);
+        }
+      }
+
+      P_TARGET_AVX2 inline vec4 sum4(const vec4 *v, std::size_t begin, std::size_t end) {
+        __m256 acc = _mm256_setzero_ps();
+        std::size_t i = begin;
+        for (; i + 2 <= end; i += 2)
+          acc = _mm256_add_ps(acc, _mm256_loadu_ps(v[i].components));
+        __m128 r = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        if (i < end)
+          r = _mm_add_ps(r, _mm_loadu_ps(v[i].components));
+        vec4 ret;
+        _mm_storeu_ps(ret.components, r);
+        return ret;
+      }
+
+      P_TARGET_AVX2 inline void bounds4(const vec4 *v, std::size_t begin, std::size_t end,
+                                        vec4 &lo, vec4 &hi) {
+        __m256 l = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        __m256 h = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+        std::size_t i = begin;
+        for (; i + 2 <= end; i += 2) {
+          const __m256 x = _mm256_loadu_ps(v[i].components);
+          l = _mm256_min_ps(x, l);
+          h = _mm256_max_ps(x, h);
+        }
+        __m128 rl = _mm_min_ps(_mm256_extractf128_ps(l, 1), _mm256_castps256_ps128(l));
+        __m128 rh = _mm_max_ps(_mm256_extractf128_ps(h, 1), _mm256_castps256_ps128(h));
+        if (i < end) {
+          const __m128 x = _mm_loadu_ps(v[i].components);
+          rl = _mm_min_ps(x, rl);
+          rh = _mm_max_ps(x, rh);
+        }
+        _mm_storeu_ps(lo.components, rl);
+        _mm_storeu_ps(hi.components, rh);
+      }
+    }
+
+    // GCC 12 warns about the self-initialized "undefined" registers in
+    // its own AVX-512 intrinsics
+#if defined(__GNUC__) && !defined(__clang__)
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wuninitialized"
+#  pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+    namespace avx512 {
+      template<int i0, int i1, int i2, int i3>
+      P_TARGET_AVX512 inline __m512 shuffle(__m512 a, __m512 b) {
+        return _mm512_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0));
+      }
+
+      P_TARGET_AVX512 inline void transpose(__m512 &r0, __m512 &r1, __m512 &r2, __m512 &r3) {
+        const __m512 t0 = _mm512_unpacklo_ps(r0, r1), t1 = _mm512_unpackhi_ps(r0, r1);
+        const __m512 t2 = _mm512_unpacklo_ps(r2, r3), t3 = _mm512_unpackhi_ps(r2, r3);
+        r0 = shuffle<0, 1, 0, 1>(t0, t2);
+        r1 = shuffle<2, 3, 2, 3>(t0, t2);
+        r2 = shuffle<0, 1, 0, 1>(t1, t3);
+        r3 = shuffle<2, 3, 2, 3>(t1, t3);
+      }
+
+      /**
+       * 1/sqrt(a) from the 2^-14 estimate and one Newton-Raphson step.
+       */
+      P_TARGET_AVX512 inline __m512 rsqrt(__m512 a) {
+        const __m512 y = _mm512_rsqrt14_ps(a);
+        const __m512 half_a = _mm512_mul_ps(_mm512_set1_ps(0.5f), a);
+        return _mm512_mul_ps(y, _mm512_fnmadd_ps(_mm512_mul_ps(half_a, y), y,
+                                                 _mm512_set1_ps(1.5f)));
+      }
+
+      P_TARGET_AVX512 inline __m512 four(__m128 v) {
+        return _mm512_broadcast_f32x4(v);
+      }
+
+      P_TARGET_AVX512 inline std::size_t normalize4(const float *src, float *dst,
+                                                    std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16, src += 64, dst += 64) {
+          __m512 x = _mm512_loadu_ps(src), y = _mm512_loadu_ps(src + 16);
+          __m512 z = _mm512_loadu_ps(src + 32), w = _mm512_loadu_ps(src + 48);
+          transpose(x, y, z, w);
+          const __m512 inv = rsqrt(_mm512_fmadd_ps(w, w, _mm512_fmadd_ps(
+            z, z, _mm512_fmadd_ps(y, y, _mm512_mul_ps(x, x)))));
+          x = _mm512_mul_ps(x, inv);
+          y = _mm512_mul_ps(y, inv);
+          z = _mm512_mul_ps(z, inv);
+          w = _mm512_mul_ps(w, inv);
+          transpose(x, y, z, w);
+          _mm512_storeu_ps(dst, x);
+          _mm512_storeu_ps(dst + 16, y);
+          _mm512_storeu_ps(dst + 32, z);
+          _mm512_storeu_ps(dst + 48, w);
+        }
+        return i;
+      }
+
+      P_TARGET_AVX512 inline std::size_t dot4(const float *a, const float *b, float *out,
+                                              std::size_t n) {
+        // lane k holds vectors k, k + 4, k + 8 and k + 12 after the transpose
+        const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13,
+                                                2, 6, 10, 14, 3, 7, 11, 15);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16, a += 64, b += 64) {
+          __m512 ax = _mm512_loadu_ps(a), ay = _mm512_loadu_ps(a + 16);
+          __m512 az = _mm512_loadu_ps(a + 32), aw = _mm512_loadu_ps(a + 48);
+          __m512 bx = _mm512_loadu_ps(b), by = _mm512_loadu_ps(b + 16);
+          __m512 bz = _mm512_loadu_ps(b + 32), bw = _mm512_loadu_ps(b + 48);
+          transpose(ax, ay, az, aw);
+          transpose(bx, by, bz, bw);
+          const __m512 d = _mm512_fmadd_ps(aw, bw, _mm512_fmadd_ps(
+            az, bz, _mm512_fmadd_ps(ay, by, _mm512_mul_ps(ax, bx))));
+          _mm512_storeu_ps(out + i, _mm512_permutexvar_ps(order, d));
+        }
+        return i;
+      }
+
+      P_TARGET_AVX512 inline std::size_t transform_points4(const mat4 &m, const vec4 *in,
+                                                           vec4 *out, std::size_t begin,
+                                                           std::size_t end) {
+        __m128 r0 = _mm_loadu_ps(m.components), r1 = _mm_loadu_ps(m.components + 4);
+        __m128 r2 = _mm_loadu_ps(m.components + 8), r3 = _mm_loadu_ps(m.components + 12);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        const __m512 c0 = four(r0), c1 = four(r1), c2 = four(r2), c3 = four(r3);
+
+        std::size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+          const __m512 v = _mm512_loadu_ps(in[i].components);
+          __m512 s = _mm512_mul_ps(c0, _mm512_permute_ps(v, 0x00));
+          s = _mm512_fmadd_ps(c1, _mm512_permute_ps(v, 0x55), s);
+          s = _mm512_fmadd_ps(c2, _mm512_permute_ps(v, 0xaa), s);
+          s = _mm512_fmadd_ps(c3, _mm512_permute_ps(v, 0xff), s);
+          _mm512_storeu_ps(out[i].components, s);
+        }
+        return i;
+      }
+
+      P_TARGET_AVX512 inline vec4 sum4(const vec4 *v, std::size_t begin, std::size_t end) {
+        __m512 acc = _mm512_setzero_ps();
+        std::size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+          acc = _mm512_add_ps(acc, _mm512_loadu_ps(v[i].components));
+        __m128 r = _mm_add_ps(
+          _mm_add_ps(_mm512_extractf32x4_ps(acc, 0), _mm512_extractf32x4_ps(acc, 1)),
+          _mm_add_ps(_mm512_extractf32x4_ps(acc, 2), _mm512_extractf32x4_ps(acc, 3)));
+        for (; i < end; ++i)
+          r = _mm_add_ps(r, _mm_loadu_ps(v[i].components));
+        vec4 ret;
+        _mm_storeu_ps(ret.components, r);
+        return ret;
+      }
+
+      P_TARGET_AVX512 inline void bounds4(const vec4 *v, std::size_t begin, std::size_t end,
+                                          vec4 &lo, vec4 &hi) {
+        __m512 l = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+        __m512 h = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+        std::size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+          const __m512 x = _mm512_loadu_ps(v[i].components);
+          l = _mm512_min_ps(x, l);
+          h = _mm512_max_ps(x, h);
+        }
+        __m128 rl = _mm_min_ps(_mm_min_ps(_mm512_extractf32x4_ps(l, 3), _mm512_extractf32x4_ps(l, 2)),
+                               _mm_min_ps(_mm512_extractf32x4_ps(l, 1), _mm512_extractf32x4_ps(l, 0)));
+        __m128 rh = _mm_max_ps(_mm_max_ps(_mm512_extractf32x4_ps(h, 3), _mm512_extractf32x4_ps(h, 2)),
+                               _mm_max_ps(_mm512_extractf32x4_ps(h, 1), _mm512_extractf32x4_ps(h, 0)));
+        for (; i < end; ++i) {
+          const __m128 x = _mm_loadu_ps(v[i].components);
+          rl = _mm_min_ps(x, rl);
+          rh = _mm_max_ps(x, rh);
+        }
+        _mm_storeu_ps(lo.components, rl);
+        _mm_storeu_ps(hi.components, rh);
+      }
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#  pragma GCC diagnostic pop
+#endif
+  }
+} // !p
+
+#endif // P_DISPATCH_X86
+
+namespace p {
+  namespace detail {
+    /*
+     * The widest kernel active_isa() allows. The element-wise ones return
+     * how many elements they did, 0 if only the baseline may run; the
+     * reductions return false then.
+     */
+#if defined(P_DISPATCH_X86)
+    inline std::size_t normalize3_wide(const float *src, float *dst, std::size_t n) {
+      if (active_isa() >= isa_avx2)
+        return avx2::normalize3(src, dst, n);
+      return 0;
+    }
+
+    inline std::size_t normalize4_wide(const float *src, float *dst, std::size_t n) {
+      if (active_isa() >= isa_avx512)
+        return avx512::normalize4(src, dst, n);
+      if (active_isa() >= isa_avx2)
+        return avx2::normalize4(src, dst, n);
+      return 0;
+    }
+
+    inline std::size_t dot3_wide(const float *a, const float *b, float *out,
+                                 std::size_t n) {
+      if (active_isa() >= isa_avx2)
+        return avx2::dot3(a, b, out, n);
+      return 0;
+    }
+
+    inline std::size_t dot4_wide(const float *a, const float *b, float *out,
+                                 std::size_t n) {
+      if (active_isa() >= isa_avx512)
+        return avx512::dot4(a, b, out, n);
+      if (active_isa() >= isa_avx2)
+        return avx2::dot4(a, b, out, n);
+      return 0;
+    }
+
+    inline std::size_t transform_points3_wide(const mat4 &m, const vec3 *in, vec3 *out,
+                                              std::size_t begin, std::size_t end) {
+      if (active_isa() >= isa_avx2)
+        return avx2::transform_points3(m, in, out, begin, end);
+      return begin;
+    }
+
+    inline std::size_t transform_points4_wide(const mat4 &m, const vec4 *in, vec4 *out,
+                                              std::size_t begin, std::size_t end) {
+      if (active_isa() >= isa_avx512)
+        return avx512::transform_points4(m, in, out, begin, end);
+      if (active_isa() >= isa_avx2)
+        return avx2::transform_points4(m, in, out, begin, end);
+      return begin;
+    }
+
+    inline bool sum3_wide(const vec3 *v, std::size_t begin, std::size_t end, vec3 &out) {
+      if (active_isa() >= isa_avx2) {
+        out = avx2::sum3(v, begin, end);
+        return true;
+      }
+      return false;
+    }
+
+    inline bool sum4_wide(const vec4 *v, std::size_t begin, std::size_t end, vec4 &out) {
+      if (active_isa() >= isa_avx512) {
+        out = avx512::sum4(v, begin, end);
+        return true;
+      }
+      if (active_isa() >= isa_avx2) {
+        out = avx2::sum4(v, begin, end);
+        return true;
+      }
+      return false;
+    }
+
+    inline bool bounds3_wide(const vec3 *v, std::size_t begin, std::size_t end,
+                             vec3 &lo, vec3 &hi) {
+      if (active_isa() >= isa_avx2) {
+        avx2::bounds3(v, begin, end, lo, hi);
+        return true;
+      }
+      return false;
+    }
+
+    inline bool bounds4_wide(const vec4 *v, std::size_t begin, std::size_t end,
+                             vec4 &lo, vec4 &hi) {
+      if (active_isa() >= isa_avx512) {
+        avx512::bounds4(v, begin, end, lo, hi);
+        return true;
+      }
+      if (active_isa() >= isa_avx2) {
+        avx2::bounds4(v, begin, end, lo, hi);
+        return true;
+      }
+      return false;
+    }
+#else
+    inline std::size_t normalize3_wide(const float *, float *, std::size_t) {return 0; }
+    inline std::size_t normalize4_wide(const float *, float *, std::size_t) {return 0; }
+
+    inline std::size_t dot3_wide(const float *, const float *, float *, std::size_t) {
+      return 0;
+    }
+
+    inline std::size_t dot4_wide(const float *, const float *, float *, std::size_t) {
+      return 0;
+    }
+
+    inline std::size_t transform_points3_wide(const mat4 &, const vec3 *, vec3 *,
+                                              std::size_t begin, std::size_t) {
+      return begin;
+    }
+
+    inline std::size_t transform_points4_wide(const mat4 &, const vec4 *, vec4 *,
+                                              std::size_t begin, std::size_t) {
+      return begin;
+    }
+
+    inline bool sum3_wide(const vec3 *, std::size_t, std::size_t, vec3 &) {return false; }
+    inline bool sum4_wide(const vec4 *, std::size_t, std::size_t, vec4 &) {return false; }
+
+    inline bool bounds3_wide(const vec3 *, std::size_t, std::size_t, vec3 &, vec3 &) {
+      return false;
+    }
+
+    inline bool bounds4_wide(const vec4 *, std::size_t, std::size_t, vec4 &, vec4 &) {
+      return false;
+    }
+#endif
+  }
+} // !p
+
+#endif // !P_UTILS_VECTOR_BATCH_X86_H
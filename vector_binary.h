@@ -0,0 +1,378 @@
+/* -- vector_binary.h ------------------------------------------------*- c++ -*-
+ * Binary on-disk format for arrays of vectors and matrices.
+ *
+ * A file is a 32 byte header followed, at data_offset (64), by the raw
+ * elements exactly as they are laid out in memory. Since vec<T, N> and
+ * mat<T, M, N> are POD, a reader can map the file and use the elements in
+ * place without parsing or copying.
+ *
+ * The header records the scalar type, the width/height of each element,
+ * the element count, and a byte order marker. A file can only be mapped
+ * on a machine with the same byte order as the writer.
+ *
+ * Writing, in as many chunks as needed:
+ * p::binary_writer<vec3> out("points.pvec");
+ * out.write(p::span<const vec3>(chunk));
+ * out.close();
+ *
+ * Reading:
+ * p::mapped_array in("points.pvec");
+ * p::span<const vec3> points = in.view<vec3>();  // empty on error
+ *
+ * On POSIX systems the file is mmap:ed. Elsewhere it's read into memory
+ * once, so view() still works but isn't zero-copy.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_BINARY_H
+#define P_UTILS_VECTOR_BINARY_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <new>
+
+#include "vector.h"
+#include "matrix.h"
+#include "span.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define P_VECTOR_BINARY_MMAP 1
+#endif
+
+namespace p {
+  struct binary_header {
+    char magic[4];             // "PVEC"
+    std::uint32_t byte_order;  // 0x01020304 in the writer's byte order
+    std::uint16_t version;
+    std::uint8_t scalar;       // one of binary_scalar
+    std::uint8_t scalar_size;  // bytes per scalar
+    std::uint16_t width;       // components of a vector, columns of a matrix
+    std::uint16_t height;      // 1 for vectors, rows of a matrix
+    std::uint64_t count;       // number of elements
+    std::uint64_t data_offset; // start of the elements from the file start
+  };
+
+  enum binary_scalar {
+    binary_unknown = 0,
+    binary_float32, binary_float64,
+    binary_int8, binary_uint8, binary_int16, binary_uint16,
+    binary_int32, binary_uint32, binary_int64, binary_uint64
+  };
+
+  enum binary_errc {
+    binary_ok = 0,
+    binary_io_error,      // couldn't open, read, write or map the file
+    binary_bad_header,    // not a file in this format, or unknown version
+    binary_wrong_endian,  // written on a machine with another byte order
+    binary_type_mismatch, // the elements aren't of the requested type
+    binary_truncated      // shorter than the header says
+  };
+
+  namespace detail {
+    const char binary_magic[4] = {'P', 'V', 'E', 'C'};
+    const std::uint32_t binary_byte_order = 0x01020304;
+    const std::uint16_t binary_version = 1;
+    const std::uint64_t binary_data_offset = 64;
+
+    template<typename T> struct binary_scalar_of {enum {value = binary_unknown}; };
+    template<> struct binary_scalar_of<float> {enum {value = binary_float32}; };
+    template<> struct binary_scalar_of<double> {enum {value = binary_float64}; };
+    template<> struct binary_scalar_of<std::int8_t> {enum {value = binary_int8}; };
+    template<> struct binary_scalar_of<std::uint8_t> {enum {value = binary_uint8}; };
+    template<> struct binary_scalar_of<std::int16_t> {enum {value = binary_int16}; };
+    template<> struct binary_scalar_of<std::uint16_t> {enum {value = binary_uint16}; };
+    template<> struct binary_scalar_of<std::int32_t> {enum {value = binary_int32}; };
+    template<> struct binary_scalar_of<std::uint32_t> {enum {value = binary_uint32}; };
+    template<> struct binary_scalar_of<std::int64_t> {enum {value = binary_int64}; };
+    template<> struct binary_scalar_of<std::uint64_t> {enum {value = binary_uint64}; };
+
+    /**
+     * Describes an element type: its scalar and its width and height.
+     */
+    template<typename E> struct binary_element;
+
+    template<typename T, std::size_t N>
+    struct binary_element<vec<T, N> > {
+      typedef T scalar_type;
+      enum {width = N, height = 1};
+    };
+
+    template<typename T, std::size_t M, std::size_t N>
+    struct binary_element<mat<T, M, N> > {
+      typedef T scalar_type;
+      enum {width = M, height = N};
+    };
+
+    template<typename E>
+    inline binary_header make_binary_header(std::uint64_t count) {
+      typedef typename binary_element<E>::scalar_type T;
+      static_assert(int(binary_scalar_of<T>::value) != int(binary_unknown),
+                    "unsupported scalar type");
+      static_assert(sizeof(E) == sizeof(T) * binary_element<E>::width *
+                                 binary_element<E>::height,
+                    "element type has padding");
+
+      binary_header h;
+      std::memset(&h, 0, sizeof h);
+      std::memcpy(h.magic, binary_magic, sizeof h.magic);
+      h.byte_order = binary_byte_order;
+      h.version = binary_version;
+      h.scalar = binary_scalar_of<T>::value;
+      h.scalar_size = sizeof(T);
+      h.width = binary_element<E>::width;
+      h.height = binary_element<E>::height;
+      h.count = count;
+      h.data_offset = binary_data_offset;
+      return h;
+    }
+
+    /**
+     * Checks everything in the header except the element type.
+     */
+    inline binary_errc check_binary_header(const binary_header &h,
+                                           std::uint64_t file_size) {
+      if (std::memcmp(h.magic, binary_magic, sizeof h.magic) != 0)
+        return binary_bad_header;
+      if (h.byte_order != binary_byte_order)
+        return binary_wrong_endian;
+      if (h.version != binary_version || h.data_offset < sizeof h)
+        return binary_bad_header;
+
+      const std::uint64_t element_size =
+        std::uint64_t(h.scalar_size) * h.width * h.height;
+      if (file_size < h.data_offset ||
+          (element_size && (file_size - h.data_offset) / element_size < h.count))
+        return binary_truncated;
+      return binary_ok;
+    }
+  }
+
+  /**
+   * Streaming writer; elements can be written in any number of chunks.
+   * The element count in the header is filled in by close(), which the
+   * destructor calls if needed.
+   */
+  template<typename E>
+  class binary_writer {
+  public:
+    binary_writer() : file(0), count(0), err(binary_ok) {}
+
+    explicit binary_writer(const char *path) : file(0), count(0), err(binary_ok) {
+      open(path);
+    }
+
+    ~binary_writer() {close(); }
+
+    bool open(const char *path) {
+      close();
+      count = 0;
+      err = binary_ok;
+      file = std::fopen(path, "wb");
+      if (!file)
+        return fail(binary_io_error);
+
+      // header, then zeros up to the data offset
+      const binary_header h = detail::make_binary_header<E>(0);
+      char pad[detail::binary_data_offset] = {0};
+      std::memcpy(pad, &h, sizeof h);
+      if (std::fwrite(pad, sizeof pad, 1, file) != 1)
+        return fail(binary_io_error);
+      return true;
+    }
+
+    bool write(span<const E> elements) {
+      if (!file)
+        return false;
+      if (!elements.empty() &&
+          std::fwrite(elements.data(), sizeof(E), elements.size(), file) != elements.size())
+        return fail(binary_io_error);
+
+      count += elements.size();
+      return true;
+    }
+
+    /**
+     * Writes the final count and closes the file. Returns false if any
+     * write failed.
+     */
+    bool close() {
+      if (!file)
+        return err == binary_ok;
+
+      const binary_header h = detail::make_binary_header<E>(count);
+      if (std::fseek(file, 0, SEEK_SET) != 0 ||
+          std::fwrite(&h, sizeof h, 1, file) != 1)
+        err = binary_io_error;
+      if (std::fclose(file) != 0)
+        err = binary_io_error;
+      file = 0;
+      return err == binary_ok;
+    }
+
+    std::uint64_t size() const {return count; }
+    binary_errc error() const {return err; }
+
+  private:
+    binary_writer(const binary_writer &);
+    binary_writer &operator =(const binary_writer &);
+
+    bool fail(binary_errc e) {
+      err = e;
+      if (file)
+        std::fclose(file);
+      file = 0;
+      return false;
+    }
+
+    std::FILE *file;
+    std::uint64_t count;
+    binary_errc err;
+  };
+
+  /**
+   * Writes a whole array to path in one go.
+   */
+  template<typename E>
+  inline binary_errc write_binary(const char *path, span<const E> elements) {
+    binary_writer<E> out(path);
+    out.write(elements);
+    out.close();
+    return out.error();
+  }
+
+  /**
+   * A file in the binary format, mapped into memory read-only.
+   */
+  class mapped_array {
+  public:
+    mapped_array() : base(0), length(0), err(binary_ok) {}
+
+    explicit mapped_array(const char *path) : base(0), length(0), err(binary_ok) {
+      open(path);
+    }
+
+    ~mapped_array() {close(); }
+
+    bool open(const char *path) {
+      close();
+
+#if defined(P_VECTOR_BINARY_MMAP)
+      const int fd = ::open(path, O_RDONLY);
+      if (fd < 0)
+        return fail(binary_io_error);
+
+      struct stat st;
+      if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return fail(binary_io_error);
+      }
+      if (std::size_t(st.st_size) < sizeof(binary_header)) {
+        ::close(fd);
+        return fail(binary_bad_header);
+      }
+
+      void *addr = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (addr == MAP_FAILED)
+        return fail(binary_io_error);
+
+      base = static_cast<const char *>(addr);
+      length = st.st_size;
+#else
+      std::FILE *file = std::fopen(path, "rb");
+      if (!file)
+        return fail(binary_io_error);
+
+      std::fseek(file, 0, SEEK_END);
+      const long size = std::ftell(file);
+      std::fseek(file, 0, SEEK_SET);
+      if (size < long(sizeof(binary_header))) {
+        std::fclose(file);
+        return fail(size < 0 ? binary_io_error : binary_bad_header);
+      }
+
+      char *buf = static_cast<char *>(::operator new(size));
+      const bool ok = std::fread(buf, 1, size, file) == std::size_t(size);
+      std::fclose(file);
+      base = buf;
+      length = size;
+      if (!ok) {
+        close();
+        return fail(binary_io_error);
+      }
+#endif
+
+      std::memcpy(&hdr, base, sizeof hdr);
+      const binary_errc e = detail::check_binary_header(hdr, length);
+      if (e != binary_ok) {
+        close();
+        return fail(e);
+      }
+      return true;
+    }
+
+    void close() {
+      if (base) {
+#if defined(P_VECTOR_BINARY_MMAP)
+        ::munmap(const_cast<char *>(base), length);
+#else
+        ::operator delete(const_cast<char *>(base));
+#endif
+      }
+      base = 0;
+      length = 0;
+      err = binary_ok;
+    }
+
+    bool is_open() const {return base != 0; }
+    binary_errc error() const {return err; }
+    const binary_header &header() const {return hdr; }
+
+    /**
+     * True if the file holds elements of type E.
+     */
+    template<typename E>
+    bool holds() const {
+      typedef detail::binary_element<E> traits;
+      typedef typename traits::scalar_type T;
+      return base &&
+        hdr.scalar == detail::binary_scalar_of<T>::value &&
+        hdr.scalar_size == sizeof(T) &&
+        hdr.width == traits::width && hdr.height == traits::height &&
+        hdr.data_offset % alignof(E) == 0;
+    }
+
+    /**
+     * The elements, in place. Empty if the file isn't open or doesn't
+     * hold elements of type E at an offset aligned for E.
+     */
+    template<typename E>
+    span<const E> view() const {
+      if (!holds<E>())
+        return span<const E>();
+      return span<const E>(reinterpret_cast<const E *>(base + hdr.data_offset),
+                           std::size_t(hdr.count));
+    }
+
+  private:
+    mapped_array(const mapped_array &);
+    mapped_array &operator =(const mapped_array &);
+
+    bool fail(binary_errc e) {
+      err = e;
+      return false;
+    }
+
+    const char *base;
+    std::size_t length;
+    binary_header hdr;
+    binary_errc err;
+  };
+} // !p
+
+#endif // !P_UTILS_VECTOR_BINARY_H
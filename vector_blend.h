@@ -0,0 +1,530 @@
+/* -- vector_blend.h -------------------------------------------------*- c++ -*-
+ * Saturating integer arithmetic and alpha blending, for ubvec and ivec
+ * pixels and for whole image rows.
+ *
+ *   saturating_add, saturating_sub  clamped to the range of the type
+ *   average                         (a + b + 1) >> 1, without overflow
+ *   mul_high                        the high half of a * b: (a * b) >> 8
+ *                                   for bytes, >> 32 for int
+ *   blend                           a + (b - a) * alpha / 255, for bytes
+ *   over                            premultiplied src over dst, for ubvec4
+ *
+ * The operators of vector.h wrap around instead, so that ubvec3(200) +
+ * ubvec3(100) is 44; saturating_add gives 255. blend and over divide by
+ * 255 rounding to nearest, exactly.
+ *
+ * The _n versions work on rows of bytes, ubvec3 or ubvec4, many pixels per
+ * instruction: 16 bytes with SSE2 or NEON, 32 with AVX2 and 64 with
+ * AVX-512 (picked at run time, see cpu.h). They give the same bytes as
+ * the single vector functions at every level.
+ *
+ * p::over_n(p::span<const p::ubvec4>(sprite), p::span<const p::ubvec4>(row),
+ *           p::span<p::ubvec4>(row));
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_BLEND_H
+#define P_UTILS_VECTOR_BLEND_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "vector.h"
+#include "simd.h"
+#include "span.h"
+#include "cpu.h"
+
+namespace p {
+  namespace detail {
+    /**
+     * The scalar operations, in a wider type of the same signedness; for
+     * integers of up to 32 bits.
+     */
+    template<typename T>
+    struct saturating_ops {
+      static_assert(std::is_integral<T>::value && sizeof(T) <= 4,
+                    "saturating operations need an integer type of at most 32 bits");
+      typedef typename std::conditional<std::is_signed<T>::value,
+                                        long long, unsigned long long>::type wide;
+
+      static T narrow(wide x) {
+        return std::is_signed<T>::value && x < wide(std::numeric_limits<T>::min())
+             ? std::numeric_limits<T>::min()
+             : x > wide(std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max() : T(x);
+      }
+
+      static T add(T a, T b) {return narrow(wide(a) + wide(b)); }
+      static T sub(T a, T b) {
+        return std::is_signed<T>::value || a > b ? narrow(wide(a) - wide(b)) : T(0);
+      }
+      static T average(T a, T b) {return T((wide(a) + wide(b) + 1) >> 1); }
+      static T mul_high(T a, T b) {return T((wide(a) * wide(b)) >> (8 * sizeof(T))); }
+    };
+
+    /**
+     * x / 255 rounded to nearest, for x up to 255 * 255.
+     */
+    inline unsigned div255(unsigned x) {
+      x += 128;
+      return (x + (x >> 8)) >> 8;
+    }
+  }
+
+  template<typename T>
+  inline T saturating_add(T a, T b) {return detail::saturating_ops<T>::add(a, b); }
+
+  template<typename T>
+  inline T saturating_sub(T a, T b) {return detail::saturating_ops<T>::sub(a, b); }
+
+  template<typename T>
+  inline T average(T a, T b) {return detail::saturating_ops<T>::average(a, b); }
+
+  template<typename T>
+  inline T mul_high(T a, T b) {return detail::saturating_ops<T>::mul_high(a, b); }
+
+  template<typename T, std::size_t N>
+  inline vec<T, N> saturating_add(const vec<T, N> &a, const vec<T, N> &b) {
+    vec<T, N> ret;
+    for (std::size_t i = 0; i < N; ++i)
+      ret[i] = saturating_add(a[i], b[i]);
+    return ret;
+  }
+
+  template<typename T, std::size_t N>
+  inline vec<T, N> saturating_sub(const vec<T, N> &a, const vec<T, N> &b) {
+    vec<T, N> ret;
+    for (std::size_t i = 0; i < N; ++i)
+      ret[i] = saturating_sub(a[i], b[i]);
+    return ret;
+  }
+
+  template<typename T, std::size_t N>
+  inline vec<T, N> average(const vec<T, N> &a, const vec<T, N> &b) {
+    vec<T, N> ret;
+    for (std::size_t i = 0; i < N; ++i)
+      ret[i] = average(a[i], b[i]);
+    return ret;
+  }
+
+  template<typename T, std::size_t N>
+  inline vec<T, N> mul_high(const vec<T, N> &a, const vec<T, N> &b) {
+    vec<T, N> ret;
+    for (std::size_t i = 0; i < N; ++i)
+      ret[i] = mul_high(a[i], b[i]);
+    return ret;
+  }
+
+  /**
+   * a where alpha is 0, b where it is 255.
+   */
+  inline std::uint8_t blend(std::uint8_t a, std::uint8_t b, std::uint8_t alpha) {
+    return std::uint8_t(detail::div255(unsigned(a) * (255u - alpha) + unsigned(b) * alpha));
+  }
+
+  template<std::size_t N>
+  inline vec<std::uint8_t, N> blend(const vec<std::uint8_t, N> &a, const vec<std::uint8_t, N> &b,
+                                    std::uint8_t alpha) {
+    vec<std::uint8_t, N> ret;
+    for (std::size_t i = 0; i < N; ++i)
+      ret[i] = blend(a[i], b[i], alpha);
+    return ret;
+  }
+
+  /**
+   * src + dst * (1 - src alpha), alpha included, for colors with
+   * premultiplied alpha.
+   */
+  inline vec<std::uint8_t, 4> over(const vec<std::uint8_t, 4> &src,
+                                   const vec<std::uint8_t, 4> &dst) {
+    vec<std::uint8_t, 4> ret;
+    for (std::size_t i = 0; i < 4; ++i)
+      ret[i] = saturating_add(src[i], std::uint8_t(detail::div255(unsigned(dst[i]) * (255u - src[3]))));
+    return ret;
+  }
+
+  namespace detail {
+#if defined(P_SIMD_SSE2)
+    /**
+     * div255 on the 16 bit lanes.
+     */
+    inline __m128i div255_sse2(__m128i x) {
+      x = _mm_add_epi16(x, _mm_set1_epi16(128));
+      return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+#endif
+
+#if defined(P_DISPATCH_X86)
+    P_TARGET_AVX2 inline __m256i div255_avx2(__m256i x) {
+      x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+      return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    }
+
+    P_TARGET_AVX512 inline __m512i div255_avx512(__m512i x) {
+      x = _mm512_add_epi16(x, _mm512_set1_epi16(128));
+      return _mm512_srli_epi16(_mm512_add_epi16(x, _mm512_srli_epi16(x, 8)), 8);
+    }
+#endif
+
+#if defined(P_SIMD_NEON)
+    /**
+     * div255 of both halves, narrowed back to bytes.
+     */
+    inline uint8x16_t div255_neon(uint16x8_t lo, uint16x8_t hi) {
+      return vcombine_u8(vrshrn_n_u16(vrsraq_n_u16(lo, lo, 8), 8),
+                         vrshrn_n_u16(vrsraq_n_u16(hi, hi, 8), 8));
+    }
+#endif
+
+    /**
+     * The byte kernels of the _n functions. Each has a scalar operator()
+     * for `group` bytes at out, and one per register width. The 16 bit
+     * products are computed on the unpacked low and high halves; unpack and
+     * pack both stay within 128 bit lanes, so the bytes come back in order.
+     */
+    struct adds_bytes {
+      enum {group = 1};
+      void operator()(const std::uint8_t *a, const std::uint8_t *b, std::uint8_t *out) const {
+        *out = saturating_add(*a, *b);
+      }
+#if defined(P_SIMD_SSE2)
+      __m128i operator()(__m128i a, __m128i b) const {return _mm_adds_epu8(a, b); }
+#endif
+#if defined(P_DISPATCH_X86)
+      P_TARGET_AVX2 __m256i operator()(__m256i a, __m256i b) const {return _mm256_adds_epu8(a, b); }
+      P_TARGET_AVX512 __m512i operator()(__m512i a, __m512i b) const {return _mm512_adds_epu8(a, b); }
+#endif
+#if defined(P_SIMD_NEON)
+      uint8x16_t operator()(uint8x16_t a, uint8x16_t b) const {return vqaddq_u8(a, b); }
+#endif
+    };
+
+    struct subs_bytes {
+      enum {group = 1};
+      void operator()(const std::uint8_t *a, const std::uint8_t *b, std::uint8_t *out) const {
+        *out = saturating_sub(*a, *b);
+      }
+#if defined(P_SIMD_SSE2)
+      __m128i operator()(__m128i a, __m128i b) const {return _mm_subs_epu8(a, b); }
+#endif
+#if defined(P_DISPATCH_X86)
+      P_TARGET_AVX2 __m256i operator()(__m256i a, __m256i b) const {return _mm256_subs_epu8(a, b); }
+      P_TARGET_AVX512 __m512i operator()(__m512i a, __m512i b) const {return _mm512_subs_epu8(a, b); }
+#endif
+#if defined(P_SIMD_NEON)
+      uint8x16_t operator()(uint8x16_t a, uint8x16_t b) const {return vqsubq_u8(a, b); }
+#endif
+    };
+
+    struct average_bytes {
+      enum {group = 1};
+      void operator()(const std::uint8_t *a, const std::uint8_t *b, std::uint8_t *out) const {
+        *out = average(*a, *b);
+      }
+#if defined(P_SIMD_SSE2)
+      __m128i operator()(__m128i a, __m128i b) const {return _mm_avg_epu8(a, b); }
+#endif
+#if defined(P_DISPATCH_X86)
+      P_TARGET_AVX2 __m256i operator()(__m256i a, __m256i b) const {return _mm256_avg_epu8(a, b); }
+      P_TARGET_AVX512 __m512i operator()(__m512i a, __m512i b) const {return _mm512_avg_epu8(a, b); }
+#endif
+#if defined(P_SIMD_NEON)
+      uint8x16_t operator()(uint8x16_t a, uint8x16_t b) const {return vrhaddq_u8(a, b); }
+#endif
+    };
+
+    struct mul_high_bytes {
+      enum {group = 1};
+      void operator()(const std::uint8_t *a, const std::uint8_t *b, std::uint8_t *out) const {
+        *out = mul_high(*a, *b);
+      }
+#if defined(P_SIMD_SSE2)
+      __m128i operator()(__m128i a, __m128i b) const {
+        const __m128i zero = _mm_setzero_si128();
+        return _mm_packus_epi16(
+          _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)), 8),
+          _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)), 8));
+      }
+#endif
+#if defined(P_DISPATCH_X86)
+      P_TARGET_AVX2 __m256i operator()(__m256i a, __m256i b) const {
+        const __m256i zero = _mm256_setzero_si256();
+        return _mm256_packus_epi16(
+          _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero),
+                                               _mm256_unpacklo_epi8(b, zero)), 8),
+          _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero),
+                                               _mm256_unpackhi_epi8(b, zero)), 8));
+      }
+      P_TARGET_AVX512 __m512i operator()(__m512i a, __m512i b) const {
+        const __m512i zero = _mm512_setzero_si512();
+        return _mm512_packus_epi16(
+          _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpacklo_epi8(a, zero),
+                                               _mm512_unpacklo_epi8(b, zero)), 8),
+          _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpackhi_epi8(a, zero),
+                                               _mm512_unpackhi_epi8(b, zero)), 8));
+      }
+#endif
+#if defined(P_SIMD_NEON)
+      uint8x16_t operator()(uint8x16_t a, uint8x16_t b) const {
+        return vcombine_u8(vshrn_n_u16(vmull_u8(vget_low_u8(a), vget_low_u8(b)), 8),
+                           vshrn_n_u16(vmull_u8(vget_high_u8(a), vget_high_u8(b)), 8));
+      }
+#endif
+    };
+
+    struct blend_bytes {
+      enum {group = 1};
+      explicit blend_bytes(std::uint8_t alpha) : alpha(alpha) {}
+      void operator()(const std::uint8_t *a, const std::uint8_t *b, std::uint8_t *out) const {
+        *out = blend(*a, *b, alpha);
+      }
+#if defined(P_SIMD_SSE2)
+      __m128i operator()(__m128i a, __m128i b) const {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i t = _mm_set1_epi16(short(alpha)), s = _mm_set1_epi16(short(255 - alpha));
+        const __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), s),
+                                         _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), t));
+        const __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), s),
+                                         _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), t));
+        return _mm_packus_epi16(div255_sse2(lo), div255_sse2(hi));
+      }
+#endif
+#if defined(P_DISPATCH_X86)
+      P_TARGET_AVX2 __m256i operator()(__m256i a, __m256i b) const {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i t = _mm256_set1_epi16(short(alpha)), s = _mm256_set1_epi16(short(255 - alpha));
+        const __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), s),
+                                            _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), t));
+        const __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), s),
+                                            _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), t));
+        return _mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi));
+      }
+      P_TARGET_AVX512 __m512i operator()(__m512i a, __m512i b) const {
+        const __m512i zero = _mm512_setzero_si512();
+        const __m512i t = _mm512_set1_epi16(short(alpha)), s = _mm512_set1_epi16(short(255 - alpha));
+        const __m512i lo = _mm512_add_epi16(_mm512_mullo_epi16(_mm512_unpacklo_epi8(a, zero), s),
+                                            _mm512_mullo_epi16(_mm512_unpacklo_epi8(b, zero), t));
+        const __m512i hi = _mm512_add_epi16(_mm512_mullo_epi16(_mm512_unpackhi_epi8(a, zero), s),
+                                            _mm512_mullo_epi16(_mm512_unpackhi_epi8(b, zero), t));
+        return _mm512_packus_epi16(div255_avx512(lo), div255_avx512(hi));
+      }
+#endif
+#if defined(P_SIMD_NEON)
+      uint8x16_t operator()(uint8x16_t a, uint8x16_t b) const {
+        const uint8x8_t t = vdup_n_u8(alpha), s = vdup_n_u8(std::uint8_t(255 - alpha));
+        return div255_neon(vmlal_u8(vmull_u8(vget_low_u8(a), s), vget_low_u8(b), t),
+                           vmlal_u8(vmull_u8(vget_high_u8(a), s), vget_high_u8(b), t));
+      }
+#endif
+      std::uint8_t alpha;
+    };
+
+    /**
+     * a is src and b dst, four bytes per pixel. The alpha word of each
+     * pixel is spread over its four words with the 16 bit shuffles.
+     */
+    struct over_bytes {
+      enum {group = 4};
+      void operator()(const std::uint8_t *a, const std::uint8_t *b, std::uint8_t *out) const {
+        for (std::size_t i = 0; i < 4; ++i)
+          out[i] = saturating_add(a[i], std::uint8_t(div255(unsigned(b[i]) * (255u - a[3]))));
+      }
+#if defined(P_SIMD_SSE2)
+      static __m128i inverse_alpha(__m128i src) {
+        src = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xff), 0xff);
+        return _mm_sub_epi16(_mm_set1_epi16(255), src);
+      }
+      __m128i operator()(__m128i a, __m128i b) const {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero),
+                                           inverse_alpha(_mm_unpacklo_epi8(a, zero)));
+        const __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero),
+                                           inverse_alpha(_mm_unpackhi_epi8(a, zero)));
+        return _mm_adds_epu8(a, _mm_packus_epi16(div255_sse2(lo), div255_sse2(hi)));
+      }
+#endif
+#if defined(P_DISPATCH_X86)
+      P_TARGET_AVX2 static __m256i inverse_alpha(__m256i src) {
+        src = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xff), 0xff);
+        return _mm256_sub_epi16(_mm256_set1_epi16(255), src);
+      }
+      P_TARGET_AVX2 __m256i operator()(__m256i a, __m256i b) const {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero),
+                                              inverse_alpha(_mm256_unpacklo_epi8(a, zero)));
+        const __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero),
+                                              inverse_alpha(_mm256_unpackhi_epi8(a, zero)));
+        return _mm256_adds_epu8(a, _mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi)));
+      }
+      P_TARGET_AVX512 static __m512i inverse_alpha(__m512i src) {
+        src = _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(src, 0xff), 0xff);
+        return _mm512_sub_epi16(_mm512_set1_epi16(255), src);
+      }
+      P_TARGET_AVX512 __m512i operator()(__m512i a, __m512i b) const {
+        const __m512i zero = _mm512_setzero_si512();
+        const __m512i lo = _mm512_mullo_epi16(_mm512_unpacklo_epi8(b, zero),
+                                              inverse_alpha(_mm512_unpacklo_epi8(a, zero)));
+        const __m512i hi = _mm512_mullo_epi16(_mm512_unpackhi_epi8(b, zero),
+                                              inverse_alpha(_mm512_unpackhi_epi8(a, zero)));
+        return _mm512_adds_epu8(a, _mm512_packus_epi16(div255_avx512(lo), div255_avx512(hi)));
+      }
+#endif
+#if defined(P_SIMD_NEON)
+      uint8x16_t operator()(uint8x16_t a, uint8x16_t b) const {
+        // the alpha byte of each pixel copied to its four bytes
+        static const std::uint8_t spread[16] = {3, 3, 3, 3, 7, 7, 7, 7,
+                                                11, 11, 11, 11, 15, 15, 15, 15};
+        const uint8x16_t index = vld1q_u8(spread);
+#  if defined(__aarch64__)
+        const uint8x16_t inv = vmvnq_u8(vqtbl1q_u8(a, index));
+#  else
+        const uint8x8x2_t t = {{vget_low_u8(a), vget_high_u8(a)}};
+        const uint8x16_t inv = vmvnq_u8(vcombine_u8(vtbl2_u8(t, vget_low_u8(index)),
+                                                    vtbl2_u8(t, vget_high_u8(index))));
+#  endif
+        return vqaddq_u8(a, div255_neon(vmull_u8(vget_low_u8(b), vget_low_u8(inv)),
+                                        vmull_u8(vget_high_u8(b), vget_high_u8(inv))));
+      }
+#endif
+    };
+
+#if defined(P_DISPATCH_X86)
+    /**
+     * Whole registers of 32 and 64 bytes; return where they stopped.
+     */
+    template<typename OpT>
+    P_TARGET_AVX2 inline std::size_t map_bytes_avx2(const std::uint8_t *a, const std::uint8_t *b,
+                                                    std::uint8_t *out, std::size_t n,
+                                                    const OpT &op) {
+      std::size_t i = 0;
+      for (; i + 32 <= n; i += 32)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                            op(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+                               _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i))));
+      return i;
+    }
+
+    template<typename OpT>
+    P_TARGET_AVX512 inline std::size_t map_bytes_avx512(const std::uint8_t *a, const std::uint8_t *b,
+                                                        std::uint8_t *out, std::size_t n,
+                                                        const OpT &op) {
+      std::size_t i = 0;
+      for (; i + 64 <= n; i += 64)
+        _mm512_storeu_si512(out + i, op(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+      return i;
+    }
+#endif
+
+    /**
+     * out[i] = op(a[i], b[i]) over n bytes, a multiple of OpT::group.
+     */
+    template<typename OpT>
+    inline void map_bytes(const std::uint8_t *a, const std::uint8_t *b, std::uint8_t *out,
+                          std::size_t n, const OpT &op) {
+      std::size_t i = 0;
+#if defined(P_DISPATCH_X86)
+      if (active_isa() >= isa_avx512)
+        i = map_bytes_avx512(a, b, out, n, op);
+      else if (active_isa() >= isa_avx2)
+        i = map_bytes_avx2(a, b, out, n, op);
+#endif
+#if defined(P_SIMD_SSE2)
+      for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         op(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i))));
+#elif defined(P_SIMD_NEON)
+      for (; i + 16 <= n; i += 16)
+        vst1q_u8(out + i, op(vld1q_u8(a + i), vld1q_u8(b + i)));
+#endif
+      for (; i < n; i += OpT::group)
+        op(a + i, b + i, out + i);
+    }
+
+    template<std::size_t N>
+    inline span<const std::uint8_t> bytes(span<const vec<std::uint8_t, N> > v) {
+      return span<const std::uint8_t>(reinterpret_cast<const std::uint8_t *>(v.data()), v.size() * N);
+    }
+
+    template<std::size_t N>
+    inline span<std::uint8_t> bytes(span<vec<std::uint8_t, N> > v) {
+      return span<std::uint8_t>(reinterpret_cast<std::uint8_t *>(v.data()), v.size() * N);
+    }
+  }
+
+  /**
+   * Row versions of the functions above, over bytes or over the
+   * components of ubvec3 and ubvec4. out may be a or b.
+   */
+  inline void saturating_add_n(span<const std::uint8_t> a, span<const std::uint8_t> b,
+                               span<std::uint8_t> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    detail::map_bytes(a.data(), b.data(), out.data(), a.size(), detail::adds_bytes());
+  }
+
+  template<std::size_t N>
+  inline void saturating_add_n(span<const vec<std::uint8_t, N> > a,
+                               span<const vec<std::uint8_t, N> > b,
+                               span<vec<std::uint8_t, N> > out) {
+    saturating_add_n(detail::bytes(a), detail::bytes(b), detail::bytes(out));
+  }
+
+  inline void saturating_sub_n(span<const std::uint8_t> a, span<const std::uint8_t> b,
+                               span<std::uint8_t> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    detail::map_bytes(a.data(), b.data(), out.data(), a.size(), detail::subs_bytes());
+  }
+
+  template<std::size_t N>
+  inline void saturating_sub_n(span<const vec<std::uint8_t, N> > a,
+                               span<const vec<std::uint8_t, N> > b,
+                               span<vec<std::uint8_t, N> > out) {
+    saturating_sub_n(detail::bytes(a), detail::bytes(b), detail::bytes(out));
+  }
+
+  inline void average_n(span<const std::uint8_t> a, span<const std::uint8_t> b,
+                        span<std::uint8_t> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    detail::map_bytes(a.data(), b.data(), out.data(), a.size(), detail::average_bytes());
+  }
+
+  template<std::size_t N>
+  inline void average_n(span<const vec<std::uint8_t, N> > a, span<const vec<std::uint8_t, N> > b,
+                        span<vec<std::uint8_t, N> > out) {
+    average_n(detail::bytes(a), detail::bytes(b), detail::bytes(out));
+  }
+
+  inline void mul_high_n(span<const std::uint8_t> a, span<const std::uint8_t> b,
+                         span<std::uint8_t> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    detail::map_bytes(a.data(), b.data(), out.data(), a.size(), detail::mul_high_bytes());
+  }
+
+  template<std::size_t N>
+  inline void mul_high_n(span<const vec<std::uint8_t, N> > a, span<const vec<std::uint8_t, N> > b,
+                         span<vec<std::uint8_t, N> > out) {
+    mul_high_n(detail::bytes(a), detail::bytes(b), detail::bytes(out));
+  }
+
+  inline void blend_n(span<const std::uint8_t> a, span<const std::uint8_t> b, std::uint8_t alpha,
+                      span<std::uint8_t> out) {
+    assert(a.size() == b.size() && a.size() == out.size());
+    detail::map_bytes(a.data(), b.data(), out.data(), a.size(), detail::blend_bytes(alpha));
+  }
+
+  template<std::size_t N>
+  inline void blend_n(span<const vec<std::uint8_t, N> > a, span<const vec<std::uint8_t, N> > b,
+                      std::uint8_t alpha, span<vec<std::uint8_t, N> > out) {
+    blend_n(detail::bytes(a), detail::bytes(b), alpha, detail::bytes(out));
+  }
+
+  inline void over_n(span<const vec<std::uint8_t, 4> > src, span<const vec<std::uint8_t, 4> > dst,
+                     span<vec<std::uint8_t, 4> > out) {
+    assert(src.size() == dst.size() && src.size() == out.size());
+    detail::map_bytes(detail::bytes(src).data(), detail::bytes(dst).data(),
+                      detail::bytes(out).data(), 4 * src.size(), detail::over_bytes());
+  }
+} // !p
+
+#endif // !P_UTILS_VECTOR_BLEND_H
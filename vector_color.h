@@ -0,0 +1,318 @@
+/* -- vector_color.h -------------------------------------------------*- c++ -*-
+ * Conversions between the color formats images come in.
+ *
+ *   ubvec4 <-> vec4      pack/unpack, pack_n/unpack_n (vector_packed.h)
+ *   uint32_t <-> ubvec4  to_rgba8/from_rgba8, 0xRRGGBBAA like color_reader
+ *   sRGB <-> linear      srgb_to_linear/linear_to_srgb, the exact curve
+ *   sRGB8 <-> linear     srgb8_to_linear/linear_to_srgb8 and the _n versions
+ *
+ * The 8-bit sRGB conversions are meant for whole images:
+ *
+ * std::vector<p::vec4> linear(pixels.size());
+ * p::srgb8_to_linear_n(p::span<const p::ubvec4>(pixels),
+ *                      p::span<p::vec4>(linear));
+ *
+ * The fourth component is alpha and is stored linearly, as by pack<uint8_t>.
+ * sRGB8 to linear is a table lookup and exact. Linear to sRGB8 interpolates
+ * in a table of 104 line segments (Giesen's method): the result is within
+ * 0.545 of the exact value in 8-bit units, so values from srgb8_to_linear
+ * always come back unchanged. NaNs become 0.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_COLOR_H
+#define P_UTILS_VECTOR_COLOR_H
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "vector.h"
+#include "vector_packed.h"
+#include "simd.h"
+#include "span.h"
+
+namespace p {
+  /**
+   * The sRGB transfer function and its inverse, on [0, 1].
+   */
+  template<typename T>
+  inline T srgb_to_linear(T s) {
+    return s <= T(0.04045) ? s / T(12.92)
+                           : T(std::pow((s + T(0.055)) / T(1.055), T(2.4)));
+  }
+
+  template<typename T>
+  inline T linear_to_srgb(T l) {
+    return l <= T(0.0031308) ? l * T(12.92)
+                             : T(T(1.055) * std::pow(l, T(1) / T(2.4)) - T(0.055));
+  }
+
+  template<typename T>
+  inline vec<T, 3> srgb_to_linear(const vec<T, 3> &s) {
+    vec<T, 3> ret = {{srgb_to_linear(s[0]), srgb_to_linear(s[1]), srgb_to_linear(s[2])}};
+    return ret;
+  }
+
+  template<typename T>
+  inline vec<T, 4> srgb_to_linear(const vec<T, 4> &s) {
+    vec<T, 4> ret = {{srgb_to_linear(s[0]), srgb_to_linear(s[1]), srgb_to_linear(s[2]), s[3]}};
+    return ret;
+  }
+
+  template<typename T>
+  inline vec<T, 3> linear_to_srgb(const vec<T, 3> &l) {
+    vec<T, 3> ret = {{linear_to_srgb(l[0]), linear_to_srgb(l[1]), linear_to_srgb(l[2])}};
+    return ret;
+  }
+
+  template<typename T>
+  inline vec<T, 4> linear_to_srgb(const vec<T, 4> &l) {
+    vec<T, 4> ret = {{linear_to_srgb(l[0]), linear_to_srgb(l[1]), linear_to_srgb(l[2]), l[3]}};
+    return ret;
+  }
+
+  namespace detail {
+    struct srgb8_table {
+      srgb8_table() {
+        for (int i = 0; i < 256; ++i)
+          values[i] = float(srgb_to_linear(double(i) / 255.0));
+      }
+
+      float values[256];
+    };
+
+    inline const float *srgb8_to_linear_table() {
+      static const srgb8_table table;
+      return table.values;
+    }
+
+    /**
+     * One line segment for each eighth of an octave from 2^-13 to 1; the
+     * high 16 bits are the offset >> 9 and the low ones the slope, both in
+     * 16.16 fixed point, to be applied to the next 8 bits of the mantissa.
+     * Fitted by least squares and checked against every float in [0, 1].
+     */
+    inline const std::uint32_t *linear_to_srgb8_table() {
+      static const std::uint32_t table[104] = {
+        0x0073000d, 0x007a000d, 0x0080000d, 0x0087000d, 0x008d000d, 0x0094000d,
+        0x009a000d, 0x00a1000d, 0x00a7001a, 0x00b4001a, 0x00c1001a, 0x00ce001a,
+        0x00da001a, 0x00e7001a, 0x00f4001a, 0x0101001a, 0x010e0033, 0x01280033,
+        0x01410033, 0x015b0033, 0x01750033, 0x018f0033, 0x01a80033, 0x01c20033,
+        0x01dc0067, 0x020f0067, 0x02430067, 0x02760067, 0x02aa0067, 0x02dd0067,
+        0x03110067, 0x03440067, 0x037800ce, 0x03df00ce, 0x044600ce, 0x04ad00ce,
+        0x051400ce, 0x057b00c5, 0x05dd00bc, 0x063b00b5, 0x06970158, 0x07420142,
+        0x07e30130, 0x087b0120, 0x090b0112, 0x09940106, 0x0a1700fc, 0x0a9500f2,
+        0x0b0f01cb, 0x0bf401ae, 0x0ccb0195, 0x0d950180, 0x0e56016e, 0x0f0d015e,
+        0x0fbc0150, 0x10630143, 0x11070264, 0x1238023e, 0x1357021d, 0x14660201,
+        0x156601e9, 0x165a01d3, 0x174401c0, 0x182401af, 0x18fe0331, 0x1a9602fe,
+        0x1c1502d2, 0x1d7e02ad, 0x1ed4028d, 0x201a0270, 0x21520256, 0x227d0240,
+        0x239f0443, 0x25c003fe, 0x27bf03c4, 0x29a10392, 0x2b6a0367, 0x2d1d0341,
+        0x2ebe031f, 0x304d0300, 0x31d105b0, 0x34a80555, 0x37520507, 0x39d504c5,
+        0x3c37048b, 0x3e7c0458, 0x40a8042a, 0x42bd0401, 0x44c20798, 0x488e071e,
+        0x4c1c06b6, 0x4f76065d, 0x52a50610, 0x55ac05cc, 0x5892058f, 0x5b590559,
+        0x5e0c0a23, 0x631c0980, 0x67db08f6, 0x6c55087f, 0x70940818, 0x74a007bd,
+        0x787d076c, 0x7c330723
+      };
+      return table;
+    }
+
+    const std::uint32_t srgb8_min_bits = (127 - 13) << 23;  // 2^-13, maps to 0
+    const std::uint32_t srgb8_max_bits = 0x3f7fffff;        // below 1, maps to 255
+
+    inline std::uint8_t linear_to_srgb8_bits(std::uint32_t u) {
+      const std::uint32_t entry = linear_to_srgb8_table()[(u - srgb8_min_bits) >> 20];
+      const std::uint32_t bias = (entry >> 16) << 9, scale = entry & 0xffff;
+      return std::uint8_t((bias + scale * ((u >> 12) & 0xff)) >> 16);
+    }
+  }
+
+  inline float srgb8_to_linear(std::uint8_t s) {
+    return detail::srgb8_to_linear_table()[s];
+  }
+
+  inline std::uint8_t linear_to_srgb8(float l) {
+    const float lo = detail::bits_float(detail::srgb8_min_bits);
+    const float hi = detail::bits_float(detail::srgb8_max_bits);
+    if (!(l > lo))  // catches NaN
+      l = lo;
+    if (l > hi)
+      l = hi;
+    return detail::linear_to_srgb8_bits(detail::float_bits(l));
+  }
+
+  /**
+   * The color as 0xRRGGBBAA, whatever the byte order of the machine.
+   */
+  inline std::uint32_t to_rgba8(const vec<std::uint8_t, 4> &c) {
+    return std::uint32_t(c[0]) << 24 | std::uint32_t(c[1]) << 16 |
+           std::uint32_t(c[2]) << 8 | std::uint32_t(c[3]);
+  }
+
+  inline vec<std::uint8_t, 4> from_rgba8(std::uint32_t rgba) {
+    vec<std::uint8_t, 4> ret = {{std::uint8_t(rgba >> 24), std::uint8_t(rgba >> 16),
+                                 std::uint8_t(rgba >> 8), std::uint8_t(rgba)}};
+    return ret;
+  }
+
+  namespace detail {
+#if defined(P_SIMD_SSE2)
+    /**
+     * linear_to_srgb8() on four lanes. The table entries are gathered one
+     * by one; madd then computes bias + scale * t with t in the low and
+     * 512 in the high half of each lane.
+     */
+    inline __m128i linear_to_srgb8_sse2(__m128 l) {
+      const std::uint32_t *table = linear_to_srgb8_table();
+      const __m128i min_bits = _mm_set1_epi32(int(srgb8_min_bits));
+      // max first, as it returns the second operand for NaN
+      const __m128i u = _mm_castps_si128(_mm_min_ps(
+        _mm_max_ps(l, _mm_castsi128_ps(min_bits)),
+        _mm_castsi128_ps(_mm_set1_epi32(int(srgb8_max_bits)))));
+
+      // the indices are below 104, so the low halves of the lanes hold them
+      const __m128i index = _mm_srli_epi32(_mm_sub_epi32(u, min_bits), 20);
+      const __m128i entry = _mm_setr_epi32(
+        int(table[_mm_cvtsi128_si32(index)]), int(table[_mm_extract_epi16(index, 2)]),
+        int(table[_mm_extract_epi16(index, 4)]), int(table[_mm_extract_epi16(index, 6)]));
+      const __m128i t = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(u, 12), _mm_set1_epi32(0xff)),
+                                     _mm_set1_epi32(512 << 16));
+      return _mm_srli_epi32(_mm_madd_epi16(entry, t), 16);
+    }
+
+    /**
+     * Swaps the bytes of each 32 bit lane.
+     */
+    inline __m128i byte_swap32_sse2(__m128i v) {
+      v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+      return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+    }
+#endif
+
+    /**
+     * Array kernels over components; with `alpha`, every fourth one is
+     * alpha and n is a multiple of 4.
+     */
+    inline void linear_to_srgb8_floats(const float *in, std::uint8_t *out,
+                                       std::size_t n, bool alpha) {
+      std::size_t i = 0;
+#if defined(P_SIMD_SSE2)
+      const __m128i alpha_mask = alpha ? _mm_setr_epi32(0, 0, 0, -1) : _mm_setzero_si128();
+      const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+      const __m128 scale = _mm_set1_ps(unorm8_scale);
+      for (; i + 16 <= n; i += 16) {
+        __m128i r[4];
+        for (std::size_t k = 0; k < 4; ++k) {
+          const __m128 l = _mm_loadu_ps(in + i + 4*k);
+          const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(l, zero), one), scale));
+          r[k] = _mm_or_si128(_mm_andnot_si128(alpha_mask, linear_to_srgb8_sse2(l)),
+                              _mm_and_si128(alpha_mask, a));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]),
+                                          _mm_packs_epi32(r[2], r[3])));
+      }
+#endif
+      for (; i < n; ++i)
+        out[i] = alpha && i % 4 == 3 ? float_to_unorm8(in[i]) : linear_to_srgb8(in[i]);
+    }
+
+    inline void srgb8_to_linear_floats(const std::uint8_t *in, float *out,
+                                       std::size_t n, bool alpha) {
+      // a gather either way; SSE2 and NEON have nothing faster than the loads
+      const float *table = srgb8_to_linear_table();
+      if (alpha) {
+        for (std::size_t i = 0; i < n; i += 4) {
+          out[i] = table[in[i]];
+          out[i + 1] = table[in[i + 1]];
+          out[i + 2] = table[in[i + 2]];
+          out[i + 3] = unorm8_to_float(in[i + 3]);
+        }
+      }
+      else {
+        for (std::size_t i = 0; i < n; ++i)
+          out[i] = table[in[i]];
+      }
+    }
+
+    inline void swap_rgba8(const std::uint8_t *in, std::uint32_t *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_SIMD_SSE2)
+      for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), byte_swap32_sse2(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 4*i))));
+#elif defined(P_SIMD_NEON) && !defined(__ARM_BIG_ENDIAN)
+      for (; i + 4 <= n; i += 4)
+        vst1q_u32(out + i, vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in + 4*i))));
+#endif
+      for (; i < n; ++i)
+        out[i] = std::uint32_t(in[4*i]) << 24 | std::uint32_t(in[4*i + 1]) << 16 |
+                 std::uint32_t(in[4*i + 2]) << 8 | std::uint32_t(in[4*i + 3]);
+    }
+
+    inline void swap_rgba8(const std::uint32_t *in, std::uint8_t *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_SIMD_SSE2)
+      for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4*i), byte_swap32_sse2(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+#elif defined(P_SIMD_NEON) && !defined(__ARM_BIG_ENDIAN)
+      for (; i + 4 <= n; i += 4)
+        vst1q_u8(out + 4*i, vrev32q_u8(vreinterpretq_u8_u32(vld1q_u32(in + i))));
+#endif
+      for (; i < n; ++i) {
+        out[4*i] = std::uint8_t(in[i] >> 24);
+        out[4*i + 1] = std::uint8_t(in[i] >> 16);
+        out[4*i + 2] = std::uint8_t(in[i] >> 8);
+        out[4*i + 3] = std::uint8_t(in[i]);
+      }
+    }
+  }
+
+  /**
+   * Whole images between 8-bit sRGB and linear float. With four
+   * components the last is alpha.
+   */
+  inline void srgb8_to_linear_n(span<const vec<std::uint8_t, 3> > in, span<vec<float, 3> > out) {
+    assert(in.size() == out.size());
+    detail::srgb8_to_linear_floats(reinterpret_cast<const std::uint8_t *>(in.data()),
+                                   reinterpret_cast<float *>(out.data()),
+                                   3 * in.size(), false);
+  }
+
+  inline void srgb8_to_linear_n(span<const vec<std::uint8_t, 4> > in, span<vec<float, 4> > out) {
+    assert(in.size() == out.size());
+    detail::srgb8_to_linear_floats(reinterpret_cast<const std::uint8_t *>(in.data()),
+                                   reinterpret_cast<float *>(out.data()),
+                                   4 * in.size(), true);
+  }
+
+  inline void linear_to_srgb8_n(span<const vec<float, 3> > in, span<vec<std::uint8_t, 3> > out) {
+    assert(in.size() == out.size());
+    detail::linear_to_srgb8_floats(reinterpret_cast<const float *>(in.data()),
+                                   reinterpret_cast<std::uint8_t *>(out.data()),
+                                   3 * in.size(), false);
+  }
+
+  inline void linear_to_srgb8_n(span<const vec<float, 4> > in, span<vec<std::uint8_t, 4> > out) {
+    assert(in.size() == out.size());
+    detail::linear_to_srgb8_floats(reinterpret_cast<const float *>(in.data()),
+                                   reinterpret_cast<std::uint8_t *>(out.data()),
+                                   4 * in.size(), true);
+  }
+
+  /**
+   * out[i] = to_rgba8(in[i]) and back, for whole images.
+   */
+  inline void to_rgba8_n(span<const vec<std::uint8_t, 4> > in, span<std::uint32_t> out) {
+    assert(in.size() == out.size());
+    detail::swap_rgba8(reinterpret_cast<const std::uint8_t *>(in.data()), out.data(), in.size());
+  }
+
+  inline void from_rgba8_n(span<const std::uint32_t> in, span<vec<std::uint8_t, 4> > out) {
+    assert(in.size() == out.size());
+    detail::swap_rgba8(in.data(), reinterpret_cast<std::uint8_t *>(out.data()), in.size());
+  }
+} // !p
+
+#endif // !P_UTILS_VECTOR_COLOR_H
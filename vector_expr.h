@@ -0,0 +1,163 @@
+/* -- vector_expr.h --------------------------------------------------*- c++ -*-
+ * Lazy arithmetic on vectors.
+ *
+ * p::lazy() turns a vector into an expression. Arithmetic involving an
+ * expression builds up a small tree of references instead of computing
+ * intermediate vectors, and the whole tree is evaluated component by
+ * component, in one loop, when it is assigned to a vector:
+ *
+ * vec3 r = lazy(a) * s + lazy(b) * t - c;  // one pass, no intermediate vec3
+ * r += lazy(b) * t;                        // in place
+ *
+ * The plain operators in vector.h stay eager, so functions that take a
+ * vec<T, N> (magnitude(a - b), etc.) keep deducing their arguments.
+ * Expressions refer to their operands; don't keep them around past the
+ * statement that creates them.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_EXPR_H
+#define P_UTILS_VECTOR_EXPR_H
+
+#include <cstddef>
+#include <functional>
+
+#include "vector.h"
+
+namespace p {
+  /**
+   * Base of all vector expressions. E is the deriving expression, which
+   * provides T operator [](std::size_t) const.
+   */
+  template<typename E, typename T, std::size_t N>
+  struct vec_expr {
+    typedef T value_type;
+    static const std::size_t size = N;
+
+    const E &self() const {return static_cast<const E &>(*this); }
+
+    operator vec<T, N>() const {
+      vec<T, N> ret;
+      for (std::size_t i = 0; i < N; ++i)
+        ret[i] = self()[i];
+      return ret;
+    }
+  };
+
+  namespace detail {
+    template<typename T, std::size_t N>
+    struct expr_leaf : vec_expr<expr_leaf<T, N>, T, N> {
+      explicit expr_leaf(const vec<T, N> &v) : v(v) {}
+      T operator [](std::size_t i) const {return v[i]; }
+
+      const vec<T, N> &v;
+    };
+
+    template<typename L, typename R, typename OpT, typename T, std::size_t N>
+    struct expr_binary : vec_expr<expr_binary<L, R, OpT, T, N>, T, N> {
+      expr_binary(const L &l, const R &r) : l(l), r(r) {}
+      T operator [](std::size_t i) const {return OpT()(l[i], r[i]); }
+
+      const L l;
+      const R r;
+    };
+
+    template<typename L, typename OpT, typename T, std::size_t N>
+    struct expr_scalar : vec_expr<expr_scalar<L, OpT, T, N>, T, N> {
+      expr_scalar(const L &l, T s) : l(l), s(s) {}
+      T operator [](std::size_t i) const {return OpT()(l[i], s); }
+
+      const L l;
+      const T s;
+    };
+
+    template<typename L, typename T, std::size_t N>
+    struct expr_negate : vec_expr<expr_negate<L, T, N>, T, N> {
+      explicit expr_negate(const L &l) : l(l) {}
+      T operator [](std::size_t i) const {return -l[i]; }
+
+      const L l;
+    };
+  }
+
+  /**
+   * Starts a lazy expression.
+   */
+  template<typename T, std::size_t N>
+  inline detail::expr_leaf<T, N> lazy(const vec<T, N> &v) {
+    return detail::expr_leaf<T, N>(v);
+  }
+
+  /**
+   * Evaluates an expression into a vector. Useful when passing an
+   * expression to a function that takes a vec<T, N>.
+   */
+  template<typename E, typename T, std::size_t N>
+  inline vec<T, N> eval(const vec_expr<E, T, N> &e) {
+    return e;
+  }
+
+
+#define P_VECTOR_EXPR_BINARY(op, fun)                                         \
+  template<typename E1, typename E2, typename T, std::size_t N>               \
+  inline detail::expr_binary<E1, E2, fun<T>, T, N>                            \
+  operator op(const vec_expr<E1, T, N> &lhs, const vec_expr<E2, T, N> &rhs) { \
+    return detail::expr_binary<E1, E2, fun<T>, T, N>(lhs.self(), rhs.self()); \
+  }                                                                           \
+  template<typename E, typename T, std::size_t N>                             \
+  inline detail::expr_binary<E, detail::expr_leaf<T, N>, fun<T>, T, N>        \
+  operator op(const vec_expr<E, T, N> &lhs, const vec<T, N> &rhs) {           \
+    return detail::expr_binary<E, detail::expr_leaf<T, N>, fun<T>, T, N>(     \
+      lhs.self(), detail::expr_leaf<T, N>(rhs));                              \
+  }                                                                           \
+  template<typename E, typename T, std::size_t N>                             \
+  inline detail::expr_binary<detail::expr_leaf<T, N>, E, fun<T>, T, N>        \
+  operator op(const vec<T, N> &lhs, const vec_expr<E, T, N> &rhs) {           \
+    return detail::expr_binary<detail::expr_leaf<T, N>, E, fun<T>, T, N>(     \
+      detail::expr_leaf<T, N>(lhs), rhs.self());                              \
+  }
+
+  P_VECTOR_EXPR_BINARY(+, std::plus)
+  P_VECTOR_EXPR_BINARY(-, std::minus)
+
+#undef P_VECTOR_EXPR_BINARY
+
+  template<typename E, typename T, std::size_t N, typename scalarT>
+  inline typename detail::if_scalar_of<T, scalarT,
+                                       detail::expr_scalar<E, std::multiplies<T>, T, N> >::type
+  operator *(const vec_expr<E, T, N> &lhs, scalarT rhs) {
+    return detail::expr_scalar<E, std::multiplies<T>, T, N>(lhs.self(), T(rhs));
+  }
+
+  template<typename E, typename T, std::size_t N, typename scalarT>
+  inline typename detail::if_scalar_of<T, scalarT,
+                                       detail::expr_scalar<E, std::divides<T>, T, N> >::type
+  operator /(const vec_expr<E, T, N> &lhs, scalarT rhs) {
+    return detail::expr_scalar<E, std::divides<T>, T, N>(lhs.self(), T(rhs));
+  }
+
+  template<typename E, typename T, std::size_t N>
+  inline detail::expr_negate<E, T, N> operator -(const vec_expr<E, T, N> &rhs) {
+    return detail::expr_negate<E, T, N>(rhs.self());
+  }
+
+  /*
+   * Compound assignment of an expression; evaluated in place. Every
+   * component of lhs is read before it is written, so lhs may appear in
+   * the expression.
+   */
+  template<typename E, typename T, std::size_t N>
+  inline vec<T, N> &operator +=(vec<T, N> &lhs, const vec_expr<E, T, N> &rhs) {
+    for (std::size_t i = 0; i < N; ++i)
+      lhs[i] += rhs.self()[i];
+    return lhs;
+  }
+
+  template<typename E, typename T, std::size_t N>
+  inline vec<T, N> &operator -=(vec<T, N> &lhs, const vec_expr<E, T, N> &rhs) {
+    for (std::size_t i = 0; i < N; ++i)
+      lhs[i] -= rhs.self()[i];
+    return lhs;
+  }
+} // !p
+
+#endif // !P_UTILS_VECTOR_EXPR_H
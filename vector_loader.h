@@ -0,0 +1,254 @@
+/* -- vector_loader.h ------------------------------------------------*- c++ -*-
+ * Streaming, multi-threaded reader for large text files of vectors.
+ *
+ * vector_loader reads a stream a chunk at a time, cuts every chunk at its
+ * last line break and parses the chunks in parallel on a thread_pool,
+ * while the next chunks are being read. The vectors come out in file
+ * order, one batch per chunk:
+ *
+ * std::ifstream file("points.txt", std::ios::binary);
+ * p::vector_loader<float, 3> loader(file);
+ * for (p::span<const p::vec3> batch; loader.next(batch); )
+ *   consume(batch);
+ * if (loader.result().error) report(loader.result().offset);
+ *
+ * or, with a callback run on the calling thread:
+ *
+ * p::parse_result r = p::load_vectors<float, 3>(file, consume);
+ *
+ * The text format, keywords and errors are those of parse_vectors, or of
+ * parse_colors with load_as_colors and load_colors; offsets count from
+ * the start of the stream. A vector must not span a line break. Memory
+ * stays at two chunks per thread of the pool, text and vectors, however
+ * large the file; a line longer than a chunk makes its chunk grow to fit.
+ *
+ * Needs C++17, like the bulk parser, and C++11 threads (parallel.h).
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_LOADER_H
+#define P_UTILS_VECTOR_LOADER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <istream>
+#include <vector>
+
+#include "vector_stream.h"
+#include "parallel.h"
+#include "span.h"
+
+#if defined(P_VECTOR_STREAM_CHARCONV)
+
+namespace p {
+  /**
+   * Which syntax a vector_loader accepts.
+   */
+  enum load_format {
+    load_as_vectors,  // parse_vectors
+    load_as_colors    // parse_colors, with keywords and hex colors
+  };
+
+  template<typename T, std::size_t N>
+  class vector_loader {
+  public:
+    enum {default_chunk_size = 1 << 20};
+
+    /**
+     * Reads from in, which must stay valid while the loader is used.
+     * Nothing is read until the first next().
+     */
+    explicit vector_loader(std::istream &in, load_format format = load_as_vectors,
+                           thread_pool &pool = thread_pool::shared(),
+                           std::size_t chunk_size = default_chunk_size)
+      : in(in), pool(pool), colors(format == load_as_colors),
+        chunk_size(std::max<std::size_t>(chunk_size, 1)), consumed(0),
+        round(0), handed_out(0), ready(0), primed(false), finished(false),
+        read_failed(false) {
+      res.count = 0;
+      res.offset = 0;
+      res.error = parse_ok;
+      for (std::size_t i = 0; i < 2; ++i)
+        slots[i].resize(pool.size());
+    }
+
+    /**
+     * The next batch of vectors, valid until the following call. Returns
+     * false at the end of the stream or at the first error.
+     */
+    bool next(span<const vec<T, N> > &batch) {
+      for (;;) {
+        std::vector<chunk> &current = slots[round % 2];
+        while (handed_out < ready) {
+          const chunk &c = current[handed_out++];
+          if (c.result.count) {
+            batch = span<const vec<T, N> >(c.out.data(), c.result.count);
+            return true;
+          }
+        }
+        if (finished)
+          return false;
+        advance();
+      }
+    }
+
+    /**
+     * The number of vectors parsed so far and where the last one ends.
+     * Once next() has returned false, also why it stopped, as parse_vectors
+     * would report it for the whole text; parse_read_error if the stream
+     * failed, after the vectors of the lines read whole before that.
+     */
+    const parse_result &result() const {return res; }
+
+  private:
+    vector_loader(const vector_loader &);
+    vector_loader &operator =(const vector_loader &);
+
+    struct chunk {
+      std::vector<char> text;    // whole lines
+      std::vector<vec<T, N> > out;
+      std::size_t offset;        // of text[0] in the stream
+      parse_result result;
+      bool used;
+    };
+
+    /**
+     * Fills c with chunk_size bytes plus the rest of the last line. Leaves
+     * c unused at the end of the stream.
+     */
+    void read_chunk(chunk &c) {
+      c.text.swap(carry);
+      carry.clear();
+      c.offset = consumed;
+
+      for (;;) {
+        const std::size_t have = c.text.size();
+        if (in.good()) {
+          c.text.resize(have + chunk_size);
+          in.read(c.text.data() + have, std::streamsize(chunk_size));
+          c.text.resize(have + std::size_t(in.gcount()));
+        }
+        if (in.bad())
+          read_failed = true;
+        if (!in.good())
+          break;
+
+        // the rest of a line cut in two goes to the next chunk
+        const std::vector<char>::iterator nl =
+          std::find(c.text.rbegin(), c.text.rend() - have, '\n').base();
+        if (nl != c.text.begin() + have) {
+          carry.assign(nl, c.text.end());
+          c.text.erase(nl, c.text.end());
+          break;
+        }
+      }
+
+      // the line a failed read cut short is not parsed
+      if (read_failed)
+        c.text.erase(std::find(c.text.rbegin(), c.text.rend(), '\n').base(), c.text.end());
+
+      consumed += c.text.size();
+      c.used = !c.text.empty();
+    }
+
+    void parse_chunk(chunk &c) {
+      // a vector takes at least four characters, or two per component
+      const std::size_t shortest = std::min<std::size_t>(2*N, 4);
+      c.out.resize(c.text.size() / shortest + 1);
+      const char *text = c.text.data();
+      c.result = detail::parse_text(text, text + c.text.size(),
+                                    span<vec<T, N> >(c.out), colors);
+    }
+
+    /**
+     * Parses the chunks read last time while reading the next ones.
+     */
+    void advance() {
+      std::vector<chunk> &reading = slots[(round + 1) % 2];
+      if (!primed) {
+        for (std::size_t i = 0; i < reading.size(); ++i)
+          read_chunk(reading[i]);
+        primed = true;
+      }
+      ++round;
+      handed_out = ready = 0;
+
+      std::vector<chunk> &parsing = slots[round % 2], &next_read = slots[(round + 1) % 2];
+      std::size_t k = 0;
+      while (k < parsing.size() && parsing[k].used)
+        ++k;
+      if (!k) {
+        if (read_failed)
+          res.error = parse_read_error;
+        finished = true;
+        return;
+      }
+
+      // task 0 reads, the others parse
+      pool.parallel_for(k + 1, 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+          if (i)
+            parse_chunk(parsing[i - 1]);
+          else if (!read_failed)
+            for (std::size_t j = 0; j < next_read.size(); ++j)
+              read_chunk(next_read[j]);
+          else
+            for (std::size_t j = 0; j < next_read.size(); ++j)
+              next_read[j].used = false;
+        }
+      });
+
+      for (ready = 0; ready < k; ++ready) {
+        const chunk &c = parsing[ready];
+        // counted here, in the caller's instrument scope, not on the workers
+        P_INSTRUMENT_COUNT(op_parse, T, N, c.result.count);
+        res.count += c.result.count;
+        if (c.result.count || c.result.error)
+          res.offset = c.offset + c.result.offset;
+        if (c.result.error) {
+          res.error = c.result.error;
+          finished = true;
+          ++ready;
+          return;
+        }
+      }
+    }
+
+    std::istream &in;
+    thread_pool &pool;
+    bool colors;
+    std::size_t chunk_size, consumed;
+
+    // the chunks handed out, and those being read, swap every round
+    std::vector<chunk> slots[2];
+    std::vector<char> carry;
+    std::size_t round, handed_out, ready;
+    bool primed, finished, read_failed;
+    parse_result res;
+  };
+
+  /**
+   * Calls f(span<const vec<T, N> >) with every batch of a vector_loader,
+   * in order, on the calling thread. Returns the loader's result().
+   */
+  template<typename T, std::size_t N, typename F>
+  inline parse_result load_vectors(std::istream &in, F f,
+                                   thread_pool &pool = thread_pool::shared()) {
+    vector_loader<T, N> loader(in, load_as_vectors, pool);
+    for (span<const vec<T, N> > batch; loader.next(batch); )
+      f(batch);
+    return loader.result();
+  }
+
+  template<typename T, std::size_t N, typename F>
+  inline parse_result load_colors(std::istream &in, F f,
+                                  thread_pool &pool = thread_pool::shared()) {
+    vector_loader<T, N> loader(in, load_as_colors, pool);
+    for (span<const vec<T, N> > batch; loader.next(batch); )
+      f(batch);
+    return loader.result();
+  }
+} // !p
+
+#endif // P_VECTOR_STREAM_CHARCONV
+
+#endif // !P_UTILS_VECTOR_LOADER_H
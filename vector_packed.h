@@ -0,0 +1,511 @@
+/* -- vector_packed.h ------------------------------------------------*- c++ -*-
+ * Compact component types for storing large vertex and normal arrays.
+ *
+ *   half     IEEE 754 binary16; 11 significant bits, range +-65504
+ *   snorm16  a signed 16 bit integer standing for [-1, 1]
+ *   unorm8   an unsigned byte standing for [0, 1]
+ *
+ * Each converts to and from float implicitly, so vec<half, 3> and the
+ * others work with the vector operators, which compute in float and round
+ * the result back. A vec3 of normals takes 6 bytes as vec<half, 3> or
+ * vec<snorm16, 3> instead of 12.
+ *
+ * Whole arrays are converted with pack_n and unpack_n:
+ *
+ * std::vector<p::vec<p::half, 3> > packed(normals.size());
+ * p::pack_n(p::span<const p::vec3>(normals),
+ *           p::span<p::vec<p::half, 3> >(packed));
+ *
+ * pack/unpack and pack_n/unpack_n also take plain vec<int16_t, N> as
+ * snorm16 and vec<uint8_t, N> (ubvec3, ubvec4) as unorm8. Rounding is to
+ * nearest, ties to even, and NaNs have no defined packed value. The batch
+ * versions use F16C for half when the compiler targets it or the CPU has
+ * it (isa_avx2, see cpu.h), SSE2 integer code otherwise, and NEON on
+ * AArch64; they give the same results as the scalar conversions as long
+ * as the FPU rounds to nearest without flushing denormals to zero.
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_PACKED_H
+#define P_UTILS_VECTOR_PACKED_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "vector.h"
+#include "simd.h"
+#include "span.h"
+#include "cpu.h"
+
+#if defined(P_SIMD_SSE2) && defined(__F16C__)
+#  include <immintrin.h>
+#  define P_PACKED_F16C 1
+#endif
+
+#if defined(P_SIMD_NEON) && defined(__aarch64__)
+#  define P_PACKED_NEON 1
+#endif
+
+namespace p {
+  namespace detail {
+    inline std::uint32_t float_bits(float f) {
+      std::uint32_t u;
+      std::memcpy(&u, &f, sizeof u);
+      return u;
+    }
+
+    inline float bits_float(std::uint32_t u) {
+      float f;
+      std::memcpy(&f, &u, sizeof f);
+      return f;
+    }
+
+    /**
+     * Round to nearest even. Subnormal halves are rounded by a float add
+     * that lines their 10 bits up at the bottom of the significand; normal
+     * ones by adding the rounding bias to the bits. NaNs become the quiet
+     * NaN 0x7e00.
+     */
+    inline std::uint16_t float_to_half_bits(float f) {
+      std::uint32_t u = float_bits(f);
+      const std::uint32_t sign = (u >> 16) & 0x8000u;
+      u &= 0x7fffffffu;
+
+      std::uint32_t h;
+      if (u >= 0x47800000u) {        // 65536 and up, infinity or NaN
+        h = u > 0x7f800000u ? 0x7e00u : 0x7c00u;
+      } else if (u < 0x38800000u) {  // below 2^-14, the smallest normal half
+        const float denorm_magic = 0.5f;
+        h = float_bits(bits_float(u) + denorm_magic) - float_bits(denorm_magic);
+      } else {
+        const std::uint32_t odd = (u >> 13) & 1u;
+        h = (u + 0xc8000fffu + odd) >> 13;
+      }
+      return std::uint16_t(h | sign);
+    }
+
+    inline float half_bits_to_float(std::uint16_t h) {
+      const std::uint32_t shifted_exp = 0x7c00u << 13;
+      std::uint32_t u = std::uint32_t(h & 0x7fffu) << 13;
+      const std::uint32_t exp = u & shifted_exp;
+      u += (127 - 15) << 23;
+      if (exp == shifted_exp) {      // infinity or NaN
+        u += (128 - 16) << 23;
+      } else if (exp == 0) {         // zero or subnormal; renormalize
+        u += 1 << 23;
+        u = float_bits(bits_float(u) - bits_float(113u << 23));
+      }
+      return bits_float(u | (std::uint32_t(h & 0x8000u) << 16));
+    }
+
+    const float snorm16_scale = 32767.0f;
+    const float snorm16_inv = 1.0f / 32767.0f;
+    const float unorm8_scale = 255.0f;
+    const float unorm8_inv = 1.0f / 255.0f;
+
+    inline std::int16_t float_to_snorm16(float f) {
+      using std::min;
+      using std::max;
+      return std::int16_t(std::lrint(max(min(f, 1.0f), -1.0f) * snorm16_scale));
+    }
+
+    inline float snorm16_to_float(std::int16_t i) {
+      using std::max;
+      return max(float(i) * snorm16_inv, -1.0f);
+    }
+
+    inline std::uint8_t float_to_unorm8(float f) {
+      using std::min;
+      using std::max;
+      return std::uint8_t(std::lrint(max(min(f, 1.0f), 0.0f) * unorm8_scale));
+    }
+
+    inline float unorm8_to_float(std::uint8_t i) {
+      return float(i) * unorm8_inv;
+    }
+  }
+
+  /**
+   * The operators convert to float, so half + half is a float; the
+   * compound assignments round the result back.
+   */
+  struct half {
+    half() = default;
+    half(float f) : bits(detail::float_to_half_bits(f)) {}
+    operator float() const {return detail::half_bits_to_float(bits); }
+
+    static half from_bits(std::uint16_t b) {half h; h.bits = b; return h; }
+
+    half &operator +=(float rhs) {return *this = float(*this) + rhs; }
+    half &operator -=(float rhs) {return *this = float(*this) - rhs; }
+    half &operator *=(float rhs) {return *this = float(*this) * rhs; }
+    half &operator /=(float rhs) {return *this = float(*this) / rhs; }
+
+    std::uint16_t bits;
+  };
+
+  /**
+   * value / 32767, clamped to [-1, 1]; -32768 reads as -1 as well.
+   */
+  struct snorm16 {
+    snorm16() = default;
+    snorm16(float f) : value(detail::float_to_snorm16(f)) {}
+    operator float() const {return detail::snorm16_to_float(value); }
+
+    snorm16 &operator +=(float rhs) {return *this = float(*this) + rhs; }
+    snorm16 &operator -=(float rhs) {return *this = float(*this) - rhs; }
+    snorm16 &operator *=(float rhs) {return *this = float(*this) * rhs; }
+    snorm16 &operator /=(float rhs) {return *this = float(*this) / rhs; }
+
+    std::int16_t value;
+  };
+
+  /**
+   * value / 255.
+   */
+  struct unorm8 {
+    unorm8() = default;
+    unorm8(float f) : value(detail::float_to_unorm8(f)) {}
+    operator float() const {return detail::unorm8_to_float(value); }
+
+    unorm8 &operator +=(float rhs) {return *this = float(*this) + rhs; }
+    unorm8 &operator -=(float rhs) {return *this = float(*this) - rhs; }
+    unorm8 &operator *=(float rhs) {return *this = float(*this) * rhs; }
+    unorm8 &operator /=(float rhs) {return *this = float(*this) / rhs; }
+
+    std::uint8_t value;
+  };
+
+  namespace detail {
+    /**
+     * Conversions of one component; plain int16_t and uint8_t are read as
+     * snorm16 and unorm8.
+     */
+    template<typename S> struct packer;
+
+    template<> struct packer<half> {
+      static half pack(float f) {return half(f); }
+      static float unpack(half h) {return h; }
+    };
+
+    template<> struct packer<snorm16> {
+      static snorm16 pack(float f) {return snorm16(f); }
+      static float unpack(snorm16 s) {return s; }
+    };
+
+    template<> struct packer<unorm8> {
+      static unorm8 pack(float f) {return unorm8(f); }
+      static float unpack(unorm8 u) {return u; }
+    };
+
+    template<> struct packer<std::int16_t> {
+      static std::int16_t pack(float f) {return float_to_snorm16(f); }
+      static float unpack(std::int16_t i) {return snorm16_to_float(i); }
+    };
+
+    template<> struct packer<std::uint8_t> {
+      static std::uint8_t pack(float f) {return float_to_unorm8(f); }
+      static float unpack(std::uint8_t i) {return unorm8_to_float(i); }
+    };
+
+    /*
+     * Array kernels. Each does what the hardware can in bulk and leaves
+     * the rest to the scalar conversions.
+     */
+#if defined(P_SIMD_SSE2) && !defined(P_PACKED_F16C)
+    /**
+     * float_to_half_bits() on four lanes; each result is in the low 16 bits
+     * of its lane, sign extended so that _mm_packs_epi32 keeps it.
+     */
+    inline __m128i float_to_half_sse2(__m128 f) {
+      const __m128 sign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32(0x80000000u)));
+      const __m128 absf = _mm_xor_ps(f, sign);
+      const __m128i u = _mm_castps_si128(absf);
+
+      const __m128i regular = _mm_cmpgt_epi32(_mm_set1_epi32(0x47800000), u);
+      const __m128i special = _mm_or_si128(
+        _mm_set1_epi32(0x7c00),
+        _mm_and_si128(_mm_castps_si128(_mm_cmpunord_ps(absf, absf)), _mm_set1_epi32(0x200)));
+
+      const __m128i subnormal = _mm_cmpgt_epi32(_mm_set1_epi32(0x38800000), u);
+      const __m128 magic = _mm_set1_ps(0.5f);
+      const __m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, magic)),
+                                        _mm_castps_si128(magic));
+
+      const __m128i odd = _mm_srai_epi32(_mm_slli_epi32(u, 31 - 13), 31); // -1 if odd
+      const __m128i normal = _mm_srli_epi32(
+        _mm_sub_epi32(_mm_add_epi32(u, _mm_set1_epi32(int(0xc8000fffu))), odd), 13);
+
+      const __m128i finite = _mm_or_si128(_mm_and_si128(subnormal, sub),
+                                          _mm_andnot_si128(subnormal, normal));
+      const __m128i h = _mm_or_si128(_mm_and_si128(regular, finite),
+                                     _mm_andnot_si128(regular, special));
+      return _mm_or_si128(h, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+    }
+
+    /**
+     * half_bits_to_float() on four lanes holding one half each. Scaling by
+     * 2^112 rebiases the exponent and normalizes subnormals in one multiply.
+     */
+    inline __m128 half_to_float_sse2(__m128i h) {
+      const __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+      const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+      const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)),
+                                       _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+      const __m128i infnan = _mm_and_si128(_mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff)),
+                                           _mm_set1_epi32(255 << 23));
+      return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infnan)));
+    }
+#endif
+
+#if defined(P_DISPATCH_X86) && !defined(P_PACKED_F16C)
+    /**
+     * F16C conversions for CPUs at isa_avx2, eight halves at a time.
+     * Return how many they did.
+     */
+    P_TARGET_AVX2 inline std::size_t pack_halves_f16c(const float *in, std::uint16_t *out,
+                                                      std::size_t n) {
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+      return i;
+    }
+
+    P_TARGET_AVX2 inline std::size_t unpack_halves_f16c(const std::uint16_t *in, float *out,
+                                                        std::size_t n) {
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+      return i;
+    }
+#endif
+
+    inline void pack_floats(const float *in, std::uint16_t *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_PACKED_F16C)
+      for (; i + 4 <= n; i += 4)
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i),
+                         _mm_cvtps_ph(_mm_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#elif defined(P_SIMD_SSE2)
+#  if defined(P_DISPATCH_X86)
+      if (active_isa() >= isa_avx2)
+        i = pack_halves_f16c(in, out, n);
+#  endif
+      for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm_packs_epi32(float_to_half_sse2(_mm_loadu_ps(in + i)),
+                                         float_to_half_sse2(_mm_loadu_ps(in + i + 4))));
+#elif defined(P_PACKED_NEON)
+      for (; i + 4 <= n; i += 4)
+        vst1_u16(out + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in + i))));
+#endif
+      for (; i < n; ++i)
+        out[i] = float_to_half_bits(in[i]);
+    }
+
+    inline void unpack_floats(const std::uint16_t *in, float *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_PACKED_F16C)
+      for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_cvtph_ps(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i))));
+#elif defined(P_SIMD_SSE2)
+#  if defined(P_DISPATCH_X86)
+      if (active_isa() >= isa_avx2)
+        i = unpack_halves_f16c(in, out, n);
+#  endif
+      const __m128i zero = _mm_setzero_si128();
+      for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_ps(out + i, half_to_float_sse2(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_ps(out + i + 4, half_to_float_sse2(_mm_unpackhi_epi16(v, zero)));
+      }
+#elif defined(P_PACKED_NEON)
+      for (; i + 4 <= n; i += 4)
+        vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in + i))));
+#endif
+      for (; i < n; ++i)
+        out[i] = half_bits_to_float(in[i]);
+    }
+
+    inline void pack_floats(const float *in, std::int16_t *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_SIMD_SSE2)
+      const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+      const __m128 scale = _mm_set1_ps(snorm16_scale);
+      for (; i + 8 <= n; i += 8) {
+        const __m128 a = _mm_mul_ps(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i), hi), lo), scale);
+        const __m128 b = _mm_mul_ps(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4), hi), lo), scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+      }
+#elif defined(P_PACKED_NEON)
+      const float32x4_t lo = vdupq_n_f32(-1.0f), hi = vdupq_n_f32(1.0f);
+      const float32x4_t scale = vdupq_n_f32(snorm16_scale);
+      for (; i + 8 <= n; i += 8) {
+        const float32x4_t a = vmulq_f32(vmaxq_f32(vminq_f32(vld1q_f32(in + i), hi), lo), scale);
+        const float32x4_t b = vmulq_f32(vmaxq_f32(vminq_f32(vld1q_f32(in + i + 4), hi), lo), scale);
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)),
+                                        vqmovn_s32(vcvtnq_s32_f32(b))));
+      }
+#endif
+      for (; i < n; ++i)
+        out[i] = float_to_snorm16(in[i]);
+    }
+
+    inline void unpack_floats(const std::int16_t *in, float *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_SIMD_SSE2)
+      const __m128 lo = _mm_set1_ps(-1.0f), inv = _mm_set1_ps(snorm16_inv);
+      for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // sign extend by moving each value to the top half and shifting back
+        const __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), inv), lo));
+        _mm_storeu_ps(out + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), inv), lo));
+      }
+#elif defined(P_PACKED_NEON)
+      const float32x4_t lo = vdupq_n_f32(-1.0f), inv = vdupq_n_f32(snorm16_inv);
+      for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vld1q_s16(in + i);
+        const float32x4_t a = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+        const float32x4_t b = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+        vst1q_f32(out + i, vmaxq_f32(vmulq_f32(a, inv), lo));
+        vst1q_f32(out + i + 4, vmaxq_f32(vmulq_f32(b, inv), lo));
+      }
+#endif
+      for (; i < n; ++i)
+        out[i] = snorm16_to_float(in[i]);
+    }
+
+    inline void pack_floats(const float *in, std::uint8_t *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_SIMD_SSE2)
+      const __m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(1.0f);
+      const __m128 scale = _mm_set1_ps(unorm8_scale);
+      for (; i + 16 <= n; i += 16) {
+        __m128i r[4];
+        for (std::size_t k = 0; k < 4; ++k)
+          r[k] = _mm_cvtps_epi32(_mm_mul_ps(
+            _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4*k), hi), lo), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]),
+                                          _mm_packs_epi32(r[2], r[3])));
+      }
+#elif defined(P_PACKED_NEON)
+      const float32x4_t lo = vdupq_n_f32(0.0f), hi = vdupq_n_f32(1.0f);
+      const float32x4_t scale = vdupq_n_f32(unorm8_scale);
+      for (; i + 8 <= n; i += 8) {
+        const float32x4_t a = vmulq_f32(vmaxq_f32(vminq_f32(vld1q_f32(in + i), hi), lo), scale);
+        const float32x4_t b = vmulq_f32(vmaxq_f32(vminq_f32(vld1q_f32(in + i + 4), hi), lo), scale);
+        const int16x8_t s = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)),
+                                         vqmovn_s32(vcvtnq_s32_f32(b)));
+        vst1_u8(out + i, vqmovun_s16(s));
+      }
+#endif
+      for (; i < n; ++i)
+        out[i] = float_to_unorm8(in[i]);
+    }
+
+    inline void unpack_floats(const std::uint8_t *in, float *out, std::size_t n) {
+      std::size_t i = 0;
+#if defined(P_SIMD_SSE2)
+      const __m128i zero = _mm_setzero_si128();
+      const __m128 inv = _mm_set1_ps(unorm8_inv);
+      for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        const __m128i w[2] = {_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)};
+        for (std::size_t k = 0; k < 2; ++k) {
+          const __m128i a = _mm_unpacklo_epi16(w[k], zero);
+          const __m128i b = _mm_unpackhi_epi16(w[k], zero);
+          _mm_storeu_ps(out + i + 8*k, _mm_mul_ps(_mm_cvtepi32_ps(a), inv));
+          _mm_storeu_ps(out + i + 8*k + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), inv));
+        }
+      }
+#elif defined(P_PACKED_NEON)
+      const float32x4_t inv = vdupq_n_f32(unorm8_inv);
+      for (; i + 8 <= n; i += 8) {
+        const uint16x8_t w = vmovl_u8(vld1_u8(in + i));
+        const float32x4_t a = vcvtq_f32_u32(vmovl_u16(vget_low_u16(w)));
+        const float32x4_t b = vcvtq_f32_u32(vmovl_u16(vget_high_u16(w)));
+        vst1q_f32(out + i, vmulq_f32(a, inv));
+        vst1q_f32(out + i + 4, vmulq_f32(b, inv));
+      }
+#endif
+      for (; i < n; ++i)
+        out[i] = unorm8_to_float(in[i]);
+    }
+
+    /**
+     * The raw type each packed type is stored as; the kernels above work
+     * on those.
+     */
+    template<typename S> struct packed_storage {typedef S type; };
+    template<> struct packed_storage<half> {typedef std::uint16_t type; };
+    template<> struct packed_storage<snorm16> {typedef std::int16_t type; };
+    template<> struct packed_storage<unorm8> {typedef std::uint8_t type; };
+  }
+
+  /**
+   * One vector to and from its packed form.
+   */
+  template<typename S, std::size_t N>
+  inline vec<S, N> pack(const vec<float, N> &v) {
+    vec<S, N> ret;
+    for (std::size_t i = 0; i < N; ++i)
+      ret[i] = detail::packer<S>::pack(v[i]);
+    return ret;
+  }
+
+  template<typename S, std::size_t N>
+  inline vec<float, N> unpack(const vec<S, N> &v) {
+    vec<float, N> ret;
+    for (std::size_t i = 0; i < N; ++i)
+      ret[i] = detail::packer<S>::unpack(v[i]);
+    return ret;
+  }
+
+  /**
+   * out[i] = pack<S>(in[i]) for whole arrays, of vectors or of single
+   * components.
+   */
+  template<typename S>
+  inline void pack_n(span<const float> in, span<S> out) {
+    typedef typename detail::packed_storage<S>::type storage;
+    assert(in.size() == out.size());
+    detail::pack_floats(in.data(), reinterpret_cast<storage *>(out.data()), in.size());
+  }
+
+  template<typename S>
+  inline void unpack_n(span<const S> in, span<float> out) {
+    typedef typename detail::packed_storage<S>::type storage;
+    assert(in.size() == out.size());
+    detail::unpack_floats(reinterpret_cast<const storage *>(in.data()), out.data(), in.size());
+  }
+
+  template<typename S, std::size_t N>
+  inline void pack_n(span<const vec<float, N> > in, span<vec<S, N> > out) {
+    assert(in.size() == out.size());
+    pack_n(span<const float>(reinterpret_cast<const float *>(in.data()), in.size() * N),
+           span<S>(reinterpret_cast<S *>(out.data()), out.size() * N));
+  }
+
+  template<typename S, std::size_t N>
+  inline void unpack_n(span<const vec<S, N> > in, span<vec<float, N> > out) {
+    assert(in.size() == out.size());
+    unpack_n(span<const S>(reinterpret_cast<const S *>(in.data()), in.size() * N),
+             span<float>(reinterpret_cast<float *>(out.data()), out.size() * N));
+  }
+
+  typedef vec<half, 2> hvec2;
+  typedef vec<half, 3> hvec3;
+  typedef vec<half, 4> hvec4;
+} // !p
+
+#endif // !P_UTILS_VECTOR_PACKED_H
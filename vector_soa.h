@@ -0,0 +1,355 @@
+/* -- vector_soa.h ---------------------------------------------------*- c++ -*-
+ * Structure-of-arrays container for large batches of vectors.
+ *
+ * vec_soa<T, N> stores every component in its own contiguous array, each
+ * starting on a 64 byte boundary. The batch operations below walk those
+ * arrays linearly so the compiler can keep a whole register of elements
+ * (4 with SSE/NEON, 8 with AVX, 16 with AVX-512) in flight per instruction.
+ *
+ * Element access goes through a proxy that converts to and from vec<T, N>:
+ *
+ * p::vec_soa<float, 3> particles(positions, count);
+ * p::vec3 v = particles[10];
+ * particles[11] = v * 2.0f;
+ * p::normalize(particles, particles);
+ * particles.copy_to(positions);
+ * -------------------------------------------------------------------------- */
+
+#ifndef P_UTILS_VECTOR_SOA_H
+#define P_UTILS_VECTOR_SOA_H
+
+#include <cassert>
+#include <cstddef>
+#include <cmath>
+#include <new>
+#include <algorithm>
+
+#include "allocator.h"
+#include "vector.h"
+#include "simd.h"
+
+namespace p {
+  /**
+   * Batch of N-component vectors stored one component array at a time.
+   */
+  template<typename T, std::size_t N>
+  class vec_soa {
+  public:
+    typedef T value_type;
+    typedef vec<T, N> vector_type;
+    static const std::size_t components = N;
+    static const std::size_t alignment = 64;
+
+    /**
+     * Proxy returned by the non-const operator []. Reads and writes a
+     * whole vector, or a single component through [].
+     */
+    class reference {
+    public:
+      reference(vec_soa &soa, std::size_t pos) : soa(soa), pos(pos) {}
+
+      operator vector_type() const {
+        return static_cast<const vec_soa &>(soa)[pos];
+      }
+
+      reference &operator =(const vector_type &v) {
+        for (std::size_t c = 0; c < N; ++c)
+          soa.data[c][pos] = v[c];
+        return *this;
+      }
+
+      reference &operator =(const reference &other) {
+        return *this = static_cast<vector_type>(other);
+      }
+
+      T &operator [](std::size_t c) {return soa.data[c][pos]; }
+      T operator [](std::size_t c) const {return soa.data[c][pos]; }
+
+    private:
+      vec_soa &soa;
+      std::size_t pos;
+    };
+
+    vec_soa() : count(0), capacity(0), block(0) {
+      std::fill(data, data + N, static_cast<T *>(0));
+    }
+
+    explicit vec_soa(std::size_t count) : count(0), capacity(0), block(0) {
+      std::fill(data, data + N, static_cast<T *>(0));
+      resize(count);
+    }
+
+    vec_soa(const vector_type *aos, std::size_t count)
+      : count(0), capacity(0), block(0)
+    {
+      std::fill(data, data + N, static_cast<T *>(0));
+      assign(aos, count);
+    }
+
+    vec_soa(const vec_soa &other) : count(0), capacity(0), block(0) {
+      std::fill(data, data + N, static_cast<T *>(0));
+      *this = other;
+    }
+
+    ~vec_soa() {detail::aligned_free(block); }
+
+    vec_soa &operator =(const vec_soa &other) {
+      if (this != &other) {
+        resize(other.count);
+        for (std::size_t c = 0; c < N; ++c)
+          std::copy(other.data[c], other.data[c] + count, data[c]);
+      }
+      return *this;
+    }
+
+    std::size_t size() const {return count; }
+    bool empty() const {return count == 0; }
+
+    /**
+     * Changes the number of elements. New elements are zeroed; existing
+     * ones are kept.
+     */
+    void resize(std::size_t new_count) {
+      if (new_count > capacity) {
+        // round every array up to a whole cache line of elements
+        const std::size_t per_line = alignment / sizeof(T) ? alignment / sizeof(T) : 1;
+        const std::size_t new_capacity = (new_count + per_line - 1) / per_line * per_line;
+
+        void *new_block = detail::aligned_alloc(new_capacity * N * sizeof(T), alignment);
+        T *base = static_cast<T *>(new_block);
+        for (std::size_t c = 0; c < N; ++c) {
+          T *arr = base + c * new_capacity;
+          std::copy(data[c], data[c] + count, arr);
+          data[c] = arr;
+        }
+
+        detail::aligned_free(block);
+        block = new_block;
+        capacity = new_capacity;
+      }
+
+      for (std::size_t c = 0; c < N; ++c)
+        std::fill(data[c] + std::min(count, new_count), data[c] + new_count, T());
+      count = new_count;
+    }
+
+    /**
+     * Replaces the contents with an array of vectors.
+     */
+    void assign(const vector_type *aos, std::size_t n) {
+      resize(n);
+      for (std::size_t c = 0; c < N; ++c) {
+        T *dst = data[c];
+        for (std::size_t i = 0; i < n; ++i)
+          dst[i] = aos[i][c];
+      }
+    }
+
+    /**
+     * Writes all elements to an array of vectors, which must hold size()
+     * elements.
+     */
+    void copy_to(vector_type *aos) const {
+      for (std::size_t c = 0; c < N; ++c) {
+        const T *src = data[c];
+        for (std::size_t i = 0; i < count; ++i)
+          aos[i][c] = src[i];
+      }
+    }
+
+    T *component(std::size_t c) {return data[c]; }
+    const T *component(std::size_t c) const {return data[c]; }
+
+    reference operator [](std::size_t pos) {return reference(*this, pos); }
+
+    vector_type operator [](std::size_t pos) const {
+      vector_type v;
+      for (std::size_t c = 0; c < N; ++c)
+        v[c] = data[c][pos];
+      return v;
+    }
+
+  private:
+    std::size_t count, capacity;
+    void *block;
+    T *data[N];
+  };
+
+
+  /*
+   * Batch operations. The output is resized to match the input and may be
+   * the same object as one of the inputs.
+   */
+
+  template<typename T, std::size_t N>
+  inline void add(const vec_soa<T, N> &a, const vec_soa<T, N> &b,
+                  vec_soa<T, N> &out) {
+    assert(a.size() == b.size());
+    const std::size_t n = a.size();
+    out.resize(n);
+    for (std::size_t c = 0; c < N; ++c) {
+      const T *pa = a.component(c), *pb = b.component(c);
+      T *po = out.component(c);
+      for (std::size_t i = 0; i < n; ++i)
+        po[i] = pa[i] + pb[i];
+    }
+  }
+
+  template<typename T, std::size_t N>
+  inline void scale(const vec_soa<T, N> &a, T s, vec_soa<T, N> &out) {
+    const std::size_t n = a.size();
+    out.resize(n);
+    for (std::size_t c = 0; c < N; ++c) {
+      const T *pa = a.component(c);
+      T *po = out.component(c);
+      for (std::size_t i = 0; i < n; ++i)
+        po[i] = pa[i] * s;
+    }
+  }
+
+  /**
+   * Component-wise minimum of every pair.
+   */
+  template<typename T, std::size_t N>
+  inline void min(const vec_soa<T, N> &a, const vec_soa<T, N> &b,
+                  vec_soa<T, N> &out) {
+    assert(a.size() == b.size());
+    const std::size_t n = a.size();
+    out.resize(n);
+    for (std::size_t c = 0; c < N; ++c) {
+      const T *pa = a.component(c), *pb = b.component(c);
+      T *po = out.component(c);
+      for (std::size_t i = 0; i < n; ++i)
+        po[i] = pb[i] < pa[i] ? pb[i] : pa[i];
+    }
+  }
+
+  /**
+   * Component-wise maximum of every pair.
+   */
+  template<typename T, std::size_t N>
+  inline void max(const vec_soa<T, N> &a, const vec_soa<T, N> &b,
+                  vec_soa<T, N> &out) {
+    assert(a.size() == b.size());
+    const std::size_t n = a.size();
+    out.resize(n);
+    for (std::size_t c = 0; c < N; ++c) {
+      const T *pa = a.component(c), *pb = b.component(c);
+      T *po = out.component(c);
+      for (std::size_t i = 0; i < n; ++i)
+        po[i] = pa[i] < pb[i] ? pb[i] : pa[i];
+    }
+  }
+
+  /**
+   * Linear interpolation of every pair, same formula as p::lerp.
+   */
+  template<typename T, std::size_t N>
+  inline void lerp(const vec_soa<T, N> &a, const vec_soa<T, N> &b, T amount,
+                   vec_soa<T, N> &out) {
+    assert(a.size() == b.size());
+    const std::size_t n = a.size();
+    const T inv = T(1) - amount;
+    out.resize(n);
+    for (std::size_t c = 0; c < N; ++c) {
+      const T *pa = a.component(c), *pb = b.component(c);
+      T *po = out.component(c);
+      for (std::size_t i = 0; i < n; ++i)
+        po[i] = pa[i] * inv + pb[i] * amount;
+    }
+  }
+
+  /**
+   * Dot product of every pair, written to out which must hold a.size()
+   * elements.
+   */
+  template<typename T, std::size_t N>
+  inline void dot_product(const vec_soa<T, N> &a, const vec_soa<T, N> &b,
+                          T *out) {
+    assert(a.size() == b.size());
+    const std::size_t n = a.size();
+    const T *pa = a.component(0), *pb = b.component(0);
+    for (std::size_t i = 0; i < n; ++i)
+      out[i] = pa[i] * pb[i];
+
+    for (std::size_t c = 1; c < N; ++c) {
+      pa = a.component(c); pb = b.component(c);
+      for (std::size_t i = 0; i < n; ++i)
+        out[i] += pa[i] * pb[i];
+    }
+  }
+
+  template<typename T>
+  inline void cross_product(const vec_soa<T, 3> &a, const vec_soa<T, 3> &b,
+                            vec_soa<T, 3> &out) {
+    assert(a.size() == b.size());
+    const std::size_t n = a.size();
+    out.resize(n);
+    const T *ax = a.component(0), *ay = a.component(1), *az = a.component(2);
+    const T *bx = b.component(0), *by = b.component(1), *bz = b.component(2);
+    T *ox = out.component(0), *oy = out.component(1), *oz = out.component(2);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      const T x = ay[i] * bz[i] - by[i] * az[i];
+      const T y = az[i] * bx[i] - bz[i] * ax[i];
+      const T z = ax[i] * by[i] - bx[i] * ay[i];
+      ox[i] = x; oy[i] = y; oz[i] = z;
+    }
+  }
+
+  template<typename T, std::size_t N>
+  inline void normalize(const vec_soa<T, N> &a, vec_soa<T, N> &out) {
+    using std::sqrt;
+    const std::size_t n = a.size();
+    out.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      T len2 = T();
+      for (std::size_t c = 0; c < N; ++c)
+        len2 += a.component(c)[i] * a.component(c)[i];
+
+      const T len = sqrt(len2);
+      for (std::size_t c = 0; c < N; ++c)
+        out.component(c)[i] = a.component(c)[i] / len;
+    }
+  }
+
+  /**
+   * Float version; sqrt keeps the compiler from vectorizing the generic
+   * loop, so this one is written against p::simd.
+   */
+  template<std::size_t N>
+  inline void normalize(const vec_soa<float, N> &a, vec_soa<float, N> &out) {
+    const std::size_t n = a.size();
+    out.resize(n);
+
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      simd::f32x4 len2 = simd::splat(0.0f);
+      for (std::size_t c = 0; c < N; ++c) {
+        const simd::f32x4 v = simd::load(a.component(c) + i);
+        len2 = simd::add(len2, simd::mul(v, v));
+      }
+
+      const simd::f32x4 len = simd::sqrt(len2);
+      for (std::size_t c = 0; c < N; ++c)
+        simd::store(out.component(c) + i,
+                    simd::div(simd::load(a.component(c) + i), len));
+    }
+
+    for (; i < n; ++i) {
+      float len2 = 0.0f;
+      for (std::size_t c = 0; c < N; ++c)
+        len2 += a.component(c)[i] * a.component(c)[i];
+
+      const float len = std::sqrt(len2);
+      for (std::size_t c = 0; c < N; ++c)
+        out.component(c)[i] = a.component(c)[i] / len;
+    }
+  }
+
+  typedef vec_soa<float, 2> vec2_soa;
+  typedef vec_soa<float, 3> vec3_soa;
+  typedef vec_soa<float, 4> vec4_soa;
+} // !p
+
+#endif // !P_UTILS_VECTOR_SOA_H
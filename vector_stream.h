@@ -12,6 +12,9 @@
  * "0xRRGGBBAA".
  * 
  * If parsing fails, the fail bit will be set.
+ *
+ * Colors are written as hexadecimal through p::color_writer, or by setting
+ * std::hex on the stream.
  * 
  * Vectors:
  * out() << vec3(13.2f, 32.0f, -1.0f) // => "13.2 32.0 -1.0"
@@ -20,6 +23,15 @@
  * vec3 color;
  * in() >> p::color_reader(color);
  *
+ * Bulk parsing straight from memory (C++17, uses std::from_chars); nothing
+ * is allocated and errors are reported as an offset into the text:
+ * std::vector<vec3> points(count);
+ * p::parse_result r = p::parse_vectors(text, text + len, p::span<vec3>(points));
+ * if (r.error) report(r.offset);
+ *
+ * and the matching formatter, into a caller-provided buffer:
+ * p::format_result w = p::format_vectors(p::span<const vec3>(points), buf, buf + size);
+ *
  * -------------------------------------------------------------------------- */
 
 #ifndef P_VECTOR_STREAM_H 
@@ -30,9 +42,15 @@
 #include <cstddef>
 #include <cstdlib>
 #include <limits>
-#include <sstream>
+#include <cctype>
 
 #include "vector.h"
+#include "span.h"
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#  include <charconv>
+#  define P_VECTOR_STREAM_CHARCONV 1
+#endif
 
 namespace p {
   namespace detail {
@@ -42,7 +60,7 @@ namespace p {
     template<> struct int_type<unsigned char> {typedef int type;};
     template<> struct int_type<signed char> {typedef int type;};
 
-    bool stricmp(const char *s1, const char *s2) {
+    inline bool stricmp(const char *s1, const char *s2) {
       std::size_t i = 0;
       do {
         if (std::tolower(s1[i]) != std::tolower(s2[i]))
@@ -74,6 +92,38 @@ namespace p {
       static inline double max() {return 1.0;}
     };
 
+    /**
+     * Conversion of one color component from and to a byte, rounding to
+     * nearest so that 8-bit values survive a round trip through any type.
+     * Bytes and floats have exact fast paths; other types scale through
+     * double.
+     */
+    template<typename T>
+    struct color_byte_traits {
+      static T from_byte(unsigned b) {
+        return T(b * (color_limits<T>::max() / 255.0));
+      }
+
+      static unsigned to_byte(T value) {
+        const double scaled = value / double(color_limits<T>::max()) * 255.0 + 0.5;
+        return scaled <= 0.0 ? 0u : scaled >= 255.0 ? 255u : unsigned(scaled);
+      }
+    };
+
+    template<> struct color_byte_traits<unsigned char> {
+      static unsigned char from_byte(unsigned b) {return (unsigned char)b; }
+      static unsigned to_byte(unsigned char value) {return value; }
+    };
+
+    template<> struct color_byte_traits<float> {
+      static float from_byte(unsigned b) {return float(b) / 255.0f; }
+
+      static unsigned to_byte(float value) {
+        const float scaled = value * 255.0f + 0.5f;
+        return !(scaled > 0.0f) ? 0u : scaled >= 255.0f ? 255u : unsigned(scaled);
+      }
+    };
+
     /**
      * A class that can store the state of an istream and revert to that state.
      * It also wraps istream::sentry so you don't have to instantiate two helper
@@ -92,10 +142,10 @@ namespace p {
       operator const void *() const {return (sentry ? this : 0); }
     };
 
-    template<class charT, class traits>
-    std::basic_ostream<charT, traits> &fail(std::basic_ostream<charT, traits> &os) {
-      os.clear(std::ios::failbit);
-      return os;
+    template<class Stream>
+    Stream &fail(Stream &s) {
+      s.clear(std::ios::failbit);
+      return s;
     }
     
     /**
@@ -132,20 +182,18 @@ namespace p {
             else if (textual.size() > 2 &&
                      textual[0] == '0' && textual[1] == 'x') {
               // parse it as hex
-	      // convert_from_bin_component to type_component
-	      // convert(0x000000FF, 8, float)
-	      // TODO: this involves some muls/divs; integer conversions
-	      //       might turn out incorrect. Maybe there should be a
-	      //       fast-path for those.
               unsigned long val = std::strtoul(textual.c_str(), NULL, 16);
               for (std::size_t i = size; i--; ) {
-                target[i] = (val & 0xFF) * (color_limits<T>::max() / 255.0);
+                target[i] = color_byte_traits<T>::from_byte(val & 0xFF);
                 val >>= 8;
               }
             }
             else {
               fail(is);
             }
+            // the vector operator >> above counts the other colors
+            if (is)
+              P_INSTRUMENT_COUNT(op_parse, T, size, 1);
           }
         }
         
@@ -173,11 +221,70 @@ namespace p {
     return detail::color_reader_impl<T, size>(target);
   }
 
-  // TODO: color_writer
+  namespace detail {
+    /**
+     * Writes "0x" and two hex digits per component, first component
+     * first; exactly 2 + 2*size characters.
+     */
+    template<typename T, std::size_t size>
+    inline char *format_color(const vec<T, size> &v, char *out) {
+      static const char digits[] = "0123456789ABCDEF";
+      *out++ = '0';
+      *out++ = 'x';
+      for (std::size_t i = 0; i < size; ++i) {
+        const unsigned byte = color_byte_traits<T>::to_byte(v[i]);
+        *out++ = digits[byte >> 4];
+        *out++ = digits[byte & 0xF];
+      }
+      return out;
+    }
+
+    /**
+     * Writing helper class for colors; created with p::color_writer.
+     */
+    template<typename T, std::size_t size>
+    class color_writer_impl {
+    public:
+      color_writer_impl(const vec<T, size> &source)
+        : source(source)
+      {
+      }
+
+      std::ostream &write(std::ostream &os) const {
+        char buf[2 + 2*size];
+        return os.write(buf, format_color(source, buf) - buf);
+      }
+
+    private:
+      const vec<T, size> &source;
+    };
+  } // !detail
+
+  /**
+   * Creates a writer object that outputs a color as hexadecimal
+   * "0xRRGGBBAA", in the form color_reader parses.
+   *
+   * @code
+   * std::cout << p::color_writer(make_vec(1.0f, 0.5f, 0.0f)); // 0xFF8000
+   */
+  template<typename T, std::size_t size>
+  detail::color_writer_impl<T, size> color_writer(const vec<T, size> &source) {
+    return detail::color_writer_impl<T, size>(source);
+  }
+
+  template<typename T, std::size_t size>
+  std::ostream &operator <<(std::ostream &s,
+                            const detail::color_writer_impl<T, size> &writer) {
+    const std::ostream::sentry sentry(s);
+    if (!sentry)
+      return s;
+
+    return writer.write(s);
+  }
   
   /**
    * Output a vector in the format x[ y[ z[...]]] unless std::hex has
-   * been set on the stream.
+   * been set on the stream, in which case it's written as by color_writer.
    * For example, "123, 43".
    */
   template<typename T, std::size_t size>
@@ -187,16 +294,7 @@ namespace p {
       return s;
     
     if (s.flags() & std::ios::hex) {
-      // TODO: this shouldn't be here... make a color_writer
-      std::stringstream ss;
-      ss << "0x" << std::hex;
-      for (std::size_t i = size; i--; ) {
-        double fraction = v[i] / double(detail::color_limits<T>::max());
-        ss << int(fraction * 255.0);
-      }
-      
-      // this safety is probably unnecessary.
-      s << (ss ? ss : detail::fail(s));
+      detail::color_writer_impl<T, size>(v).write(s);
     }
     else {
       typedef typename detail::int_type<T>::type text_rep;
@@ -245,6 +343,8 @@ namespace p {
       }
     }
   
+    if (s)
+      P_INSTRUMENT_COUNT(op_parse, T, size, 1);
     return s;
   }
   
@@ -254,6 +354,251 @@ namespace p {
     return reader.read(s);
   }
 
+#if defined(P_VECTOR_STREAM_CHARCONV)
+  enum parse_errc {
+    parse_ok = 0,
+    parse_invalid,       // not a number or keyword
+    parse_out_of_range,  // number doesn't fit the component type
+    parse_incomplete,    // the text ended in the middle of a vector
+    parse_read_error     // the stream failed (vector_loader.h)
+  };
+
+  struct parse_result {
+    std::size_t count;   // number of vectors written
+    std::size_t offset;  // end of the last vector, or start of the bad token
+    parse_errc error;
+  };
+
+  namespace detail {
+    inline bool is_space(char c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+             c == '\f' || c == '\v';
+    }
+
+    inline const char *skip_space(const char *p, const char *last) {
+      while (p != last && is_space(*p))
+        ++p;
+      return p;
+    }
+
+    inline const char *token_end(const char *p, const char *last) {
+      while (p != last && !is_space(*p))
+        ++p;
+      return p;
+    }
+
+    /**
+     * Case-insensitive comparison of [first, last) with a keyword.
+     */
+    inline bool token_is(const char *first, const char *last, const char *kw) {
+      for (; first != last && *kw; ++first, ++kw) {
+        if (std::tolower(static_cast<unsigned char>(*first)) != *kw)
+          return false;
+      }
+      return first == last && !*kw;
+    }
+
+    /**
+     * Parses one component, which has to end at whitespace or at last.
+     */
+    template<typename T>
+    inline parse_errc parse_component(const char *&p, const char *last, T &out) {
+      typedef typename int_type<T>::type text_rep;
+      const char *first = p;
+      if (first != last && *first == '+') {
+        ++first;
+        // from_chars would take a second sign
+        if (first != last && *first == '-')
+          return parse_invalid;
+      }
+
+      text_rep val;
+      const std::from_chars_result r = std::from_chars(first, last, val);
+      if (r.ec == std::errc::invalid_argument)
+        return parse_invalid;
+      if (r.ec == std::errc::result_out_of_range ||
+          val < text_rep(std::numeric_limits<T>::lowest()) ||
+          val > text_rep(std::numeric_limits<T>::max()))
+        return parse_out_of_range;
+      if (r.ptr != last && !is_space(*r.ptr))
+        return parse_invalid;
+
+      out = T(val);
+      p = r.ptr;
+      return parse_ok;
+    }
+
+    /**
+     * "0xRRGGBBAA"; the last byte goes to the last component, like
+     * color_reader.
+     */
+    template<typename T, std::size_t size>
+    inline bool parse_hex_color(const char *first, const char *last,
+                                vec<T, size> &target) {
+      unsigned long val;
+      const std::from_chars_result r = std::from_chars(first + 2, last, val, 16);
+      if (r.ec != std::errc() || r.ptr != last)
+        return false;
+
+      for (std::size_t i = size; i--; ) {
+        target[i] = color_byte_traits<T>::from_byte(val & 0xFF);
+        val >>= 8;
+      }
+      return true;
+    }
+
+    template<typename T, std::size_t size>
+    inline parse_result parse_text(const char *first, const char *last,
+                                   span<vec<T, size> > out, bool colors) {
+      parse_result res = {0, 0, parse_ok};
+      const char *p = first;
+
+      while (res.count < out.size()) {
+        const char *tok = skip_space(p, last);
+        if (tok == last)
+          break;
+
+        vec<T, size> &v = out[res.count];
+        const char *end = token_end(tok, last);
+        res.offset = tok - first;
+
+        if (token_is(tok, end, "null") || token_is(tok, end, "zero")) {
+          for (std::size_t i = 0; i < size; ++i)
+            v[i] = T();
+          p = end;
+        }
+        else if (colors && token_is(tok, end, "red")) {
+          set_all_but(v, 0);
+          v[0] = color_limits<T>::max();
+          p = end;
+        }
+        else if (colors && end - tok > 2 && tok[0] == '0' &&
+                 (tok[1] == 'x' || tok[1] == 'X')) {
+          if (!parse_hex_color(tok, end, v)) {
+            res.error = parse_invalid;
+            return res;
+          }
+          p = end;
+        }
+        else {
+          p = tok;
+          for (std::size_t i = 0; i < size; ++i) {
+            if (i) {
+              p = skip_space(p, last);
+              res.offset = p - first;
+              if (p == last) {
+                res.error = parse_incomplete;
+                return res;
+              }
+            }
+
+            res.error = parse_component(p, last, v[i]);
+            if (res.error)
+              return res;
+          }
+        }
+
+        ++res.count;
+        res.offset = p - first;
+      }
+
+      return res;
+    }
+  } // !detail
+
+  /**
+   * Parses whitespace separated vectors from [first, last) into out, until
+   * out is full or the text ends. Accepts the same keywords as operator >>.
+   * On error, offset points at the offending token and out holds the count
+   * vectors parsed before it.
+   */
+  template<typename T, std::size_t size>
+  inline parse_result parse_vectors(const char *first, const char *last,
+                                    span<vec<T, size> > out) {
+    const parse_result r = detail::parse_text(first, last, out, false);
+    P_INSTRUMENT_COUNT(op_parse, T, size, r.count);
+    return r;
+  }
+
+  /**
+   * Like parse_vectors, but also accepts the color_reader keywords and
+   * hexadecimal colors ("0xRRGGBBAA").
+   */
+  template<typename T, std::size_t size>
+  inline parse_result parse_colors(const char *first, const char *last,
+                                   span<vec<T, size> > out) {
+    const parse_result r = detail::parse_text(first, last, out, true);
+    P_INSTRUMENT_COUNT(op_parse, T, size, r.count);
+    return r;
+  }
+
+  struct format_result {
+    std::size_t count;  // number of vectors written
+    std::size_t size;   // number of characters written
+  };
+
+  namespace detail {
+    /**
+     * Writes "x y z\n" with the shortest representation that reads back
+     * to the same value. Returns 0 if it doesn't fit.
+     */
+    template<typename T, std::size_t size>
+    inline char *format_vector(const vec<T, size> &v, char *first, char *last) {
+      typedef typename int_type<T>::type text_rep;
+      for (std::size_t i = 0; i < size; ++i) {
+        const std::to_chars_result r = std::to_chars(first, last, text_rep(v[i]));
+        if (r.ec != std::errc() || r.ptr == last)
+          return 0;
+        first = r.ptr;
+        *first++ = (i + 1 == size ? '\n' : ' ');
+      }
+      return first;
+    }
+  }
+
+  /**
+   * Formats vectors into [first, last), one per line with the components
+   * separated by a space. Floats are written in their shortest round-trip
+   * form. Stops before the first vector that doesn't fit; compare count
+   * with in.size() to detect that.
+   */
+  template<typename T, std::size_t size>
+  inline format_result format_vectors(span<const vec<T, size> > in,
+                                      char *first, char *last) {
+    format_result res = {0, 0};
+    char *p = first;
+    for (; res.count < in.size(); ++res.count) {
+      char *next = detail::format_vector(in[res.count], p, last);
+      if (!next)
+        break;
+      p = next;
+    }
+
+    res.size = p - first;
+    return res;
+  }
+
+  /**
+   * Formats colors into [first, last) as "0xRRGGBBAA", one per line.
+   */
+  template<typename T, std::size_t size>
+  inline format_result format_colors(span<const vec<T, size> > in,
+                                     char *first, char *last) {
+    const std::size_t width = 2 + 2*size + 1;
+    const std::size_t fits = std::size_t(last - first) / width;
+    format_result res = {in.size() < fits ? in.size() : fits, 0};
+
+    char *p = first;
+    for (std::size_t i = 0; i < res.count; ++i) {
+      p = detail::format_color(in[i], p);
+      *p++ = '\n';
+    }
+
+    res.size = p - first;
+    return res;
+  }
+#endif // P_VECTOR_STREAM_CHARCONV
+
 } // !p
 
 #endif // !P_VECTOR_STREAM_H